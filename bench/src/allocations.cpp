@@ -0,0 +1,89 @@
+#include "allocations.hpp"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+// NOLINTBEGIN(cppcoreguidelines-no-malloc, *-avoid-non-const-global-variables)
+
+// Per thread, so helper threads (e.g. the fake Redis server) don't skew the count
+static thread_local uint64_t allocation_count = 0;
+
+namespace raccoon {
+namespace bench {
+
+uint64_t
+allocations() noexcept
+{
+    return allocation_count;
+}
+
+uint64_t
+peak_rss_kb() noexcept
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+
+    return static_cast<uint64_t>(usage.ru_maxrss); // KiB on Linux
+}
+
+} // namespace bench
+} // namespace raccoon
+
+/*
+ * Replace the global allocation functions. The array and nothrow forms call these
+ * by default, so they are counted too.
+ */
+
+void*
+operator new(std::size_t size)
+{
+    allocation_count++;
+
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) [[likely]]
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void*
+operator new(std::size_t size, std::align_val_t align)
+{
+    allocation_count++;
+
+    auto alignment = static_cast<std::size_t>(align);
+    auto rounded = (std::max<std::size_t>(size, 1) + alignment - 1) & ~(alignment - 1);
+
+    if (void* ptr = std::aligned_alloc(alignment, rounded)) [[likely]]
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void
+operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void
+operator delete(void* ptr, std::size_t /*size*/) noexcept
+{
+    std::free(ptr);
+}
+
+void
+operator delete(void* ptr, std::align_val_t /*align*/) noexcept
+{
+    std::free(ptr);
+}
+
+void
+operator delete(void* ptr, std::size_t /*size*/, std::align_val_t /*align*/) noexcept
+{
+    std::free(ptr);
+}
+
+// NOLINTEND(cppcoreguidelines-no-malloc, *-avoid-non-const-global-variables)
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+
+namespace raccoon {
+namespace bench {
+
+/**
+ * Number of C++ heap allocations (operator new) made by the calling thread so far.
+ *
+ * Allocations made by C libraries through malloc directly, such as hiredis's
+ * buffers, are not counted.
+ */
+uint64_t allocations() noexcept;
+
+/**
+ * The most memory the process has had resident so far, in KiB.
+ */
+uint64_t peak_rss_kb() noexcept;
+
+/**
+ * Counts the allocations made by a benchmark's loop, and reports them per
+ * iteration as the "allocs" counter.
+ *
+ * Create it just before the loop so setup isn't counted.
+ */
+class AllocationCounter {
+    benchmark::State& state_;
+    uint64_t start_;
+
+public:
+    explicit AllocationCounter(benchmark::State& state) :
+        state_(state), start_(allocations())
+    {}
+
+    ~AllocationCounter()
+    {
+        state_.counters["allocs"] = benchmark::Counter(
+            static_cast<double>(allocations() - start_),
+            benchmark::Counter::kAvgIterations
+        );
+    }
+
+    AllocationCounter(const AllocationCounter&) = delete;
+    AllocationCounter(AllocationCounter&&) = delete;
+    AllocationCounter& operator=(const AllocationCounter&) = delete;
+    AllocationCounter& operator=(AllocationCounter&&) = delete;
+};
+
+} // namespace bench
+} // namespace raccoon
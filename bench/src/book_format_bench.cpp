@@ -0,0 +1,464 @@
+#include "allocations.hpp"
+#include "fixtures.hpp"
+#include "raccoon/packed_book.hpp"
+#include "storage/orderbook.hpp"
+#include "storage/redis.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <span>
+
+using namespace raccoon::bench;     // NOLINT(*-using-namespace)
+using namespace raccoon::exchanges; // NOLINT(*-using-namespace)
+using namespace raccoon::storage;   // NOLINT(*-using-namespace)
+
+namespace packed = raccoon::packed;
+
+namespace {
+
+/**
+ * Size of a RESP bulk string.
+ */
+size_t
+bulk_size(size_t len)
+{
+    return fmt::formatted_size("${}\r\n", len) + len + 2;
+}
+
+/**
+ * Report bytes sent or received per book as the "wire_bytes" counter.
+ */
+void
+set_wire_bytes(benchmark::State& state, size_t bytes)
+{
+    state.counters["wire_bytes"] = static_cast<double>(bytes);
+}
+
+/*
+ * Writer: one book of `depth` levels per side, in each format
+ */
+
+/**
+ * Packed books are written `depth` levels deep too, so both carry the same levels.
+ */
+void
+BM_WriteBook(benchmark::State& state)
+{
+    auto format = state.range(0) != 0 ? BookFormat::PACKED : BookFormat::HASH;
+    auto depth = static_cast<size_t>(state.range(1));
+    std::string product_id = "ETH-USD";
+
+    NullRedis redis;
+    OrderbookProcessor books;
+    books.set_format(format, depth);
+    books.process_incoming_snapshot(book_snapshot(depth));
+
+    auto bytes_before = redis.server().stats().bytes_in;
+
+    {
+        AllocationCounter allocs(state);
+
+        for (auto _ : state)
+            books.ob_to_redis(redis.get(), product_id);
+    }
+
+    auto bytes = redis.server().stats().bytes_in - bytes_before;
+    set_wire_bytes(state, bytes / static_cast<uint64_t>(state.iterations()));
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_WriteBook)
+    ->ArgsProduct({{0, 1}, {10, 50, 100}})
+    ->ArgNames({"packed", "depth"});
+
+/*
+ * Reader: from the Redis reply to sorted price levels
+ */
+
+/**
+ * Parse an HGETALL reply of one side, then sort it, as hashes don't keep order.
+ */
+template <class Compare>
+void
+parse_hash_side(const std::vector<std::string>& reply, std::vector<PriceLevel>& out)
+{
+    out.clear();
+
+    for (size_t i = 0; i + 1 < reply.size(); i += 2) {
+        PriceLevel level{};
+
+        const auto& price = reply[i];
+        const auto& size = reply[i + 1];
+
+        std::from_chars(price.data(), price.data() + price.size(), level.price);
+        std::from_chars(size.data(), size.data() + size.size(), level.size);
+
+        out.push_back(level);
+    }
+
+    std::ranges::sort(out, Compare{}, &PriceLevel::price);
+}
+
+/**
+ * HGETALL replies for both sides, as raccoon writes them: in hash order, so shuffled.
+ */
+void
+BM_ReadHashBook(benchmark::State& state)
+{
+    auto snapshot = book_snapshot(static_cast<size_t>(state.range(0)));
+    std::mt19937 rng(42); // NOLINT(*-magic-numbers)
+
+    auto to_reply = [&rng](std::vector<PriceLevel> levels) {
+        std::ranges::shuffle(levels, rng);
+        std::vector<std::string> reply;
+
+        for (const auto& level : levels) {
+            reply.push_back(std::to_string(level.price));
+            reply.push_back(std::to_string(level.size));
+        }
+
+        return reply;
+    };
+
+    auto bids_reply = to_reply(snapshot.bids);
+    auto asks_reply = to_reply(snapshot.asks);
+
+    size_t reply_bytes = 0;
+
+    for (const auto* reply : {&bids_reply, &asks_reply}) {
+        reply_bytes += fmt::formatted_size("*{}\r\n", reply->size());
+
+        for (const auto& str : *reply)
+            reply_bytes += bulk_size(str.size());
+    }
+
+    std::vector<PriceLevel> bids;
+    std::vector<PriceLevel> asks;
+
+    AllocationCounter allocs(state);
+
+    for (auto _ : state) {
+        parse_hash_side<std::greater<>>(bids_reply, bids);
+        parse_hash_side<std::less<>>(asks_reply, asks);
+
+        benchmark::DoNotOptimize(bids.data());
+        benchmark::DoNotOptimize(asks.data());
+    }
+
+    set_wire_bytes(state, reply_bytes);
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_ReadHashBook)->Arg(10)->Arg(50)->Arg(100)->ArgName("depth");
+
+/**
+ * A GET reply of a packed book, decoded and converted to doubles.
+ */
+void
+BM_ReadPackedBook(benchmark::State& state)
+{
+    auto snapshot = book_snapshot(static_cast<size_t>(state.range(0)));
+
+    auto to_fixed = [](const std::vector<PriceLevel>& levels) {
+        std::vector<packed::Level> res;
+
+        for (const auto& level : levels) {
+            res.push_back({
+                .price = std::llround(level.price * 1e8), // NOLINT(*-magic-numbers)
+                .size = std::llround(level.size * 1e8),   // NOLINT(*-magic-numbers)
+            });
+        }
+
+        return res;
+    };
+
+    packed::Book book{
+        .bids = to_fixed(snapshot.bids),
+        .asks = to_fixed(snapshot.asks),
+    };
+
+    std::string reply;
+    packed::encode(book, reply);
+
+    packed::Book decoded;
+    std::vector<PriceLevel> bids;
+    std::vector<PriceLevel> asks;
+
+    auto to_double = [&decoded](const std::vector<packed::Level>& side, auto& out) {
+        out.clear();
+
+        for (const auto& level : side) {
+            out.push_back({
+                .price = decoded.to_double(level.price),
+                .size = decoded.to_double(level.size),
+            });
+        }
+    };
+
+    AllocationCounter allocs(state);
+
+    for (auto _ : state) {
+        packed::decode(reply, decoded);
+        to_double(decoded.bids, bids);
+        to_double(decoded.asks, asks);
+
+        benchmark::DoNotOptimize(bids.data());
+        benchmark::DoNotOptimize(asks.data());
+    }
+
+    set_wire_bytes(state, bulk_size(reply.size()));
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_ReadPackedBook)->Arg(10)->Arg(50)->Arg(100)->ArgName("depth");
+
+/**
+ * Apply one small update, then write the book. Hashes rewrite every level, sorted
+ * sets only the changed ones.
+ */
+void
+BM_WriteBookUpdate(benchmark::State& state)
+{
+    auto format = state.range(0) != 0 ? BookFormat::ZSET : BookFormat::HASH;
+    auto depth = static_cast<size_t>(state.range(1));
+    std::string product_id = "ETH-USD";
+
+    NullRedis redis;
+    OrderbookProcessor books;
+    books.set_format(format);
+    books.process_incoming_snapshot(book_snapshot(depth));
+    books.ob_to_redis(redis.get(), product_id);
+
+    auto deltas = book_deltas(1024, depth); // NOLINT(*-magic-numbers)
+    size_t next = 0;
+
+    auto bytes_before = redis.server().stats().bytes_in;
+
+    {
+        AllocationCounter allocs(state);
+
+        for (auto _ : state) {
+            books.process_incoming_update(deltas[next++ % deltas.size()]);
+            books.ob_to_redis(redis.get(), product_id);
+        }
+    }
+
+    auto bytes = redis.server().stats().bytes_in - bytes_before;
+    set_wire_bytes(state, bytes / static_cast<uint64_t>(state.iterations()));
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_WriteBookUpdate)
+    ->ArgsProduct({{0, 1}, {50, 500}})
+    ->ArgNames({"zset", "depth"});
+
+/*
+ * Reader round trips: the best `top` levels of each side of a stored book, from
+ * sending the request to sorted price levels
+ */
+
+/**
+ * Send commands in one round trip and collect their replies.
+ */
+void
+round_trip(
+    redisContext* redis,
+    std::span<const RedisCommand> commands,
+    std::vector<redisReply*>& replies
+)
+{
+    for (const auto& command : commands)
+        command.append_to(redis);
+
+    replies.clear();
+
+    for (size_t i = 0; i < commands.size(); i++) {
+        void* reply = nullptr;
+        redisGetReply(redis, &reply);
+        replies.push_back(static_cast<redisReply*>(reply));
+    }
+}
+
+void
+free_replies(std::vector<redisReply*>& replies)
+{
+    for (auto* reply : replies)
+        freeReplyObject(reply);
+
+    replies.clear();
+}
+
+double
+to_double(const redisReply* reply)
+{
+    double value = 0;
+    std::from_chars(reply->str, reply->str + reply->len, value);
+    return value;
+}
+
+/**
+ * A book stored in one format, and the bytes its readers receive.
+ */
+struct stored_book {
+    NullRedis redis{{.store = true}};
+    uint64_t bytes_before = 0;
+
+    stored_book(BookFormat format, size_t depth)
+    {
+        OrderbookProcessor books;
+        books.set_format(format);
+        books.process_incoming_snapshot(book_snapshot(depth));
+        books.ob_to_redis(redis.get(), "ETH-USD");
+
+        bytes_before = redis.server().stats().bytes_out;
+    }
+
+    void
+    report(benchmark::State& state) const
+    {
+        auto bytes = redis.server().stats().bytes_out - bytes_before;
+        set_wire_bytes(state, bytes / static_cast<uint64_t>(state.iterations()));
+        state.SetItemsProcessed(state.iterations());
+    }
+};
+
+/**
+ * HGETALL both sides, whatever the depth wanted, then sort out the best levels.
+ */
+template <class Compare>
+void
+top_of_hash(const redisReply* reply, size_t top, std::vector<PriceLevel>& out)
+{
+    out.clear();
+
+    for (size_t i = 0; i + 1 < reply->elements; i += 2) {
+        out.push_back({
+            .price = to_double(reply->element[i]),
+            .size = to_double(reply->element[i + 1]),
+        });
+    }
+
+    auto count = std::min(top, out.size());
+    auto last = out.begin() + static_cast<ptrdiff_t>(count);
+
+    std::ranges::partial_sort(out, last, Compare{}, &PriceLevel::price);
+    out.resize(count);
+}
+
+void
+BM_RoundTripHashBook(benchmark::State& state)
+{
+    auto depth = static_cast<size_t>(state.range(0));
+    auto top = static_cast<size_t>(state.range(1));
+
+    stored_book book(BookFormat::HASH, depth);
+    auto* redis = book.redis.get();
+
+    std::vector<redisReply*> replies;
+    std::vector<PriceLevel> bids;
+    std::vector<PriceLevel> asks;
+
+    AllocationCounter allocs(state);
+
+    for (auto _ : state) {
+        std::array commands{RedisCommand("HGETALL"), RedisCommand("HGETALL")};
+        commands[0].arg("ETH-USD-BIDS");
+        commands[1].arg("ETH-USD-ASKS");
+
+        round_trip(redis, commands, replies);
+
+        top_of_hash<std::greater<>>(replies[0], top, bids);
+        top_of_hash<std::less<>>(replies[1], top, asks);
+        free_replies(replies);
+
+        benchmark::DoNotOptimize(bids.data());
+        benchmark::DoNotOptimize(asks.data());
+    }
+
+    book.report(state);
+}
+
+BENCHMARK(BM_RoundTripHashBook)
+    ->ArgsProduct({{50, 500}, {10}})
+    ->ArgNames({"depth", "top"});
+
+/**
+ * A range of the best prices from each sorted set, then their sizes: two round
+ * trips, but only the levels wanted.
+ */
+void
+BM_RoundTripZsetBook(benchmark::State& state)
+{
+    auto depth = static_cast<size_t>(state.range(0));
+    auto top = static_cast<size_t>(state.range(1));
+
+    stored_book book(BookFormat::ZSET, depth);
+    auto* redis = book.redis.get();
+
+    std::vector<redisReply*> prices;
+    std::vector<redisReply*> sizes;
+    std::vector<PriceLevel> bids;
+    std::vector<PriceLevel> asks;
+
+    auto to_levels = [](const redisReply* price, const redisReply* size, auto& out) {
+        out.clear();
+
+        for (size_t i = 0; i < price->elements && i < size->elements; i++) {
+            out.push_back({
+                .price = to_double(price->element[i]),
+                .size = to_double(size->element[i]),
+            });
+        }
+    };
+
+    AllocationCounter allocs(state);
+
+    for (auto _ : state) {
+        std::array ranges{
+            RedisCommand("ZREVRANGEBYSCORE"), RedisCommand("ZRANGEBYSCORE")
+        };
+        ranges[0].arg("ETH-USD-ZBIDS").arg("+inf").arg("-inf");
+        ranges[1].arg("ETH-USD-ZASKS").arg("-inf").arg("+inf");
+
+        for (auto& range : ranges)
+            range.arg("LIMIT").arg(0).arg(top);
+
+        round_trip(redis, ranges, prices);
+
+        // Members are the prices, and the fields of the sizes
+        std::array lookups{RedisCommand("HMGET"), RedisCommand("HMGET")};
+        lookups[0].arg("ETH-USD-ZBIDS-SIZES");
+        lookups[1].arg("ETH-USD-ZASKS-SIZES");
+
+        for (size_t side = 0; side < 2; side++) {
+            const auto* members = prices[side];
+
+            for (size_t i = 0; i < members->elements; i++)
+                lookups[side].arg({members->element[i]->str, members->element[i]->len});
+        }
+
+        round_trip(redis, lookups, sizes);
+
+        to_levels(prices[0], sizes[0], bids);
+        to_levels(prices[1], sizes[1], asks);
+        free_replies(prices);
+        free_replies(sizes);
+
+        benchmark::DoNotOptimize(bids.data());
+        benchmark::DoNotOptimize(asks.data());
+    }
+
+    book.report(state);
+}
+
+BENCHMARK(BM_RoundTripZsetBook)
+    ->ArgsProduct({{50, 500}, {10}})
+    ->ArgNames({"depth", "top"});
+
+} // namespace
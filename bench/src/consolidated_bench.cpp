@@ -0,0 +1,85 @@
+#include "allocations.hpp"
+#include "exchanges/events.hpp"
+#include "storage/consolidated.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <random>
+
+using namespace raccoon::exchanges; // NOLINT(*-using-namespace)
+using namespace raccoon::storage;   // NOLINT(*-using-namespace)
+
+namespace {
+
+constexpr double MID_PRICE = 1000.0;
+constexpr double TICK = 0.01;
+
+/**
+ * Fill a book with `depth` levels per side from each of `venues` venues.
+ */
+ConsolidatedBook
+make_book(size_t venues, size_t depth)
+{
+    ConsolidatedBook book;
+
+    for (size_t venue = 0; venue < venues; venue++) {
+        for (size_t level = 1; level <= depth; level++) {
+            auto offset = static_cast<double>(level) * TICK;
+            auto id = static_cast<Venue>(venue);
+
+            book.apply(id, Side::BID, MID_PRICE - offset, 1.0);
+            book.apply(id, Side::ASK, MID_PRICE + offset, 1.0);
+        }
+    }
+
+    return book;
+}
+
+/**
+ * Cost of one level change from one venue, then reading the new best bid/offer.
+ *
+ * Changes land near the top of the book, as they do in practice.
+ */
+void
+BM_ConsolidatedUpdate(benchmark::State& state)
+{
+    auto venues = static_cast<size_t>(state.range(0));
+    auto depth = static_cast<size_t>(state.range(1));
+
+    auto book = make_book(venues, depth);
+
+    std::mt19937 rng(42); // NOLINT(*-magic-numbers)
+    std::geometric_distribution<size_t> level_dist(0.2);
+    std::uniform_int_distribution<size_t> venue_dist(0, venues - 1);
+    std::uniform_real_distribution<double> size_dist(0.0, 2.0);
+
+    auto now = ConsolidatedBook::clock::now();
+    raccoon::bench::AllocationCounter allocs(state);
+
+    for (auto _ : state) {
+        auto level = 1 + std::min(level_dist(rng), depth - 1);
+        auto side = (level & 1U) ? Side::BID : Side::ASK;
+        auto offset = static_cast<double>(level) * TICK;
+        auto price = side == Side::BID ? MID_PRICE - offset : MID_PRICE + offset;
+
+        // Roughly one in five changes removes the level
+        auto size = size_dist(rng);
+        if (size < 0.4) // NOLINT(*-magic-numbers)
+            size = 0.0;
+
+        book.apply(static_cast<Venue>(venue_dist(rng)), side, price, size, now);
+
+        benchmark::DoNotOptimize(book.best_bid());
+        benchmark::DoNotOptimize(book.best_ask());
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+} // namespace
+
+// Venues beyond the ones we support only exercise the extra slots
+BENCHMARK(BM_ConsolidatedUpdate)
+    ->ArgsProduct({{1, 2, 4, 8}, {10, 100, 1000, 10000}})
+    ->ArgNames({"venues", "depth"});
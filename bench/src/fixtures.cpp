@@ -0,0 +1,165 @@
+#include "fixtures.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+
+namespace raccoon {
+namespace bench {
+
+using exchanges::Side;
+
+/**
+ * Level changes near the top of a book, reproducible between calls.
+ */
+static std::vector<exchanges::LevelChange>
+make_changes(size_t count, size_t depth)
+{
+    std::mt19937 rng(42); // NOLINT(*-magic-numbers)
+    std::geometric_distribution<size_t> level_dist(0.2);
+    std::uniform_real_distribution<double> size_dist(0.0, 2.0);
+
+    std::vector<exchanges::LevelChange> changes;
+    changes.reserve(count);
+
+    for (size_t i = 0; i < count; i++) {
+        auto level = 1 + std::min(level_dist(rng), depth - 1);
+        auto side = (i & 1U) ? Side::BID : Side::ASK;
+        auto offset = static_cast<double>(level) * TICK;
+
+        auto size = size_dist(rng);
+        if (size < 0.4) // NOLINT(*-magic-numbers)
+            size = 0.0;
+
+        changes.push_back(
+            {side, side == Side::BID ? MID_PRICE - offset : MID_PRICE + offset, size}
+        );
+    }
+
+    return changes;
+}
+
+std::string
+coinbase_snapshot(size_t depth)
+{
+    std::string asks;
+    std::string bids;
+
+    for (size_t level = 1; level <= depth; level++) {
+        auto offset = static_cast<double>(level) * TICK;
+        auto sep = level == 1 ? "" : ",";
+
+        asks += fmt::format(R"({}["{:.2f}","{:.8f}"])", sep, MID_PRICE + offset, 1.5);
+        bids += fmt::format(R"({}["{:.2f}","{:.8f}"])", sep, MID_PRICE - offset, 1.5);
+    }
+
+    return fmt::format(
+        R"({{"type":"snapshot","product_id":"ETH-USD","asks":[{}],"bids":[{}],)"
+        R"("time":"2023-09-19T17:10:35.000000Z"}})",
+        asks,
+        bids
+    );
+}
+
+std::vector<std::string>
+coinbase_updates(size_t count, size_t depth)
+{
+    std::vector<std::string> res;
+    res.reserve(count);
+
+    for (const auto& change : make_changes(count, depth)) {
+        res.push_back(fmt::format(
+            R"({{"type":"l2update","product_id":"ETH-USD",)"
+            R"("changes":[["{}","{:.2f}","{:.8f}"]],)"
+            R"("time":"2023-09-19T17:10:35.123456Z"}})",
+            change.side == Side::BID ? "buy" : "sell",
+            change.price,
+            change.size
+        ));
+    }
+
+    return res;
+}
+
+std::vector<std::string>
+coinbase_matches(size_t count)
+{
+    std::vector<std::string> res;
+    res.reserve(count);
+
+    for (size_t i = 0; i < count; i++) {
+        res.push_back(fmt::format(
+            R"({{"type":"match","trade_id":{},)"
+            R"("maker_order_id":"4c3c0a54-8ab6-4cd8-b75a-f5da3bd6ee5f",)"
+            R"("taker_order_id":"be9b7bfd-5c0c-4e7a-9c0b-dc3e5a8e9f77",)"
+            R"("side":"{}","size":"0.01537","price":"{:.2f}","product_id":"ETH-USD",)"
+            R"("sequence":{},"time":"2023-09-19T17:10:35.531622Z"}})",
+            475348218 + i, // NOLINT(*-magic-numbers)
+            (i & 1U) ? "buy" : "sell",
+            MID_PRICE + static_cast<double>(i % 5) * TICK, // NOLINT(*-magic-numbers)
+            51563738497 + i                                // NOLINT(*-magic-numbers)
+        ));
+    }
+
+    return res;
+}
+
+exchanges::BookSnapshot
+book_snapshot(size_t depth)
+{
+    exchanges::BookSnapshot snapshot{
+        .venue = exchanges::Venue::COINBASE,
+        .product_id = "ETH-USD",
+    };
+
+    for (size_t level = 1; level <= depth; level++) {
+        auto offset = static_cast<double>(level) * TICK;
+
+        snapshot.asks.push_back({MID_PRICE + offset, 1.5});
+        snapshot.bids.push_back({MID_PRICE - offset, 1.5});
+    }
+
+    return snapshot;
+}
+
+std::vector<exchanges::BookDelta>
+book_deltas(size_t count, size_t depth)
+{
+    std::vector<exchanges::BookDelta> res;
+    res.reserve(count);
+
+    for (const auto& change : make_changes(count, depth)) {
+        res.push_back({
+            .venue = exchanges::Venue::COINBASE,
+            .product_id = "ETH-USD",
+            .changes = {change},
+        });
+    }
+
+    return res;
+}
+
+/*
+ * NullRedis
+ */
+
+NullRedis::NullRedis(resp::ServerConfig config) : server_(std::move(config))
+{
+    if (!server_.start())
+        throw std::runtime_error("Could not start RESP server");
+
+    redis_ = redisConnect("127.0.0.1", server_.port());
+
+    if (redis_ == nullptr || redis_->err != 0)
+        throw std::runtime_error("Could not connect to RESP server");
+}
+
+NullRedis::~NullRedis()
+{
+    redisFree(redis_);
+}
+
+} // namespace bench
+} // namespace raccoon
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "exchanges/events.hpp"
+#include "resp_server/server.hpp"
+
+#include <hiredis/hiredis.h>
+
+#include <string>
+#include <vector>
+
+namespace raccoon {
+namespace bench {
+
+inline constexpr double MID_PRICE = 1646.50;
+inline constexpr double TICK = 0.01;
+
+/*
+ * Coinbase feed messages, shaped like the real ones for ETH-USD
+ */
+
+/**
+ * A level2 snapshot with `depth` levels per side around MID_PRICE.
+ */
+std::string coinbase_snapshot(size_t depth);
+
+/**
+ * Level2 updates, one change each as Coinbase sends them, landing near the top of a
+ * book of `depth` levels. Roughly one in five removes its level.
+ */
+std::vector<std::string> coinbase_updates(size_t count, size_t depth);
+
+/**
+ * Match messages with increasing trade ids.
+ */
+std::vector<std::string> coinbase_matches(size_t count);
+
+/*
+ * The same, already normalized
+ */
+
+/**
+ * A book snapshot with `depth` levels per side around MID_PRICE.
+ */
+exchanges::BookSnapshot book_snapshot(size_t depth);
+
+/**
+ * Book deltas of one change each, matching coinbase_updates().
+ */
+std::vector<exchanges::BookDelta> book_deltas(size_t count, size_t depth);
+
+/**
+ * A Redis connection to an in-process RESP server, which accepts writes without
+ * storing them unless configured to.
+ *
+ * Lets storage code run its real Redis path, including formatting and the socket
+ * round trip, without an outside server or its processing time.
+ */
+class NullRedis {
+    resp::RespServer server_;
+    redisContext* redis_ = nullptr;
+
+public:
+    explicit NullRedis(resp::ServerConfig config = {});
+    ~NullRedis();
+
+    NullRedis(const NullRedis&) = delete;
+    NullRedis(NullRedis&&) = delete;
+    NullRedis& operator=(const NullRedis&) = delete;
+    NullRedis& operator=(NullRedis&&) = delete;
+
+    [[nodiscard]] redisContext*
+    get() const noexcept
+    {
+        return redis_;
+    }
+
+    [[nodiscard]] const resp::RespServer&
+    server() const noexcept
+    {
+        return server_;
+    }
+};
+
+} // namespace bench
+} // namespace raccoon
@@ -0,0 +1,65 @@
+#include "allocations.hpp"
+#include "common.hpp"
+#include "fixtures.hpp"
+#include "storage/processing.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <mutex>
+
+using namespace raccoon::bench;   // NOLINT(*-using-namespace)
+using namespace raccoon::storage; // NOLINT(*-using-namespace)
+
+namespace {
+
+constexpr size_t MESSAGE_COUNT = 4096;
+constexpr size_t DEPTH = 100;
+
+/**
+ * Set every logger we use on the message path to a level.
+ */
+void
+set_log_level(quill::LogLevel level)
+{
+    namespace logging = raccoon::logging;
+
+    logging::get_main_logger()->set_log_level(level);
+    logging::get_redis_logger()->set_log_level(level);
+    logging::get_web_logger()->set_log_level(level);
+}
+
+/**
+ * Book updates through the DataProcessor, with logging set up as in production: the
+ * backend thread running, console and file handlers, and backtraces if built in.
+ *
+ * At Info nothing on the message path should log. With debug on, per-message logs
+ * are sampled. Compare builds with different raccoon_LOG_LEVEL to see what compiling
+ * levels out saves.
+ */
+void
+BM_LoggedUpdates(benchmark::State& state)
+{
+    static std::once_flag started;
+    std::call_once(started, [] { raccoon::logging::init(quill::LogLevel::Info); });
+
+    set_log_level(state.range(0) != 0 ? quill::LogLevel::Debug : quill::LogLevel::Info);
+
+    auto messages = coinbase_updates(MESSAGE_COUNT, DEPTH);
+
+    NullRedis redis;
+    DataProcessor processor(redis.get());
+    processor.process_incoming_data(coinbase_snapshot(DEPTH));
+
+    size_t idx = 0;
+    AllocationCounter allocs(state);
+
+    for (auto _ : state)
+        processor.process_incoming_data(messages[idx++ % messages.size()]);
+
+    state.SetItemsProcessed(state.iterations());
+    set_log_level(quill::LogLevel::Info);
+}
+
+BENCHMARK(BM_LoggedUpdates)->Arg(0)->Arg(1)->ArgName("debug");
+
+} // namespace
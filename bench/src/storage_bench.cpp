@@ -0,0 +1,365 @@
+#include "allocations.hpp"
+#include "fixtures.hpp"
+#include "storage/orderbook.hpp"
+#include "storage/processing.hpp"
+#include "storage/sink.hpp"
+#include "storage/trades.hpp"
+#include "utils/utils.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <chrono>
+#include <limits>
+
+using namespace raccoon::bench;     // NOLINT(*-using-namespace)
+using namespace raccoon::exchanges; // NOLINT(*-using-namespace)
+using namespace raccoon::storage;   // NOLINT(*-using-namespace)
+
+namespace {
+
+// Messages to cycle through, so branch predictors can't learn a single one
+constexpr size_t MESSAGE_COUNT = 4096;
+
+/*
+ * DataProcessor: a raw feed message in, Redis writes out
+ */
+
+void
+BM_ProcessSnapshot(benchmark::State& state)
+{
+    auto depth = static_cast<size_t>(state.range(0));
+    auto message = coinbase_snapshot(depth);
+
+    NullRedis redis;
+    DataProcessor processor(redis.get());
+
+    AllocationCounter allocs(state);
+
+    for (auto _ : state)
+        processor.process_incoming_data(message);
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(message.size()));
+}
+
+BENCHMARK(BM_ProcessSnapshot)->Arg(10)->Arg(100)->Arg(1000)->ArgName("depth");
+
+void
+BM_ProcessUpdate(benchmark::State& state)
+{
+    auto depth = static_cast<size_t>(state.range(0));
+    auto messages = coinbase_updates(MESSAGE_COUNT, depth);
+
+    NullRedis redis;
+    DataProcessor processor(redis.get());
+    processor.process_incoming_data(coinbase_snapshot(depth));
+
+    size_t idx = 0;
+    AllocationCounter allocs(state);
+
+    for (auto _ : state)
+        processor.process_incoming_data(messages[idx++ % messages.size()]);
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_ProcessUpdate)->Arg(10)->Arg(100)->Arg(1000)->ArgName("depth");
+
+/**
+ * The same without Redis, into a sink that only counts, on the feed's thread or
+ * behind a queue.
+ */
+void
+BM_ProcessUpdateToSink(benchmark::State& state)
+{
+    auto messages = coinbase_updates(MESSAGE_COUNT, 100); // NOLINT(*-magic-numbers)
+
+    DataProcessor processor(nullptr);
+
+    if (state.range(0) != 0)
+        processor.add_sink(std::make_unique<AsyncSink<NullSink>>(SINK_QUEUE_CAPACITY));
+    else
+        processor.add_sink(std::make_unique<SinkGroup<NullSink>>(NullSink{}));
+
+    processor.process_incoming_data(coinbase_snapshot(100)); // NOLINT(*-magic-numbers)
+
+    size_t idx = 0;
+    AllocationCounter allocs(state);
+
+    for (auto _ : state)
+        processor.process_incoming_data(messages[idx++ % messages.size()]);
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_ProcessUpdateToSink)->Arg(0)->Arg(1)->ArgName("async");
+
+/**
+ * Includes serializing every match seen in the last second, as the trade processor
+ * does on each one.
+ */
+void
+BM_ProcessMatch(benchmark::State& state)
+{
+    auto messages = coinbase_matches(MESSAGE_COUNT);
+
+    NullRedis redis;
+    DataProcessor processor(redis.get());
+
+    size_t idx = 0;
+    AllocationCounter allocs(state);
+
+    for (auto _ : state)
+        processor.process_incoming_data(messages[idx++ % messages.size()]);
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_ProcessMatch);
+
+/**
+ * A loop cycle's worth of book updates and some matches, then the flush at the end
+ * of the cycle, as the feed loop runs them. Reports the process's peak RSS too.
+ */
+void
+BM_ReplayLoopCycle(benchmark::State& state)
+{
+    constexpr size_t DEPTH = 1000;
+    constexpr size_t MATCH_EVERY = 16;
+
+    auto batch = static_cast<size_t>(state.range(0));
+    auto deltas = book_deltas(MESSAGE_COUNT, DEPTH);
+
+    Trade trade{
+        .venue = Venue::COINBASE,
+        .product_id = "ETH-USD",
+        .side = Side::BID,
+        .price = MID_PRICE,
+        .size = 0.01537, // NOLINT(*-magic-numbers)
+    };
+
+    NullRedis redis;
+    DataProcessor processor(redis.get());
+    processor.process_event(book_snapshot(DEPTH));
+
+    size_t idx = 0;
+    AllocationCounter allocs(state);
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < batch; i++) {
+            processor.process_event(deltas[idx++ % deltas.size()]);
+
+            if (idx % MATCH_EVERY == 0) {
+                trade.trade_id++;
+                processor.process_event(trade);
+            }
+        }
+
+        processor.flush();
+    }
+
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(batch));
+    state.counters["peak_rss_kb"] = static_cast<double>(peak_rss_kb());
+}
+
+BENCHMARK(BM_ReplayLoopCycle)->Arg(1)->Arg(64)->ArgName("batch");
+
+/*
+ * OrderbookProcessor: applying normalized events, then the Redis argv
+ */
+
+void
+BM_OrderbookSnapshot(benchmark::State& state)
+{
+    auto snapshot = book_snapshot(static_cast<size_t>(state.range(0)));
+    OrderbookProcessor books;
+
+    AllocationCounter allocs(state);
+
+    // Deep ones built at once, rather than over loop cycles
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(&books.process_incoming_snapshot(snapshot));
+        books.continue_snapshots(std::numeric_limits<size_t>::max(), {});
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_OrderbookSnapshot)
+    ->Arg(10)
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->ArgName("depth");
+
+void
+BM_OrderbookUpdate(benchmark::State& state)
+{
+    auto depth = static_cast<size_t>(state.range(0));
+    auto deltas = book_deltas(MESSAGE_COUNT, depth);
+
+    OrderbookProcessor books;
+    books.process_incoming_snapshot(book_snapshot(depth));
+    books.continue_snapshots(std::numeric_limits<size_t>::max(), {});
+
+    size_t idx = 0;
+    AllocationCounter allocs(state);
+
+    for (auto _ : state) {
+        const auto& delta = deltas[idx++ % deltas.size()];
+        benchmark::DoNotOptimize(&books.process_incoming_update(delta));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_OrderbookUpdate)
+    ->Arg(10)
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->ArgName("depth");
+
+/**
+ * Writing both sides of a book, which builds the HMSET argv for each.
+ */
+void
+BM_OrderbookToRedis(benchmark::State& state)
+{
+    auto depth = static_cast<size_t>(state.range(0));
+    std::string product_id = "ETH-USD";
+
+    NullRedis redis;
+    OrderbookProcessor books;
+    books.process_incoming_snapshot(book_snapshot(depth));
+    books.continue_snapshots(std::numeric_limits<size_t>::max(), {});
+
+    AllocationCounter allocs(state);
+
+    for (auto _ : state)
+        books.ob_to_redis(redis.get(), product_id);
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_OrderbookToRedis)
+    ->Arg(10)
+    ->Arg(100)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->ArgName("depth");
+
+/**
+ * A deep snapshot replacing a live book, with an update per loop cycle until it's
+ * applied, built over cycles or at once. Reports the longest cycle, which is what
+ * updates to other books wait behind.
+ */
+void
+BM_SnapshotSpike(benchmark::State& state)
+{
+    auto depth = static_cast<size_t>(state.range(0));
+    bool chunked = state.range(1) != 0;
+
+    // Every other snapshot has new sizes, so there's a diff to publish
+    std::array snapshots{book_snapshot(depth), book_snapshot(depth)};
+    for (auto& level : snapshots[1].bids)
+        level.size *= 2;
+
+    auto deltas = book_deltas(MESSAGE_COUNT, depth);
+    auto levels = chunked ? SNAPSHOT_CHUNK_LEVELS : std::numeric_limits<size_t>::max();
+
+    OrderbookProcessor books;
+    books.process_incoming_snapshot(snapshots[0]);
+    books.continue_snapshots(std::numeric_limits<size_t>::max(), {});
+
+    size_t idx = 0;
+    int64_t cycles = 0;
+    std::chrono::nanoseconds longest{};
+
+    for (auto _ : state) {
+        auto start = std::chrono::steady_clock::now();
+        books.process_incoming_snapshot(snapshots[idx % snapshots.size()]);
+
+        do {
+            books.process_incoming_update(deltas[idx++ % deltas.size()]);
+            books.continue_snapshots(levels, {});
+
+            auto end = std::chrono::steady_clock::now();
+            longest = std::max(longest, end - start);
+            start = end;
+            cycles++;
+        } while (books.rebuilding());
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.counters["cycles"] = benchmark::Counter(
+        static_cast<double>(cycles), benchmark::Counter::kAvgIterations
+    );
+    state.counters["longest_cycle_us"] =
+        std::chrono::duration<double, std::micro>(longest).count();
+}
+
+BENCHMARK(BM_SnapshotSpike)
+    ->ArgsProduct({{1000, 50000}, {0, 1}})
+    ->ArgNames({"depth", "chunked"});
+
+/*
+ * TradeProcessor
+ */
+
+/**
+ * Serializing and writing a window of matches.
+ */
+void
+BM_TradesToRedis(benchmark::State& state)
+{
+    NullRedis redis;
+    TradeProcessor trades;
+
+    Trade trade{
+        .venue = Venue::COINBASE,
+        .product_id = "ETH-USD",
+        .side = Side::BID,
+        .price = MID_PRICE,
+        .size = 0.01537, // NOLINT(*-magic-numbers)
+    };
+
+    for (int64_t i = 0; i < state.range(0); i++) {
+        trade.trade_id++;
+        trades.process_incoming_match(trade);
+    }
+
+    AllocationCounter allocs(state);
+
+    for (auto _ : state)
+        trades.matches_to_redis(redis.get());
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_TradesToRedis)->Arg(1)->Arg(100)->Arg(1000)->ArgName("matches");
+
+/*
+ * Utilities
+ */
+
+void
+BM_Hexdump(benchmark::State& state)
+{
+    std::vector<uint8_t> data(static_cast<size_t>(state.range(0)));
+
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = static_cast<uint8_t>(i);
+
+    AllocationCounter allocs(state);
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(raccoon::utils::hexdump(data));
+
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BM_Hexdump)->Arg(64)->Arg(1024)->Arg(16384)->ArgName("bytes");
+
+} // namespace
@@ -0,0 +1,168 @@
+#include "allocations.hpp"
+#include "storage/ticks.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+using namespace raccoon::exchanges; // NOLINT(*-using-namespace)
+using namespace raccoon::storage;   // NOLINT(*-using-namespace)
+
+namespace {
+
+constexpr int64_t START = 1'700'000'000'000'000'000;
+constexpr int64_t TICK = 1'000'000; // 0.01 in fixed point
+
+/**
+ * Book delta rows shaped like a live feed: bursts of changes near the touch, with
+ * the mid wandering a few ticks at a time.
+ */
+TickColumns
+make_rows(size_t count)
+{
+    std::mt19937_64 rng(42); // NOLINT(*-magic-numbers)
+    std::geometric_distribution<int64_t> gap_us(0.01);
+    std::geometric_distribution<int64_t> level(0.3);
+    std::uniform_int_distribution<int64_t> walk(-2, 2);
+    std::uniform_int_distribution<int64_t> lots(0, 500);
+
+    TickColumns rows;
+    int64_t timestamp = START;
+    int64_t mid = 2000'00000000;
+    uint64_t sequence = 1;
+
+    for (size_t i = 0; i < count; i++) {
+        timestamp += gap_us(rng) * 1000;
+        mid += walk(rng) * TICK;
+
+        bool bid = (i & 1U) != 0;
+        auto offset = (1 + level(rng)) * TICK;
+
+        rows.push_back({
+            .timestamp = timestamp,
+            .id = sequence++,
+            .side = bid ? Side::BID : Side::ASK,
+            .price = bid ? mid - offset : mid + offset,
+            .size = lots(rng) * 1'000'000, // NOLINT(*-magic-numbers)
+        });
+    }
+
+    return rows;
+}
+
+/**
+ * Encode and compress one block; reports the compression ratio against the
+ * in-memory row size.
+ */
+void
+BM_TickEncode(benchmark::State& state)
+{
+    auto rows = make_rows(static_cast<size_t>(state.range(0)));
+    std::string encoded;
+    raccoon::bench::AllocationCounter allocs(state);
+
+    for (auto _ : state) {
+        encoded.clear();
+        ticks::encode_block(rows, encoded);
+        benchmark::DoNotOptimize(encoded.data());
+    }
+
+    auto raw_bytes = static_cast<double>(rows.size() * sizeof(TickRow));
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.counters["ratio"] = raw_bytes / static_cast<double>(encoded.size());
+    state.counters["bytes_per_row"] =
+        static_cast<double>(encoded.size()) / static_cast<double>(rows.size());
+}
+
+BENCHMARK(BM_TickEncode)->Arg(1024)->Arg(4096)->Arg(16384);
+
+/**
+ * Cost of recording a trade on the hot path, with the writer thread running.
+ */
+void
+BM_TickWriterWrite(benchmark::State& state)
+{
+    auto root = std::filesystem::temp_directory_path() / "raccoon_tick_bench";
+    std::filesystem::remove_all(root);
+
+    uint64_t dropped = 0;
+
+    {
+        TickWriter writer(root);
+
+        Trade trade{
+            .venue = Venue::COINBASE,
+            .product_id = "ETH-USD",
+            .timestamp = START,
+        };
+
+        raccoon::bench::AllocationCounter allocs(state);
+
+        for (auto _ : state) {
+            trade.trade_id++;
+            trade.timestamp += TICK;
+            writer.write(trade);
+        }
+
+        dropped = writer.dropped();
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.counters["dropped"] = static_cast<double>(dropped);
+
+    std::filesystem::remove_all(root);
+}
+
+BENCHMARK(BM_TickWriterWrite);
+
+/**
+ * Scan a memory mapped file, touching every row.
+ */
+void
+BM_TickReaderScan(benchmark::State& state)
+{
+    constexpr size_t BLOCK_ROWS = 4096;
+    auto total_rows = static_cast<size_t>(state.range(0));
+
+    auto path = std::filesystem::temp_directory_path() / "raccoon_tick_scan.trades";
+    {
+        auto rows = make_rows(total_rows);
+        std::string encoded;
+        TickColumns block;
+
+        for (size_t i = 0; i < rows.size(); i++) {
+            block.push_back(rows[i]);
+
+            if (block.size() == BLOCK_ROWS || i + 1 == rows.size()) {
+                ticks::encode_block(block, encoded);
+                block.clear();
+            }
+        }
+
+        std::ofstream(path, std::ios::binary) << encoded;
+    }
+
+    TickReader reader(path);
+    raccoon::bench::AllocationCounter allocs(state);
+
+    for (auto _ : state) {
+        int64_t volume = 0;
+
+        reader.for_each_block(START, INT64_MAX, [&](const TickColumns& columns) {
+            for (auto size : columns.sizes)
+                volume += size;
+        });
+
+        benchmark::DoNotOptimize(volume);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    std::filesystem::remove(path);
+}
+
+BENCHMARK(BM_TickReaderScan)->Arg(1 << 20);
+
+} // namespace
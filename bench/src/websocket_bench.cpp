@@ -0,0 +1,161 @@
+#include "allocations.hpp"
+#include "common.hpp"
+#include "mock_exchange/server.hpp"
+#include "web/session.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <map>
+#include <thread>
+
+using namespace raccoon::bench; // NOLINT(*-using-namespace)
+using namespace raccoon::web;   // NOLINT(*-using-namespace)
+
+namespace {
+
+constexpr size_t BATCH = 1000;        // messages received per iteration
+constexpr double SERVER_RATE = 200e3; // messages per second sent by the mock
+
+constexpr int PLAIN_PORT = 38675;
+constexpr int DEFLATE_PORT = 38676;
+
+constexpr std::string_view SUBSCRIBE =
+    R"({"type":"subscribe","product_ids":["ETH-USD"],"channels":["level2_batch"]})";
+
+/**
+ * Start a mock exchange on its own thread, for the rest of the run.
+ */
+void
+start_mock(int port, bool deflate)
+{
+    // NOLINTBEGIN(*-owning-memory)
+    auto* loop = new uv_loop_t;
+    uv_loop_init(loop);
+
+    raccoon::mock::TrafficConfig config;
+    config.rate = SERVER_RATE;
+    config.match_ratio = 0;
+
+    auto* server = new raccoon::mock::MockServer(loop, config);
+    server->set_deflate(deflate);
+    server->listen("127.0.0.1", port);
+    // NOLINTEND(*-owning-memory)
+
+    std::thread([loop] { uv_run(loop, UV_RUN_DEFAULT); }).detach();
+}
+
+/**
+ * A client subscribed to a mock exchange, on the benchmark's thread.
+ */
+struct feed {
+    uv_loop_t loop{};
+    Session* session = nullptr;
+    size_t received = 0;
+    size_t bytes = 0;
+
+    // Keep whichever connection was opened
+    std::shared_ptr<void> conn;
+
+    /**
+     * Receive at least some messages.
+     */
+    void
+    receive(size_t count)
+    {
+        auto target = received + count;
+
+        while (received < target)
+            uv_run(&loop, UV_RUN_ONCE);
+    }
+};
+
+/**
+ * Get the client for a transport, connected and past the book snapshot.
+ *
+ * Sessions can't be torn down, so each is kept for the rest of the run.
+ */
+feed&
+get_feed(bool native, bool deflate)
+{
+    static std::map<std::pair<bool, bool>, feed*> feeds;
+
+    if (auto it = feeds.find({native, deflate}); it != feeds.end())
+        return *it->second;
+
+    static bool started = [] {
+        start_mock(PLAIN_PORT, false);
+        start_mock(DEFLATE_PORT, true);
+        return true;
+    }();
+    UNUSED(started);
+
+    auto* client = new feed; // NOLINT(*-owning-memory)
+    uv_loop_init(&client->loop);
+    client->session = new Session(&client->loop); // NOLINT(*-owning-memory)
+
+    auto on_data = [client](auto* conn, const auto& data) {
+        if (data.size() == PROXY_FIRST_MESSAGE_LEN) [[unlikely]] {
+            conn->send(SUBSCRIBE);
+            return;
+        }
+
+        client->received++;
+        client->bytes += data.size();
+    };
+
+    auto url = fmt::format("ws://127.0.0.1:{}", deflate ? DEFLATE_PORT : PLAIN_PORT);
+
+    if (native)
+        client->conn = client->session->native_ws(url, on_data);
+    else
+        client->conn = client->session->ws(url, on_data);
+
+    // Past the subscription and snapshot
+    client->receive(2);
+
+    feeds[{native, deflate}] = client;
+    return *client;
+}
+
+/**
+ * Coinbase updates received over WebSocket from the mock exchange, through libcurl
+ * or the native client, and compressed or not for the native client.
+ *
+ * The mock sends from its own thread, faster than the client can keep up, and
+ * CPU time is the client thread's: reading, decrypting if need be, framing,
+ * inflating and the callback, without any processing of the messages.
+ */
+void
+BM_WebSocketReceive(benchmark::State& state)
+{
+    bool native = state.range(0) != 0;
+    bool deflate = state.range(1) != 0;
+
+    auto& client = get_feed(native, deflate);
+    auto start_received = client.received;
+    auto start_bytes = client.bytes;
+
+    {
+        AllocationCounter allocs(state);
+
+        for (auto _ : state)
+            client.receive(BATCH);
+    }
+
+    // One read can bring more than a batch
+    auto received = client.received - start_received;
+
+    state.SetItemsProcessed(static_cast<int64_t>(received));
+    state.counters["msg_bytes"] = benchmark::Counter(
+        static_cast<double>(client.bytes - start_bytes) / static_cast<double>(received)
+    );
+}
+
+BENCHMARK(BM_WebSocketReceive)
+    ->Args({0, 0})
+    ->Args({1, 0})
+    ->Args({1, 1})
+    ->ArgNames({"native", "deflate"})
+    ->Unit(benchmark::kMicrosecond);
+
+} // namespace
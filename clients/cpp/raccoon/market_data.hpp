@@ -0,0 +1,338 @@
+#pragma once
+
+/**
+ * Binary market data, as raccoon sends it over UDP multicast when run with
+ * MULTICAST set, and over its recovery socket.
+ *
+ * Header only, and only needs the standard library and packed_book.hpp beside it,
+ * so readers can copy both as is. raccoon encodes with the same code.
+ *
+ * Each datagram is a packet: a header, then messages back to back. Every message
+ * sent takes the next sequence number of its channel, so receivers can tell when
+ * they missed some. Little endian throughout.
+ *
+ * Packet header:
+ *
+ *     offset  size
+ *     0       4     magic, "RMD1"
+ *     4       1     version, 1
+ *     5       1     flags: 1 for a snapshot, 2 for a retransmission
+ *     6       2     message count
+ *     8       2     channel
+ *     10      6     reserved
+ *     16      8     sequence number of the first message; for snapshots, the
+ *                   last one the snapshot includes
+ *     24      8     send time, nanoseconds since epoch
+ *
+ * Messages start with:
+ *
+ *     0       1     type: 1 for a level, 2 for top of book, 3 for a trade,
+ *                   4 for a feed's status
+ *     1       1     venue, 0 for Coinbase and 1 for Binance
+ *     2       1     side, 0 for bid and 1 for ask; for trades, the aggressor's
+ *     3       1     flags: 1 if the book was replaced by a snapshot, 8 if
+ *                   it's sent whole again; for statuses, 2 if stale and 4 if
+ *                   it's the whole connection
+ *     4       4     reserved
+ *     8       16    product id, padded with NULs; for a connection's status, the
+ *                   venue's name
+ *     24      8     exchange timestamp, nanoseconds since epoch, 0 if unknown;
+ *                   for statuses, when raccoon noticed
+ *     32      8     venue sequence number (0 if unsupported), or trade id; for
+ *                   statuses, milliseconds since something last arrived
+ *
+ * then prices and sizes, as signed integers times 10^EXPONENT:
+ *
+ *     level   40 price, 48 size (0 if removed); 56 bytes in all
+ *     top     40 bid, 48 bid size, 56 ask, 64 ask size; 72 bytes in all
+ *     trade   40 price, 48 size; 56 bytes in all
+ *     status  none; 40 bytes in all
+ *
+ * Levels are sent in the order they changed; applying them in sequence keeps a
+ * copy of the book. A top of book message follows the levels of each update.
+ * If raccoon lost some of a book's changes on the way to the sender, it sends
+ * the whole book again, flagged 8: drop the levels held for it, then apply
+ * these, up to its top.
+ * Statuses are sent when a feed goes stale, again while it stays so, and when it
+ * comes back; a stale book may be out of date.
+ *
+ * The recovery socket takes one line, "SNAPSHOT" or "RETRANSMIT <first> <last>",
+ * replies with packets each prefixed by its 4 byte length, then closes. A snapshot
+ * is every book, as levels then its top, as of the sequence number in its headers.
+ * Retransmissions are the packets sent, as far back as they're kept.
+ */
+
+#include "packed_book.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace raccoon {
+namespace market_data {
+
+inline constexpr std::array<char, 4> MAGIC{'R', 'M', 'D', '1'};
+inline constexpr uint8_t FORMAT_VERSION = 1;
+
+inline constexpr size_t HEADER_SIZE = 32;
+inline constexpr size_t PRODUCT_SIZE = 16;
+
+/**
+ * Prices and sizes have 8 decimal places, like packed books.
+ */
+inline constexpr int8_t EXPONENT = packed::EXPONENT;
+
+// Packet flags
+inline constexpr uint8_t PACKET_SNAPSHOT = 1;
+inline constexpr uint8_t PACKET_RETRANSMIT = 2;
+
+// Message flags
+inline constexpr uint8_t MESSAGE_SNAPSHOT = 1;
+inline constexpr uint8_t MESSAGE_STALE = 2;
+inline constexpr uint8_t MESSAGE_CONNECTION = 4;
+inline constexpr uint8_t MESSAGE_RESET = 8;
+
+enum class MessageType : uint8_t {
+    LEVEL = 1,
+    TOP = 2,
+    TRADE = 3,
+    STATUS = 4,
+};
+
+/**
+ * Size of a message of some type, 0 if unknown.
+ */
+constexpr size_t
+message_size(MessageType type) noexcept
+{
+    switch (type) {
+        case MessageType::LEVEL:
+        case MessageType::TRADE:
+            return 56; // NOLINT(*-magic-numbers)
+        case MessageType::TOP:
+            return 72; // NOLINT(*-magic-numbers)
+        case MessageType::STATUS:
+            return 40; // NOLINT(*-magic-numbers)
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Largest message, to size buffers.
+ */
+inline constexpr size_t MAX_MESSAGE_SIZE = message_size(MessageType::TOP);
+
+struct PacketHeader {
+    uint8_t flags = 0;
+    uint16_t count = 0;
+    uint16_t channel = 0;
+    uint64_t sequence = 0;
+    int64_t send_time = 0;
+};
+
+/**
+ * A decoded message, or one to encode.
+ */
+struct Message {
+    MessageType type = MessageType::LEVEL;
+    uint8_t venue = 0;
+    uint8_t side = 0;
+    uint8_t flags = 0;
+    std::array<char, PRODUCT_SIZE> product{};
+
+    int64_t timestamp = 0;
+    uint64_t id = 0; // sequence, trade id, or milliseconds silent
+
+    // Price and size, or bid, bid size, ask and ask size
+    std::array<int64_t, 4> values{};
+
+    /**
+     * Product id, without padding.
+     */
+    [[nodiscard]] std::string_view
+    product_id() const noexcept
+    {
+        std::string_view res(product.data(), product.size());
+        return res.substr(0, res.find('\0'));
+    }
+
+    /**
+     * Set the product id, cut to PRODUCT_SIZE.
+     */
+    void
+    set_product_id(std::string_view product_id) noexcept
+    {
+        product.fill('\0');
+        product_id.copy(product.data(), product.size());
+    }
+
+    /**
+     * Convert a scaled price or size to a double.
+     */
+    [[nodiscard]] static double
+    to_double(int64_t value) noexcept
+    {
+        return static_cast<double>(value) / 1e8; // NOLINT(*-magic-numbers)
+    }
+};
+
+static_assert(EXPONENT == -8, "Message::to_double assumes 8 decimal places");
+
+/**
+ * Write a packet header into the first HEADER_SIZE bytes of `out`.
+ */
+inline void
+encode_header(const PacketHeader& header, char* out) noexcept
+{
+    using packed::detail::put;
+
+    // NOLINTBEGIN(*-magic-numbers, *-pointer-arithmetic)
+    for (size_t i = 0; i < MAGIC.size(); i++)
+        out[i] = MAGIC[i];
+
+    put<uint8_t>(out + 4, FORMAT_VERSION);
+    put<uint8_t>(out + 5, header.flags);
+    put<uint16_t>(out + 6, header.count);
+    put<uint16_t>(out + 8, header.channel);
+
+    for (size_t i = 10; i < 16; i++)
+        out[i] = '\0';
+
+    put<uint64_t>(out + 16, header.sequence);
+    put<int64_t>(out + 24, header.send_time);
+    // NOLINTEND(*-magic-numbers, *-pointer-arithmetic)
+}
+
+/**
+ * Write a message at `out`, which must have room for message_size(message.type).
+ *
+ * @returns size_t Bytes written.
+ */
+inline size_t
+encode_message(const Message& message, char* out) noexcept
+{
+    using packed::detail::put;
+
+    auto size = message_size(message.type);
+
+    // NOLINTBEGIN(*-magic-numbers, *-pointer-arithmetic)
+    put<uint8_t>(out, static_cast<uint8_t>(message.type));
+    put<uint8_t>(out + 1, message.venue);
+    put<uint8_t>(out + 2, message.side);
+    put<uint8_t>(out + 3, message.flags);
+    put<uint32_t>(out + 4, 0);
+
+    for (size_t i = 0; i < PRODUCT_SIZE; i++)
+        out[8 + i] = message.product[i];
+
+    put<int64_t>(out + 24, message.timestamp);
+    put<uint64_t>(out + 32, message.id);
+
+    for (size_t i = 0; 40 + 8 * i < size; i++)
+        put<int64_t>(out + 40 + 8 * i, message.values[i]);
+    // NOLINTEND(*-magic-numbers, *-pointer-arithmetic)
+
+    return size;
+}
+
+/**
+ * Read a packet header.
+ *
+ * @returns bool If `data` starts with a header of a version we understand.
+ */
+inline bool
+decode_header(std::string_view data, PacketHeader& header) noexcept
+{
+    using packed::detail::get;
+
+    std::string_view magic(MAGIC.data(), MAGIC.size());
+
+    if (data.size() < HEADER_SIZE || !data.starts_with(magic))
+        return false;
+
+    const char* ptr = data.data();
+
+    // NOLINTBEGIN(*-magic-numbers, *-pointer-arithmetic)
+    if (get<uint8_t>(ptr + 4) != FORMAT_VERSION)
+        return false;
+
+    header.flags = get<uint8_t>(ptr + 5);
+    header.count = get<uint16_t>(ptr + 6);
+    header.channel = get<uint16_t>(ptr + 8);
+    header.sequence = get<uint64_t>(ptr + 16);
+    header.send_time = get<int64_t>(ptr + 24);
+    // NOLINTEND(*-magic-numbers, *-pointer-arithmetic)
+
+    return true;
+}
+
+/**
+ * Read the message at the front of `data`.
+ *
+ * @returns size_t Bytes read, or 0 if it's truncated or of an unknown type.
+ */
+inline size_t
+decode_message(std::string_view data, Message& message) noexcept
+{
+    using packed::detail::get;
+
+    if (data.empty())
+        return 0;
+
+    const char* ptr = data.data();
+
+    auto type = static_cast<MessageType>(get<uint8_t>(ptr));
+    auto size = message_size(type);
+
+    if (size == 0 || data.size() < size)
+        return 0;
+
+    // NOLINTBEGIN(*-magic-numbers, *-pointer-arithmetic)
+    message.type = type;
+    message.venue = get<uint8_t>(ptr + 1);
+    message.side = get<uint8_t>(ptr + 2);
+    message.flags = get<uint8_t>(ptr + 3);
+
+    for (size_t i = 0; i < PRODUCT_SIZE; i++)
+        message.product[i] = ptr[8 + i];
+
+    message.timestamp = get<int64_t>(ptr + 24);
+    message.id = get<uint64_t>(ptr + 32);
+
+    message.values.fill(0);
+
+    for (size_t i = 0; 40 + 8 * i < size; i++)
+        message.values[i] = get<int64_t>(ptr + 40 + 8 * i);
+    // NOLINTEND(*-magic-numbers, *-pointer-arithmetic)
+
+    return size;
+}
+
+/**
+ * Call `fn` with each message of a packet, after its header.
+ *
+ * @returns bool If every message the header counts was there.
+ */
+template <class Fn>
+bool
+for_each_message(std::string_view packet, const PacketHeader& header, Fn&& fn)
+{
+    Message message;
+    packet.remove_prefix(HEADER_SIZE);
+
+    for (size_t i = 0; i < header.count; i++) {
+        auto used = decode_message(packet, message);
+        if (used == 0)
+            return false;
+
+        fn(message);
+        packet.remove_prefix(used);
+    }
+
+    return true;
+}
+
+} // namespace market_data
+} // namespace raccoon
@@ -0,0 +1,218 @@
+#pragma once
+
+/**
+ * Packed binary books, as raccoon writes them to {product}-BOOK when run with
+ * BOOK_FORMAT=packed.
+ *
+ * Header only, and only needs the standard library, so readers can copy it as is.
+ * raccoon encodes with the same code.
+ *
+ * Layout, little endian:
+ *
+ *     offset  size
+ *     0       4     magic, "RBOK"
+ *     4       1     version, 1
+ *     5       1     exponent: prices and sizes are integers times 10^exponent
+ *     6       1     venue, 0 for Coinbase and 1 for Binance
+ *     7       1     reserved
+ *     8       2     bid level count
+ *     10      2     ask level count
+ *     12      4     reserved
+ *     16      8     venue sequence number, 0 if unsupported
+ *     24      8     exchange timestamp, nanoseconds since epoch, 0 if unknown
+ *     32            bid levels then ask levels, best first, 16 bytes each: price
+ *                   then size, as signed 64 bit integers
+ */
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace raccoon {
+namespace packed {
+
+inline constexpr std::array<char, 4> MAGIC{'R', 'B', 'O', 'K'};
+inline constexpr uint8_t FORMAT_VERSION = 1;
+
+inline constexpr size_t HEADER_SIZE = 32;
+inline constexpr size_t LEVEL_SIZE = 16;
+
+/**
+ * Exponent raccoon writes with: 8 decimal places, as exchanges send.
+ */
+inline constexpr int8_t EXPONENT = -8;
+
+/**
+ * A price level, as scaled integers.
+ */
+struct Level {
+    int64_t price;
+    int64_t size;
+};
+
+/**
+ * A decoded book, or one to encode.
+ */
+struct Book {
+    uint8_t venue = 0;
+    int8_t exponent = EXPONENT;
+    uint64_t sequence = 0;
+    int64_t timestamp = 0;
+
+    std::vector<Level> bids; // best first
+    std::vector<Level> asks; // best first
+
+    /**
+     * Convert a scaled price or size to a double.
+     */
+    [[nodiscard]] double
+    to_double(int64_t value) const noexcept
+    {
+        // NOLINTNEXTLINE(*-magic-numbers)
+        static constexpr std::array<double, 19> POWERS{
+            1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,
+            1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+        };
+
+        auto exp = static_cast<size_t>(exponent < 0 ? -exponent : exponent);
+        double scale = exp < POWERS.size() ? POWERS[exp] : std::pow(10.0, exp);
+
+        auto res = static_cast<double>(value);
+        return exponent < 0 ? res / scale : res * scale;
+    }
+};
+
+/**
+ * Implementation details.
+ */
+namespace detail {
+
+template <class T>
+inline void
+put(char* out, T value) noexcept
+{
+    auto bits = static_cast<uint64_t>(value);
+
+    for (size_t i = 0; i < sizeof(T); i++)
+        out[i] = static_cast<char>((bits >> (8 * i)) & 0xFFU); // NOLINT
+}
+
+template <class T>
+inline T
+get(const char* in) noexcept
+{
+    uint64_t bits = 0;
+
+    for (size_t i = 0; i < sizeof(T); i++)
+        bits |= static_cast<uint64_t>(static_cast<uint8_t>(in[i])) << (8 * i); // NOLINT
+
+    return static_cast<T>(bits);
+}
+
+} // namespace detail
+
+/**
+ * Size of an encoded book.
+ */
+constexpr size_t
+encoded_size(size_t bids, size_t asks) noexcept
+{
+    return HEADER_SIZE + (bids + asks) * LEVEL_SIZE;
+}
+
+/**
+ * Encode a book, replacing the contents of `out`.
+ *
+ * Sides are cut to 65535 levels.
+ */
+inline void
+encode(const Book& book, std::string& out)
+{
+    constexpr size_t MAX_LEVELS = UINT16_MAX;
+
+    auto bids = book.bids.size() < MAX_LEVELS ? book.bids.size() : MAX_LEVELS;
+    auto asks = book.asks.size() < MAX_LEVELS ? book.asks.size() : MAX_LEVELS;
+
+    out.assign(encoded_size(bids, asks), '\0');
+    char* ptr = out.data();
+
+    // NOLINTBEGIN(*-magic-numbers, *-pointer-arithmetic)
+    for (size_t i = 0; i < MAGIC.size(); i++)
+        ptr[i] = MAGIC[i];
+
+    detail::put<uint8_t>(ptr + 4, FORMAT_VERSION);
+    detail::put<int8_t>(ptr + 5, book.exponent);
+    detail::put<uint8_t>(ptr + 6, book.venue);
+    detail::put<uint16_t>(ptr + 8, static_cast<uint16_t>(bids));
+    detail::put<uint16_t>(ptr + 10, static_cast<uint16_t>(asks));
+    detail::put<uint64_t>(ptr + 16, book.sequence);
+    detail::put<int64_t>(ptr + 24, book.timestamp);
+
+    ptr += HEADER_SIZE;
+
+    auto put_side = [&ptr](const std::vector<Level>& side, size_t count) {
+        for (size_t i = 0; i < count; i++, ptr += LEVEL_SIZE) {
+            detail::put<int64_t>(ptr, side[i].price);
+            detail::put<int64_t>(ptr + 8, side[i].size);
+        }
+    };
+    // NOLINTEND(*-magic-numbers, *-pointer-arithmetic)
+
+    put_side(book.bids, bids);
+    put_side(book.asks, asks);
+}
+
+/**
+ * Decode a book, reusing the level vectors of `book`.
+ *
+ * @returns bool If `data` was a complete book of a version we understand.
+ */
+inline bool
+decode(std::string_view data, Book& book)
+{
+    std::string_view magic(MAGIC.data(), MAGIC.size());
+
+    if (data.size() < HEADER_SIZE || !data.starts_with(magic))
+        return false;
+
+    const char* ptr = data.data();
+
+    // NOLINTBEGIN(*-magic-numbers, *-pointer-arithmetic)
+    if (detail::get<uint8_t>(ptr + 4) != FORMAT_VERSION)
+        return false;
+
+    auto bids = detail::get<uint16_t>(ptr + 8);
+    auto asks = detail::get<uint16_t>(ptr + 10);
+
+    if (data.size() < encoded_size(bids, asks))
+        return false;
+
+    book.exponent = detail::get<int8_t>(ptr + 5);
+    book.venue = detail::get<uint8_t>(ptr + 6);
+    book.sequence = detail::get<uint64_t>(ptr + 16);
+    book.timestamp = detail::get<int64_t>(ptr + 24);
+
+    ptr += HEADER_SIZE;
+
+    auto get_side = [&ptr](std::vector<Level>& side, size_t count) {
+        side.resize(count);
+
+        for (size_t i = 0; i < count; i++, ptr += LEVEL_SIZE) {
+            side[i].price = detail::get<int64_t>(ptr);
+            side[i].size = detail::get<int64_t>(ptr + 8);
+        }
+    };
+    // NOLINTEND(*-magic-numbers, *-pointer-arithmetic)
+
+    get_side(book.bids, bids);
+    get_side(book.asks, asks);
+
+    return true;
+}
+
+} // namespace packed
+} // namespace raccoon
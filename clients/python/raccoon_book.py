@@ -0,0 +1,77 @@
+"""Decode packed books, as raccoon writes them to {product}-BOOK with
+BOOK_FORMAT=packed.
+
+Only needs the standard library. The layout is documented in
+clients/cpp/raccoon/packed_book.hpp.
+
+    import redis
+    import raccoon_book
+
+    r = redis.Redis(port=6379)
+    book = raccoon_book.decode(r.get("ETH-USD-BOOK"))
+    print(book.bids[0], book.asks[0])
+"""
+
+import struct
+from dataclasses import dataclass, field
+
+MAGIC = b"RBOK"
+FORMAT_VERSION = 1
+
+_HEADER = struct.Struct("<4sBbBxHH4xQq")
+_LEVEL_SIZE = 16
+
+VENUES = ("coinbase", "binance")
+
+
+@dataclass
+class Book:
+    venue: str
+    sequence: int  # 0 if the venue doesn't send one
+    timestamp: int  # nanoseconds since epoch, 0 if unknown
+    bids: list = field(default_factory=list)  # (price, size), best first
+    asks: list = field(default_factory=list)
+
+
+def decode(data: bytes) -> Book:
+    """Decode a packed book, with prices and sizes as floats.
+
+    Raises ValueError if data isn't a complete book of a version we understand.
+    """
+    if len(data) < _HEADER.size:
+        raise ValueError("too short for a packed book")
+
+    magic, version, exponent, venue, bid_count, ask_count, sequence, timestamp = (
+        _HEADER.unpack_from(data)
+    )
+
+    if magic != MAGIC or version != FORMAT_VERSION:
+        raise ValueError("not a packed book, or an unsupported version")
+
+    if len(data) < _HEADER.size + (bid_count + ask_count) * _LEVEL_SIZE:
+        raise ValueError("truncated packed book")
+
+    def scaled(value):
+        return value / 10**-exponent if exponent < 0 else value * 10**exponent
+
+    count = 2 * (bid_count + ask_count)
+    levels = [scaled(v) for v in struct.unpack_from(f"<{count}q", data, _HEADER.size)]
+    pairs = list(zip(levels[0::2], levels[1::2]))
+
+    return Book(
+        venue=VENUES[venue] if venue < len(VENUES) else str(venue),
+        sequence=sequence,
+        timestamp=timestamp,
+        bids=pairs[:bid_count],
+        asks=pairs[bid_count:],
+    )
+
+
+if __name__ == "__main__":
+    import sys
+
+    book = decode(sys.stdin.buffer.read())
+    print(f"{book.venue} seq {book.sequence} at {book.timestamp}")
+
+    for (bid, bid_size), (ask, ask_size) in zip(book.bids, book.asks):
+        print(f"{bid_size:>16.8f} {bid:>16.8f} | {ask:<16.8f} {ask_size:<16.8f}")
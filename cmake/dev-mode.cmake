@@ -1,10 +1,23 @@
 include(cmake/folders.cmake)
 
 include(CTest)
+
+option(BUILD_BENCHMARKS "Build the benchmarks" OFF)
+option(BUILD_TOOLS "Build the developer tools, e.g. the mock exchange" OFF)
+
+# Tests and benchmarks run against the tools' RESP server
+if(BUILD_TOOLS OR BUILD_TESTING OR BUILD_BENCHMARKS)
+  add_subdirectory(tools)
+endif()
+
 if(BUILD_TESTING)
   add_subdirectory(test)
 endif()
 
+if(BUILD_BENCHMARKS)
+  add_subdirectory(bench)
+endif()
+
 add_custom_target(
     run-exe
     COMMAND raccoon_exe
@@ -26,3 +26,19 @@ if(NOT PROJECT_IS_TOP_LEVEL)
     set(warning_guard SYSTEM)
   endif()
 endif()
+
+# ---- Logging ----
+
+# Log calls below this level are compiled out. The default keeps every level, to
+# be chosen at run time; hot-path release builds should use INFO
+set(
+    raccoon_LOG_LEVEL TRACE_L3
+    CACHE STRING "Most verbose log level compiled in"
+)
+set_property(
+    CACHE raccoon_LOG_LEVEL PROPERTY STRINGS
+    TRACE_L3 TRACE_L2 TRACE_L1 DEBUG INFO WARNING ERROR CRITICAL NONE
+)
+
+# Backtrace logs are buffered whatever the level, to be dumped on an error
+option(raccoon_LOG_BACKTRACE "Capture backtrace logs" ON)
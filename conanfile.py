@@ -22,8 +22,12 @@ class Recipe(ConanFile):
         # ZLib is a curl dep
         self.requires("zlib/1.2.13")
 
+        # TLS, for curl and the native WebSocket client
+        self.requires("openssl/[>=3 <4]")
+
     def build_requirements(self):
         self.test_requires("gtest/1.13.0")
+        self.test_requires("benchmark/1.8.3")
 
     def configure(self):
         pass
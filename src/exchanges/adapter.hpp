@@ -0,0 +1,72 @@
+#pragma once
+
+#include "common.hpp"
+#include "events.hpp"
+
+#include <concepts>
+#include <string_view>
+
+namespace raccoon {
+namespace exchanges {
+
+/**
+ * Kind of normalized event decoded from a wire message.
+ */
+enum class EventType : uint8_t {
+    NONE,          // valid message with nothing to report (heartbeats, acks)
+    BOOK_SNAPSHOT, // a BookSnapshot
+    BOOK_DELTA,    // a BookDelta
+    TRADE,         // a Trade
+    INVALID,       // message could not be parsed
+};
+
+/**
+ * Something that can receive every kind of normalized event.
+ */
+template <class HandlerType>
+concept EventHandler = requires(
+    HandlerType handler,
+    const BookSnapshot& snapshot,
+    const BookDelta& delta,
+    const Trade& trade
+) {
+    handler(snapshot);
+    handler(delta);
+    handler(trade);
+};
+
+namespace detail {
+
+/**
+ * Minimal handler used to check adapters against the concept.
+ */
+struct handler_archetype {
+    void operator()(const BookSnapshot& /* unused */) const {}
+
+    void operator()(const BookDelta& /* unused */) const {}
+
+    void operator()(const Trade& /* unused */) const {}
+};
+
+} // namespace detail
+
+/**
+ * An exchange adapter.
+ *
+ * Adapters translate a venue's wire format into normalized events. Parsing is a
+ * template over the handler so that dispatch to storage is resolved at compile
+ * time, with no virtual call per message. Adapters own the buffers they decode
+ * into, so events are only valid for the duration of the handler call.
+ */
+template <class AdapterType>
+concept ExchangeAdapter = requires(
+    AdapterType adapter,
+    std::string_view data,
+    detail::handler_archetype handler
+) {
+    { AdapterType::VENUE } -> std::convertible_to<Venue>;
+    { adapter.parse(data, handler) } -> std::same_as<bool>;
+};
+
+} // namespace exchanges
+} // namespace raccoon
@@ -0,0 +1,247 @@
+#include "binance.hpp"
+
+#include "utils/parsing.hpp"
+
+namespace raccoon {
+namespace exchanges {
+
+// Binance adds fields over time, so don't fail on ones we don't know
+static constexpr glz::opts READ_OPTS{.error_on_unknown_keys = false};
+
+// Binance timestamps are in milliseconds
+static constexpr int64_t NANOS_PER_MILLI = 1'000'000;
+
+static void
+normalize_changes(
+    const std::vector<std::tuple<std::string, std::string>>& raw,
+    Side side,
+    std::vector<LevelChange>& changes
+)
+{
+    for (const auto& [price, size] : raw) {
+        changes.push_back(
+            {side, utils::parse_double(price), utils::parse_double(size)}
+        );
+    }
+}
+
+static void
+normalize_levels(
+    const std::vector<std::tuple<std::string, std::string>>& raw,
+    std::vector<PriceLevel>& levels
+)
+{
+    levels.clear();
+    levels.reserve(raw.size());
+
+    for (const auto& [price, size] : raw)
+        levels.push_back({utils::parse_double(price), utils::parse_double(size)});
+}
+
+EventType
+BinanceAdapter::decode_(std::string_view data)
+{
+    // Unwrap combined streams: {"stream":"<name>","data":{...}}
+    if (auto inner = utils::json_object_field(data, "data"); !inner.empty())
+        data = inner;
+
+    auto type = utils::json_string_field(data, "e");
+
+    if (type == "depthUpdate") [[likely]] {
+        auto err = glz::read<READ_OPTS>(raw_update_, data);
+        if (err) [[unlikely]] {
+            log_e(main, "Error parsing depth update: {}", glz::format_error(err, data));
+            return EventType::INVALID;
+        }
+
+        delta_.product_id = raw_update_.symbol;
+        delta_.sequence = raw_update_.final_update_id;
+        delta_.timestamp = raw_update_.event_time * NANOS_PER_MILLI;
+
+        delta_.changes.clear();
+        delta_.changes.reserve(raw_update_.bids.size() + raw_update_.asks.size());
+
+        normalize_changes(raw_update_.bids, Side::BID, delta_.changes);
+        normalize_changes(raw_update_.asks, Side::ASK, delta_.changes);
+
+        return EventType::BOOK_DELTA;
+    }
+
+    if (type == "trade") {
+        auto err = glz::read<READ_OPTS>(raw_trade_, data);
+        if (err) [[unlikely]] {
+            log_e(main, "Error parsing trade: {}", glz::format_error(err, data));
+            return EventType::INVALID;
+        }
+
+        trade_.product_id = raw_trade_.symbol;
+        trade_.trade_id = raw_trade_.trade_id;
+        trade_.sequence = raw_trade_.trade_id; // trade ids are sequential per symbol
+        trade_.timestamp = raw_trade_.trade_time * NANOS_PER_MILLI;
+        trade_.exact_price = utils::parse_fixed(raw_trade_.price);
+        trade_.exact_size = utils::parse_fixed(raw_trade_.quantity);
+        trade_.price = trade_.exact_price.to_double();
+        trade_.size = trade_.exact_size.to_double();
+
+        // If the buyer was resting, the seller was the aggressor
+        trade_.side = raw_trade_.buyer_is_maker ? Side::ASK : Side::BID;
+
+        return EventType::TRADE;
+    }
+
+    // Subscription acks ({"result":null,"id":1}), other streams, etc.
+    log_t1(main, "Ignoring Binance message of type {}", type);
+    return EventType::NONE;
+}
+
+binance::DepthSync::Action
+BinanceAdapter::sequence_update_()
+{
+    using Action = binance::DepthSync::Action;
+
+    auto& state = symbols_[delta_.product_id];
+    auto action =
+        state.sync.on_diff(raw_update_.first_update_id, raw_update_.final_update_id);
+
+    switch (action) {
+        case Action::APPLY:
+            break;
+
+        case Action::DROP:
+            log_t1(
+                main,
+                "Dropping stale diff {}-{} for {}",
+                raw_update_.first_update_id,
+                raw_update_.final_update_id,
+                delta_.product_id
+            );
+            break;
+
+        case Action::RESYNC:
+            log_w(
+                main,
+                "Gap in depth stream for {}: expected {}, got {}; resyncing",
+                delta_.product_id,
+                state.sync.last_update_id() + 1,
+                raw_update_.first_update_id
+            );
+            [[fallthrough]];
+
+        case Action::BUFFER:
+            if (state.buffered.size() >= MAX_BUFFERED_DIFFS) [[unlikely]]
+                state.buffered.pop_front(); // snapshot validation will catch the gap
+
+            state.buffered.push_back({raw_update_.first_update_id, delta_});
+            request_snapshot_for_(delta_.product_id, state);
+            break;
+    }
+
+    return action;
+}
+
+bool
+BinanceAdapter::decode_snapshot_(const std::string& symbol, std::string_view data)
+{
+    auto& state = symbols_[symbol];
+    state.snapshot_requested = false;
+
+    auto err = glz::read<READ_OPTS>(raw_snapshot_, data);
+    if (err) [[unlikely]] {
+        log_e(
+            main,
+            "Error parsing depth snapshot for {}: {}",
+            symbol,
+            glz::format_error(err, data)
+        );
+
+        request_snapshot_for_(symbol, state);
+        return false;
+    }
+
+    const uint64_t last_update_id = raw_snapshot_.last_update_id;
+
+    // Drop diffs the snapshot already contains
+    while (!state.buffered.empty()
+           && state.buffered.front().delta.sequence <= last_update_id)
+        state.buffered.pop_front();
+
+    // If the oldest diff we hold starts after the snapshot, we missed updates
+    if (!state.buffered.empty()
+        && state.buffered.front().first_update_id > last_update_id + 1) {
+        log_w(
+            main,
+            "Snapshot {} for {} is older than buffered diffs (first {}), refetching",
+            last_update_id,
+            symbol,
+            state.buffered.front().first_update_id
+        );
+
+        request_snapshot_for_(symbol, state);
+        return false;
+    }
+
+    log_i(main, "Applying depth snapshot {} for {}", last_update_id, symbol);
+
+    snapshot_.product_id = symbol;
+    snapshot_.sequence = last_update_id;
+    snapshot_.timestamp = 0; // REST snapshots are not timestamped
+
+    normalize_levels(raw_snapshot_.bids, snapshot_.bids);
+    normalize_levels(raw_snapshot_.asks, snapshot_.asks);
+
+    state.sync.on_snapshot(last_update_id);
+    return true;
+}
+
+bool
+BinanceAdapter::replay_buffered_(const std::string& symbol)
+{
+    using Action = binance::DepthSync::Action;
+
+    auto& state = symbols_[symbol];
+
+    while (!state.buffered.empty()) {
+        auto& next = state.buffered.front();
+
+        switch (state.sync.on_diff(next.first_update_id, next.delta.sequence)) {
+            case Action::APPLY:
+                delta_ = std::move(next.delta);
+                state.buffered.pop_front();
+                return true;
+
+            case Action::DROP:
+                state.buffered.pop_front();
+                break;
+
+            case Action::RESYNC:
+            case Action::BUFFER:
+                log_w(main, "Gap in buffered diffs for {}; resyncing", symbol);
+                request_snapshot_for_(symbol, state);
+                return false;
+        }
+    }
+
+    return false;
+}
+
+void
+BinanceAdapter::snapshot_failed(const std::string& symbol)
+{
+    log_w(main, "Fetching depth snapshot for {} failed", symbol);
+    symbols_[symbol].snapshot_requested = false;
+}
+
+void
+BinanceAdapter::request_snapshot_for_(const std::string& symbol, symbol_state& state)
+{
+    if (state.snapshot_requested || !request_snapshot_)
+        return;
+
+    log_i(main, "Requesting depth snapshot for {}", symbol);
+
+    state.snapshot_requested = true;
+    request_snapshot_(symbol);
+}
+
+} // namespace exchanges
+} // namespace raccoon
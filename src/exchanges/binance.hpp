@@ -0,0 +1,379 @@
+#pragma once
+
+#include "adapter.hpp"
+#include "common.hpp"
+#include "events.hpp"
+
+#include <glaze/glaze.hpp>
+
+#include <deque>
+#include <functional>
+#include <string_view>
+#include <utility>
+
+namespace raccoon {
+namespace exchanges {
+
+/**
+ * Binance wire format and book synchronization.
+ */
+namespace binance {
+
+/**
+ * Diff. depth stream event (<symbol>@depth).
+ */
+struct DepthUpdate {
+    std::string event_type;   // e
+    int64_t event_time;       // E, milliseconds
+    std::string symbol;       // s
+    uint64_t first_update_id; // U
+    uint64_t final_update_id; // u
+
+    std::vector<std::tuple<std::string, std::string>> bids; // b
+    std::vector<std::tuple<std::string, std::string>> asks; // a
+};
+
+/**
+ * Trade stream event (<symbol>@trade).
+ */
+struct TradeEvent {
+    std::string event_type; // e
+    int64_t event_time;     // E, milliseconds
+    std::string symbol;     // s
+    uint64_t trade_id;      // t
+    std::string price;      // p
+    std::string quantity;   // q
+    int64_t trade_time;     // T, milliseconds
+    bool buyer_is_maker;    // m
+};
+
+/**
+ * REST depth snapshot (GET /api/v3/depth).
+ */
+struct DepthSnapshot {
+    uint64_t last_update_id;
+    std::vector<std::tuple<std::string, std::string>> bids;
+    std::vector<std::tuple<std::string, std::string>> asks;
+};
+
+/**
+ * Local order book synchronization state for one symbol.
+ *
+ * Implements Binance's documented algorithm: buffer diffs until a REST snapshot
+ * arrives, drop diffs already contained in the snapshot, require the first applied
+ * diff to straddle the snapshot's lastUpdateId, and require every diff after that
+ * to start exactly where the previous one ended.
+ */
+class DepthSync {
+    uint64_t last_update_id_ = 0; // last update id applied to the book
+    bool synced_ = false;         // if we have a valid snapshot
+    bool first_ = false;          // if the next diff is the first after a snapshot
+
+public:
+    /**
+     * What to do with a diff.
+     */
+    enum class Action : uint8_t {
+        BUFFER, // no snapshot yet, hold on to it
+        DROP,   // already contained in the book
+        APPLY,  // apply it to the book
+        RESYNC, // sequence gap, a new snapshot is needed
+    };
+
+    /**
+     * Classify a diff by its update id range.
+     *
+     * @param first_id The diff's first update id (U).
+     * @param final_id The diff's final update id (u).
+     */
+    constexpr Action
+    on_diff(uint64_t first_id, uint64_t final_id) noexcept
+    {
+        if (!synced_)
+            return Action::BUFFER;
+
+        if (final_id <= last_update_id_)
+            return Action::DROP;
+
+        bool in_sequence = first_ ? first_id <= last_update_id_ + 1
+                                  : first_id == last_update_id_ + 1;
+
+        if (!in_sequence) [[unlikely]] {
+            synced_ = false;
+            return Action::RESYNC;
+        }
+
+        first_ = false;
+        last_update_id_ = final_id;
+
+        return Action::APPLY;
+    }
+
+    /**
+     * Mark a snapshot as applied.
+     */
+    constexpr void
+    on_snapshot(uint64_t last_update_id) noexcept
+    {
+        last_update_id_ = last_update_id;
+        synced_ = true;
+        first_ = true;
+    }
+
+    [[nodiscard]] constexpr bool
+    synced() const noexcept
+    {
+        return synced_;
+    }
+
+    [[nodiscard]] constexpr uint64_t
+    last_update_id() const noexcept
+    {
+        return last_update_id_;
+    }
+};
+
+} // namespace binance
+
+/**
+ * Adapter for the Binance spot websocket streams.
+ *
+ * Accepts both raw streams and the combined stream envelope. Book diffs are held
+ * back until a REST snapshot has been supplied with on_snapshot(); the adapter asks
+ * for one through the snapshot request callback whenever a symbol is out of sync.
+ */
+class BinanceAdapter {
+public:
+    /**
+     * Callback asking the owner to fetch a REST snapshot for a symbol.
+     *
+     * The snapshot must be supplied later through on_snapshot(), not from within
+     * the callback itself.
+     */
+    using snapshot_request = std::function<void(const std::string&)>;
+
+    static constexpr Venue VENUE = Venue::BINANCE;
+
+    // Upper bound on diffs held per symbol while waiting for a snapshot
+    static constexpr size_t MAX_BUFFERED_DIFFS = 4096;
+
+private:
+    /**
+     * A diff waiting for a snapshot.
+     */
+    struct buffered_diff {
+        uint64_t first_update_id;
+        BookDelta delta;
+    };
+
+    /**
+     * Synchronization state for one symbol.
+     */
+    struct symbol_state {
+        binance::DepthSync sync;
+        std::deque<buffered_diff> buffered;
+        bool snapshot_requested = false;
+    };
+
+    snapshot_request request_snapshot_;
+    std::unordered_map<std::string, symbol_state> symbols_;
+
+    // Raw messages, reused between calls
+    binance::DepthUpdate raw_update_;
+    binance::TradeEvent raw_trade_;
+    binance::DepthSnapshot raw_snapshot_;
+
+    // Normalized events, reused between calls
+    BookSnapshot snapshot_{.venue = VENUE};
+    BookDelta delta_{.venue = VENUE};
+    Trade trade_{.venue = VENUE};
+
+public:
+    /**
+     * Create a new Binance adapter.
+     *
+     * @param on_snapshot_needed Called when a symbol needs a REST snapshot.
+     */
+    explicit BinanceAdapter(snapshot_request on_snapshot_needed) :
+        request_snapshot_(std::move(on_snapshot_needed))
+    {}
+
+    /**
+     * Parse a message from the feed and pass any events to the handler.
+     *
+     * @returns bool If the message was valid.
+     */
+    template <EventHandler Handler>
+    bool
+    parse(std::string_view data, Handler&& handler)
+    {
+        switch (decode_(data)) {
+            case EventType::BOOK_DELTA:
+                if (sequence_update_() == binance::DepthSync::Action::APPLY)
+                    handler(std::as_const(delta_));
+                return true;
+
+            case EventType::TRADE:
+                handler(std::as_const(trade_));
+                return true;
+
+            case EventType::BOOK_SNAPSHOT: // only from on_snapshot()
+            case EventType::NONE:
+                return true;
+
+            case EventType::INVALID:
+                return false;
+        }
+
+        return false;
+    }
+
+    /**
+     * Supply a REST depth snapshot for a symbol.
+     *
+     * Emits the snapshot followed by any buffered diffs that follow it. If the
+     * snapshot is unusable (malformed, or older than the buffered diffs) nothing is
+     * emitted and a new snapshot is requested.
+     *
+     * @returns bool If the snapshot was applied.
+     */
+    template <EventHandler Handler>
+    bool
+    on_snapshot(const std::string& symbol, std::string_view data, Handler&& handler)
+    {
+        if (!decode_snapshot_(symbol, data))
+            return false;
+
+        handler(std::as_const(snapshot_));
+
+        // Replay everything we held back
+        while (replay_buffered_(symbol))
+            handler(std::as_const(delta_));
+
+        return true;
+    }
+
+    /**
+     * Note that fetching a snapshot failed.
+     *
+     * The next diff for the symbol will request a new one.
+     */
+    void snapshot_failed(const std::string& symbol);
+
+    /**
+     * If a symbol's book is currently in sync.
+     */
+    [[nodiscard]] bool
+    synced(const std::string& symbol) const
+    {
+        auto it = symbols_.find(symbol);
+        return it != symbols_.end() && it->second.sync.synced();
+    }
+
+    /**
+     * Get the REST URL of a depth snapshot.
+     *
+     * @param base_url The REST API base url (e.g. https://api.binance.com).
+     * @param symbol The symbol, as reported by the stream (e.g. ETHUSDT).
+     * @param limit The number of levels to request per side.
+     */
+    static std::string
+    snapshot_url(
+        std::string_view base_url, std::string_view symbol, size_t limit = 1000
+    )
+    {
+        return fmt::format(
+            "{}/api/v3/depth?symbol={}&limit={}", base_url, symbol, limit
+        );
+    }
+
+private:
+    /**
+     * Decode a stream message into the matching normalized event buffer.
+     */
+    EventType decode_(std::string_view data);
+
+    /**
+     * Run the decoded diff through the symbol's sync state.
+     */
+    binance::DepthSync::Action sequence_update_();
+
+    /**
+     * Decode and validate a REST snapshot into the snapshot buffer.
+     */
+    bool decode_snapshot_(const std::string& symbol, std::string_view data);
+
+    /**
+     * Move the next applicable buffered diff for a symbol into the delta buffer.
+     *
+     * @returns bool If there was a diff to replay.
+     */
+    bool replay_buffered_(const std::string& symbol);
+
+    /**
+     * Ask for a snapshot for a symbol, if we have not already.
+     */
+    void request_snapshot_for_(const std::string& symbol, symbol_state& state);
+};
+
+static_assert(ExchangeAdapter<BinanceAdapter>);
+
+} // namespace exchanges
+} // namespace raccoon
+
+template <>
+struct glz::meta<raccoon::exchanges::binance::DepthUpdate> {
+    using T = raccoon::exchanges::binance::DepthUpdate;
+    static constexpr auto value = object(
+        "e",
+        &T::event_type,
+        "E",
+        &T::event_time,
+        "s",
+        &T::symbol,
+        "U",
+        &T::first_update_id,
+        "u",
+        &T::final_update_id,
+        "b",
+        &T::bids,
+        "a",
+        &T::asks
+    );
+};
+
+template <>
+struct glz::meta<raccoon::exchanges::binance::TradeEvent> {
+    using T = raccoon::exchanges::binance::TradeEvent;
+    static constexpr auto value = object(
+        "e",
+        &T::event_type,
+        "E",
+        &T::event_time,
+        "s",
+        &T::symbol,
+        "t",
+        &T::trade_id,
+        "p",
+        &T::price,
+        "q",
+        &T::quantity,
+        "T",
+        &T::trade_time,
+        "m",
+        &T::buyer_is_maker
+    );
+};
+
+template <>
+struct glz::meta<raccoon::exchanges::binance::DepthSnapshot> {
+    using T = raccoon::exchanges::binance::DepthSnapshot;
+    static constexpr auto value = object(
+        "lastUpdateId",
+        &T::last_update_id,
+        "bids",
+        &T::bids,
+        "asks",
+        &T::asks
+    );
+};
@@ -0,0 +1,106 @@
+#include "coinbase.hpp"
+
+#include "utils/parsing.hpp"
+
+namespace raccoon {
+namespace exchanges {
+
+// Coinbase adds fields over time, so don't fail on ones we don't know
+static constexpr glz::opts READ_OPTS{.error_on_unknown_keys = false};
+
+static void
+normalize_levels(
+    const std::vector<std::tuple<std::string, std::string>>& raw,
+    std::vector<PriceLevel>& levels
+)
+{
+    levels.clear();
+    levels.reserve(raw.size());
+
+    for (const auto& [price, size] : raw)
+        levels.push_back({utils::parse_double(price), utils::parse_double(size)});
+}
+
+EventType
+CoinbaseAdapter::decode_(std::string_view data)
+{
+    auto type = utils::json_string_field(data, "type");
+
+    if (type == "l2update") [[likely]] {
+        auto err = glz::read<READ_OPTS>(raw_update_, data);
+        if (err) [[unlikely]] {
+            log_e(main, "Error parsing update: {}", glz::format_error(err, data));
+            return EventType::INVALID;
+        }
+
+        delta_.product_id = raw_update_.product_id;
+        delta_.timestamp = utils::parse_timestamp(raw_update_.time);
+        delta_.changes.clear();
+        delta_.changes.reserve(raw_update_.changes.size());
+
+        for (const auto& [side, price, size] : raw_update_.changes) {
+            // Coinbase sends "buy"/"sell"; be lenient about case
+            bool is_buy = !side.empty() && (side[0] == 'b' || side[0] == 'B');
+
+            delta_.changes.push_back(
+                {is_buy ? Side::BID : Side::ASK,
+                 utils::parse_double(price),
+                 utils::parse_double(size)}
+            );
+        }
+
+        return EventType::BOOK_DELTA;
+    }
+
+    if (type == "match" || type == "last_match") {
+        auto err = glz::read<READ_OPTS>(raw_match_, data);
+        if (err) [[unlikely]] {
+            log_e(main, "Error parsing match: {}", glz::format_error(err, data));
+            return EventType::INVALID;
+        }
+
+        trade_.product_id = raw_match_.product_id;
+        trade_.trade_id = raw_match_.trade_id;
+        trade_.sequence = raw_match_.sequence;
+        trade_.maker_order_id = raw_match_.maker_order_id;
+        trade_.taker_order_id = raw_match_.taker_order_id;
+        trade_.timestamp = utils::parse_timestamp(raw_match_.time);
+        trade_.exact_price = utils::parse_fixed(raw_match_.price);
+        trade_.exact_size = utils::parse_fixed(raw_match_.size);
+        trade_.price = trade_.exact_price.to_double();
+        trade_.size = trade_.exact_size.to_double();
+
+        // Coinbase reports the maker's side; we report the aggressor's
+        trade_.side = raw_match_.side == "buy" ? Side::ASK : Side::BID;
+
+        return EventType::TRADE;
+    }
+
+    if (type == "snapshot") {
+        auto err = glz::read<READ_OPTS>(raw_snapshot_, data);
+        if (err) [[unlikely]] {
+            log_e(main, "Error parsing snapshot: {}", glz::format_error(err, data));
+            return EventType::INVALID;
+        }
+
+        snapshot_.product_id = raw_snapshot_.product_id;
+        snapshot_.timestamp = utils::parse_timestamp(raw_snapshot_.time);
+
+        normalize_levels(raw_snapshot_.bids, snapshot_.bids);
+        normalize_levels(raw_snapshot_.asks, snapshot_.asks);
+
+        return EventType::BOOK_SNAPSHOT;
+    }
+
+    if (type == "error") [[unlikely]] {
+        log_e(main, "Coinbase sent an error: {}", data);
+        return EventType::INVALID;
+    }
+
+    // Subscription acks, heartbeats, etc.
+    log_t1(main, "Ignoring Coinbase message of type {}", type);
+    return EventType::NONE;
+}
+
+} // namespace exchanges
+} // namespace raccoon
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "adapter.hpp"
+#include "common.hpp"
+#include "events.hpp"
+
+#include <glaze/glaze.hpp>
+
+#include <string_view>
+#include <utility>
+
+namespace raccoon {
+namespace exchanges {
+
+/**
+ * Coinbase wire format.
+ */
+namespace coinbase {
+
+struct OrderbookSnapshot {
+    std::string type = "snapshot";
+    std::string time;
+    std::string product_id;
+    std::vector<std::tuple<std::string, std::string>> asks;
+    std::vector<std::tuple<std::string, std::string>> bids;
+};
+
+struct OrderbookUpdate {
+    std::string type = "l2update";
+    std::string time;
+    std::string product_id;
+    std::vector<std::tuple<std::string, std::string, std::string>> changes;
+};
+
+struct Match {
+    std::string type = "match";
+    std::string time;
+    uint64_t trade_id;
+    std::string maker_order_id;
+    std::string taker_order_id;
+    std::string side;
+    std::string size;
+    std::string price;
+    std::string product_id;
+    uint64_t sequence;
+};
+
+} // namespace coinbase
+
+/**
+ * Adapter for the Coinbase Exchange websocket feed.
+ */
+class CoinbaseAdapter {
+    // Raw messages, reused between calls
+    coinbase::OrderbookSnapshot raw_snapshot_;
+    coinbase::OrderbookUpdate raw_update_;
+    coinbase::Match raw_match_;
+
+    // Normalized events, reused between calls
+    BookSnapshot snapshot_{.venue = VENUE};
+    BookDelta delta_{.venue = VENUE};
+    Trade trade_{.venue = VENUE};
+
+public:
+    static constexpr Venue VENUE = Venue::COINBASE;
+
+    /**
+     * Parse a message from the feed and pass any events to the handler.
+     *
+     * @returns bool If the message was valid.
+     */
+    template <EventHandler Handler>
+    bool
+    parse(std::string_view data, Handler&& handler)
+    {
+        switch (decode_(data)) {
+            case EventType::BOOK_SNAPSHOT:
+                handler(std::as_const(snapshot_));
+                return true;
+
+            case EventType::BOOK_DELTA:
+                handler(std::as_const(delta_));
+                return true;
+
+            case EventType::TRADE:
+                handler(std::as_const(trade_));
+                return true;
+
+            case EventType::NONE:
+                return true;
+
+            case EventType::INVALID:
+                return false;
+        }
+
+        return false;
+    }
+
+private:
+    /**
+     * Decode a message into the matching normalized event buffer.
+     */
+    EventType decode_(std::string_view data);
+};
+
+static_assert(ExchangeAdapter<CoinbaseAdapter>);
+
+} // namespace exchanges
+} // namespace raccoon
+
+template <>
+struct glz::meta<raccoon::exchanges::coinbase::OrderbookSnapshot> {
+    using T = raccoon::exchanges::coinbase::OrderbookSnapshot;
+    static constexpr auto value = object(
+        "time",
+        &T::time,
+        "type",
+        &T::type,
+        "product_id",
+        &T::product_id,
+        "asks",
+        &T::asks,
+        "bids",
+        &T::bids
+    );
+};
+
+template <>
+struct glz::meta<raccoon::exchanges::coinbase::OrderbookUpdate> {
+    using T = raccoon::exchanges::coinbase::OrderbookUpdate;
+    static constexpr auto value = object(
+        "time",
+        &T::time,
+        "type",
+        &T::type,
+        "product_id",
+        &T::product_id,
+        "changes",
+        &T::changes
+    );
+};
+
+template <>
+struct glz::meta<raccoon::exchanges::coinbase::Match> {
+    using T = raccoon::exchanges::coinbase::Match;
+    static constexpr auto value = object(
+        "type",
+        &T::type,
+        "time",
+        &T::time,
+        "trade_id",
+        &T::trade_id,
+        "maker_order_id",
+        &T::maker_order_id,
+        "taker_order_id",
+        &T::taker_order_id,
+        "side",
+        &T::side,
+        "size",
+        &T::size,
+        "price",
+        &T::price,
+        "product_id",
+        &T::product_id,
+        "sequence",
+        &T::sequence
+    );
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "common.hpp"
+#include "utils/fixed_point.hpp"
+
+#include <string_view>
+
+namespace raccoon {
+namespace exchanges {
+
+/**
+ * An exchange we receive market data from.
+ */
+enum class Venue : uint8_t {
+    COINBASE,
+    BINANCE,
+};
+
+/**
+ * Number of venues we support.
+ */
+inline constexpr size_t VENUE_COUNT = 2;
+
+/**
+ * Side of the book.
+ *
+ * For trades this is the side of the aggressor (taker), so BID is a buy.
+ */
+enum class Side : uint8_t {
+    BID,
+    ASK,
+};
+
+/**
+ * A single price level.
+ */
+struct PriceLevel {
+    double price;
+    double size;
+};
+
+/**
+ * A change to a single price level.
+ *
+ * Sizes are absolute; a size of zero removes the level.
+ */
+struct LevelChange {
+    Side side;
+    double price;
+    double size;
+};
+
+/**
+ * A full replacement of a product's book.
+ */
+struct BookSnapshot {
+    Venue venue{};
+    std::string product_id{};
+    uint64_t sequence{}; // venue sequence number, 0 if unsupported
+    int64_t timestamp{}; // nanoseconds since epoch, 0 if unknown
+    std::vector<PriceLevel> bids{};
+    std::vector<PriceLevel> asks{};
+};
+
+/**
+ * An incremental update to a product's book.
+ */
+struct BookDelta {
+    Venue venue{};
+    std::string product_id{};
+    uint64_t sequence{}; // venue sequence number, 0 if unsupported
+    int64_t timestamp{}; // nanoseconds since epoch, 0 if unknown
+    std::vector<LevelChange> changes{};
+};
+
+/**
+ * A trade print.
+ */
+struct Trade {
+    Venue venue{};
+    std::string product_id{};
+    uint64_t trade_id{};
+    uint64_t sequence{}; // venue sequence number, 0 if unsupported
+    int64_t timestamp{}; // nanoseconds since epoch, 0 if unknown
+    Side side{};         // aggressor side
+    double price{};
+    double size{};
+
+    // Price and size exactly as sent, for aggregation
+    utils::Fixed exact_price{};
+    utils::Fixed exact_size{};
+
+    // Order ids, from venues that send them, empty otherwise
+    std::string maker_order_id{};
+    std::string taker_order_id{};
+};
+
+/**
+ * Get the name of a venue.
+ */
+constexpr std::string_view
+venue_name(Venue venue) noexcept
+{
+    switch (venue) {
+        case Venue::COINBASE:
+            return "coinbase";
+        case Venue::BINANCE:
+            return "binance";
+    }
+
+    return "unknown";
+}
+
+/**
+ * {fmt} formatting function for Venue.
+ */
+inline auto
+format_as(Venue venue)
+{
+    return venue_name(venue);
+}
+
+/**
+ * {fmt} formatting function for Side.
+ */
+inline auto
+format_as(Side side)
+{
+    return side == Side::BID ? "bid" : "ask";
+}
+
+} // namespace exchanges
+} // namespace raccoon
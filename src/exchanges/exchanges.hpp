@@ -0,0 +1,9 @@
+#pragma once
+
+// Re-exports
+
+#include "adapter.hpp"
+#include "binance.hpp"
+#include "coinbase.hpp"
+#include "events.hpp"
+#include "symbols.hpp"
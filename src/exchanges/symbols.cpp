@@ -0,0 +1,77 @@
+#include "symbols.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+namespace raccoon {
+namespace exchanges {
+
+// Quote assets Binance concatenates onto symbols, longest first
+static constexpr std::array<std::string_view, 12> BINANCE_QUOTES{
+    "FDUSD", "USDT", "USDC", "BUSD", "TUSD", "BTC",
+    "ETH",   "BNB",  "EUR",  "GBP",  "TRY",  "USD",
+};
+
+// Quotes that we consider equivalent to USD
+static constexpr std::array<std::string_view, 5> USD_ALIASES{
+    "USDT", "USDC", "BUSD", "FDUSD", "TUSD",
+};
+
+static std::string_view
+alias_quote(std::string_view quote) noexcept
+{
+    bool is_usd = std::find(USD_ALIASES.begin(), USD_ALIASES.end(), quote)
+                  != USD_ALIASES.end();
+
+    return is_usd ? "USD" : quote;
+}
+
+static std::string
+to_upper(std::string_view str)
+{
+    std::string res(str);
+    std::transform(res.begin(), res.end(), res.begin(), [](char chr) {
+        return static_cast<char>(std::toupper(static_cast<unsigned char>(chr)));
+    });
+
+    return res;
+}
+
+std::string
+normalize_symbol(Venue venue, std::string_view product_id)
+{
+    std::string symbol = to_upper(product_id);
+    std::string_view view = symbol;
+
+    switch (venue) {
+        case Venue::COINBASE:
+            {
+                // Already BASE-QUOTE
+                auto dash = view.find('-');
+                if (dash == std::string_view::npos) [[unlikely]]
+                    return symbol;
+
+                return fmt::format(
+                    "{}-{}", view.substr(0, dash), alias_quote(view.substr(dash + 1))
+                );
+            }
+
+        case Venue::BINANCE:
+            {
+                // BASEQUOTE, so look for a quote suffix
+                for (auto quote : BINANCE_QUOTES) {
+                    if (view.size() > quote.size() && view.ends_with(quote)) {
+                        auto base = view.substr(0, view.size() - quote.size());
+                        return fmt::format("{}-{}", base, alias_quote(quote));
+                    }
+                }
+
+                return symbol;
+            }
+    }
+
+    return symbol;
+}
+
+} // namespace exchanges
+} // namespace raccoon
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "common.hpp"
+#include "events.hpp"
+
+#include <string_view>
+
+namespace raccoon {
+namespace exchanges {
+
+/**
+ * Normalize a venue's product id to a common BASE-QUOTE symbol.
+ *
+ * Stablecoin quotes are folded into USD, so that Binance's ETHUSDT and Coinbase's
+ * ETH-USD land in the same consolidated book.
+ *
+ * @param venue The venue the product id came from.
+ * @param product_id The venue's native product id.
+ *
+ * @returns std::string The normalized symbol, e.g. ETH-USD.
+ */
+std::string normalize_symbol(Venue venue, std::string_view product_id);
+
+} // namespace exchanges
+} // namespace raccoon
@@ -104,9 +104,12 @@ init(quill::LogLevel log_level)
 
     // Set backtrace and log level on the main logger
     quill::Logger* main_logger = quill::get_logger();
-    main_logger->init_backtrace(LOG_BACKTRACE_SIZE, quill::LogLevel::Error);
     main_logger->set_log_level(log_level);
 
+#if LOG_BACKTRACE_ENABLED()
+    main_logger->init_backtrace(LOG_BACKTRACE_SIZE, quill::LogLevel::Error);
+#endif
+
     // Set the thread name
     set_thread_name("MainThread");
 
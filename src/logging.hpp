@@ -2,8 +2,14 @@
 
 #include "config.h"
 
+// Quill compiles out log calls below this level, so it must come first
+#ifndef QUILL_ACTIVE_LOG_LEVEL
+#  define QUILL_ACTIVE_LOG_LEVEL LOG_ACTIVE_LEVEL
+#endif
+
 #include <quill/Quill.h>
 
+#include <cstdint>
 #include <string>
 
 namespace raccoon {
@@ -30,7 +36,10 @@ get_logger(const std::string& name)
     } catch (quill::QuillError&) {
         logger = quill::create_logger(name);
         logger->set_log_level(application_log_level);
+
+#if LOG_BACKTRACE_ENABLED()
         logger->init_backtrace(LOG_BACKTRACE_SIZE, quill::LogLevel::Error);
+#endif
     }
 
     return logger;
@@ -38,6 +47,39 @@ get_logger(const std::string& name)
 
 } // namespace detail
 
+/**
+ * If a logger would write at a level, checked at compile time first so levels that
+ * are compiled out cost nothing.
+ *
+ * Quill numbers its levels and its level macros the same way.
+ */
+template <quill::LogLevel Level>
+inline bool
+should_log(quill::Logger* logger)
+{
+    if constexpr (static_cast<int>(Level) < QUILL_ACTIVE_LOG_LEVEL)
+        return false;
+    else
+        return logger->should_log<Level>();
+}
+
+/**
+ * Picks one in every so many events, for logging on hot paths.
+ */
+class Sampler {
+    uint64_t every_;
+    uint64_t count_ = 0;
+
+public:
+    explicit constexpr Sampler(uint64_t every) noexcept : every_(every) {}
+
+    bool
+    operator()() noexcept
+    {
+        return count_++ % every_ == 0;
+    }
+};
+
 /**
  * Set our thread name.
  */
@@ -102,8 +144,12 @@ CREATE_LOG_CATEGORY(libcurl);
 } // namespace raccoon
 
 // NOLINTBEGIN
-#define log_bt(category, ...)                                                          \
-    LOG_BACKTRACE(raccoon::logging::get_##category##_logger(), __VA_ARGS__)
+#if LOG_BACKTRACE_ENABLED()
+#  define log_bt(category, ...)                                                        \
+      LOG_BACKTRACE(raccoon::logging::get_##category##_logger(), __VA_ARGS__)
+#else
+#  define log_bt(category, ...) (void)0
+#endif
 
 #define log_t3(category, ...)                                                          \
     LOG_TRACE_L3(raccoon::logging::get_##category##_logger(), __VA_ARGS__)
@@ -128,4 +174,16 @@ CREATE_LOG_CATEGORY(libcurl);
 
 #define log_c(category, ...)                                                           \
     LOG_CRITICAL(raccoon::logging::get_##category##_logger(), __VA_ARGS__)
+
+// Debug logs for every message, sampled to one in LOG_SAMPLE_EVERY per call site
+#if QUILL_ACTIVE_LOG_LEVEL <= QUILL_LOG_LEVEL_DEBUG
+#  define log_d_sampled(category, ...)                                                 \
+      do {                                                                             \
+          static thread_local raccoon::logging::Sampler sampler_(LOG_SAMPLE_EVERY);    \
+          if (sampler_())                                                              \
+              log_d(category, __VA_ARGS__);                                            \
+      } while (0)
+#else
+#  define log_d_sampled(category, ...) (void)0
+#endif
 // NOLINTEND
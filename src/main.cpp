@@ -1,7 +1,9 @@
 #include "common.hpp"
+#include "exchanges/exchanges.hpp"
 #include "git.h"
 #include "storage/storage.hpp"
 #include "utils/utils.hpp"
+#include "utils/reserved_memory.hpp"
 #include "web/web.hpp"
 
 #include <argparse/argparse.hpp>
@@ -10,29 +12,13 @@
 #include <quill/LogLevel.h>
 #include <uv.h>
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <ranges>
 #include <string_view>
 #include <tuple>
-
-constexpr static std::string_view COINBASE_SUBSCRIBE_STR = R"(
-{
-  "type": "subscribe",
-  "channels": [
-    {
-      "name": "matches",
-      "product_ids": [
-        "ETH-USD"
-      ]
-    },
-    {
-      "name": "level2_batch",
-      "product_ids": [
-        "ETH-USD"
-      ]
-    }
-  ]
-}
-)";
+#include <unordered_map>
 
 static std::tuple<uint8_t>
 process_arguments(int argc, const char** argv)
@@ -71,6 +57,141 @@ process_arguments(int argc, const char** argv)
     return std::make_tuple(verbosity);
 }
 
+/**
+ * Build a Binance combined stream URL for a comma separated list of symbols.
+ */
+static std::string
+binance_stream_url(const std::string& base_url, const std::string& symbols)
+{
+    std::vector<std::string> streams;
+
+    for (auto symbol : std::views::split(symbols, ',')) {
+        std::string name(symbol.begin(), symbol.end());
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+        if (name.empty())
+            continue;
+
+        streams.push_back(name + "@depth@100ms");
+        streams.push_back(name + "@trade");
+    }
+
+    return fmt::format("{}/stream?streams={}", base_url, fmt::join(streams, "/"));
+}
+
+/**
+ * Read a Coinbase feed: subscribe once the proxy greets us, then process what
+ * arrives while this is the active connection.
+ *
+ * A standby's messages are dropped, so when it takes over, the books missed
+ * whatever came while the other went quiet. Its level2 updates carry no sequence
+ * numbers to tell, so it subscribes again, for new snapshots to start over from.
+ */
+template <class Conn>
+static raccoon::web::Task
+read_coinbase(
+    Conn* conn,
+    const std::string& subscribe,
+    const std::string& unsubscribe,
+    raccoon::storage::DataProcessor& prox
+)
+{
+    bool active = !conn->standby();
+
+    while (auto data = co_await conn->next_message()) {
+        if (data->size() >= PROXY_FIRST_MESSAGE_LEN
+            && memcmp(data->data(), PROXY_FIRST_MESSAGE, PROXY_FIRST_MESSAGE_LEN) == 0)
+            [[unlikely]] // only the first message is like this
+        {
+            conn->send(subscribe);
+        }
+        else if (!conn->standby()) [[likely]] {
+            if (!active) [[unlikely]] {
+                log_w(main, "Subscribing again to {}, after taking over", conn->url());
+
+                conn->send(unsubscribe);
+                conn->send(subscribe);
+                active = true;
+            }
+
+            prox.process_incoming_data(*data);
+        }
+        else {
+            active = false;
+        }
+    }
+}
+
+/**
+ * Read a Binance feed, which is subscribed to by its URL.
+ *
+ * When a standby takes over, the adapter sees the updates it missed as a gap in
+ * their ids, and fetches new snapshots.
+ */
+template <class Conn>
+static raccoon::web::Task
+read_binance(
+    Conn* conn,
+    raccoon::exchanges::BinanceAdapter& binance,
+    raccoon::storage::DataProcessor& prox
+)
+{
+    while (auto data = co_await conn->next_message()) {
+        if (!conn->standby()) [[likely]]
+            prox.process_incoming_data(binance, *data);
+    }
+}
+
+/**
+ * Fetch the depth snapshot a Binance symbol needs, and hand it to the adapter.
+ */
+static raccoon::web::Task
+fetch_binance_snapshot(
+    raccoon::web::Session& session,
+    raccoon::exchanges::BinanceAdapter& binance,
+    std::string symbol,
+    std::string url,
+    raccoon::storage::DataProcessor& prox
+)
+{
+    auto response = co_await session.http_get(std::move(url));
+
+    if (response.status != 200) [[unlikely]] {
+        log_e(main, "Depth snapshot for {} failed with {}", symbol, response.status);
+        binance.snapshot_failed(symbol);
+        co_return;
+    }
+
+    binance.on_snapshot(symbol, response.body, [&prox](const auto& event) {
+        prox.process_event(event);
+    });
+}
+
+/**
+ * Build a Coinbase subscribe, or unsubscribe, message for a comma separated list
+ * of products.
+ */
+static std::string
+coinbase_subscribe_message(const std::string& products, bool subscribe = true)
+{
+    std::vector<std::string> ids;
+
+    for (auto product : std::views::split(products, ',')) {
+        std::string name(product.begin(), product.end());
+
+        if (!name.empty())
+            ids.push_back(fmt::format("\"{}\"", name));
+    }
+
+    return fmt::format(
+        R"({{"type":"{1}","channels":[)"
+        R"({{"name":"matches","product_ids":[{0}]}},)"
+        R"({{"name":"level2_batch","product_ids":[{0}]}}]}})",
+        fmt::join(ids, ","),
+        subscribe ? "subscribe" : "unsubscribe"
+    );
+}
+
 static void
 log_build_info()
 {
@@ -118,8 +239,80 @@ main(int argc, const char** argv)
 
     log_i(main, "Successfully connected to redis");
 
+    // Hot structures are reserved up front, on huge pages and locked if asked to
+    auto& memory = utils::memory_options();
+    auto huge_pages = utils::getenv("HUGE_PAGES", "none");
+
+    if (huge_pages == "transparent")
+        memory.huge_pages = utils::HugePages::TRANSPARENT;
+    else if (huge_pages == "explicit")
+        memory.huge_pages = utils::HugePages::EXPLICIT;
+
+    memory.lock = utils::getenv("MEMORY_LOCK", "0") == "1";
+
     raccoon::storage::DataProcessor prox(ctx);
 
+    prox.reserve_books(
+        std::stoul(utils::getenv("RESERVE_BOOKS", std::to_string(RESERVE_BOOKS))),
+        std::stoul(
+            utils::getenv("RESERVE_BOOK_DEPTH", std::to_string(RESERVE_BOOK_DEPTH))
+        )
+    );
+
+    // Far levels are dropped past a depth or a distance from the mid, and deep books
+    // are trimmed once books take more than the budget
+    raccoon::storage::depth_limits limits{
+        .max_levels = std::stoul(
+            utils::getenv("BOOK_MAX_LEVELS", std::to_string(BOOK_MAX_LEVELS))
+        ),
+        .max_distance = std::stod(utils::getenv("BOOK_MAX_DISTANCE", "0")),
+    };
+
+    auto budget =
+        utils::getenv("BOOK_MEMORY_BUDGET", std::to_string(BOOK_MEMORY_BUDGET));
+    prox.set_book_limits(limits, std::stoul(budget));
+
+    // Record history, if asked to
+    if (auto tick_dir = utils::getenv("TICK_DIR", ""); !tick_dir.empty())
+        prox.enable_tick_store(tick_dir);
+
+    // Books as hashes by default, packed for readers that decode them, or sorted
+    // sets for readers that want a few levels at a time
+    auto book_format = utils::getenv("BOOK_FORMAT", "hash");
+
+    for (auto format : {raccoon::storage::BookFormat::PACKED,
+                        raccoon::storage::BookFormat::ZSET}) {
+        if (book_format == book_format_name(format))
+            prox.set_book_format(format);
+    }
+
+    // Change notifications, for readers that would rather block than poll
+    auto notify = utils::getenv("NOTIFY", "none");
+
+    for (auto mode : {raccoon::storage::NotifyMode::PUBLISH,
+                      raccoon::storage::NotifyMode::STREAM}) {
+        if (notify == notify_mode_name(mode))
+            prox.set_notify(mode);
+    }
+
+    // Binary market data over UDP multicast, for readers that can't wait on Redis
+    if (auto multicast = utils::getenv("MULTICAST", ""); !multicast.empty()) {
+        raccoon::storage::multicast_config config;
+
+        auto colon = multicast.rfind(':');
+        config.group = multicast.substr(0, colon);
+
+        if (colon != std::string::npos)
+            config.port = std::stoi(multicast.substr(colon + 1));
+
+        config.interface = utils::getenv("MULTICAST_INTERFACE", "127.0.0.1");
+        config.recovery_port =
+            std::stoi(utils::getenv("MULTICAST_RECOVERY_PORT", "-1"));
+
+        using Sink = raccoon::storage::AsyncSink<raccoon::storage::MulticastSink>;
+        prox.add_sink(std::make_unique<Sink>(SINK_QUEUE_CAPACITY, std::move(config)));
+    }
+
     // Init curl
     if (curl_global_init(CURL_GLOBAL_ALL)) {
         log_c(main, "Could not initialize cURL");
@@ -129,22 +322,124 @@ main(int argc, const char** argv)
     // Create web session
     raccoon::web::Session session;
 
-    // Create websocket
-    auto data_cb = [&prox](auto* conn, std::vector<uint8_t> data) {
-        if (memcmp(data.data(), PROXY_FIRST_MESSAGE, PROXY_FIRST_MESSAGE_LEN) == 0)
-            [[unlikely]] // only the first message is like this
-        {
-            std::vector<uint8_t> bytes(
-                COINBASE_SUBSCRIBE_STR.begin(), COINBASE_SUBSCRIBE_STR.end()
-            );
-            conn->send(std::move(bytes));
-        }
-        else [[likely]] {
-            prox.process_incoming_data(data);
-        }
+    // Ping feeds, and reopen them when they go quiet
+    session.set_heartbeat(
+        std::chrono::milliseconds(
+            std::stoi(utils::getenv("WS_PING_MS", std::to_string(WS_PING_INTERVAL_MS)))
+        ),
+        std::chrono::milliseconds(
+            std::stoi(utils::getenv("WS_STALE_MS", std::to_string(WS_STALE_AFTER_MS)))
+        )
+    );
+
+    // Products can go quiet on their own, on a connection still busy with others
+    if (auto stale_ms = utils::getenv("PRODUCT_STALE_MS", ""); !stale_ms.empty())
+        prox.set_product_stale_after(std::chrono::milliseconds(std::stoi(stale_ms)));
+
+    // Which venue each feed's connection is to, to tell readers when it's stale
+    std::unordered_map<std::string, raccoon::exchanges::Venue> feed_venues;
+
+    session.on_metrics([&prox] {
+        prox.log_book_memory();
+        prox.log_conflation();
+    });
+
+    session.on_health([&](const std::string& url, bool stale, auto silent) {
+        auto it = feed_venues.find(url);
+        if (it == feed_venues.end())
+            return;
+
+        using std::chrono::nanoseconds;
+        auto now = std::chrono::system_clock::now().time_since_epoch();
+
+        prox.feed_status({
+            .venue = it->second,
+            .feed = raccoon::exchanges::venue_name(it->second),
+            .connection = true,
+            .stale = stale,
+            .silent_ms = silent.count(),
+            .timestamp = std::chrono::duration_cast<nanoseconds>(now).count(),
+        });
+    });
+
+    // Create websocket, to the proxy or a mock exchange
+    auto coinbase_ws_url = utils::getenv("COINBASE_WS_URL", "ws://localhost:8675");
+    auto coinbase_products = utils::getenv("COINBASE_PRODUCTS", "ETH-USD");
+    auto coinbase_subscribe = coinbase_subscribe_message(coinbase_products);
+    auto coinbase_unsubscribe = coinbase_subscribe_message(coinbase_products, false);
+
+    // libcurl by default, or our own WebSocket client for the lowest overhead
+    bool native_ws = utils::getenv("WS_TRANSPORT", "curl") == "native";
+
+    // A second, subscribed connection per feed, to take over without a reconnect
+    bool standby = utils::getenv("WS_STANDBY", "0") == "1";
+
+    // Open a feed, on whichever transport was picked, and read it, and its standby
+    auto open_ws = [&](const std::string& url, auto read) -> std::shared_ptr<void> {
+        auto start = [&](auto conn) -> std::shared_ptr<void> {
+            read(conn.get());
+
+            if (auto* backup = conn->partner())
+                read(backup);
+
+            return conn;
+        };
+
+        if (native_ws)
+            return start(session.native_ws(url, {}, standby));
+
+        return start(session.ws(url, {}, standby));
     };
 
-    auto ws1 = session.ws("ws://localhost:8675", data_cb);
+    feed_venues[coinbase_ws_url] = raccoon::exchanges::Venue::COINBASE;
+    auto ws1 = open_ws(coinbase_ws_url, [&](auto* conn) {
+        read_coinbase(conn, coinbase_subscribe, coinbase_unsubscribe, prox);
+    });
+
+    // Binance feed, if any symbols were requested
+    auto binance_symbols = utils::getenv("BINANCE_SYMBOLS", "");
+    auto binance_ws_url = utils::getenv("BINANCE_WS_URL", BINANCE_WS_URL);
+    auto binance_rest_url = utils::getenv("BINANCE_REST_URL", BINANCE_REST_URL);
+
+    using raccoon::exchanges::BinanceAdapter;
+
+    BinanceAdapter binance([&](const std::string& symbol) {
+        auto url = BinanceAdapter::snapshot_url(binance_rest_url, symbol);
+        fetch_binance_snapshot(session, binance, symbol, std::move(url), prox);
+    });
+
+    std::shared_ptr<void> ws2;
+
+    if (!binance_symbols.empty()) {
+        auto url = binance_stream_url(binance_ws_url, binance_symbols);
+        feed_venues[url] = raccoon::exchanges::Venue::BINANCE;
+
+        ws2 = open_ws(url, [&](auto* conn) { read_binance(conn, binance, prox); });
+    }
+
+    // Keep the loop turning without waiting on feeds while snapshots are built
+    uv_idle_t rebuild_idle{};
+    uv_idle_init(uv_default_loop(), &rebuild_idle);
+    rebuild_idle.data = &prox;
+    uv_unref(reinterpret_cast<uv_handle_t*>(&rebuild_idle)); // NOLINT
+
+    // Write conflated books once per loop cycle, after everything read is processed
+    uv_check_t flush_check{};
+    uv_check_init(uv_default_loop(), &flush_check);
+    flush_check.data = &rebuild_idle;
+
+    uv_check_start(&flush_check, [](auto* handle) {
+        auto* idle = static_cast<uv_idle_t*>(handle->data);
+        auto* processor = static_cast<raccoon::storage::DataProcessor*>(idle->data);
+
+        processor->flush();
+
+        if (processor->rebuilding())
+            uv_idle_start(idle, [](auto*) {});
+        else
+            uv_idle_stop(idle);
+    });
+    uv_unref(reinterpret_cast<uv_handle_t*>(&flush_check)); // NOLINT
 
     // Run session
     auto err = session.run();
@@ -0,0 +1,188 @@
+#include "bars.hpp"
+
+#include "redis.hpp"
+
+#include <limits>
+
+namespace raccoon {
+namespace storage {
+
+bool
+BarBuilder::on_trade(const exchanges::Trade& trade, Bar& closed) noexcept
+{
+    auto timestamp = trade.timestamp;
+
+    // Not every feed timestamps trades
+    if (timestamp == 0) [[unlikely]] {
+        auto now = std::chrono::system_clock::now().time_since_epoch();
+        timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+    }
+
+    // Closed bars are published, so what comes too late for them goes in the next
+    timestamp = std::max(timestamp, closed_until_);
+
+    bool closed_bar = close_expired(timestamp, closed);
+
+    if (!open_) {
+        bar_ = {
+            .start = timestamp - timestamp % interval_,
+            .interval = interval_,
+            .open = trade.exact_price,
+            .high = trade.exact_price,
+            .low = trade.exact_price,
+        };
+        open_ = true;
+    }
+
+    bar_.high = std::max(bar_.high, trade.exact_price);
+    bar_.low = std::min(bar_.low, trade.exact_price);
+    bar_.close = trade.exact_price;
+
+    bar_.volume += trade.exact_size;
+    if (trade.side == exchanges::Side::BID)
+        bar_.buy_volume += trade.exact_size;
+    else
+        bar_.sell_volume += trade.exact_size;
+
+    bar_.notional += trade.exact_price.to_double() * trade.exact_size.to_double();
+    bar_.trades++;
+
+    return closed_bar;
+}
+
+bool
+BarBuilder::close_expired(int64_t now, Bar& closed) noexcept
+{
+    if (!open_ || now < bar_.start + interval_)
+        return false;
+
+    closed = bar_;
+    open_ = false;
+    closed_until_ = bar_.start + interval_;
+
+    return true;
+}
+
+std::vector<std::chrono::seconds>
+BarProcessor::default_intervals()
+{
+    std::vector<std::chrono::seconds> res;
+
+    for (auto secs : {BAR_INTERVALS_S})
+        res.emplace_back(secs);
+
+    return res;
+}
+
+BarProcessor::BarProcessor(std::vector<std::chrono::seconds> intervals)
+{
+    intervals_.reserve(intervals.size());
+
+    for (auto interval : intervals) {
+        if (interval.count() <= 0) [[unlikely]] {
+            log_w(main, "Ignoring bar interval of {}", interval);
+            continue;
+        }
+
+        intervals_.emplace_back(interval);
+    }
+}
+
+void
+BarProcessor::process_trade(const exchanges::Trade& trade)
+{
+    auto [it, inserted] = builders_.try_emplace(trade.product_id);
+    auto& builders = it->second;
+
+    if (inserted) [[unlikely]] {
+        builders.reserve(intervals_.size());
+
+        for (auto interval : intervals_)
+            builders.emplace_back(interval);
+    }
+
+    Bar closed;
+
+    for (auto& builder : builders) {
+        if (builder.on_trade(trade, closed))
+            closed_.push_back({trade.product_id, closed});
+    }
+}
+
+void
+BarProcessor::close_expired(int64_t now)
+{
+    if (now < next_close_) [[likely]]
+        return;
+
+    // Bars are aligned to the epoch, so none can end before the next boundary
+    next_close_ = std::numeric_limits<int64_t>::max();
+
+    for (auto interval : intervals_) {
+        auto ns = interval.count();
+        next_close_ = std::min(next_close_, now - now % ns + ns);
+    }
+
+    Bar closed;
+
+    for (auto& [product_id, builders] : builders_) {
+        for (auto& builder : builders) {
+            if (builder.close_expired(now, closed))
+                closed_.push_back({product_id, closed});
+        }
+    }
+}
+
+std::string
+interval_name(int64_t interval)
+{
+    using namespace std::chrono;
+
+    auto secs = duration_cast<seconds>(nanoseconds(interval)).count();
+
+    if (secs && secs % 3600 == 0)
+        return fmt::format("{}h", secs / 3600);
+    if (secs && secs % 60 == 0)
+        return fmt::format("{}m", secs / 60);
+
+    return fmt::format("{}s", secs);
+}
+
+void
+BarProcessor::bars_to_redis(redisContext* redis)
+{
+    if (closed_.empty()) [[likely]]
+        return;
+
+    log_d(redis, "Pushing {} closed bars to redis", closed_.size());
+
+    std::vector<RedisCommand> commands;
+    commands.reserve(closed_.size());
+
+    for (const auto& [product_id, bar] : closed_) {
+        auto key = fmt::format("{}-BARS-{}", product_id, interval_name(bar.interval));
+
+        auto& cmd = commands.emplace_back("XADD");
+        cmd.arg(key)
+            .arg("MAXLEN")
+            .arg("~")
+            .arg(BAR_STREAM_MAXLEN)
+            .arg("*")
+            .field("start", bar.start)
+            .field("open", utils::to_string(bar.open))
+            .field("high", utils::to_string(bar.high))
+            .field("low", utils::to_string(bar.low))
+            .field("close", utils::to_string(bar.close))
+            .field("volume", utils::to_string(bar.volume))
+            .field("buy_volume", utils::to_string(bar.buy_volume))
+            .field("sell_volume", utils::to_string(bar.sell_volume))
+            .field("vwap", bar.vwap())
+            .field("trades", bar.trades);
+    }
+
+    redis_pipeline(redis, commands);
+    closed_.clear();
+}
+
+} // namespace storage
+} // namespace raccoon
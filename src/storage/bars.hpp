@@ -0,0 +1,160 @@
+#pragma once
+
+#include "common.hpp"
+#include "exchanges/events.hpp"
+#include "utils/fixed_point.hpp"
+
+#include <hiredis/hiredis.h>
+
+#include <algorithm>
+#include <chrono>
+#include <span>
+
+namespace raccoon {
+namespace storage {
+
+/**
+ * An OHLCV bar with trade flow.
+ */
+struct Bar {
+    int64_t start{};    // nanoseconds since epoch
+    int64_t interval{}; // nanoseconds
+
+    utils::Fixed open{};
+    utils::Fixed high{};
+    utils::Fixed low{};
+    utils::Fixed close{};
+
+    utils::Fixed volume{};
+    utils::Fixed buy_volume{};  // aggressor bought
+    utils::Fixed sell_volume{}; // aggressor sold
+
+    double notional{}; // sum of price * size, for VWAP
+    uint64_t trades{};
+
+    [[nodiscard]] double
+    vwap() const noexcept
+    {
+        return volume.raw ? notional / volume.to_double() : close.to_double();
+    }
+};
+
+/**
+ * Builds bars of one interval for one product, one trade at a time.
+ *
+ * Bars are aligned to the epoch. Intervals without trades produce no bar. A trade
+ * older than the open bar is folded into it rather than reopening a closed bar,
+ * and one older than the last closed bar goes into the next.
+ */
+class BarBuilder {
+    int64_t interval_;
+    Bar bar_;
+    bool open_ = false;
+    int64_t closed_until_ = 0; // end of the last closed bar
+
+public:
+    explicit BarBuilder(std::chrono::nanoseconds interval) :
+        interval_(interval.count()), bar_{.interval = interval_}
+    {}
+
+    /**
+     * Add a trade to the open bar.
+     *
+     * @param closed Set to the previous bar if this trade closed it.
+     *
+     * @returns bool If a bar was closed.
+     */
+    bool on_trade(const exchanges::Trade& trade, Bar& closed) noexcept;
+
+    /**
+     * Close the open bar if its interval has ended.
+     *
+     * @param now Nanoseconds since epoch.
+     * @param closed Set to the open bar if it was closed.
+     *
+     * @returns bool If a bar was closed.
+     */
+    bool close_expired(int64_t now, Bar& closed) noexcept;
+
+    /**
+     * The bar currently being built, if any.
+     */
+    [[nodiscard]] const Bar*
+    current() const noexcept
+    {
+        return open_ ? &bar_ : nullptr;
+    }
+};
+
+/**
+ * Maintains bars for every product and interval from the trade stream.
+ */
+class BarProcessor {
+public:
+    /**
+     * A bar that has closed and is waiting to be published.
+     */
+    struct closed_bar {
+        std::string product_id;
+        Bar bar;
+    };
+
+private:
+    std::vector<std::chrono::nanoseconds> intervals_;
+    std::unordered_map<std::string, std::vector<BarBuilder>> builders_;
+
+    std::vector<closed_bar> closed_;
+    int64_t next_close_ = 0; // when the next interval ends, as of the last check
+
+public:
+    /**
+     * Create a new bar processor.
+     *
+     * @param intervals The bar intervals to build for every product.
+     */
+    explicit BarProcessor(
+        std::vector<std::chrono::seconds> intervals = default_intervals()
+    );
+
+    /**
+     * The intervals set by BAR_INTERVALS_S.
+     */
+    static std::vector<std::chrono::seconds> default_intervals();
+
+    /**
+     * Add a trade to its product's bars.
+     */
+    void process_trade(const exchanges::Trade& trade);
+
+    /**
+     * Close every bar whose interval has ended, for products that went quiet.
+     *
+     * Cheap to call every loop cycle, since bars are only looked at once an
+     * interval has ended.
+     *
+     * @param now Nanoseconds since epoch.
+     */
+    void close_expired(int64_t now);
+
+    /**
+     * Bars closed since they were last published.
+     */
+    [[nodiscard]] std::span<const closed_bar>
+    closed() const noexcept
+    {
+        return closed_;
+    }
+
+    /**
+     * Publish closed bars to {product}-BARS-{interval} streams.
+     */
+    void bars_to_redis(redisContext* redis);
+};
+
+/**
+ * Short name of a bar interval, e.g. 1s, 5m.
+ */
+std::string interval_name(int64_t interval);
+
+} // namespace storage
+} // namespace raccoon
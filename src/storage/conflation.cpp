@@ -0,0 +1,64 @@
+#include "conflation.hpp"
+
+namespace raccoon {
+namespace storage {
+
+bool
+Conflator::on_update(const std::string& product_id, const std::string& symbol)
+{
+    stats_.updates++;
+    cycle_updates_++;
+
+    if (!conflating_) [[likely]]
+        return true;
+
+    dirty_products_.insert(product_id);
+    dirty_symbols_.insert(symbol);
+    return false;
+}
+
+void
+Conflator::update_mode_()
+{
+    auto cycle_updates = std::exchange(cycle_updates_, 0);
+
+    if (!conflating_) [[likely]] {
+        if (write_latency_ <= max_write_latency_ && cycle_updates <= max_cycle_updates_)
+            return;
+
+        log_w(
+            redis,
+            "Redis is falling behind ({} per book, {} updates in a cycle), "
+            "conflating book updates",
+            std::chrono::duration_cast<std::chrono::microseconds>(write_latency_),
+            cycle_updates
+        );
+
+        conflating_ = true;
+        stats_.episodes++;
+        episode_start_ = stats_;
+        return;
+    }
+
+    // Wait until well clear of the thresholds, so we don't flap
+    bool caught_up = write_latency_ <= max_write_latency_ / 2
+                     && cycle_updates <= max_cycle_updates_ / 2;
+
+    if (!caught_up)
+        return;
+
+    conflating_ = false;
+
+    auto updates = stats_.updates - episode_start_.updates;
+    auto writes = stats_.writes - episode_start_.writes;
+
+    log_i(
+        redis,
+        "Redis caught up, stopped conflating after writing {} book updates as {} books",
+        updates,
+        writes
+    );
+}
+
+} // namespace storage
+} // namespace raccoon
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <chrono>
+#include <unordered_set>
+
+namespace raccoon {
+namespace storage {
+
+/**
+ * Counters for book writes, conflated or not.
+ */
+struct conflation_stats {
+    uint64_t updates = 0;  // book snapshots and updates applied
+    uint64_t writes = 0;   // books written to Redis
+    uint64_t episodes = 0; // times conflation was switched on
+
+    /**
+     * Book updates per book written, 1 if nothing was conflated.
+     */
+    [[nodiscard]] double
+    ratio() const noexcept
+    {
+        if (writes == 0)
+            return 1.0;
+
+        return static_cast<double>(updates) / static_cast<double>(writes);
+    }
+};
+
+/**
+ * Decides when book writes are conflated, and holds the books waiting to be written.
+ *
+ * Normally each book is written as soon as an update is applied. When Redis falls
+ * behind, because writes get slow or because updates pile up faster than one loop
+ * cycle can write them, books are only marked dirty instead. Each dirty book is
+ * written once, in its latest state, when the cycle is flushed. Conflation switches
+ * off again once both have come down to half their thresholds.
+ *
+ * Only books are conflated; trades are never held back.
+ */
+class Conflator {
+public:
+    using clock = std::chrono::steady_clock;
+
+private:
+    // Thresholds to switch conflation on
+    clock::duration max_write_latency_;
+    size_t max_cycle_updates_;
+
+    bool conflating_ = false;
+    clock::duration write_latency_{}; // moving average
+    size_t cycle_updates_ = 0;        // updates since the last flush
+
+    // Books waiting for the next flush, and the consolidated views they feed
+    std::unordered_set<std::string> dirty_products_;
+    std::unordered_set<std::string> dirty_symbols_;
+
+    conflation_stats stats_;
+    conflation_stats episode_start_; // stats when conflation last switched on
+
+public:
+    /**
+     * Create a new conflator.
+     *
+     * @param max_write_latency Average book write time that switches conflation on.
+     * @param max_cycle_updates Book updates in one cycle that switch conflation on.
+     */
+    explicit Conflator(
+        clock::duration max_write_latency =
+            std::chrono::microseconds(CONFLATE_WRITE_LATENCY_US),
+        size_t max_cycle_updates = CONFLATE_CYCLE_UPDATES
+    ) :
+        max_write_latency_(max_write_latency),
+        max_cycle_updates_(max_cycle_updates)
+    {}
+
+    /**
+     * Count an applied book update.
+     *
+     * @returns bool If the book should be written now, otherwise it waits for a flush.
+     */
+    bool on_update(const std::string& product_id, const std::string& symbol);
+
+    /**
+     * Record how long a book took to write.
+     */
+    void
+    on_write(clock::duration took) noexcept
+    {
+        static constexpr int WEIGHT = 8; // samples averaged over, roughly
+
+        write_latency_ += (took - write_latency_) / WEIGHT;
+        stats_.writes++;
+    }
+
+    /**
+     * End a loop cycle: write every dirty book, then decide whether to keep
+     * conflating.
+     *
+     * @param write_book Called with each dirty product id.
+     * @param write_symbol Called with each normalized symbol they belong to.
+     */
+    template <class WriteBook, class WriteSymbol>
+    void
+    flush(WriteBook&& write_book, WriteSymbol&& write_symbol)
+    {
+        for (const auto& product_id : dirty_products_)
+            write_book(product_id);
+
+        for (const auto& symbol : dirty_symbols_)
+            write_symbol(symbol);
+
+        dirty_products_.clear();
+        dirty_symbols_.clear();
+
+        update_mode_();
+    }
+
+    /**
+     * If book writes are being conflated.
+     */
+    [[nodiscard]] bool
+    conflating() const noexcept
+    {
+        return conflating_;
+    }
+
+    /**
+     * Books waiting for the next flush.
+     */
+    [[nodiscard]] size_t
+    pending() const noexcept
+    {
+        return dirty_products_.size();
+    }
+
+    /**
+     * Average time to write a book.
+     */
+    [[nodiscard]] clock::duration
+    write_latency() const noexcept
+    {
+        return write_latency_;
+    }
+
+    [[nodiscard]] const conflation_stats&
+    stats() const noexcept
+    {
+        return stats_;
+    }
+
+private:
+    void update_mode_();
+};
+
+} // namespace storage
+} // namespace raccoon
@@ -0,0 +1,209 @@
+#include "consolidated.hpp"
+
+#include "redis.hpp"
+
+namespace raccoon {
+namespace storage {
+
+template <class Map>
+static void
+apply_level(Map& side, size_t venue, double price, double new_size)
+{
+    if (new_size <= 0.0) {
+        auto it = side.find(price);
+        if (it == side.end())
+            return;
+
+        auto& lvl = it->second;
+        lvl.total -= lvl.sizes[venue];
+        lvl.sizes[venue] = 0.0;
+
+        // Drop the level once no venue quotes it
+        bool empty = true;
+        for (double size : lvl.sizes)
+            empty &= size <= 0.0;
+
+        if (empty)
+            side.erase(it);
+
+        return;
+    }
+
+    auto& lvl = side[price];
+    lvl.total += new_size - lvl.sizes[venue];
+    lvl.sizes[venue] = new_size;
+}
+
+void
+ConsolidatedBook::apply(
+    exchanges::Venue venue,
+    exchanges::Side side,
+    double price,
+    double new_size,
+    clock::time_point now
+)
+{
+    auto idx = static_cast<size_t>(venue);
+
+    if (side == exchanges::Side::BID)
+        apply_level(bids_, idx, price, new_size);
+    else
+        apply_level(asks_, idx, price, new_size);
+
+    last_update_[idx] = now;
+    venues_ |= static_cast<venue_mask>(1U << idx);
+}
+
+void
+ConsolidatedBook::apply(
+    exchanges::Venue venue,
+    std::span<const level_update> changes,
+    clock::time_point now
+)
+{
+    auto idx = static_cast<size_t>(venue);
+
+    for (const auto& change : changes) {
+        if (change.side == exchanges::Side::BID)
+            apply_level(bids_, idx, change.price, change.new_size);
+        else
+            apply_level(asks_, idx, change.price, change.new_size);
+    }
+
+    // An update with no changes still shows the venue is alive
+    last_update_[idx] = now;
+    venues_ |= static_cast<venue_mask>(1U << idx);
+}
+
+ConsolidatedBook::venue_mask
+ConsolidatedBook::stale_venues(
+    clock::duration stale_after, clock::time_point now
+) const noexcept
+{
+    venue_mask stale{};
+
+    for (size_t venue = 0; venue < MAX_VENUES; venue++) {
+        if ((venues_ >> venue) & 1U && now - last_update_[venue] > stale_after)
+            stale |= static_cast<venue_mask>(1U << venue);
+    }
+
+    return stale;
+}
+
+void
+ConsolidatedProcessor::process_changes(
+    const product_tracker& tracker, std::span<const level_update> changes
+)
+{
+    if (tracker.symbol.empty()) [[unlikely]]
+        return;
+
+    books_[tracker.symbol].apply(tracker.venue, changes);
+}
+
+static std::string
+venue_list(ConsolidatedBook::venue_mask venues)
+{
+    std::string res;
+
+    for (size_t venue = 0; venue < exchanges::VENUE_COUNT; venue++) {
+        if (!((venues >> venue) & 1U))
+            continue;
+
+        if (!res.empty())
+            res += ',';
+
+        res += exchanges::venue_name(static_cast<exchanges::Venue>(venue));
+    }
+
+    return res;
+}
+
+template <class Map>
+static RedisCommand
+depth_command(
+    std::string_view key,
+    const Map& side,
+    size_t depth,
+    std::pmr::memory_resource* memory
+)
+{
+    RedisCommand cmd("HSET", memory);
+    cmd.arg(key);
+
+    for (const auto& [price, lvl] : side) {
+        if (depth-- == 0)
+            break;
+
+        cmd.field(price, lvl.total);
+    }
+
+    return cmd;
+}
+
+void
+ConsolidatedProcessor::to_redis(redisContext* redis, const std::string& symbol)
+{
+    auto it = books_.find(symbol);
+
+    // Nothing to consolidate with a single venue
+    if (it == books_.end() || it->second.venue_count() < 2)
+        return;
+
+    const auto& book = it->second;
+    log_d_sampled(redis, "Pushing consolidated book {} to redis", symbol);
+
+    auto stale = book.stale_venues(stale_after_);
+    auto bid = book.best_bid(stale);
+    auto ask = book.best_ask(stale);
+
+    RedisCommand top("HSET", scratch_);
+    top.arg_format("{}-CONSOLIDATED", symbol)
+        .field("bid", bid.price)
+        .field("bid_size", bid.size)
+        .field("bid_venues", venue_list(bid.venues))
+        .field("ask", ask.price)
+        .field("ask_size", ask.size)
+        .field("ask_venues", venue_list(ask.venues))
+        .field("venues", venue_list(book.venues()))
+        .field("stale_venues", venue_list(stale));
+
+    // Per-venue staleness, so readers don't have to parse the lists
+    for (size_t venue = 0; venue < exchanges::VENUE_COUNT; venue++) {
+        if (!((book.venues() >> venue) & 1U))
+            continue;
+
+        auto name = exchanges::venue_name(static_cast<exchanges::Venue>(venue));
+        top.arg_format("{}_stale", name).arg((stale >> venue) & 1U);
+    }
+
+    // Replace the merged depth atomically, levels come and go
+    std::pmr::string bids_key(scratch_);
+    std::pmr::string asks_key(scratch_);
+    fmt::format_to(std::back_inserter(bids_key), "{}-CBIDS", symbol);
+    fmt::format_to(std::back_inserter(asks_key), "{}-CASKS", symbol);
+
+    RedisCommand del("DEL", scratch_);
+    del.arg(bids_key).arg(asks_key);
+
+    std::pmr::vector<RedisCommand> commands(scratch_);
+    commands.reserve(6);
+
+    commands.push_back(std::move(top));
+    commands.emplace_back("MULTI", scratch_);
+    commands.push_back(std::move(del));
+
+    auto depth = publish_depth_;
+
+    if (!book.bids().empty())
+        commands.push_back(depth_command(bids_key, book.bids(), depth, scratch_));
+    if (!book.asks().empty())
+        commands.push_back(depth_command(asks_key, book.asks(), depth, scratch_));
+
+    commands.emplace_back("EXEC", scratch_);
+
+    redis_pipeline(redis, commands);
+}
+
+} // namespace storage
+} // namespace raccoon
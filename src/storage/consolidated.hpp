@@ -0,0 +1,238 @@
+#pragma once
+
+#include "common.hpp"
+#include "exchanges/events.hpp"
+#include "orderbook.hpp"
+
+#include <hiredis/hiredis.h>
+
+#include <bit>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <span>
+
+namespace raccoon {
+namespace storage {
+
+/**
+ * A book merged across venues for one normalized symbol.
+ *
+ * Each level keeps the size contributed by every venue, so a change from one venue
+ * only touches that venue's slot. The book is maintained from the per-venue level
+ * changes, never rebuilt.
+ */
+class ConsolidatedBook {
+public:
+    using clock = std::chrono::steady_clock;
+
+    // Venue slots per level; venues are indexed by their enum value
+    static constexpr size_t MAX_VENUES = 8;
+    static_assert(exchanges::VENUE_COUNT <= MAX_VENUES);
+
+    /**
+     * Bitmask of venues, bit N is the venue with enum value N.
+     */
+    using venue_mask = uint8_t;
+
+    /**
+     * A merged price level.
+     */
+    struct level {
+        double total = 0.0;
+        std::array<double, MAX_VENUES> sizes{};
+    };
+
+    /**
+     * Best price on one side, with the venues quoting it.
+     */
+    struct quote {
+        double price = 0.0;
+        double size = 0.0;    // total size across attributed venues
+        venue_mask venues{};  // venues quoting at this price
+        bool valid = false;   // false if the side is empty
+    };
+
+private:
+    std::map<double, level, std::greater<>> bids_;
+    std::map<double, level, std::less<>> asks_;
+
+    std::array<clock::time_point, MAX_VENUES> last_update_{};
+    venue_mask venues_{}; // venues that have contributed to this book
+
+public:
+    /**
+     * Apply a level change from one venue.
+     */
+    void apply(
+        exchanges::Venue venue,
+        exchanges::Side side,
+        double price,
+        double new_size,
+        clock::time_point now = clock::now()
+    );
+
+    /**
+     * Apply every level change from one venue's update.
+     */
+    void apply(
+        exchanges::Venue venue,
+        std::span<const level_update> changes,
+        clock::time_point now = clock::now()
+    );
+
+    /**
+     * Best bid across venues.
+     *
+     * @param exclude Venues to leave out, e.g. stale ones.
+     */
+    [[nodiscard]] quote
+    best_bid(venue_mask exclude = 0) const noexcept
+    {
+        return best_(bids_, exclude);
+    }
+
+    /**
+     * Best ask across venues.
+     *
+     * @param exclude Venues to leave out, e.g. stale ones.
+     */
+    [[nodiscard]] quote
+    best_ask(venue_mask exclude = 0) const noexcept
+    {
+        return best_(asks_, exclude);
+    }
+
+    /**
+     * Venues that have not updated within a window.
+     */
+    [[nodiscard]] venue_mask stale_venues(
+        clock::duration stale_after, clock::time_point now = clock::now()
+    ) const noexcept;
+
+    /**
+     * Venues that have contributed to this book.
+     */
+    [[nodiscard]] venue_mask
+    venues() const noexcept
+    {
+        return venues_;
+    }
+
+    /**
+     * Number of venues that have contributed to this book.
+     */
+    [[nodiscard]] size_t
+    venue_count() const noexcept
+    {
+        return static_cast<size_t>(std::popcount(venues_));
+    }
+
+    /**
+     * Merged bids, best first.
+     */
+    [[nodiscard]] const auto&
+    bids() const noexcept
+    {
+        return bids_;
+    }
+
+    /**
+     * Merged asks, best first.
+     */
+    [[nodiscard]] const auto&
+    asks() const noexcept
+    {
+        return asks_;
+    }
+
+private:
+    template <class Map>
+    static quote
+    best_(const Map& side, venue_mask exclude) noexcept
+    {
+        // Levels are best first, so this is O(1) unless the top is all excluded
+        for (const auto& [price, lvl] : side) {
+            quote res{.price = price};
+
+            for (size_t venue = 0; venue < MAX_VENUES; venue++) {
+                if ((exclude >> venue) & 1U || lvl.sizes[venue] <= 0.0)
+                    continue;
+
+                res.size += lvl.sizes[venue];
+                res.venues |= static_cast<venue_mask>(1U << venue);
+            }
+
+            if (res.venues) {
+                res.valid = true;
+                return res;
+            }
+        }
+
+        return {};
+    }
+};
+
+/**
+ * Maintains consolidated books for every normalized symbol.
+ */
+class ConsolidatedProcessor {
+    std::unordered_map<std::string, ConsolidatedBook> books_;
+
+    ConsolidatedBook::clock::duration stale_after_;
+    size_t publish_depth_;
+
+    // Where commands are built, only until they're sent
+    std::pmr::memory_resource* scratch_ = std::pmr::get_default_resource();
+
+public:
+    /**
+     * Create a new consolidated processor.
+     *
+     * @param stale_after How long a venue can go without updates before it is
+     *                    flagged stale and left out of the best bid/offer.
+     * @param publish_depth How many merged levels per side to publish.
+     */
+    explicit ConsolidatedProcessor(
+        std::chrono::milliseconds stale_after =
+            std::chrono::milliseconds(CONSOLIDATED_STALE_AFTER_MS),
+        size_t publish_depth = CONSOLIDATED_PUBLISH_DEPTH
+    ) :
+        stale_after_(stale_after),
+        publish_depth_(publish_depth)
+    {}
+
+    /**
+     * Build Redis commands in scratch memory, as OrderbookProcessor does.
+     */
+    void
+    set_scratch(std::pmr::memory_resource* scratch) noexcept
+    {
+        scratch_ = scratch;
+    }
+
+    /**
+     * Apply the changes from one venue's book to its symbol's consolidated book.
+     */
+    void process_changes(
+        const product_tracker& tracker, std::span<const level_update> changes
+    );
+
+    /**
+     * Publish a symbol's consolidated book, if more than one venue feeds it.
+     */
+    void to_redis(redisContext* redis, const std::string& symbol);
+
+    /**
+     * Get the consolidated book for a symbol, if there is one.
+     */
+    [[nodiscard]] const ConsolidatedBook*
+    book(const std::string& symbol) const
+    {
+        auto it = books_.find(symbol);
+        return it == books_.end() ? nullptr : &it->second;
+    }
+};
+
+} // namespace storage
+} // namespace raccoon
@@ -0,0 +1,584 @@
+#include "multicast.hpp"
+
+#include "utils/fixed_point.hpp"
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+
+namespace raccoon {
+namespace storage {
+
+using market_data::Message;
+using market_data::MessageType;
+using market_data::PacketHeader;
+
+// Longest request line the recovery socket accepts
+static constexpr size_t MAX_REQUEST_LEN = 64;
+
+static int64_t
+now_nanos()
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+static int64_t
+scaled(double value)
+{
+    constexpr auto SCALE = static_cast<double>(utils::Fixed::SCALE);
+    return std::llround(value * SCALE);
+}
+
+/**
+ * Write what a non-blocking socket takes of `data`, from `written` on. True once
+ * it's all written, or the socket failed.
+ */
+static bool
+write_some(int fd, std::string_view data, size_t& written)
+{
+    while (written < data.size()) {
+        auto sent =
+            ::send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return false;
+
+        if (sent <= 0) {
+            log_w(
+                main, "Market data recovery reply cut short: {}", std::strerror(errno)
+            );
+            return true;
+        }
+
+        written += static_cast<size_t>(sent);
+    }
+
+    return true;
+}
+
+/**
+ * Append a packet to a recovery reply, after its length.
+ */
+static void
+append_frame(std::string& reply, std::string_view packet)
+{
+    auto offset = reply.size();
+    reply.resize(offset + sizeof(uint32_t));
+    packed::detail::put<uint32_t>(&reply[offset], static_cast<uint32_t>(packet.size()));
+    reply.append(packet);
+}
+
+MulticastSink::MulticastSink(multicast_config config) : config_(std::move(config))
+{
+    // Room for at least one message per packet
+    config_.max_datagram = std::max(
+        config_.max_datagram, market_data::HEADER_SIZE + market_data::MAX_MESSAGE_SIZE
+    );
+    packet_.reserve(config_.max_datagram);
+
+    in_addr interface{};
+    destination_.sin_family = AF_INET;
+    destination_.sin_port = htons(static_cast<uint16_t>(config_.port));
+
+    if (inet_pton(AF_INET, config_.group.c_str(), &destination_.sin_addr) != 1 ||
+        inet_pton(AF_INET, config_.interface.c_str(), &interface) != 1) {
+        log_e(
+            main,
+            "Invalid multicast address {} or {}",
+            config_.group,
+            config_.interface
+        );
+        return;
+    }
+
+    int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        log_e(main, "Can't open multicast socket: {}", std::strerror(errno));
+        return;
+    }
+
+    // Loop back, so receivers on this host get the datagrams too
+    auto ttl = static_cast<uint8_t>(config_.ttl);
+    uint8_t loop = 1;
+
+    if (::setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) ||
+        ::setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) ||
+        ::setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop))) {
+        log_e(
+            main,
+            "Can't set up multicast on {}: {}",
+            config_.interface,
+            std::strerror(errno)
+        );
+        ::close(fd);
+        return;
+    }
+
+    if (config_.recovery_port >= 0 && !open_recovery_()) {
+        ::close(fd);
+        return;
+    }
+
+    socket_ = fd;
+
+    log_i(
+        main,
+        "Multicasting market data to {}:{} on {}",
+        config_.group,
+        config_.port,
+        config_.interface
+    );
+}
+
+MulticastSink::~MulticastSink()
+{
+    for (const auto& client : clients_)
+        ::close(client.fd);
+
+    if (listener_ >= 0)
+        ::close(listener_);
+
+    if (socket_ >= 0)
+        ::close(socket_);
+}
+
+bool
+MulticastSink::open_recovery_()
+{
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(config_.recovery_port));
+    inet_pton(AF_INET, config_.interface.c_str(), &address.sin_addr);
+
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    socklen_t len = sizeof(address);
+
+    // NOLINTBEGIN(*-reinterpret-cast)
+    bool ok = fd >= 0 &&
+              ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == 0 &&
+              ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 &&
+              ::listen(fd, SOMAXCONN) == 0 &&
+              ::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &len) == 0;
+    // NOLINTEND(*-reinterpret-cast)
+
+    if (!ok) {
+        log_e(
+            main,
+            "Can't listen for recovery on {}:{}: {}",
+            config_.interface,
+            config_.recovery_port,
+            std::strerror(errno)
+        );
+
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+
+    listener_ = fd;
+    recovery_port_ = ntohs(address.sin_port);
+
+    log_i(
+        main,
+        "Serving market data recovery on {}:{}",
+        config_.interface,
+        recovery_port_
+    );
+    return true;
+}
+
+void
+MulticastSink::on_book(const BookChange& book)
+{
+    if (!ok()) [[unlikely]]
+        return;
+
+    key_ = book.product_id;
+    auto& state = books_[key_];
+
+    // Changes were lost on the way here, so what was kept is wrong, and so are
+    // receivers' books
+    if (book.reset) [[unlikely]] {
+        state.bids.clear();
+        state.asks.clear();
+    }
+
+    message_.venue = static_cast<uint8_t>(book.venue);
+    message_.flags = book.snapshot ? market_data::MESSAGE_SNAPSHOT : 0;
+
+    if (book.reset)
+        message_.flags |= market_data::MESSAGE_RESET;
+    message_.timestamp = book.timestamp;
+    message_.id = book.sequence;
+    message_.set_product_id(book.product_id);
+
+    message_.type = MessageType::LEVEL;
+    message_.values.fill(0);
+
+    for (const auto& change : book.changes) {
+        auto price = scaled(change.price);
+        auto size = scaled(change.new_size);
+
+        auto& side = change.side == exchanges::Side::BID ? state.bids : state.asks;
+
+        if (size == 0)
+            side.erase(price);
+        else
+            side[price] = size;
+
+        message_.side = static_cast<uint8_t>(change.side);
+        message_.values[0] = price;
+        message_.values[1] = size;
+        append_(message_);
+    }
+
+    message_.type = MessageType::TOP;
+    message_.side = 0;
+    message_.values = {
+        scaled(book.l1.bid),
+        scaled(book.l1.bid_size),
+        scaled(book.l1.ask),
+        scaled(book.l1.ask_size),
+    };
+    append_(message_);
+
+    state.top = message_;
+}
+
+void
+MulticastSink::on_trade(const exchanges::Trade& trade)
+{
+    if (!ok()) [[unlikely]]
+        return;
+
+    message_.type = MessageType::TRADE;
+    message_.venue = static_cast<uint8_t>(trade.venue);
+    message_.side = static_cast<uint8_t>(trade.side);
+    message_.flags = 0;
+    message_.timestamp = trade.timestamp;
+    message_.id = trade.trade_id;
+    message_.set_product_id(trade.product_id);
+    message_.values = {scaled(trade.price), scaled(trade.size), 0, 0};
+
+    append_(message_);
+}
+
+void
+MulticastSink::on_status(const FeedStatus& status)
+{
+    if (!ok()) [[unlikely]]
+        return;
+
+    message_.type = MessageType::STATUS;
+    message_.venue = static_cast<uint8_t>(status.venue);
+    message_.side = 0;
+    message_.flags = 0;
+
+    if (status.stale)
+        message_.flags |= market_data::MESSAGE_STALE;
+    if (status.connection)
+        message_.flags |= market_data::MESSAGE_CONNECTION;
+
+    message_.timestamp = status.timestamp;
+    message_.id = static_cast<uint64_t>(status.silent_ms);
+    message_.set_product_id(status.feed);
+    message_.values = {};
+
+    append_(message_);
+}
+
+void
+MulticastSink::flush()
+{
+    if (count_ != 0)
+        send_();
+
+    serve_recovery_();
+}
+
+void
+MulticastSink::idle()
+{
+    serve_recovery_();
+}
+
+void
+MulticastSink::append_(const Message& message)
+{
+    auto size = market_data::message_size(message.type);
+
+    if (packet_.size() + size > config_.max_datagram || count_ == UINT16_MAX)
+        send_();
+
+    // The header is written when sent
+    if (packet_.empty()) {
+        packet_.resize(market_data::HEADER_SIZE);
+        first_sequence_ = next_sequence_;
+    }
+
+    auto offset = packet_.size();
+    packet_.resize(offset + size);
+    market_data::encode_message(message, packet_.data() + offset);
+
+    count_++;
+    next_sequence_++;
+}
+
+void
+MulticastSink::send_()
+{
+    if (packet_.empty())
+        return;
+
+    PacketHeader header{
+        .flags = 0,
+        .count = count_,
+        .channel = config_.channel,
+        .sequence = first_sequence_,
+        .send_time = now_nanos(),
+    };
+    market_data::encode_header(header, packet_.data());
+
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    const auto* destination = reinterpret_cast<const sockaddr*>(&destination_);
+    auto sent = ::sendto(
+        socket_, packet_.data(), packet_.size(), 0, destination, sizeof(destination_)
+    );
+
+    if (sent < 0) [[unlikely]] {
+        // Receivers see the gap, and can ask for the packet again
+        if (stats_.send_errors++ == 0)
+            log_w(main, "Can't send multicast packet: {}", std::strerror(errno));
+    }
+    else {
+        stats_.packets++;
+        stats_.messages += count_;
+        stats_.bytes += packet_.size();
+    }
+
+    // Keep it for retransmission, recycling the oldest packet's buffer
+    if (config_.retransmit_packets != 0) {
+        sent_packet kept;
+
+        if (sent_.size() >= config_.retransmit_packets) {
+            kept = std::move(sent_.front());
+            sent_.pop_front();
+        }
+
+        kept.first = first_sequence_;
+        kept.last = next_sequence_ - 1;
+        kept.data.swap(packet_);
+        sent_.push_back(std::move(kept));
+    }
+
+    packet_.clear();
+    count_ = 0;
+}
+
+void
+MulticastSink::serve_recovery_()
+{
+    if (listener_ < 0)
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+
+    while (true) {
+        int fd = ::accept4(listener_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            break;
+
+        auto& client = clients_.emplace_back();
+        client.fd = fd;
+        client.deadline = now + config_.recovery_timeout;
+    }
+
+    std::array<char, MAX_REQUEST_LEN> buf{};
+
+    // Read the request, then write as much of the reply as the client takes
+    auto done = [this, &buf, now](recovery_client& client) {
+        if (now > client.deadline) {
+            if (stats_.slow_clients++ == 0)
+                log_w(main, "Market data recovery client too slow, dropped");
+            return true;
+        }
+
+        if (!client.replied) {
+            auto nread = ::recv(client.fd, buf.data(), buf.size(), 0);
+
+            if (nread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return false;
+            if (nread <= 0)
+                return true;
+
+            client.request.append(buf.data(), static_cast<size_t>(nread));
+
+            auto end = client.request.find('\n');
+            if (end == std::string::npos)
+                return client.request.size() > MAX_REQUEST_LEN;
+
+            reply_(client.reply, std::string_view(client.request).substr(0, end));
+            client.replied = true;
+        }
+
+        return write_some(client.fd, client.reply, client.written);
+    };
+
+    std::erase_if(clients_, [&done](recovery_client& client) {
+        if (!done(client))
+            return false;
+
+        ::close(client.fd);
+        return true;
+    });
+}
+
+void
+MulticastSink::reply_(std::string& reply, std::string_view request)
+{
+    if (request.ends_with('\r'))
+        request.remove_suffix(1);
+
+    if (request == "SNAPSHOT") {
+        send_snapshot_(reply);
+        return;
+    }
+
+    constexpr std::string_view RETRANSMIT = "RETRANSMIT ";
+
+    if (request.starts_with(RETRANSMIT)) {
+        request.remove_prefix(RETRANSMIT.size());
+
+        uint64_t first = 0;
+        uint64_t last = 0;
+        const char* end = request.data() + request.size();
+
+        auto [ptr, ec] = std::from_chars(request.data(), end, first);
+        if (ec == std::errc() && ptr != end && *ptr == ' ') {
+            auto res = std::from_chars(ptr + 1, end, last);
+
+            if (res.ec == std::errc() && res.ptr == end && first <= last) {
+                send_retransmission_(reply, first, last);
+                return;
+            }
+        }
+    }
+
+    log_w(main, "Invalid market data recovery request: {}", request);
+}
+
+void
+MulticastSink::send_snapshot_(std::string& reply)
+{
+    // Whatever's pending goes first, so the snapshot is as of the last sequence sent
+    if (count_ != 0)
+        send_();
+
+    std::string packet;
+    uint16_t count = 0;
+    bool sent_any = false;
+
+    PacketHeader header{
+        .flags = market_data::PACKET_SNAPSHOT,
+        .count = 0,
+        .channel = config_.channel,
+        .sequence = next_sequence_ - 1,
+        .send_time = 0,
+    };
+
+    // Even with no books, a packet says what sequence number to carry on from
+    auto send_packet = [&]() {
+        if (count == 0 && sent_any)
+            return;
+
+        if (packet.empty())
+            packet.resize(market_data::HEADER_SIZE);
+
+        sent_any = true;
+        header.count = count;
+        header.send_time = now_nanos();
+        market_data::encode_header(header, packet.data());
+
+        append_frame(reply, packet);
+        packet.clear();
+        count = 0;
+    };
+
+    auto append = [&](const Message& message) {
+        auto size = market_data::message_size(message.type);
+
+        if (packet.size() + size > config_.max_datagram)
+            send_packet();
+
+        if (packet.empty())
+            packet.resize(market_data::HEADER_SIZE);
+
+        auto offset = packet.size();
+        packet.resize(offset + size);
+        market_data::encode_message(message, packet.data() + offset);
+        count++;
+    };
+
+    Message level;
+    level.type = MessageType::LEVEL;
+
+    for (const auto& [product_id, state] : books_) {
+        level.venue = state.top.venue;
+        level.flags = market_data::MESSAGE_SNAPSHOT;
+        level.timestamp = state.top.timestamp;
+        level.id = state.top.id;
+        level.product = state.top.product;
+
+        auto append_side = [&](const auto& side, exchanges::Side which) {
+            level.side = static_cast<uint8_t>(which);
+
+            for (const auto& [price, size] : side) {
+                level.values[0] = price;
+                level.values[1] = size;
+                append(level);
+            }
+        };
+
+        append_side(state.bids, exchanges::Side::BID);
+        append_side(state.asks, exchanges::Side::ASK);
+
+        Message top = state.top;
+        top.flags = market_data::MESSAGE_SNAPSHOT;
+        append(top);
+    }
+
+    send_packet();
+    stats_.snapshots++;
+}
+
+void
+MulticastSink::send_retransmission_(std::string& reply, uint64_t first, uint64_t last)
+{
+    // The flags are patched in the reply, so kept packets stay as they were sent
+    for (const auto& kept : sent_) {
+        if (kept.last < first || kept.first > last)
+            continue;
+
+        auto offset = reply.size() + sizeof(uint32_t);
+        append_frame(reply, kept.data);
+        packed::detail::put<uint8_t>(
+            &reply[offset + 5], market_data::PACKET_RETRANSMIT
+        );
+    }
+
+    stats_.retransmissions++;
+}
+
+} // namespace storage
+} // namespace raccoon
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "common.hpp"
+#include "sink.hpp"
+
+#include <netinet/in.h>
+#include <raccoon/market_data.hpp>
+
+#include <chrono>
+#include <deque>
+#include <map>
+
+namespace raccoon {
+namespace storage {
+
+struct multicast_config {
+    std::string group = MULTICAST_GROUP; // or any unicast address
+    int port = MULTICAST_PORT;
+    std::string interface = "127.0.0.1"; // local address to send and listen on
+    int ttl = 1;                         // 1 keeps datagrams on the local segment
+    uint16_t channel = 0;
+
+    size_t max_datagram = MULTICAST_MAX_DATAGRAM;
+
+    // TCP port for snapshots and retransmissions: 0 for any free one, -1 for none
+    int recovery_port = -1;
+    size_t retransmit_packets = MULTICAST_RETRANSMIT_PACKETS; // packets kept
+
+    // Recovery clients that take longer to ask and read the reply are dropped
+    std::chrono::milliseconds recovery_timeout{MULTICAST_RECOVERY_TIMEOUT_MS};
+};
+
+/**
+ * Counters of a multicast sink.
+ */
+struct multicast_stats {
+    uint64_t packets = 0;
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    uint64_t send_errors = 0;
+    uint64_t snapshots = 0;
+    uint64_t retransmissions = 0;
+    uint64_t slow_clients = 0; // recovery clients dropped on timeout
+};
+
+/**
+ * Sends book changes, trades and feed statuses as binary market data over UDP
+ * multicast.
+ *
+ * The format is in raccoon/market_data.hpp. Messages are packed into datagrams of
+ * up to `max_datagram` bytes, sent when full or on flush(), so a batch of events
+ * costs a few sends. Every message takes the channel's next sequence number.
+ *
+ * If `recovery_port` is set, receivers that joined late or missed packets can ask
+ * a TCP socket for a snapshot of every book, or for recent packets again. The
+ * socket is served between batches and when idle, on the sink's own thread, so
+ * run this sink in an AsyncSink. Replies are written as clients read them, and
+ * clients slower than `recovery_timeout` are dropped, so none can hold it up.
+ */
+class MulticastSink {
+    // A packet kept for retransmission
+    struct sent_packet {
+        uint64_t first;
+        uint64_t last;
+        std::string data;
+    };
+
+    // A book as sent, for snapshots
+    struct book_state {
+        std::map<int64_t, int64_t> bids;
+        std::map<int64_t, int64_t> asks;
+        market_data::Message top;
+    };
+
+    // A recovery connection, until its reply is written
+    struct recovery_client {
+        int fd = -1;
+        std::string request;
+        std::string reply;
+        size_t written = 0;
+        bool replied = false;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    multicast_config config_;
+
+    int socket_ = -1;
+    sockaddr_in destination_{};
+    int listener_ = -1;
+    int recovery_port_ = -1;
+
+    // Packet being filled
+    std::string packet_;
+    uint16_t count_ = 0;
+    uint64_t first_sequence_ = 1;
+    uint64_t next_sequence_ = 1;
+
+    std::deque<sent_packet> sent_;
+    std::unordered_map<std::string, book_state> books_;
+    std::vector<recovery_client> clients_;
+
+    // Reused between calls
+    std::string key_;
+    market_data::Message message_;
+
+    multicast_stats stats_;
+
+public:
+    /**
+     * Open the sockets. Errors are logged, and leave the sink dropping everything.
+     */
+    explicit MulticastSink(multicast_config config);
+
+    ~MulticastSink();
+
+    MulticastSink(const MulticastSink&) = delete;
+    MulticastSink(MulticastSink&&) = delete;
+    MulticastSink& operator=(const MulticastSink&) = delete;
+    MulticastSink& operator=(MulticastSink&&) = delete;
+
+    void on_book(const BookChange& book);
+    void on_trade(const exchanges::Trade& trade);
+    void on_status(const FeedStatus& status);
+
+    /**
+     * Send the packet being filled, then serve recovery requests.
+     */
+    void flush();
+
+    /**
+     * Serve recovery requests, when there's nothing else to do.
+     */
+    void idle();
+
+    /**
+     * If the sockets opened.
+     */
+    [[nodiscard]] bool
+    ok() const noexcept
+    {
+        return socket_ >= 0;
+    }
+
+    /**
+     * The recovery socket's port, -1 if there's none.
+     */
+    [[nodiscard]] int
+    recovery_port() const noexcept
+    {
+        return recovery_port_;
+    }
+
+    [[nodiscard]] const multicast_stats&
+    stats() const noexcept
+    {
+        return stats_;
+    }
+
+private:
+    bool open_recovery_();
+
+    void append_(const market_data::Message& message);
+    void send_();
+
+    void serve_recovery_();
+    void reply_(std::string& reply, std::string_view request);
+    void send_snapshot_(std::string& reply);
+    void send_retransmission_(std::string& reply, uint64_t first, uint64_t last);
+};
+
+} // namespace storage
+} // namespace raccoon
@@ -0,0 +1,37 @@
+#include "notify.hpp"
+
+namespace raccoon {
+namespace storage {
+
+Notification::Notification(
+    NotifyMode mode, std::string_view product_id, std::pmr::memory_resource* memory
+) :
+    command_(mode == NotifyMode::STREAM ? "XADD" : "PUBLISH", memory),
+    mode_(mode),
+    message_(memory)
+{
+    command_.arg_format("{}-NOTIFY", product_id);
+
+    if (mode_ == NotifyMode::STREAM)
+        command_.arg("MAXLEN").arg("~").arg(NOTIFY_STREAM_MAXLEN).arg("*");
+
+    // Every field is written with a leading comma, replaced when finished
+    message_ = "{";
+}
+
+RedisCommand
+Notification::finish() &&
+{
+    if (mode_ != NotifyMode::STREAM) {
+        if (message_.size() > 1)
+            message_.erase(1, 1);
+
+        message_ += '}';
+        command_.arg(message_);
+    }
+
+    return std::move(command_);
+}
+
+} // namespace storage
+} // namespace raccoon
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "common.hpp"
+#include "redis.hpp"
+
+#include <concepts>
+#include <string>
+#include <string_view>
+
+namespace raccoon {
+namespace storage {
+
+/**
+ * How readers are told that a product changed, so they don't have to poll.
+ */
+enum class NotifyMode : uint8_t {
+    NONE,    // nothing is sent
+    PUBLISH, // a JSON message on the {product}-NOTIFY channel
+    STREAM,  // an entry in the {product}-NOTIFY stream, capped at NOTIFY_STREAM_MAXLEN
+};
+
+/**
+ * Name of a mode, as the NOTIFY environment variable takes it.
+ */
+constexpr std::string_view
+notify_mode_name(NotifyMode mode) noexcept
+{
+    switch (mode) {
+        case NotifyMode::PUBLISH:
+            return "publish";
+        case NotifyMode::STREAM:
+            return "stream";
+        default:
+            return "none";
+    }
+}
+
+/**
+ * Builds one notification command, to send in the same pipeline as the write it
+ * announces, on the {product}-NOTIFY channel or stream.
+ *
+ * Fields become the members of a flat JSON object for PUBLISH, or the fields of a
+ * stream entry. Strings aren't escaped, so they must be plain names like product
+ * ids.
+ */
+class Notification {
+    RedisCommand command_;
+    NotifyMode mode_;
+    std::pmr::string message_; // JSON, for PUBLISH
+
+public:
+    /**
+     * @param mode Anything but NotifyMode::NONE.
+     * @param memory Where the command is built, as for RedisCommand.
+     */
+    Notification(
+        NotifyMode mode,
+        std::string_view product_id,
+        std::pmr::memory_resource* memory = std::pmr::get_default_resource()
+    );
+
+    Notification&
+    field(std::string_view name, std::string_view value)
+    {
+        if (mode_ == NotifyMode::STREAM)
+            command_.field(name, value);
+        else
+            fmt::format_to(std::back_inserter(message_), ",\"{}\":\"{}\"", name, value);
+
+        return *this;
+    }
+
+    template <class T>
+    requires std::integral<T> || std::floating_point<T>
+    Notification&
+    field(std::string_view name, T value)
+    {
+        if (mode_ == NotifyMode::STREAM)
+            command_.field(name, value);
+        else
+            fmt::format_to(std::back_inserter(message_), ",\"{}\":{}", name, value);
+
+        return *this;
+    }
+
+    /**
+     * The command to send, after the last field.
+     */
+    RedisCommand finish() &&;
+};
+
+} // namespace storage
+} // namespace raccoon
@@ -1,103 +1,901 @@
 #include "orderbook.hpp"
 
+#include "exchanges/symbols.hpp"
+#include "redis.hpp"
+#include "utils/fixed_point.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
 namespace raccoon {
 namespace storage {
 
+// A level's hash node and bucket, with room for chunks the pool hasn't filled
+static constexpr size_t RESERVED_LEVEL_BYTES = 64;
+
+// The pool's own bookkeeping, whatever the books hold
+static constexpr size_t RESERVED_POOL_BYTES = 1 << 16;
+
+// Sizes round to zero below this, at the precision they're parsed and packed with
+static constexpr double MIN_LEVEL_SIZE = 0.5 / static_cast<double>(utils::Fixed::SCALE);
+
+void
+OrderbookProcessor::reserve(
+    size_t products, size_t depth, const utils::MemoryOptions& options
+)
+{
+    // Both sides of every book
+    auto levels = products * depth * 2;
+
+    reserved_.reserve(
+        "book levels", levels * RESERVED_LEVEL_BYTES + RESERVED_POOL_BYTES, options
+    );
+    reserved_depth_ = depth;
+
+    orderbook_.reserve(products);
+}
+
+void
+OrderbookProcessor::set_depth_limits(const depth_limits& limits)
+{
+    limits_ = limits;
+
+    // Never fewer than packed books and the features need
+    auto min_levels = std::max<size_t>(packed_depth_, 2 * BOOK_FEATURE_DEPTH);
+
+    if (limits_.max_levels > 0 && limits_.max_levels < min_levels) {
+        log_w(main, "Keeping {} levels, not {}", min_levels, limits.max_levels);
+        limits_.max_levels = min_levels;
+    }
+
+    log_i(
+        main,
+        "Keeping {} levels per side, {} from the mid",
+        limits_.max_levels,
+        limits_.max_distance
+    );
+}
+
+void
+OrderbookProcessor::set_format(BookFormat format, size_t packed_depth)
+{
+    format_ = format;
+    packed_depth_ = packed_depth;
+
+    // Sorted sets are written incrementally, so start them over
+    for (auto& [product_id, tracker] : orderbook_) {
+        tracker.unwritten_bids.clear();
+        tracker.unwritten_asks.clear();
+        tracker.unwritten_reset = true;
+
+        keep_top_levels_(tracker);
+    }
+}
+
+void
+OrderbookProcessor::keep_top_levels_(product_tracker& tracker) const
+{
+    // Packed books are cut from the best levels, rather than sorting the sides
+    auto levels = format_ == BookFormat::PACKED ? packed_depth_ : 0;
+
+    tracker.top_bids.keep(levels, tracker.bids);
+    tracker.top_asks.keep(levels, tracker.asks);
+}
+
 void
 OrderbookProcessor::ob_to_redis(redisContext* redis, const std::string& product_id)
 {
-    log_d(main, "Pushing orderbook {} to redis", product_id);
+    log_d_sampled(main, "Pushing orderbook {} to redis", product_id);
 
-    product_tracker tracker = orderbook_[product_id];
-    map_to_redis_(redis, tracker.asks, product_id + "-ASKS");
-    map_to_redis_(redis, tracker.bids, product_id + "-BIDS");
+    auto it = orderbook_.find(product_id);
+    if (it == orderbook_.end()) [[unlikely]]
+        return;
+
+    auto& tracker = it->second;
+
+    // Queued behind the book's writes, so whoever is told of them finds them done
+    std::pmr::vector<RedisCommand> after(scratch_);
+    features_commands_(product_id, tracker, after);
+
+    if (format_ == BookFormat::PACKED) {
+        packed_to_redis_(redis, product_id, tracker, after);
+        return;
+    }
+
+    if (format_ == BookFormat::ZSET) {
+        zset_to_redis_(redis, product_id, tracker, after);
+        return;
+    }
+
+    std::pmr::string key(scratch_);
+    bool replace = tracker.unwritten_reset;
+
+    fmt::format_to(std::back_inserter(key), "{}-ASKS", product_id);
+    bool ok =
+        map_to_redis_(redis, tracker.asks, key, tracker.removed_asks, replace, {});
+
+    key.clear();
+    fmt::format_to(std::back_inserter(key), "{}-BIDS", product_id);
+    ok = map_to_redis_(
+             redis, tracker.bids, key, tracker.removed_bids, replace, after
+         )
+         && ok;
+
+    // On failure, the removals are kept for the next write
+    if (!ok) [[unlikely]]
+        return;
+
+    tracker.removed_asks.clear();
+    tracker.removed_bids.clear();
+    tracker.unwritten_reset = false;
 }
 
 void
-OrderbookProcessor::process_incoming_update(const OrderbookUpdate& newUpdate)
+OrderbookProcessor::features_commands_(
+    const std::string& product_id,
+    const product_tracker& tracker,
+    std::pmr::vector<RedisCommand>& commands
+)
 {
-    log_d(main, "Processing incoming update for {}", newUpdate.product_id);
+    const auto& features = tracker.features;
+
+    RedisCommand cmd("HSET", scratch_);
+    cmd.arg_format("{}-L1", product_id)
+        .field("valid", static_cast<int>(features.valid))
+        .field("bid", features.bid)
+        .field("bid_size", features.bid_size)
+        .field("ask", features.ask)
+        .field("ask_size", features.ask_size)
+        .field("spread", features.spread)
+        .field("mid", features.mid)
+        .field("microprice", features.microprice)
+        .field("bid_depth", features.bid_depth)
+        .field("ask_depth", features.ask_depth)
+        .field("imbalance", features.imbalance);
+
+    commands.push_back(std::move(cmd));
 
-    auto [it, inserted] = orderbook_.emplace(newUpdate.product_id, product_tracker());
+    if (notify_ == NotifyMode::NONE) [[likely]]
+        return;
+
+    Notification notification(notify_, product_id, scratch_);
+    notification.field("type", "book")
+        .field("product", product_id)
+        .field("venue", exchanges::venue_name(tracker.venue))
+        .field("sequence", tracker.sequence)
+        .field("timestamp", tracker.timestamp)
+        .field("valid", static_cast<int>(features.valid))
+        .field("bid", features.bid)
+        .field("bid_size", features.bid_size)
+        .field("ask", features.ask)
+        .field("ask_size", features.ask_size);
+
+    commands.push_back(std::move(notification).finish());
+}
+
+product_tracker&
+OrderbookProcessor::tracker_(exchanges::Venue venue, const std::string& product_id)
+{
+    auto [it, inserted] = orderbook_.try_emplace(product_id, &memory_);
     product_tracker& tracker = it->second;
 
-    auto updateOrderbook =
-        [](std::unordered_map<double, double>& orderSide, double price, double volume) {
-            if (volume <= std::numeric_limits<double>::epsilon()) {
-                orderSide.erase(price);
-            }
-            else {
-                auto [iterator, insert] = orderSide.emplace(price, volume);
-                if (!insert) {
-                    iterator->second += volume;
-                }
+    if (inserted) [[unlikely]] {
+        tracker.venue = venue;
+        tracker.symbol = exchanges::normalize_symbol(venue, product_id);
+        keep_top_levels_(tracker);
+
+        if (reserved_depth_ > 0) {
+            tracker.bids.reserve(reserved_depth_);
+            tracker.asks.reserve(reserved_depth_);
+
+            if (format_ == BookFormat::ZSET) {
+                tracker.unwritten_bids.reserve(reserved_depth_);
+                tracker.unwritten_asks.reserve(reserved_depth_);
             }
-        };
+        }
+    }
+
+    return tracker;
+}
+
+const product_tracker&
+OrderbookProcessor::process_incoming_update(const exchanges::BookDelta& delta)
+{
+    log_d_sampled(main, "Processing incoming update for {}", delta.product_id);
+
+    product_tracker& tracker = tracker_(delta.venue, delta.product_id);
+    changes_.clear();
 
-    for (const auto& change : newUpdate.changes) {
-        bool isBuy = std::get<0>(change) == "BUY";
-        double price = std::stod(std::get<1>(change));
-        double volume = std::stod(std::get<2>(change));
+    // Kept for the snapshot the book is rebuilding to, which it's already behind
+    if (tracker.rebuilding()) [[unlikely]] {
+        auto& build = *tracker.build;
 
-        updateOrderbook(isBuy ? tracker.bids : tracker.asks, price, volume);
+        if (build.stage == snapshot_build::Stage::INSERT)
+            build.deltas.push_back(delta);
+        else
+            apply_to_build_(build, delta);
+
+        return tracker;
     }
+
+    tracker.sequence = delta.sequence;
+    tracker.timestamp = delta.timestamp;
+
+    // Sizes are absolute, so replace the level (or drop it if empty)
+    auto updateOrderbook = [this, &tracker](
+                               level_map& orderSide,
+                               exchanges::Side side,
+                               double price,
+                               double volume
+                           ) {
+        if (volume < MIN_LEVEL_SIZE) {
+            auto level = orderSide.find(price);
+            if (level == orderSide.end())
+                return;
+
+            changes_.push_back({side, price, level->second, 0.0});
+            orderSide.erase(level);
+            removed_(tracker, side, price);
+        }
+        else {
+            auto [level, inserted] = orderSide.try_emplace(price, 0.0);
+            changes_.push_back({side, price, level->second, volume});
+            level->second = volume;
+        }
+    };
+
+    for (const auto& change : delta.changes) {
+        bool isBuy = change.side == exchanges::Side::BID;
+        updateOrderbook(
+            isBuy ? tracker.bids : tracker.asks, change.side, change.price, change.size
+        );
+    }
+
+    enforce_limits_(tracker, false);
+    follow_changes_(tracker);
+
+    return tracker;
 }
 
 void
-OrderbookProcessor::process_incoming_snapshot(const OrderbookSnapshot& newOb)
+OrderbookProcessor::follow_changes_(product_tracker& tracker)
 {
-    log_d(main, "Processing incoming snapshot for {}", newOb.product_id);
+    // Only a change to the best levels can move the features
+    for (const auto& change : changes_) {
+        if (change.side == exchanges::Side::BID)
+            tracker.top_bids.on_change(change.price, change.new_size, tracker.bids);
+        else
+            tracker.top_asks.on_change(change.price, change.new_size, tracker.asks);
+    }
 
-    auto [it, inserted] = orderbook_.emplace(newOb.product_id, product_tracker());
-    product_tracker& tracker = it->second;
+    tracker.features = compute_features(tracker.top_bids, tracker.top_asks);
+
+    // Keep the latest size of each changed level until the next write
+    if (format_ == BookFormat::ZSET && !tracker.unwritten_reset) {
+        for (const auto& change : changes_) {
+            auto& unwritten = change.side == exchanges::Side::BID
+                                  ? tracker.unwritten_bids
+                                  : tracker.unwritten_asks;
+
+            unwritten[change.price] = change.new_size;
+        }
+    }
+}
+
+const product_tracker&
+OrderbookProcessor::process_incoming_snapshot(const exchanges::BookSnapshot& snapshot)
+{
+    log_d(main, "Processing incoming snapshot for {}", snapshot.product_id);
+
+    product_tracker& tracker = tracker_(snapshot.venue, snapshot.product_id);
+    changes_.clear();
+
+    // A snapshot still being built is superseded, and its build with it
+    if (!tracker.build) {
+        auto it = orderbook_.find(snapshot.product_id);
+        building_.emplace_back(it->first, &tracker);
+    }
+
+    tracker.build = std::make_unique<snapshot_build>(&tracker.memory, snapshot);
+
+    // Shallow ones go in right away
+    size_t budget = SNAPSHOT_CHUNK_LEVELS;
+    build_(tracker, budget);
+
+    if (!tracker.build) {
+        std::erase_if(building_, [&tracker](const auto& entry) {
+            return entry.second == &tracker;
+        });
+    }
+
+    return tracker;
+}
+
+void
+OrderbookProcessor::continue_snapshots(
+    size_t levels, const snapshot_callback& on_applied
+)
+{
+    for (auto [product_id, tracker] : building_) {
+        if (levels == 0)
+            break;
+
+        // A swap's changes are its own, not whatever was applied last
+        changes_.clear();
+
+        if (build_(*tracker, levels) && on_applied)
+            on_applied(std::string(product_id), *tracker);
+    }
+
+    std::erase_if(building_, [](const auto& entry) { return !entry.second->build; });
+}
+
+/**
+ * If two sizes are the same, at the precision they're parsed with.
+ */
+static bool
+same_size(double lhs, double rhs) noexcept
+{
+    return std::abs(lhs - rhs) < MIN_LEVEL_SIZE;
+}
+
+bool
+OrderbookProcessor::build_(product_tracker& tracker, size_t& budget)
+{
+    using Stage = snapshot_build::Stage;
+
+    auto& build = *tracker.build;
+    bool swapped = false;
+
+    if (build.stage == Stage::INSERT) {
+        const auto& asks = build.snapshot.asks;
+        const auto& bids = build.snapshot.bids;
+        auto total = asks.size() + bids.size();
+
+        for (; build.inserted < total && budget > 0; build.inserted++, budget--) {
+            bool ask = build.inserted < asks.size();
+            const auto& level = ask ? asks[build.inserted]
+                                    : bids[build.inserted - asks.size()];
+
+            if (level.size < MIN_LEVEL_SIZE) [[unlikely]]
+                continue;
+
+            (ask ? build.asks : build.bids)[level.price] = level.size;
+
+            // Levels the live book already has as they are stay out of changes()
+            const auto& live = ask ? tracker.asks : tracker.bids;
+            auto it = live.find(level.price);
+
+            if (it == live.end() || !same_size(it->second, level.size))
+                (ask ? build.changed_asks : build.changed_bids).emplace(level.price, 0);
+        }
+
+        if (build.inserted < total)
+            return false;
+
+        // The snapshot's levels are in, so what came after it can go on top
+        for (const auto& delta : build.deltas)
+            apply_to_build_(build, delta);
+
+        build.deltas = {};
+        build.snapshot.bids = {};
+        build.snapshot.asks = {};
+
+        build.stage = Stage::DIFF;
+        build.diffing = exchanges::Side::ASK;
+        build.next_live = tracker.asks.begin();
+    }
+
+    if (build.stage == Stage::DIFF) {
+        while (budget > 0) {
+            bool ask = build.diffing == exchanges::Side::ASK;
+            const auto& live = ask ? tracker.asks : tracker.bids;
+
+            if (build.next_live == live.end()) {
+                if (!ask)
+                    break;
 
-    auto updateSnapshot =
-        [](std::unordered_map<double, double>& orderSide,
-           const std::vector<std::tuple<std::string, std::string>>& orders) {
-            for (const auto& order : orders) {
-                double price = std::stod(std::get<0>(order));
-                double volume = std::stod(std::get<1>(order));
-                orderSide[price] = volume;
+                build.diffing = exchanges::Side::BID;
+                build.next_live = tracker.bids.begin();
+                continue;
             }
-        };
 
-    updateSnapshot(tracker.asks, newOb.asks);
-    updateSnapshot(tracker.bids, newOb.bids);
+            auto price = build.next_live->first;
+
+            if (!(ask ? build.asks : build.bids).contains(price))
+                (ask ? build.changed_asks : build.changed_bids).emplace(price, 0);
+
+            ++build.next_live;
+            budget--;
+        }
+
+        bool done = build.diffing == exchanges::Side::BID
+                    && build.next_live == tracker.bids.end();
+
+        if (!done)
+            return false;
+
+        swap_(tracker);
+        swapped = true;
+    }
+
+    // Chunks of the old book at a time, from the front since erasing is cheap there
+    for (auto* side : {&build.asks, &build.bids}) {
+        auto count = std::min(budget, side->size());
+        auto last = std::next(side->begin(), static_cast<ptrdiff_t>(count));
+
+        side->erase(side->begin(), last);
+        budget -= count;
+    }
+
+    if (build.asks.empty() && build.bids.empty())
+        tracker.build.reset();
+
+    return swapped;
+}
+
+void
+OrderbookProcessor::apply_to_build_(
+    snapshot_build& build, const exchanges::BookDelta& delta
+)
+{
+    for (const auto& change : delta.changes) {
+        bool bid = change.side == exchanges::Side::BID;
+        auto& side = bid ? build.bids : build.asks;
+
+        if (change.size < MIN_LEVEL_SIZE)
+            side.erase(change.price);
+        else
+            side[change.price] = change.size;
+
+        (bid ? build.changed_bids : build.changed_asks).emplace(change.price, 0);
+    }
+
+    build.sequence = delta.sequence;
+    build.timestamp = delta.timestamp;
+}
+
+void
+OrderbookProcessor::swap_(product_tracker& tracker)
+{
+    auto& build = *tracker.build;
+
+    // Only the prices that may differ are compared
+    auto diff = [this](
+                    exchanges::Side side,
+                    const level_map& changed,
+                    const level_map& live,
+                    const level_map& built
+                ) {
+        for (const auto& [price, unused] : changed) {
+            auto old_level = live.find(price);
+            auto new_level = built.find(price);
+
+            auto old_size = old_level != live.end() ? old_level->second : 0.0;
+            auto new_size = new_level != built.end() ? new_level->second : 0.0;
+
+            if (!same_size(old_size, new_size))
+                changes_.push_back({side, price, old_size, new_size});
+        }
+    };
+
+    diff(exchanges::Side::ASK, build.changed_asks, tracker.asks, build.asks);
+    diff(exchanges::Side::BID, build.changed_bids, tracker.bids, build.bids);
+
+    // All at once, so nothing ever sees half of each
+    tracker.asks.swap(build.asks);
+    tracker.bids.swap(build.bids);
+    tracker.sequence = build.sequence;
+    tracker.timestamp = build.timestamp;
+
+    build.changed_asks = level_map(&tracker.memory);
+    build.changed_bids = level_map(&tracker.memory);
+    build.stage = snapshot_build::Stage::RETIRE;
+
+    for (const auto& change : changes_) {
+        if (change.new_size <= 0.0)
+            removed_(tracker, change.side, change.price);
+    }
+
+    enforce_limits_(tracker, true);
+    follow_changes_(tracker);
 }
 
 void
+OrderbookProcessor::removed_(
+    product_tracker& tracker, exchanges::Side side, double price
+)
+{
+    if (format_ != BookFormat::HASH || tracker.unwritten_reset)
+        return;
+
+    auto& removed =
+        side == exchanges::Side::BID ? tracker.removed_bids : tracker.removed_asks;
+    removed.push_back(price);
+
+    // Replacing the book is cheaper than removing more levels than it holds
+    auto levels = tracker.bids.size() + tracker.asks.size();
+
+    if (removed.size() > levels + BOOK_TRIM_SLACK) [[unlikely]] {
+        tracker.removed_bids.clear();
+        tracker.removed_asks.clear();
+        tracker.unwritten_reset = true;
+    }
+}
+
+void
+OrderbookProcessor::enforce_limits_(product_tracker& tracker, bool force)
+{
+    auto keep = limits_.max_levels;
+    bool limited = keep > 0 || limits_.max_distance > 0;
+
+    // Over budget, books over their share are cut down to it
+    bool over_budget = budget_ > 0 && memory_.bytes() > budget_;
+    auto share = over_budget ? budget_ / orderbook_.size() : 0;
+
+    if (over_budget && tracker.memory.bytes() > share) [[unlikely]] {
+        auto levels = tracker.bids.size() + tracker.asks.size();
+        auto min_levels = std::max<size_t>(packed_depth_, 2 * BOOK_FEATURE_DEPTH);
+        auto fit = std::max(levels * share / tracker.memory.bytes() / 2, min_levels);
+
+        if (!tracker.over_budget) {
+            log_w(
+                main,
+                "Books take {} bytes, over the budget of {}; keeping {} levels per "
+                "side of {}, which takes {}",
+                memory_.bytes(),
+                budget_,
+                fit,
+                tracker.symbol,
+                tracker.memory.bytes()
+            );
+        }
+
+        tracker.over_budget = true;
+        keep = keep > 0 ? std::min(keep, fit) : fit;
+        limited = true;
+        force = true;
+    }
+    else {
+        tracker.over_budget = false;
+    }
+
+    if (!limited) [[likely]]
+        return;
+
+    // A batch at a time, once a side grew past its last trim or the limit
+    auto due = [&](const level_map& side, size_t& trimmed) {
+        trimmed = std::min(trimmed, side.size());
+
+        if (side.size() <= trimmed + BOOK_TRIM_SLACK && !force)
+            return false;
+
+        return force || limits_.max_distance > 0 || side.size() > keep;
+    };
+
+    if (due(tracker.bids, tracker.trimmed_bids)) {
+        trim_side_<std::greater<>>(tracker, tracker.bids, exchanges::Side::BID, keep);
+        tracker.trimmed_bids = tracker.bids.size();
+    }
+
+    if (due(tracker.asks, tracker.trimmed_asks)) {
+        trim_side_<std::less<>>(tracker, tracker.asks, exchanges::Side::ASK, keep);
+        tracker.trimmed_asks = tracker.asks.size();
+    }
+}
+
+template <class Compare>
+void
+OrderbookProcessor::trim_side_(
+    product_tracker& tracker, level_map& side, exchanges::Side which, size_t keep
+)
+{
+    sorted_.clear();
+
+    for (const auto& [price, size] : side)
+        sorted_.push_back({price, size});
+
+    auto by_price = [](const auto& lhs, const auto& rhs) {
+        return Compare{}(lhs.price, rhs.price);
+    };
+
+    // The best levels are always kept, however far from the mid
+    auto min_levels = std::max<size_t>(packed_depth_, 2 * BOOK_FEATURE_DEPTH);
+    auto first = sorted_.begin();
+    auto kept = sorted_.end();
+
+    if (sorted_.size() > min_levels) {
+        first += static_cast<ptrdiff_t>(min_levels);
+        std::nth_element(sorted_.begin(), first, sorted_.end(), by_price);
+    }
+    else {
+        first = sorted_.end();
+    }
+
+    const auto& features = tracker.features;
+
+    if (limits_.max_distance > 0 && features.valid) {
+        auto max_distance = limits_.max_distance * features.mid;
+
+        kept = std::partition(first, kept, [&](const exchanges::PriceLevel& level) {
+            return std::abs(level.price - features.mid) <= max_distance;
+        });
+    }
+
+    if (keep > 0 && kept - sorted_.begin() > static_cast<ptrdiff_t>(keep)) {
+        auto last = sorted_.begin() + static_cast<ptrdiff_t>(keep);
+        std::nth_element(sorted_.begin(), last, kept, by_price);
+        kept = last;
+    }
+
+    for (auto it = kept; it != sorted_.end(); ++it) {
+        changes_.push_back({which, it->price, it->size, 0.0});
+        side.erase(it->price);
+        removed_(tracker, which, it->price);
+    }
+
+    auto dropped = static_cast<size_t>(sorted_.end() - kept);
+    trimmed_ += dropped;
+
+    // Buckets aren't given back as levels go, so give back those of most of a side
+    if (dropped > side.size())
+        side.rehash(0);
+}
+
+bool
 OrderbookProcessor::map_to_redis_(
     redisContext* redis,
-    const std::unordered_map<double, double>& table,
-    const std::string& map_id
+    const level_map& table,
+    std::string_view map_id,
+    std::span<const double> removed,
+    bool replace,
+    std::span<const RedisCommand> after
 )
 {
-    std::vector<const char*> argv;
+    std::pmr::vector<const char*> argv(scratch_);
+    std::pmr::vector<size_t> argv_len(scratch_);
     argv.reserve(2 * table.size() + 2);
+    argv_len.reserve(2 * table.size() + 2);
 
     argv.push_back("HMSET");
-    argv.push_back(map_id.c_str());
+    argv_len.push_back(5); // NOLINT(*-magic-numbers)
+    argv.push_back(map_id.data());
+    argv_len.push_back(map_id.size());
 
-    std::vector<std::string> kvPairs; // container for strings
-    kvPairs.reserve(2 * table.size());
+    // Formatted as std::to_string did, into one buffer; pointers into it are only
+    // taken once it's done growing
+    std::pmr::string fields(scratch_);
+    fields.reserve(2 * table.size() * 16); // NOLINT(*-magic-numbers)
 
-    for (const auto& pair : table) {
-        kvPairs.push_back(std::to_string(pair.first));
-        kvPairs.push_back(std::to_string(pair.second));
-        argv.push_back(kvPairs[kvPairs.size() - 2].c_str());
-        argv.push_back(kvPairs[kvPairs.size() - 1].c_str());
+    for (const auto& [price, size] : table) {
+        for (auto value : {price, size}) {
+            auto start = fields.size();
+            fmt::format_to(std::back_inserter(fields), "{:f}", value);
+            argv_len.push_back(fields.size() - start);
+        }
     }
 
-    redisReply* reply = static_cast<redisReply*>(
-        redisCommandArgv(redis, static_cast<int>(argv.size()), argv.data(), NULL)
+    size_t offset = 0;
+
+    for (auto len : std::span(argv_len).subspan(2)) {
+        argv.push_back(fields.data() + offset); // NOLINT(*-pointer-arithmetic)
+        offset += len;
+    }
+
+    // Levels gone from the book go from the hash in the same transaction
+    std::pmr::vector<RedisCommand> before(scratch_);
+
+    if (replace || !removed.empty()) {
+        before.emplace_back("MULTI", scratch_);
+
+        auto& remove = before.emplace_back(replace ? "DEL" : "HDEL", scratch_);
+        remove.arg(map_id);
+
+        for (auto price : replace ? std::span<const double>() : removed)
+            remove.arg_format("{:f}", price);
+    }
+
+    size_t replies = 0;
+
+    for (const auto& command : before) {
+        if (!command.append_to(redis)) [[unlikely]] {
+            log_e(redis, "Error queueing command: {}", redis->errstr);
+            return false;
+        }
+
+        replies++;
+    }
+
+    // An empty book has no fields to set
+    if (!table.empty()) {
+        auto err = redisAppendCommandArgv(
+            redis, static_cast<int>(argv.size()), argv.data(), argv_len.data()
+        );
+
+        if (err != REDIS_OK) [[unlikely]] {
+            log_e(redis, "Error queueing command: {}", redis->errstr);
+            return false;
+        }
+
+        replies++;
+    }
+
+    if (!before.empty()) {
+        RedisCommand("EXEC", scratch_).append_to(redis);
+        replies++;
+    }
+
+    for (const auto& command : after) {
+        if (!command.append_to(redis)) [[unlikely]] {
+            log_e(redis, "Error queueing command: {}", redis->errstr);
+            break;
+        }
+
+        replies++;
+    }
+
+    return redis_replies(redis, replies);
+}
+
+void
+OrderbookProcessor::pack_side_(
+    std::span<const exchanges::PriceLevel> levels, std::vector<packed::Level>& out
+)
+{
+    static_assert(packed::EXPONENT == -utils::Fixed::DIGITS);
+    constexpr auto SCALE = static_cast<double>(utils::Fixed::SCALE);
+
+    out.clear();
+
+    for (const auto& level : levels) {
+        out.push_back({
+            .price = std::llround(level.price * SCALE),
+            .size = std::llround(level.size * SCALE),
+        });
+    }
+}
+
+void
+OrderbookProcessor::packed_to_redis_(
+    redisContext* redis,
+    const std::string& product_id,
+    const product_tracker& tracker,
+    std::span<const RedisCommand> after
+)
+{
+    packed_.venue = static_cast<uint8_t>(tracker.venue);
+    packed_.sequence = tracker.sequence;
+    packed_.timestamp = tracker.timestamp;
+
+    // Kept sorted on every change, and at least this deep; see keep_top_levels_()
+    pack_side_(tracker.top_bids.top(packed_depth_), packed_.bids);
+    pack_side_(tracker.top_asks.top(packed_depth_), packed_.asks);
+
+    packed::encode(packed_, packed_buffer_);
+
+    std::pmr::string key(scratch_);
+    fmt::format_to(std::back_inserter(key), "{}-BOOK", product_id);
+
+    std::array<const char*, 3> argv{"SET", key.data(), packed_buffer_.data()};
+    std::array<size_t, 3> argv_len{3, key.size(), packed_buffer_.size()};
+
+    auto err = redisAppendCommandArgv(
+        redis, static_cast<int>(argv.size()), argv.data(), argv_len.data()
     );
 
-    if (reply == nullptr) {
-        log_e(main, "Error: %s\n", redis->errstr);
+    if (err != REDIS_OK) [[unlikely]] {
+        log_e(redis, "Error writing packed book {}: {}", product_id, redis->errstr);
+        return;
+    }
+
+    size_t replies = 1;
+
+    for (const auto& command : after) {
+        if (!command.append_to(redis)) [[unlikely]] {
+            log_e(redis, "Error queueing command: {}", redis->errstr);
+            break;
+        }
+
+        replies++;
+    }
+
+    if (!redis_replies(redis, replies)) [[unlikely]]
+        log_e(redis, "Error writing packed book {}", product_id);
+}
+
+/**
+ * Queue the writes of some levels of one side: ZADD and HSET of those with a size,
+ * ZREM and HDEL of those without.
+ *
+ * Members are prices, scored by themselves. Their sizes go in a hash beside the
+ * sorted set, with the same prices as fields.
+ */
+static void
+zset_side(
+    std::pmr::vector<RedisCommand>& commands,
+    std::string_view key,
+    const level_map& levels
+)
+{
+    auto* memory = commands.get_allocator().resource();
+
+    RedisCommand zadd("ZADD", memory);
+    RedisCommand hset("HSET", memory);
+    RedisCommand zrem("ZREM", memory);
+    RedisCommand hdel("HDEL", memory);
+
+    zadd.arg(key);
+    hset.arg_format("{}-SIZES", key);
+    zrem.arg(key);
+    hdel.arg_format("{}-SIZES", key);
+
+    for (const auto& [price, size] : levels) {
+        if (size > 0) {
+            zadd.arg(price).arg(price);
+            hset.field(price, size);
+        }
+        else {
+            zrem.arg(price);
+            hdel.arg(price);
+        }
+    }
+
+    // Only those with levels, after the key
+    for (auto* command : {&zadd, &hset, &zrem, &hdel}) {
+        if (command->size() > 2)
+            commands.push_back(std::move(*command));
+    }
+}
+
+void
+OrderbookProcessor::zset_to_redis_(
+    redisContext* redis,
+    const std::string& product_id,
+    product_tracker& tracker,
+    std::span<const RedisCommand> after
+)
+{
+    std::pmr::string bids_key(scratch_);
+    std::pmr::string asks_key(scratch_);
+    fmt::format_to(std::back_inserter(bids_key), "{}-ZBIDS", product_id);
+    fmt::format_to(std::back_inserter(asks_key), "{}-ZASKS", product_id);
+
+    std::pmr::vector<RedisCommand> commands(scratch_);
+    commands.emplace_back("MULTI", scratch_);
+
+    if (tracker.unwritten_reset) {
+        RedisCommand del("DEL", scratch_);
+        del.arg(bids_key).arg_format("{}-SIZES", bids_key);
+        del.arg(asks_key).arg_format("{}-SIZES", asks_key);
+        commands.push_back(std::move(del));
+
+        zset_side(commands, bids_key, tracker.bids);
+        zset_side(commands, asks_key, tracker.asks);
+    }
+    else {
+        zset_side(commands, bids_key, tracker.unwritten_bids);
+        zset_side(commands, asks_key, tracker.unwritten_asks);
+    }
+
+    // Nothing changed, but the L1 hash is written all the same
+    if (commands.size() == 1)
+        commands.clear();
+    else
+        commands.emplace_back("EXEC", scratch_);
+
+    commands.insert(commands.end(), after.begin(), after.end());
+
+    // On failure, the changes are kept for the next write
+    if (!redis_pipeline(redis, commands)) [[unlikely]] {
+        log_e(redis, "Error writing sorted set book {}", product_id);
         return;
     }
 
-    freeReplyObject(reply);
+    tracker.unwritten_bids.clear();
+    tracker.unwritten_asks.clear();
+    tracker.unwritten_reset = false;
 }
+
 } // namespace storage
 } // namespace raccoon
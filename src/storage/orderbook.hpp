@@ -1,79 +1,496 @@
+#pragma once
+
 #include "common.hpp"
+#include "exchanges/events.hpp"
+#include "notify.hpp"
+#include "top_of_book.hpp"
+#include "utils/counting_resource.hpp"
+#include "utils/reserved_memory.hpp"
 
-#include <glaze/glaze.hpp>
 #include <hiredis/hiredis.h>
+#include <raccoon/packed_book.hpp>
+
+#include <functional>
+#include <memory_resource>
+#include <span>
+#include <string_view>
 
 namespace raccoon {
 namespace storage {
 
+/**
+ * Sizes by price, of one side of a book.
+ */
+using level_map = std::pmr::unordered_map<double, double>;
+
+/**
+ * A snapshot being built beside the live book it replaces, a chunk at a time, so a
+ * deep one doesn't hold the loop up. Deltas wait for it, and prices that may differ
+ * from the live book are collected as it goes, so the swap only touches those.
+ */
+struct snapshot_build {
+    enum class Stage : uint8_t {
+        INSERT, // the snapshot's levels go in, while deltas are held back
+        DIFF,   // live levels the snapshot lacks are found, deltas go straight in
+        RETIRE, // swapped in, and the old levels are freed
+    };
+
+    Stage stage = Stage::INSERT;
+
+    exchanges::BookSnapshot snapshot;
+    size_t inserted = 0; // of the snapshot's levels, asks then bids
+
+    // The new book, then the old one once swapped
+    level_map bids;
+    level_map asks;
+
+    // Prices that may differ between the two, mapped to nothing
+    level_map changed_bids;
+    level_map changed_asks;
+
+    std::vector<exchanges::BookDelta> deltas;
+
+    // The next live level to look for in the new book
+    exchanges::Side diffing = exchanges::Side::ASK;
+    level_map::const_iterator next_live;
+
+    // Of the last snapshot or delta applied
+    uint64_t sequence;
+    int64_t timestamp;
+
+    snapshot_build(
+        std::pmr::memory_resource* levels, const exchanges::BookSnapshot& from
+    ) :
+        snapshot(from),
+        bids(levels),
+        asks(levels),
+        changed_bids(levels),
+        changed_asks(levels),
+        sequence(from.sequence),
+        timestamp(from.timestamp)
+    {
+        bids.reserve(from.bids.size());
+        asks.reserve(from.asks.size());
+    }
+};
+
 struct product_tracker {
-    std::unordered_map<double, double> bids;
-    std::unordered_map<double, double> asks;
+    exchanges::Venue venue{};
+    std::string symbol; // normalized symbol, for cross-venue views
+
+    // Of the last snapshot or update applied
+    uint64_t sequence = 0;
+    int64_t timestamp = 0;
+
+    // What the book's levels take, which they're allocated through
+    utils::CountingResource memory;
+
+    level_map bids;
+    level_map asks;
+
+    // Levels changed since the last sorted set write, 0 if removed, or the whole
+    // book if a snapshot replaced it. Only kept for BookFormat::ZSET.
+    level_map unwritten_bids;
+    level_map unwritten_asks;
+
+    // Prices removed since the last hash write. Only kept for BookFormat::HASH.
+    std::pmr::vector<double> removed_bids;
+    std::pmr::vector<double> removed_asks;
+
+    // If the next write replaces the whole book
+    bool unwritten_reset = true;
+
+    // Size of each side after it was last trimmed to the depth limits
+    size_t trimmed_bids = 0;
+    size_t trimmed_asks = 0;
+    bool over_budget = false; // if it was last trimmed for the memory budget
+
+    // Best levels and derived features, maintained on every change
+    TopLevels<std::greater<>> top_bids;
+    TopLevels<std::less<>> top_asks;
+    book_features features;
+
+    // A snapshot on its way in, or the book it replaced on its way out
+    std::unique_ptr<snapshot_build> build;
+
+    /**
+     * @param levels Where the levels of every side are kept.
+     */
+    explicit product_tracker(std::pmr::memory_resource* levels) :
+        memory(levels),
+        bids(&memory),
+        asks(&memory),
+        unwritten_bids(&memory),
+        unwritten_asks(&memory),
+        removed_bids(&memory),
+        removed_asks(&memory)
+    {}
+
+    ~product_tracker() = default;
+
+    /* No copy or move operators, the levels point into us */
+    product_tracker(const product_tracker&) = delete;
+    product_tracker(product_tracker&&) = delete;
+    product_tracker& operator=(const product_tracker&) = delete;
+    product_tracker& operator=(product_tracker&&) = delete;
+
+    /**
+     * If a snapshot is being built, and the book is kept as it was until it's in.
+     */
+    [[nodiscard]] bool
+    rebuilding() const noexcept
+    {
+        return build && build->stage != snapshot_build::Stage::RETIRE;
+    }
+};
+
+/**
+ * How deep books are kept. Levels past either limit are dropped a batch at a time,
+ * as a side grows, so levels far from the touch don't pile up.
+ */
+struct depth_limits {
+    size_t max_levels = BOOK_MAX_LEVELS; // best levels kept per side, 0 for all
+    double max_distance = 0.0; // from the mid, as a fraction of it, 0 for any
 };
 
-struct OrderbookSnapshot {
-    std::string type = "snapshot";
-    std::string time;
-    std::string product_id;
-    std::vector<std::tuple<std::string, std::string>> asks;
-    std::vector<std::tuple<std::string, std::string>> bids;
+/**
+ * A change to one level of a book, as applied.
+ */
+struct level_update {
+    exchanges::Side side;
+    double price;
+    double old_size; // 0 if the level is new
+    double new_size; // 0 if the level was removed
 };
 
-struct OrderbookUpdate {
-    std::string type = "l2update";
-    std::string time;
-    std::string product_id;
-    std::vector<std::tuple<std::string, std::string, std::string>> changes;
+/**
+ * How books are written to Redis.
+ */
+enum class BookFormat : uint8_t {
+    HASH,   // {product}-BIDS and {product}-ASKS hashes, a field per level
+    PACKED, // {product}-BOOK, the best levels as one binary string
+    ZSET,   // {product}-ZBIDS and {product}-ZASKS sorted sets, sizes alongside
 };
 
+/**
+ * Name of a format, as the BOOK_FORMAT environment variable takes it.
+ */
+constexpr std::string_view
+book_format_name(BookFormat format) noexcept
+{
+    switch (format) {
+        case BookFormat::PACKED:
+            return "packed";
+        case BookFormat::ZSET:
+            return "zset";
+        default:
+            return "hash";
+    }
+}
+
 class OrderbookProcessor {
 private:
+    // Price levels come and go all the time, so their nodes are pooled, and a
+    // removed level's node is reused by the next level added to any book. The pool
+    // draws from memory reserved for the expected books, once reserve() is called.
+    utils::ReservedMemory reserved_;
+    std::pmr::unsynchronized_pool_resource levels_{
+        std::pmr::pool_options{.max_blocks_per_chunk = BOOK_POOL_CHUNK_LEVELS},
+        &reserved_
+    };
+
+    // What every book takes, under each book's own count
+    utils::CountingResource memory_{&levels_};
+
     std::unordered_map<std::string, product_tracker> orderbook_;
+    size_t reserved_depth_ = 0; // levels per side new books get buckets for
+
+    // Books with a snapshot build, by their key in orderbook_
+    std::vector<std::pair<std::string_view, product_tracker*>> building_;
+
+    depth_limits limits_;
+    size_t budget_ = BOOK_MEMORY_BUDGET;
+    uint64_t trimmed_ = 0; // levels dropped for the limits or the budget
+
+    // Where commands are built, only until they're sent
+    std::pmr::memory_resource* scratch_ = std::pmr::get_default_resource();
+
+    // Levels changed by the last snapshot or update, reused between calls
+    std::vector<level_update> changes_;
+
+    BookFormat format_ = BookFormat::HASH;
+    size_t packed_depth_ = PACKED_BOOK_DEPTH;
+    NotifyMode notify_ = NotifyMode::NONE;
+
+    // Reused between trims
+    std::vector<exchanges::PriceLevel> sorted_;
+
+    // Reused between packed writes
+    packed::Book packed_;
+    std::string packed_buffer_;
 
 public:
-    void process_incoming_snapshot(const OrderbookSnapshot& newOb);
-    void process_incoming_update(const OrderbookUpdate& newUpdate);
+    /**
+     * Told when a snapshot built over several calls is in, with changes() valid for
+     * the duration of the call.
+     */
+    using snapshot_callback = std::function<
+        void(const std::string& product_id, const product_tracker& tracker)>;
+
+    /**
+     * Reserve memory for the levels of the books expected, and give each new book
+     * buckets for as many levels, so neither the allocator nor a rehash is waited
+     * on in a burst. What outgrows it comes from the heap, with a warning.
+     *
+     * @param products Books expected.
+     * @param depth Levels per side expected in a book.
+     */
+    void reserve(
+        size_t products,
+        size_t depth,
+        const utils::MemoryOptions& options = utils::memory_options()
+    );
+
+    /**
+     * The memory reserved for levels.
+     */
+    [[nodiscard]] const utils::ReservedMemory&
+    reserved() const noexcept
+    {
+        return reserved_;
+    }
+
+    /**
+     * Set how deep books are kept.
+     */
+    void set_depth_limits(const depth_limits& limits);
+
+    /**
+     * Set the bytes all books together may take, 0 for no limit.
+     *
+     * Past it, a book taking more than its share is trimmed down to its share the
+     * next time it changes, best levels kept, so one deep book can't take over.
+     */
+    void
+    set_memory_budget(size_t bytes) noexcept
+    {
+        budget_ = bytes;
+    }
+
+    /**
+     * What every book takes.
+     */
+    [[nodiscard]] const utils::CountingResource&
+    memory() const noexcept
+    {
+        return memory_;
+    }
+
+    [[nodiscard]] size_t
+    memory_budget() const noexcept
+    {
+        return budget_;
+    }
+
+    /**
+     * Levels dropped for the depth limits or the memory budget.
+     */
+    [[nodiscard]] uint64_t
+    trimmed() const noexcept
+    {
+        return trimmed_;
+    }
+
+    /**
+     * Every book, by product id.
+     */
+    [[nodiscard]] const std::unordered_map<std::string, product_tracker>&
+    books() const noexcept
+    {
+        return orderbook_;
+    }
+
+    /**
+     * Set how books are written.
+     *
+     * @param packed_depth Levels per side in packed books.
+     */
+    void set_format(BookFormat format, size_t packed_depth = PACKED_BOOK_DEPTH);
+
+    /**
+     * Build Redis commands in scratch memory, such as a DataProcessor's arena,
+     * rather than on the heap.
+     */
+    void
+    set_scratch(std::pmr::memory_resource* scratch) noexcept
+    {
+        scratch_ = scratch;
+    }
+
+    /**
+     * Announce each book write, with the new top of book.
+     */
+    void
+    set_notify(NotifyMode mode) noexcept
+    {
+        notify_ = mode;
+    }
+
+    /**
+     * Replace a book with a snapshot.
+     *
+     * The new book is built beside the live one, which is swapped for it at once,
+     * and changes() are only what differs. Snapshots of more than
+     * SNAPSHOT_CHUNK_LEVELS levels are only started: the book is rebuilding(),
+     * stays as it was and holds its deltas back, and continue_snapshots() swaps it.
+     */
+    const product_tracker& process_incoming_snapshot(
+        const exchanges::BookSnapshot& snapshot
+    );
+
+    /**
+     * Apply a delta, or hold it back for the snapshot a book is rebuilding to.
+     */
+    const product_tracker& process_incoming_update(const exchanges::BookDelta& delta);
+
+    /**
+     * Build snapshots further, and free the books they replaced.
+     *
+     * @param levels At most this many levels, over every book.
+     * @param on_applied Told of each book swapped for its snapshot.
+     */
+    void continue_snapshots(size_t levels, const snapshot_callback& on_applied);
+
+    /**
+     * If any snapshot is being built, or any replaced book freed.
+     */
+    [[nodiscard]] bool
+    rebuilding() const noexcept
+    {
+        return !building_.empty();
+    }
+
+    /**
+     * Write a product's book in the current format, then its top of book and
+     * features to {product}-L1.
+     *
+     * Readers get everything they need for L1 in one small hash, without pulling
+     * the full book. The book's notification, if any, goes last in the same
+     * pipeline, so readers are only told once both are written.
+     */
     void ob_to_redis(redisContext* redis, const std::string& product_id);
 
+    /**
+     * Levels changed by the last processed snapshot or update.
+     */
+    [[nodiscard]] std::span<const level_update>
+    changes() const noexcept
+    {
+        return changes_;
+    }
+
 private:
-    void map_to_redis_(
+    product_tracker& tracker_(exchanges::Venue venue, const std::string& product_id);
+
+    /**
+     * Move a book's snapshot build along, swapping it in once it's built.
+     *
+     * @param budget Levels left to spend, less what's spent.
+     * @returns bool If the book was swapped for its snapshot.
+     */
+    bool build_(product_tracker& tracker, size_t& budget);
+
+    /**
+     * Apply a delta to the snapshot a book is rebuilding to.
+     */
+    static void apply_to_build_(
+        snapshot_build& build, const exchanges::BookDelta& delta
+    );
+
+    /**
+     * Swap a book for its built snapshot, setting changes() to what differs.
+     */
+    void swap_(product_tracker& tracker);
+
+    /**
+     * Follow changes() with the best levels, the features and sorted set writes.
+     */
+    void follow_changes_(product_tracker& tracker);
+
+    /**
+     * Trim a book to the depth limits, once a side has grown enough since it was
+     * last trimmed, and to its share of the memory budget if it's over.
+     *
+     * @param force Trim to the limits whatever the sides' growth.
+     */
+    void enforce_limits_(product_tracker& tracker, bool force);
+
+    /**
+     * Drop the levels of a side past the best `keep`, or too far from the mid.
+     */
+    template <class Compare>
+    void trim_side_(
+        product_tracker& tracker, level_map& side, exchanges::Side which, size_t keep
+    );
+
+    /**
+     * Remember a removed level, for the next hash write.
+     */
+    void removed_(product_tracker& tracker, exchanges::Side side, double price);
+
+    /**
+     * Queue the L1 hash write of a book, and its notification if any.
+     */
+    void features_commands_(
+        const std::string& product_id,
+        const product_tracker& tracker,
+        std::pmr::vector<RedisCommand>& commands
+    );
+
+    /**
+     * Write one side as a hash, removing what's gone from it.
+     *
+     * @param removed Prices removed since the last write.
+     * @param replace Replace the whole hash, rather than removing levels.
+     * @param after Sent in the same pipeline, once the side is written.
+     * @returns bool If the write succeeded.
+     */
+    bool map_to_redis_(
         redisContext* redis,
-        const std::unordered_map<double, double>& table,
-        const std::string& map_id
+        const level_map& table,
+        std::string_view map_id,
+        std::span<const double> removed,
+        bool replace,
+        std::span<const RedisCommand> after
     );
-};
 
-} // namespace storage
-} // namespace raccoon
+    void packed_to_redis_(
+        redisContext* redis,
+        const std::string& product_id,
+        const product_tracker& tracker,
+        std::span<const RedisCommand> after
+    );
 
-template <>
-struct glz::meta<raccoon::storage::OrderbookSnapshot> {
-    using T = raccoon::storage::OrderbookSnapshot;
-    static constexpr auto value = object(
-        "time",
-        &T::time,
-        "type",
-        &T::type,
-        "product_id",
-        &T::product_id,
-        "asks",
-        &T::asks,
-        "bids",
-        &T::bids
+    /**
+     * Write the levels changed since the last write, in one transaction so readers
+     * never see half an update.
+     */
+    void zset_to_redis_(
+        redisContext* redis,
+        const std::string& product_id,
+        product_tracker& tracker,
+        std::span<const RedisCommand> after
     );
-};
 
-template <>
-struct glz::meta<raccoon::storage::OrderbookUpdate> {
-    using T = raccoon::storage::OrderbookUpdate;
-    static constexpr auto value = object(
-        "time",
-        &T::time,
-        "type",
-        &T::type,
-        "product_id",
-        &T::product_id,
-        "changes",
-        &T::changes
+    void pack_side_(
+        std::span<const exchanges::PriceLevel> levels, std::vector<packed::Level>& out
     );
+
+    /**
+     * Have a book's best levels held deep enough for the format it's written in.
+     */
+    void keep_top_levels_(product_tracker& tracker) const;
 };
+
+} // namespace storage
+} // namespace raccoon
@@ -1,48 +1,365 @@
 #include "processing.hpp"
 
 #include "common.hpp"
+#include "redis.hpp"
+
+#include <algorithm>
+#include <array>
 
 namespace raccoon {
 namespace storage {
 
 void
-DataProcessor::process_incoming_data(const std::string& json_data)
+DataProcessor::flush()
+{
+    using namespace std::chrono;
+
+    orderbook_prox_.continue_snapshots(
+        SNAPSHOT_CHUNK_LEVELS,
+        [this](const std::string& product_id, const product_tracker& tracker) {
+            snapshot_applied_(product_id, tracker);
+        }
+    );
+
+    auto write_book = [this](const std::string& product_id) {
+        book_to_redis_(product_id);
+    };
+    auto write_symbol = [this](const std::string& symbol) {
+        consolidated_prox_.to_redis(redis_, symbol);
+    };
+
+    if (redis_ != nullptr)
+        conflator_.flush(write_book, write_symbol);
+
+    if (redis_ != nullptr && steady_clock::now() >= next_conflation_metrics_) {
+        conflation_to_redis_();
+        next_conflation_metrics_ =
+            steady_clock::now() + milliseconds(CONFLATE_METRICS_INTERVAL_MS);
+    }
+
+    // Bars of quiet products close on time, less a delay for trades still in flight
+    auto closing = system_clock::now() - milliseconds(BAR_CLOSE_DELAY_MS);
+    auto closing_ns = duration_cast<nanoseconds>(closing.time_since_epoch()).count();
+    bar_prox_.close_expired(closing_ns);
+
+    if (redis_ != nullptr)
+        bar_prox_.bars_to_redis(redis_);
+
+    staleness_.check(StalenessTracker::clock::now(), [this](const FeedStatus& status) {
+        feed_status(status);
+    });
+
+    // Books a sink dropped changes of go out whole, in parts as it has room for them
+    for (auto& sink : sinks_) {
+        resends_.clear();
+        sink->take_resends(resends_);
+
+        for (const auto& product_id : resends_)
+            start_resend_(*sink, product_id);
+    }
+
+    std::erase_if(resending_, [this](book_resend& resend) {
+        return !continue_resend_(resend);
+    });
+
+    for (auto& sink : sinks_)
+        sink->flush();
+
+    scratch_.reset();
+}
+
+void
+DataProcessor::log_book_memory() const
+{
+    const auto& memory = orderbook_prox_.memory();
+
+    log_i(
+        main,
+        "Books take {} bytes, {} at most, of a budget of {}; {} levels trimmed",
+        memory.bytes(),
+        memory.peak(),
+        orderbook_prox_.memory_budget(),
+        orderbook_prox_.trimmed()
+    );
+
+    for (const auto& [product_id, tracker] : orderbook_prox_.books()) {
+        log_i(
+            main,
+            "Book {}: {} bytes, {} bids, {} asks{}",
+            product_id,
+            tracker.memory.bytes(),
+            tracker.bids.size(),
+            tracker.asks.size(),
+            tracker.over_budget ? ", over its share of the budget" : ""
+        );
+    }
+}
+
+void
+DataProcessor::log_conflation() const
+{
+    const auto& stats = conflator_.stats();
+
+    log_i(
+        main,
+        "Conflation ratio {:.2f}: {} book updates written as {} books, conflated {} "
+        "times, {}",
+        stats.ratio(),
+        stats.updates,
+        stats.writes,
+        stats.episodes,
+        conflator_.conflating() ? "conflating now" : "not conflating now"
+    );
+}
+
+void
+DataProcessor::conflation_to_redis_()
+{
+    const auto& stats = conflator_.stats();
+
+    RedisCommand cmd("HSET", scratch_.resource());
+    cmd.arg("CONFLATION")
+        .field("updates", stats.updates)
+        .field("writes", stats.writes)
+        .field("ratio", stats.ratio())
+        .field("episodes", stats.episodes)
+        .field("conflating", conflator_.conflating() ? 1 : 0);
+
+    redis_pipeline(redis_, std::span(&cmd, 1));
+}
+
+void
+DataProcessor::feed_status(const FeedStatus& status)
+{
+    if (status.stale) {
+        log_w(
+            main,
+            "{} {} is stale, silent for {}ms",
+            status.venue,
+            status.feed,
+            status.silent_ms
+        );
+    }
+    else
+        log_i(main, "{} {} is live again", status.venue, status.feed);
+
+    for (auto& sink : sinks_)
+        sink->on_status(status);
+
+    if (redis_ == nullptr)
+        return;
+
+    std::array<RedisCommand, 2> commands = {
+        RedisCommand("HSET", scratch_.resource()),
+        RedisCommand("PUBLISH", scratch_.resource()),
+    };
+
+    commands[0].arg("FEED-STATUS").field(status.feed, status.stale ? "stale" : "live");
+    commands[1].arg("FEED-STATUS").arg_format(
+        R"({{"venue":"{}","feed":"{}","connection":{},"stale":{},"silent_ms":{},)"
+        R"("timestamp":{}}})",
+        status.venue,
+        status.feed,
+        status.connection,
+        status.stale,
+        status.silent_ms,
+        status.timestamp
+    );
+
+    redis_pipeline(redis_, commands);
+}
+
+void
+DataProcessor::process_event(const exchanges::BookSnapshot& snapshot)
+{
+    staleness_.on_event(snapshot.venue, snapshot.product_id);
+
+    // Deep snapshots are built over the next cycles, in flush()
+    const auto& tracker = orderbook_prox_.process_incoming_snapshot(snapshot);
+
+    if (tracker.rebuilding()) [[unlikely]]
+        return;
+
+    snapshot_applied_(snapshot.product_id, tracker);
+}
+
+void
+DataProcessor::snapshot_applied_(
+    const std::string& product_id, const product_tracker& tracker
+)
+{
+    consolidated_prox_.process_changes(tracker, orderbook_prox_.changes());
+    book_to_sinks_(product_id, tracker, true);
+
+    if (redis_ == nullptr)
+        return;
+
+    if (conflator_.on_update(product_id, tracker.symbol)) {
+        book_to_redis_(product_id);
+        consolidated_prox_.to_redis(redis_, tracker.symbol);
+        scratch_.reset();
+    }
+}
+
+void
+DataProcessor::process_event(const exchanges::BookDelta& delta)
 {
-    // Parse JSON data using glaze
-    std::variant<OrderbookSnapshot, OrderbookUpdate, Match> data{};
+    staleness_.on_event(delta.venue, delta.product_id);
+
+    if (ticks_)
+        ticks_->write(delta);
 
-    auto err = glz::read_json(data, json_data);
-    if (err) [[unlikely]] {
-        log_e(main, "Error parsing data: {}", glz::format_error(err, json_data));
+    // Held back while the book is rebuilding, and published with the snapshot
+    const auto& tracker = orderbook_prox_.process_incoming_update(delta);
+
+    if (tracker.rebuilding()) [[unlikely]]
+        return;
+
+    consolidated_prox_.process_changes(tracker, orderbook_prox_.changes());
+    book_to_sinks_(delta.product_id, tracker, false);
+
+    if (redis_ == nullptr)
         return;
+
+    if (conflator_.on_update(delta.product_id, tracker.symbol)) {
+        book_to_redis_(delta.product_id);
+        consolidated_prox_.to_redis(redis_, tracker.symbol);
+        scratch_.reset();
     }
+}
 
-    auto processMessage = [&](const auto& message) {
-        using T = std::decay_t<decltype(data)>;
-        // Check what kind of data we got
-        if constexpr (std::is_same_v<T, OrderbookUpdate>) {
-            // We got an update
-            orderbook_prox_.process_incoming_update(message);
-            orderbook_prox_.ob_to_redis(redis_, message.product_id);
-        }
-        else if constexpr (std::is_same_v<T, OrderbookSnapshot>) {
-            // We got a snapshot
-            orderbook_prox_.process_incoming_snapshot(message);
-            orderbook_prox_.ob_to_redis(redis_, message.product_id);
-        }
-        else if constexpr (std::is_same_v<T, Match>) {
-            // We got a match
-            const auto& match = std::get<Match>(data);
+void
+DataProcessor::process_event(const exchanges::Trade& trade)
+{
+    staleness_.on_event(trade.venue, trade.product_id);
 
-            trade_prox_.process_incoming_match(match);
-            trade_prox_.matches_to_redis(redis_);
-        }
-        else {
-            log_e(main, "Unknown data type");
-        }
+    if (ticks_)
+        ticks_->write(trade);
+
+    for (auto& sink : sinks_)
+        sink->on_trade(trade);
+
+    trade_prox_.process_incoming_match(trade);
+    bar_prox_.process_trade(trade);
+
+    if (redis_ == nullptr)
+        return;
+
+    trade_prox_.matches_to_redis(redis_);
+    bar_prox_.bars_to_redis(redis_);
+    scratch_.reset();
+}
+
+void
+DataProcessor::book_to_sinks_(
+    const std::string& product_id, const product_tracker& tracker, bool snapshot
+)
+{
+    if (sinks_.empty()) [[likely]]
+        return;
+
+    BookChange book{
+        .venue = tracker.venue,
+        .product_id = product_id,
+        .symbol = tracker.symbol,
+        .sequence = tracker.sequence,
+        .timestamp = tracker.timestamp,
+        .snapshot = snapshot,
+        .changes = orderbook_prox_.changes(),
+        .l1 = tracker.features,
     };
 
-    std::visit(processMessage, data);
+    for (auto& sink : sinks_)
+        sink->on_book(book);
+}
+
+void
+DataProcessor::start_resend_(Sink& sink, const std::string& product_id)
+{
+    const auto& books = orderbook_prox_.books();
+    auto it = books.find(product_id);
+
+    if (it == books.end()) [[unlikely]]
+        return;
+
+    const auto& tracker = it->second;
+    log_i(main, "Sending {} whole to a sink that dropped some of it", product_id);
+
+    auto resend = std::find_if(resending_.begin(), resending_.end(), [&](auto& r) {
+        return r.sink == &sink && r.product_id == product_id;
+    });
+
+    if (resend == resending_.end())
+        resend = resending_.insert(
+            resending_.end(), {.sink = &sink, .product_id = product_id, .levels = {}}
+        );
+
+    resend->levels.clear();
+    resend->sent = 0;
+
+    for (const auto& [price, size] : tracker.bids)
+        resend->levels.push_back({exchanges::Side::BID, price, 0.0, size});
+    for (const auto& [price, size] : tracker.asks)
+        resend->levels.push_back({exchanges::Side::ASK, price, 0.0, size});
+}
+
+bool
+DataProcessor::continue_resend_(book_resend& resend)
+{
+    const auto& books = orderbook_prox_.books();
+    auto it = books.find(resend.product_id);
+
+    if (it == books.end()) [[unlikely]]
+        return false;
+
+    const auto& tracker = it->second;
+
+    // The header needs a slot too, so no room means none for it either
+    auto room = resend.sink->book_room();
+    if (room == 0)
+        return true;
+
+    auto count = std::min(room, resend.levels.size() - resend.sent);
+    book_part_.clear();
+
+    // Changes since the book was copied have gone to the sink already, so parts
+    // after the first carry what's in the book now; levels since removed, as such
+    for (size_t i = resend.sent; i < resend.sent + count; i++) {
+        auto level = resend.levels[i];
+        const auto& side = level.side == exchanges::Side::BID ? tracker.bids
+                                                               : tracker.asks;
+        auto found = side.find(level.price);
+        level.new_size = found == side.end() ? 0.0 : found->second;
+
+        book_part_.push_back(level);
+    }
+
+    bool first = resend.sent == 0;
+    resend.sent += count;
+
+    resend.sink->on_book({
+        .venue = tracker.venue,
+        .product_id = resend.product_id,
+        .symbol = tracker.symbol,
+        .sequence = tracker.sequence,
+        .timestamp = tracker.timestamp,
+        .snapshot = first,
+        .reset = first,
+        .changes = book_part_,
+        .l1 = tracker.features,
+    });
+
+    return resend.sent < resend.levels.size();
+}
+
+void
+DataProcessor::book_to_redis_(const std::string& product_id)
+{
+    auto start = Conflator::clock::now();
+
+    orderbook_prox_.ob_to_redis(redis_, product_id);
+
+    conflator_.on_write(Conflator::clock::now() - start);
 }
 
 } // namespace storage
@@ -1,30 +1,347 @@
+#pragma once
+
+#include "bars.hpp"
 #include "common.hpp"
+#include "conflation.hpp"
+#include "consolidated.hpp"
+#include "exchanges/exchanges.hpp"
 #include "orderbook.hpp"
+#include "sink.hpp"
+#include "staleness.hpp"
+#include "ticks.hpp"
 #include "trades.hpp"
+#include "utils/arena.hpp"
 
-#include <glaze/glaze.hpp>
 #include <hiredis/hiredis.h>
 
+#include <ranges>
+#include <span>
+#include <string_view>
+
 namespace raccoon {
 namespace storage {
 
+/**
+ * Applies normalized events, and writes the results to Redis and any other sinks.
+ */
 class DataProcessor {
-    redisContext* redis_;
+    redisContext* redis_; // nullptr to write to sinks only
+
+    // What writing an event builds, such as Redis commands, is only kept until
+    // it's written, so it all comes from here; reset after each event's writes, and
+    // once per loop cycle in flush()
+    utils::Arena scratch_;
     OrderbookProcessor orderbook_prox_;
     TradeProcessor trade_prox_;
+    BarProcessor bar_prox_;
+
+    // Optional history sink
+    std::unique_ptr<TickWriter> ticks_;
+    ConsolidatedProcessor consolidated_prox_;
+
+    // Holds book writes back when Redis falls behind
+    Conflator conflator_;
+    std::chrono::steady_clock::time_point next_conflation_metrics_{};
+
+    // Outputs besides Redis, each given every change
+    std::vector<std::unique_ptr<Sink>> sinks_;
+    std::vector<std::string> resends_; // books a sink needs whole again
+    std::vector<level_update> book_part_;
+
+    // A book going to a sink whole again, in parts as the sink has room for them
+    struct book_resend {
+        Sink* sink;
+        std::string product_id;
+        std::vector<level_update> levels; // sizes are looked up as each part goes
+        size_t sent = 0;
+    };
+
+    std::vector<book_resend> resending_;
+
+    // Products nothing arrived for in a while
+    StalenessTracker staleness_;
+
+    // Default adapter for feeds that don't bring their own
+    exchanges::CoinbaseAdapter coinbase_;
 
 public:
-    explicit DataProcessor(redisContext* redis) : redis_(redis), orderbook_prox_() {}
+    /**
+     * @param redis Where books and trades are written, or nullptr for none, e.g. to
+     *              only feed sinks in tests.
+     */
+    explicit DataProcessor(redisContext* redis) : redis_(redis), orderbook_prox_()
+    {
+        orderbook_prox_.set_scratch(scratch_.resource());
+        trade_prox_.set_scratch(scratch_.resource());
+        consolidated_prox_.set_scratch(scratch_.resource());
+    }
+
+    /**
+     * Also send every book change and trade to a sink.
+     *
+     * Sinks are called on the feed's thread, in the order they were added; wrap
+     * slow ones in an AsyncSink.
+     */
+    void
+    add_sink(std::unique_ptr<Sink> sink)
+    {
+        sinks_.push_back(std::move(sink));
+    }
+
+    /**
+     * Also record book deltas and trades to tick files under a directory.
+     */
+    void
+    enable_tick_store(const std::filesystem::path& root)
+    {
+        log_i(main, "Recording ticks to {}", root);
+        ticks_ = std::make_unique<TickWriter>(root);
+    }
+
+    /**
+     * Reserve memory for the books expected, up front.
+     *
+     * @param products Books expected.
+     * @param depth Levels per side expected in a book.
+     */
+    void
+    reserve_books(size_t products, size_t depth)
+    {
+        log_i(main, "Reserving {} books of {} levels per side", products, depth);
+        orderbook_prox_.reserve(products, depth);
+    }
+
+    /**
+     * Set how deep books are kept, and how much memory they may take in all.
+     *
+     * @param budget Bytes, 0 for no limit.
+     */
+    void
+    set_book_limits(const depth_limits& limits, size_t budget)
+    {
+        orderbook_prox_.set_depth_limits(limits);
+        orderbook_prox_.set_memory_budget(budget);
+        log_i(main, "Books may take {} bytes", budget);
+    }
+
+    /**
+     * Log what books take, in all and each.
+     */
+    void log_book_memory() const;
+
+    /**
+     * Log the conflation ratio and the counters behind it.
+     */
+    void log_conflation() const;
+
+    /**
+     * Set how books are written to Redis.
+     */
+    void
+    set_book_format(BookFormat format)
+    {
+        log_i(main, "Writing {} books to Redis", book_format_name(format));
+        orderbook_prox_.set_format(format);
+    }
+
+    /**
+     * Tell readers about book writes and trades, so they don't have to poll.
+     */
+    void
+    set_notify(NotifyMode mode)
+    {
+        log_i(main, "Notifying changes: {}", notify_mode_name(mode));
+        orderbook_prox_.set_notify(mode);
+        trade_prox_.set_notify(mode);
+    }
+
+    /**
+     * Set how long a product can go without an event before it's stale, 0 to never
+     * mark products stale.
+     */
+    void
+    set_product_stale_after(std::chrono::milliseconds stale_after)
+    {
+        log_i(main, "Products are stale after {} of silence", stale_after);
+        staleness_.set_stale_after(stale_after);
+    }
+
+    /**
+     * Publish a feed going stale or coming back, to Redis and every sink.
+     *
+     * Statuses are kept in the FEED-STATUS hash, by product id or venue name, and
+     * published on the FEED-STATUS channel.
+     */
+    void feed_status(const FeedStatus& status);
+
+    /**
+     * Build deep snapshots further, write books held back by conflation, switch
+     * conflation on or off, check for stale products, and flush sinks.
+     *
+     * Conflation metrics are written to the CONFLATION hash every
+     * CONFLATE_METRICS_INTERVAL_MS: updates, writes, ratio, episodes and conflating.
+     *
+     * Call once per loop cycle, after processing everything read. Books are never
+     * conflated if this isn't called, and deep snapshots never applied.
+     */
+    void flush();
+
+    /**
+     * If a snapshot is being built, so flush() has work to do even when nothing
+     * else arrives.
+     */
+    [[nodiscard]] bool
+    rebuilding() const noexcept
+    {
+        return orderbook_prox_.rebuilding();
+    }
+
+    /**
+     * Book write counters, for the conflation ratio.
+     */
+    [[nodiscard]] const conflation_stats&
+    conflation() const noexcept
+    {
+        return conflator_.stats();
+    }
+
+    /**
+     * Scratch memory, for its size and how often it had to grow.
+     */
+    [[nodiscard]] const utils::Arena&
+    scratch() const noexcept
+    {
+        return scratch_;
+    }
+
+    /**
+     * If book writes are being conflated.
+     */
+    [[nodiscard]] bool
+    conflating() const noexcept
+    {
+        return conflator_.conflating();
+    }
+
+    /**
+     * Process a message from an exchange, using the given adapter to decode it.
+     *
+     * Events are dispatched to storage at compile time.
+     */
+    template <exchanges::ExchangeAdapter Adapter>
+    void
+    process_incoming_data(Adapter& adapter, std::string_view data)
+    {
+        bool valid =
+            adapter.parse(data, [this](const auto& event) { process_event(event); });
+
+        if (!valid) [[unlikely]]
+            log_w(main, "Dropped invalid message from {}", Adapter::VENUE);
+    }
+
+    template <exchanges::ExchangeAdapter Adapter, Container C>
+    requires std::ranges::contiguous_range<C>
+    void
+    process_incoming_data(Adapter& adapter, const C& data)
+    {
+        std::string_view str(
+            reinterpret_cast<const char*>(std::ranges::data(data)),
+            std::ranges::size(data) * sizeof(typename C::value_type)
+        );
+        process_incoming_data(adapter, str);
+    }
+
+    /**
+     * Process a message still in the transport's receive buffer, as the native
+     * WebSocket hands them over.
+     */
+    template <exchanges::ExchangeAdapter Adapter>
+    void
+    process_incoming_data(Adapter& adapter, std::span<const uint8_t> data)
+    {
+        std::string_view str(
+            reinterpret_cast<const char*>(data.data()), // NOLINT(*-reinterpret-cast)
+            data.size()
+        );
+        process_incoming_data(adapter, str);
+    }
+
+    void
+    process_incoming_data(std::span<const uint8_t> json_data)
+    {
+        process_incoming_data(coinbase_, json_data);
+    }
 
     template <Container C>
     void
     process_incoming_data(const C& json_data)
     {
-        std::string str(json_data.begin(), json_data.end());
-        process_incoming_data(str);
+        if constexpr (std::ranges::contiguous_range<C>) {
+            process_incoming_data(coinbase_, json_data);
+        }
+        else {
+            std::string str(json_data.begin(), json_data.end());
+            process_incoming_data(coinbase_, str);
+        }
     }
 
-    void process_incoming_data(const std::string& json_data);
+    void
+    process_incoming_data(const std::string& json_data)
+    {
+        process_incoming_data(coinbase_, json_data);
+    }
+
+    /**
+     * Store a normalized book snapshot.
+     */
+    void process_event(const exchanges::BookSnapshot& snapshot);
+
+    /**
+     * Store a normalized book update.
+     */
+    void process_event(const exchanges::BookDelta& delta);
+
+    /**
+     * Store a normalized trade.
+     */
+    void process_event(const exchanges::Trade& trade);
+
+private:
+    /**
+     * Publish a book just swapped for its snapshot.
+     */
+    void
+    snapshot_applied_(const std::string& product_id, const product_tracker& tracker);
+
+    /**
+     * Write a product's book and features, timing it for the conflator.
+     */
+    void book_to_redis_(const std::string& product_id);
+
+    /**
+     * Start sending a sink a product's whole book, after it dropped some of its
+     * changes; from the beginning again if it was already being sent.
+     */
+    void start_resend_(Sink& sink, const std::string& product_id);
+
+    /**
+     * Send a sink as much of a book it needs whole as it has room for.
+     *
+     * @returns bool If there's more to send.
+     */
+    bool continue_resend_(book_resend& resend);
+
+    /**
+     * Write the conflation counters and ratio to the CONFLATION hash.
+     */
+    void conflation_to_redis_();
+
+    /**
+     * Hand the last snapshot or update applied to every sink.
+     */
+    void book_to_sinks_(
+        const std::string& product_id, const product_tracker& tracker, bool snapshot
+    );
 };
 
 } // namespace storage
@@ -0,0 +1,70 @@
+#include "redis.hpp"
+
+namespace raccoon {
+namespace storage {
+
+bool
+RedisCommand::append_to(redisContext* redis) const
+{
+    std::pmr::vector<const char*> argv(memory());
+    std::pmr::vector<size_t> argv_len(memory());
+
+    argv.reserve(args_.size());
+    argv_len.reserve(args_.size());
+
+    for (const auto& arg : args_) {
+        argv.push_back(arg.data());
+        argv_len.push_back(arg.size());
+    }
+
+    int err = redisAppendCommandArgv(
+        redis, static_cast<int>(argv.size()), argv.data(), argv_len.data()
+    );
+
+    return err == REDIS_OK;
+}
+
+bool
+redis_pipeline(redisContext* redis, std::span<const RedisCommand> commands)
+{
+    // Queue everything up
+    for (const auto& command : commands) {
+        if (!command.append_to(redis)) [[unlikely]] {
+            log_e(redis, "Error queueing command: {}", redis->errstr);
+            return false;
+        }
+    }
+
+    return redis_replies(redis, commands.size());
+}
+
+bool
+redis_replies(redisContext* redis, size_t count)
+{
+    // Collect replies, which also flushes the output buffer
+    bool ok = true;
+
+    for (size_t i = 0; i < count; i++) {
+        void* raw_reply = nullptr;
+
+        if (redisGetReply(redis, &raw_reply) != REDIS_OK) [[unlikely]] {
+            log_e(redis, "Error reading reply: {}", redis->errstr);
+            return false;
+        }
+
+        auto* reply = static_cast<redisReply*>(raw_reply);
+
+        if (reply->type == REDIS_REPLY_ERROR) [[unlikely]] {
+            std::string_view error(reply->str, reply->len);
+            log_e(redis, "Command failed: {}", error);
+            ok = false;
+        }
+
+        freeReplyObject(reply);
+    }
+
+    return ok;
+}
+
+} // namespace storage
+} // namespace raccoon
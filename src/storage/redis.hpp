@@ -0,0 +1,127 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <hiredis/hiredis.h>
+
+#include <concepts>
+#include <memory_resource>
+#include <span>
+#include <string_view>
+
+namespace raccoon {
+namespace storage {
+
+/**
+ * Arguments for a single Redis command.
+ *
+ * Arguments are binary safe, and are formatted once when added, in memory from the
+ * resource the command was started with. Commands only live until they're sent, so
+ * processors start them in their scratch arena.
+ */
+class RedisCommand {
+    std::pmr::vector<std::pmr::string> args_;
+
+public:
+    /**
+     * Start a new command.
+     *
+     * @param name The command name, e.g. HSET.
+     * @param memory Where the arguments are kept.
+     */
+    explicit RedisCommand(
+        std::string_view name,
+        std::pmr::memory_resource* memory = std::pmr::get_default_resource()
+    ) :
+        args_(memory)
+    {
+        args_.emplace_back(name);
+    }
+
+    /**
+     * Add a string argument.
+     */
+    RedisCommand&
+    arg(std::string_view value)
+    {
+        args_.emplace_back(value);
+        return *this;
+    }
+
+    /**
+     * Add a numeric argument, formatted as its shortest round-trip representation.
+     */
+    template <class T>
+    requires std::integral<T> || std::floating_point<T>
+    RedisCommand&
+    arg(T value)
+    {
+        fmt::format_to(std::back_inserter(args_.emplace_back()), "{}", value);
+        return *this;
+    }
+
+    /**
+     * Add an argument formatted in place, such as a key built from a product id.
+     */
+    template <class... Args>
+    RedisCommand&
+    arg_format(fmt::format_string<Args...> format, Args&&... args)
+    {
+        auto out = std::back_inserter(args_.emplace_back());
+        fmt::format_to(out, format, std::forward<Args>(args)...);
+        return *this;
+    }
+
+    /**
+     * Add a field and value pair, for hash commands.
+     */
+    template <class K, class T>
+    RedisCommand&
+    field(const K& name, const T& value)
+    {
+        arg(name);
+        return arg(value);
+    }
+
+    /**
+     * Number of arguments, including the command name.
+     */
+    [[nodiscard]] size_t
+    size() const noexcept
+    {
+        return args_.size();
+    }
+
+    /**
+     * Where the arguments are kept.
+     */
+    [[nodiscard]] std::pmr::memory_resource*
+    memory() const noexcept
+    {
+        return args_.get_allocator().resource();
+    }
+
+    /**
+     * Append this command to a context's output buffer without sending it.
+     *
+     * @returns bool If the command was appended.
+     */
+    bool append_to(redisContext* redis) const;
+};
+
+/**
+ * Send a batch of commands in one round trip and wait for all replies.
+ *
+ * @returns bool If every command succeeded.
+ */
+bool redis_pipeline(redisContext* redis, std::span<const RedisCommand> commands);
+
+/**
+ * Wait for the replies of commands already appended, such as with append_to().
+ *
+ * @returns bool If every command succeeded.
+ */
+bool redis_replies(redisContext* redis, size_t count);
+
+} // namespace storage
+} // namespace raccoon
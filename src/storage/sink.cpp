@@ -0,0 +1,182 @@
+#include "sink.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace raccoon {
+namespace storage {
+
+EventQueue::EventQueue(size_t capacity) : queue_(capacity, "sink queue") {}
+
+void
+EventQueue::copy_name_(name& dst, std::string_view src) noexcept
+{
+    auto len = std::min(src.size(), MAX_NAME_LEN);
+
+    std::memcpy(dst.data(), src.data(), len);
+    dst[len] = '\0';
+}
+
+void
+EventQueue::count_drop_(std::string_view what) noexcept
+{
+    auto dropped = dropped_.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    // On the first drop, and every time they double
+    if (dropped >= warn_at_) {
+        log_w(main, "Sink queue is full, dropped {}; {} dropped in all", what, dropped);
+        warn_at_ = dropped * 2;
+    }
+}
+
+bool
+EventQueue::push(const BookChange& book)
+{
+    // The producer only sees the queue fuller than it is, so there's at least this
+    // much room; rather than wait for more, the book is sent again when there is
+    if (book.changes.size() >= free_()) [[unlikely]] {
+        count_drop_(book.product_id);
+        resends_.emplace(book.product_id);
+        return false;
+    }
+
+    queued_event event;
+
+    for (const auto& level : book.changes) {
+        event.level = level;
+        queue_.try_push(event);
+    }
+
+    event.kind = queued_event::type::BOOK;
+    event.venue = book.venue;
+    event.snapshot = book.snapshot;
+    event.reset = book.reset;
+    event.id = book.sequence;
+    event.timestamp = book.timestamp;
+    event.l1 = book.l1;
+
+    copy_name_(event.product_id, book.product_id);
+    copy_name_(event.symbol, book.symbol);
+
+    queue_.try_push(event);
+    return true;
+}
+
+bool
+EventQueue::push(const exchanges::Trade& trade) noexcept
+{
+    queued_event event;
+    event.kind = queued_event::type::TRADE;
+    event.venue = trade.venue;
+    event.side = trade.side;
+    event.id = trade.trade_id;
+    event.trade_sequence = trade.sequence;
+    event.timestamp = trade.timestamp;
+    event.price = trade.price;
+    event.size = trade.size;
+    event.exact_price = trade.exact_price;
+    event.exact_size = trade.exact_size;
+
+    copy_name_(event.product_id, trade.product_id);
+
+    if (!queue_.try_push(event)) [[unlikely]] {
+        count_drop_("a trade");
+        return false;
+    }
+
+    return true;
+}
+
+bool
+EventQueue::push(const FeedStatus& status) noexcept
+{
+    queued_event event;
+    event.kind = queued_event::type::STATUS;
+    event.venue = status.venue;
+    event.snapshot = status.stale;
+    event.connection = status.connection;
+    event.id = static_cast<uint64_t>(status.silent_ms);
+    event.timestamp = status.timestamp;
+
+    copy_name_(event.product_id, status.feed);
+
+    if (!queue_.try_push(event)) [[unlikely]] {
+        count_drop_("a feed status");
+        return false;
+    }
+
+    return true;
+}
+
+void
+EventQueue::take_resends(std::vector<std::string>& product_ids)
+{
+    if (resends_.empty() || free_() < queue_.capacity() / 2) [[likely]]
+        return;
+
+    product_ids.insert(product_ids.end(), resends_.begin(), resends_.end());
+    resends_.clear();
+}
+
+EventQueue::Kind
+EventQueue::pop(BookChange& book, exchanges::Trade& trade, FeedStatus& status)
+{
+    // Levels of the last book popped are done with
+    if (popped_.kind == queued_event::type::BOOK) {
+        levels_.clear();
+        popped_.kind = queued_event::type::LEVEL;
+    }
+
+    // A book's levels may be popped before its header is pushed, so they're kept
+    // until it is
+    while (queue_.try_pop(popped_)) {
+        switch (popped_.kind) {
+            case queued_event::type::LEVEL:
+                levels_.push_back(popped_.level);
+                break;
+
+            case queued_event::type::BOOK:
+                book = {
+                    .venue = popped_.venue,
+                    .product_id = popped_.product_id.data(),
+                    .symbol = popped_.symbol.data(),
+                    .sequence = popped_.id,
+                    .timestamp = popped_.timestamp,
+                    .snapshot = popped_.snapshot,
+                    .reset = popped_.reset,
+                    .changes = levels_,
+                    .l1 = popped_.l1,
+                };
+                return Kind::BOOK;
+
+            case queued_event::type::TRADE:
+                trade.venue = popped_.venue;
+                trade.product_id = popped_.product_id.data();
+                trade.trade_id = popped_.id;
+                trade.sequence = popped_.trade_sequence;
+                trade.timestamp = popped_.timestamp;
+                trade.side = popped_.side;
+                trade.price = popped_.price;
+                trade.size = popped_.size;
+                trade.exact_price = popped_.exact_price;
+                trade.exact_size = popped_.exact_size;
+                return Kind::TRADE;
+
+            case queued_event::type::STATUS:
+                status = {
+                    .venue = popped_.venue,
+                    .feed = popped_.product_id.data(),
+                    .connection = popped_.connection,
+                    .stale = popped_.snapshot,
+                    .silent_ms = static_cast<int64_t>(popped_.id),
+                    .timestamp = popped_.timestamp,
+                };
+                return Kind::STATUS;
+        }
+    }
+
+    return Kind::NONE;
+}
+
+} // namespace storage
+} // namespace raccoon
@@ -0,0 +1,499 @@
+#pragma once
+
+#include "common.hpp"
+#include "exchanges/events.hpp"
+#include "orderbook.hpp"
+#include "top_of_book.hpp"
+#include "utils/spsc_queue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
+
+namespace raccoon {
+namespace storage {
+
+/**
+ * A book after a snapshot or update was applied: what changed, and its top of book.
+ *
+ * Only valid for the duration of the call it's passed to.
+ */
+struct BookChange {
+    exchanges::Venue venue{};
+    std::string_view product_id;
+    std::string_view symbol; // normalized, for cross-venue views
+    uint64_t sequence = 0;
+    int64_t timestamp = 0;
+    bool snapshot = false; // the whole book was replaced, changes are what differs
+    bool reset = false;    // changes are the whole book, as sent again after a drop
+
+    std::span<const level_update> changes;
+    book_features l1;
+};
+
+/**
+ * A feed going stale, or coming back: a connection nothing arrived on, or a
+ * product nothing arrived for, for too long.
+ */
+struct FeedStatus {
+    exchanges::Venue venue{};
+    std::string_view feed;   // a product id, or the venue's name for a connection
+    bool connection = false; // the whole connection, rather than one product
+    bool stale = false;
+    int64_t silent_ms = 0; // since something last arrived
+    int64_t timestamp = 0; // when it was noticed, nanoseconds since epoch
+};
+
+/**
+ * Something that receives normalized book changes and trades, besides Redis.
+ *
+ * flush() ends a batch: it's called once per loop cycle, so sinks can write
+ * everything received since the last one at once.
+ *
+ * Sinks with an on_status() method are also told about feeds going stale.
+ */
+template <class S>
+concept OutputSink =
+    requires(S sink, const BookChange& book, const exchanges::Trade& trade) {
+        sink.on_book(book);
+        sink.on_trade(trade);
+        sink.flush();
+    };
+
+/**
+ * A sink chosen at runtime. Wrap sinks known at compile time in a SinkGroup, so
+ * they're called without a virtual call each.
+ */
+class Sink {
+public:
+    Sink() = default;
+    virtual ~Sink() = default;
+
+    Sink(const Sink&) = delete;
+    Sink(Sink&&) = delete;
+    Sink& operator=(const Sink&) = delete;
+    Sink& operator=(Sink&&) = delete;
+
+    virtual void on_book(const BookChange& book) = 0;
+    virtual void on_trade(const exchanges::Trade& trade) = 0;
+    virtual void flush() = 0;
+
+    virtual void
+    on_status(const FeedStatus& /* status */)
+    {}
+
+    /**
+     * Products this sink dropped changes of, so it needs their whole book again.
+     * Called once per loop cycle; each is then given to on_book(), the first part
+     * with `reset` set.
+     */
+    virtual void
+    take_resends(std::vector<std::string>& /* product_ids */)
+    {}
+
+    /**
+     * Levels one on_book() can take right now without dropping them. Books sent
+     * again whole are split into parts of at most this many.
+     */
+    [[nodiscard]] virtual size_t
+    book_room() const
+    {
+        return std::numeric_limits<size_t>::max();
+    }
+};
+
+/**
+ * Tell a sink about a feed's status, if it wants to know.
+ */
+template <OutputSink S>
+void
+status_to_sink(S& sink, const FeedStatus& status)
+{
+    if constexpr (requires { sink.on_status(status); })
+        sink.on_status(status);
+}
+
+/**
+ * Sinks called one after the other on the caller's thread, dispatched statically.
+ */
+template <OutputSink... S>
+class SinkGroup final : public Sink {
+    std::tuple<S...> sinks_;
+
+public:
+    explicit SinkGroup(S... sinks) : sinks_(std::move(sinks)...) {}
+
+    void
+    on_book(const BookChange& book) override
+    {
+        std::apply([&book](auto&... sink) { (sink.on_book(book), ...); }, sinks_);
+    }
+
+    void
+    on_trade(const exchanges::Trade& trade) override
+    {
+        std::apply([&trade](auto&... sink) { (sink.on_trade(trade), ...); }, sinks_);
+    }
+
+    void
+    flush() override
+    {
+        std::apply([](auto&... sink) { (sink.flush(), ...); }, sinks_);
+    }
+
+    void
+    on_status(const FeedStatus& status) override
+    {
+        std::apply(
+            [&status](auto&... sink) { (status_to_sink(sink, status), ...); }, sinks_
+        );
+    }
+
+    template <size_t I>
+    [[nodiscard]] auto&
+    get() noexcept
+    {
+        return std::get<I>(sinks_);
+    }
+};
+
+/**
+ * Counts what it receives, and nothing else. For benchmarks.
+ */
+struct NullSink {
+    uint64_t books = 0;
+    uint64_t levels = 0;
+    uint64_t trades = 0;
+    uint64_t flushes = 0;
+
+    void
+    on_book(const BookChange& book) noexcept
+    {
+        books++;
+        levels += book.changes.size();
+    }
+
+    void
+    on_trade(const exchanges::Trade& /* trade */) noexcept
+    {
+        trades++;
+    }
+
+    void
+    flush() noexcept
+    {
+        flushes++;
+    }
+};
+
+/**
+ * A lock-free queue of book changes and trades, between one producer thread and
+ * one consumer thread.
+ *
+ * Events are copied into fixed size slots, so pushing never allocates. A book
+ * change takes a slot per changed level plus one. Pushing never waits: one larger
+ * than the room left is dropped whole and counted, and its product is marked for
+ * its whole book to be sent again once there's room, in parts that fit; see
+ * take_resends() and book_room(). Product ids and symbols longer than MAX_NAME_LEN
+ * are truncated.
+ */
+class EventQueue {
+public:
+    static constexpr size_t MAX_NAME_LEN = 22;
+
+    enum class Kind : uint8_t {
+        NONE, // the queue is empty
+        BOOK,
+        TRADE,
+        STATUS,
+    };
+
+private:
+    using name = std::array<char, MAX_NAME_LEN + 1>;
+
+    /**
+     * A slot. Levels of a book change come first, then its header.
+     */
+    struct queued_event {
+        enum class type : uint8_t { LEVEL, BOOK, TRADE, STATUS };
+
+        type kind = type::LEVEL;
+        exchanges::Venue venue{};
+        exchanges::Side side{}; // trades
+        bool snapshot = false;
+        bool reset = false;
+        bool connection = false; // statuses, along with stale in snapshot
+
+        name product_id{};
+        name symbol{};
+
+        uint64_t id = 0; // book sequence, trade id or silent milliseconds
+        uint64_t trade_sequence = 0;
+        int64_t timestamp = 0;
+
+        level_update level{}; // levels
+        book_features l1;     // book headers
+
+        // Trades
+        double price = 0;
+        double size = 0;
+        utils::Fixed exact_price;
+        utils::Fixed exact_size;
+    };
+
+    utils::SpscQueue<queued_event> queue_;
+    std::atomic<uint64_t> dropped_{0};
+
+    // Producer side
+    std::unordered_set<std::string> resends_; // products whose changes were dropped
+    uint64_t warn_at_ = 1; // drops at which to warn again
+
+    // Consumer side, what popped events point into
+    queued_event popped_;
+    std::vector<level_update> levels_;
+
+public:
+    /**
+     * @param capacity Slots, rounded up to a power of two.
+     */
+    explicit EventQueue(size_t capacity);
+
+    /**
+     * Queue a book change, from the producer thread.
+     *
+     * @returns bool False if it was dropped.
+     */
+    bool push(const BookChange& book);
+
+    /**
+     * Queue a trade, from the producer thread.
+     *
+     * @returns bool False if it was dropped.
+     */
+    bool push(const exchanges::Trade& trade) noexcept;
+
+    /**
+     * Queue a feed's status, from the producer thread.
+     *
+     * @returns bool False if it was dropped.
+     */
+    bool push(const FeedStatus& status) noexcept;
+
+    /**
+     * Pop the next whole event, from the consumer thread.
+     *
+     * A book change or status is valid until the next pop. A trade is assigned to
+     * `trade`, which keeps its product id's capacity between calls.
+     */
+    Kind pop(BookChange& book, exchanges::Trade& trade, FeedStatus& status);
+
+    /**
+     * Move out the products whose book changes were dropped, once the queue is at
+     * most half full, from the producer thread.
+     */
+    void take_resends(std::vector<std::string>& product_ids);
+
+    /**
+     * Levels a book change pushed now is sure to fit, from the producer thread.
+     */
+    [[nodiscard]] size_t
+    book_room() const noexcept
+    {
+        auto free = free_();
+        return free > 0 ? free - 1 : 0;
+    }
+
+    /**
+     * Events dropped because the queue was full.
+     */
+    [[nodiscard]] uint64_t
+    dropped() const noexcept
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    static void copy_name_(name& dst, std::string_view src) noexcept;
+
+    [[nodiscard]] size_t
+    free_() const noexcept
+    {
+        return queue_.capacity() - queue_.size_approx();
+    }
+
+    void count_drop_(std::string_view what) noexcept;
+};
+
+/**
+ * Runs a sink on its own thread, so it can't hold up the feed or other sinks.
+ *
+ * Events are queued without allocating. The thread hands everything queued to the
+ * sink, then flushes it, so the sink sees batches as large as it's behind by. If it
+ * falls so far behind that the queue fills, events are dropped and counted.
+ *
+ * Sinks with an idle() method have it called whenever the queue is empty.
+ */
+template <OutputSink S>
+class AsyncSink final : public Sink {
+    S sink_;
+    EventQueue queue_;
+    std::atomic<uint64_t> delivered_{0};
+
+    std::jthread thread_;
+
+public:
+    /**
+     * Start the sink's thread.
+     *
+     * @param args Passed to the sink's constructor.
+     */
+    template <class... Args>
+    explicit AsyncSink(size_t queue_capacity, Args&&... args) :
+        sink_(std::forward<Args>(args)...),
+        queue_(queue_capacity),
+        thread_([this](const std::stop_token& stop) { run_(stop); })
+    {}
+
+    /**
+     * Stop the thread, after delivering everything queued.
+     */
+    ~AsyncSink() override { stop(); }
+
+    AsyncSink(const AsyncSink&) = delete;
+    AsyncSink(AsyncSink&&) = delete;
+    AsyncSink& operator=(const AsyncSink&) = delete;
+    AsyncSink& operator=(AsyncSink&&) = delete;
+
+    void
+    on_book(const BookChange& book) override
+    {
+        queue_.push(book);
+    }
+
+    void
+    on_trade(const exchanges::Trade& trade) override
+    {
+        queue_.push(trade);
+    }
+
+    void
+    on_status(const FeedStatus& status) override
+    {
+        queue_.push(status);
+    }
+
+    void
+    take_resends(std::vector<std::string>& product_ids) override
+    {
+        queue_.take_resends(product_ids);
+    }
+
+    [[nodiscard]] size_t
+    book_room() const override
+    {
+        return queue_.book_room();
+    }
+
+    /**
+     * Nothing to do, the sink's thread flushes after each batch.
+     */
+    void
+    flush() override
+    {}
+
+    /**
+     * Deliver everything queued, then stop the thread. Nothing is delivered after.
+     */
+    void
+    stop()
+    {
+        if (!thread_.joinable())
+            return;
+
+        thread_.request_stop();
+        thread_.join();
+    }
+
+    /**
+     * The sink itself; only safe to use from other threads once stopped.
+     */
+    [[nodiscard]] S&
+    sink() noexcept
+    {
+        return sink_;
+    }
+
+    [[nodiscard]] uint64_t
+    dropped() const noexcept
+    {
+        return queue_.dropped();
+    }
+
+    [[nodiscard]] uint64_t
+    delivered() const noexcept
+    {
+        return delivered_.load(std::memory_order_relaxed);
+    }
+
+private:
+    void
+    run_(const std::stop_token& stop)
+    {
+        logging::set_thread_name("sink");
+
+        BookChange book;
+        exchanges::Trade trade;
+        FeedStatus status;
+
+        constexpr auto IDLE_SLEEP = std::chrono::microseconds(SINK_IDLE_SLEEP_US);
+
+        while (!stop.stop_requested()) {
+            if (drain_(book, trade, status) != 0) {
+                sink_.flush();
+                continue;
+            }
+
+            // Nothing to do, don't spin; sinks that serve requests can meanwhile
+            if constexpr (requires { sink_.idle(); })
+                sink_.idle();
+
+            std::this_thread::sleep_for(IDLE_SLEEP);
+        }
+
+        drain_(book, trade, status);
+        sink_.flush();
+    }
+
+    size_t
+    drain_(BookChange& book, exchanges::Trade& trade, FeedStatus& status)
+    {
+        size_t count = 0;
+
+        while (true) {
+            auto kind = queue_.pop(book, trade, status);
+
+            if (kind == EventQueue::Kind::BOOK)
+                sink_.on_book(book);
+            else if (kind == EventQueue::Kind::TRADE)
+                sink_.on_trade(trade);
+            else if (kind == EventQueue::Kind::STATUS)
+                status_to_sink(sink_, status);
+            else
+                break;
+
+            count++;
+        }
+
+        delivered_.fetch_add(count, std::memory_order_relaxed);
+        return count;
+    }
+};
+
+} // namespace storage
+} // namespace raccoon
@@ -0,0 +1,46 @@
+#include "staleness.hpp"
+
+namespace raccoon {
+namespace storage {
+
+void
+StalenessTracker::find_(exchanges::Venue venue, std::string_view product_id)
+{
+    auto it = products_.find(std::string(product_id));
+
+    if (it == products_.end()) {
+        product_state state;
+        state.venue = venue;
+        state.last_seen = clock::now();
+
+        it = products_.emplace(product_id, state).first;
+    }
+
+    // Nodes don't move, so the key can be kept
+    last_product_ = it->first;
+    last_state_ = &it->second;
+}
+
+FeedStatus
+StalenessTracker::status_(
+    const std::string& product_id,
+    const product_state& state,
+    bool stale,
+    clock::duration silent
+)
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+
+    return {
+        .venue = state.venue,
+        .feed = product_id,
+        .connection = false,
+        .stale = stale,
+        .silent_ms =
+            std::chrono::duration_cast<std::chrono::milliseconds>(silent).count(),
+        .timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count(),
+    };
+}
+
+} // namespace storage
+} // namespace raccoon
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "common.hpp"
+#include "exchanges/events.hpp"
+#include "sink.hpp"
+
+#include <chrono>
+#include <string_view>
+#include <unordered_map>
+
+namespace raccoon {
+namespace storage {
+
+/**
+ * Notices products nothing arrived for in a while, on connections that may still
+ * be busy with others.
+ *
+ * Events only set a flag; the time is read when products are checked, at most once
+ * per STALE_CHECK_INTERVAL_MS, so silence is measured to within that.
+ */
+class StalenessTracker {
+public:
+    using clock = std::chrono::steady_clock;
+
+private:
+    struct product_state {
+        exchanges::Venue venue{};
+        bool seen = false; // since the last check
+        bool stale = false;
+        clock::time_point last_seen;
+        clock::time_point last_stale; // last told stale
+    };
+
+    clock::duration stale_after_;
+    clock::duration check_interval_;
+    clock::time_point last_check_;
+
+    std::unordered_map<std::string, product_state> products_;
+
+    // Feeds mostly bring one product after another of the same
+    std::string_view last_product_;
+    product_state* last_state_ = nullptr;
+
+public:
+    /**
+     * @param stale_after Silence before a product is stale, 0 to never check.
+     */
+    explicit StalenessTracker(
+        clock::duration stale_after = std::chrono::milliseconds(PRODUCT_STALE_AFTER_MS),
+        clock::duration check_interval =
+            std::chrono::milliseconds(STALE_CHECK_INTERVAL_MS)
+    ) :
+        stale_after_(stale_after),
+        check_interval_(check_interval)
+    {}
+
+    void
+    set_stale_after(clock::duration stale_after) noexcept
+    {
+        stale_after_ = stale_after;
+    }
+
+    /**
+     * Something arrived for a product.
+     */
+    void
+    on_event(exchanges::Venue venue, std::string_view product_id)
+    {
+        if (last_state_ == nullptr || product_id != last_product_) [[unlikely]]
+            find_(venue, product_id);
+
+        last_state_->seen = true;
+    }
+
+    /**
+     * Check every product, if it's been long enough since the last time.
+     *
+     * Products that went stale are passed to `on_change`, and passed again every
+     * `stale_after` while they stay stale; then once more when something arrives.
+     *
+     * @param on_change Called with a FeedStatus, valid for the call.
+     */
+    template <class OnChange>
+    void
+    check(clock::time_point now, OnChange&& on_change)
+    {
+        if (stale_after_ == clock::duration::zero()) [[unlikely]]
+            return;
+
+        if (now - last_check_ < check_interval_)
+            return;
+
+        last_check_ = now;
+
+        for (auto& [product_id, state] : products_) {
+            auto silent = now - state.last_seen;
+
+            if (state.seen) [[likely]] {
+                state.seen = false;
+                state.last_seen = now;
+
+                if (state.stale) [[unlikely]] {
+                    state.stale = false;
+                    on_change(status_(product_id, state, false, silent));
+                }
+
+                continue;
+            }
+
+            if (silent < stale_after_)
+                continue;
+
+            if (state.stale && now - state.last_stale < stale_after_)
+                continue;
+
+            state.stale = true;
+            state.last_stale = now;
+            on_change(status_(product_id, state, true, silent));
+        }
+    }
+
+    /**
+     * Products being tracked.
+     */
+    [[nodiscard]] size_t
+    size() const noexcept
+    {
+        return products_.size();
+    }
+
+private:
+    /**
+     * Look a product up, adding it if it's new, and remember it as the last one.
+     */
+    void find_(exchanges::Venue venue, std::string_view product_id);
+
+    static FeedStatus status_(
+        const std::string& product_id,
+        const product_state& state,
+        bool stale,
+        clock::duration silent
+    );
+};
+
+} // namespace storage
+} // namespace raccoon
@@ -1,3 +1,4 @@
 #pragma once
 
+#include "multicast.hpp"
 #include "processing.hpp"
@@ -0,0 +1,571 @@
+#include "ticks.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+namespace raccoon {
+namespace storage {
+
+static constexpr int64_t NANOS_PER_DAY = 86'400'000'000'000;
+
+namespace ticks {
+
+// Favour speed: the columns are mostly runs of small fixed-width values, which run
+// length matching handles nearly as well as a full search, at a third of the cost
+static constexpr int COMPRESSION_LEVEL = 1;
+static constexpr int COMPRESSION_STRATEGY = Z_RLE;
+static constexpr int WINDOW_BITS = 15;
+static constexpr int MEM_LEVEL = 8;
+
+static constexpr uint64_t
+zigzag(int64_t value) noexcept
+{
+    return (static_cast<uint64_t>(value) << 1U) ^ static_cast<uint64_t>(value >> 63);
+}
+
+static constexpr int64_t
+unzigzag(uint64_t value) noexcept
+{
+    return static_cast<int64_t>(value >> 1U) ^ -static_cast<int64_t>(value & 1U);
+}
+
+// Columns are stored as raw little-endian integers
+static_assert(std::endian::native == std::endian::little);
+
+// Powers of ten a column can be scaled down by
+static constexpr std::array<int64_t, 19> POW10 = [] {
+    std::array<int64_t, 19> res{};
+    res[0] = 1;
+    for (size_t i = 1; i < res.size(); i++)
+        res[i] = res[i - 1] * 10;
+    return res;
+}();
+
+/**
+ * Largest power of ten dividing every value in a column.
+ *
+ * Prices sit on a tick grid and millisecond timestamps end in zeros, so dividing
+ * it out shrinks the values a lot.
+ */
+template <class T>
+static uint8_t
+common_scale(const std::vector<T>& column) noexcept
+{
+    auto exp = static_cast<uint8_t>(POW10.size() - 1);
+
+    // One division per value once the exponent settles
+    for (auto value : column) {
+        while (exp > 0 && static_cast<int64_t>(value) % POW10[exp] != 0)
+            exp--;
+
+        if (exp == 0)
+            break;
+    }
+
+    return exp;
+}
+
+/**
+ * Encode a column: scale byte, width byte, base value, then one fixed width value
+ * per row.
+ *
+ * Delta columns start from the base (their first value), so the deltas stay small.
+ * Fixed widths (rather than varints) keep decoding branch free; zlib takes care of
+ * the zero bytes.
+ */
+template <bool Delta, class T>
+static void
+put_column(std::vector<uint8_t>& out, const std::vector<T>& column)
+{
+    thread_local std::vector<uint64_t> values;
+    values.clear();
+
+    auto exp = common_scale(column);
+    auto scale = POW10[exp];
+
+    int64_t base = 0;
+    if (Delta && !column.empty())
+        base = static_cast<int64_t>(column[0]) / scale;
+
+    int64_t prev = base;
+    uint64_t all_bits = 0;
+
+    for (auto raw : column) {
+        auto value = static_cast<int64_t>(raw) / scale;
+        auto encoded = zigzag(Delta ? value - prev : value);
+
+        values.push_back(encoded);
+        all_bits |= encoded;
+        prev = value;
+    }
+
+    uint8_t width = all_bits >> 32U ? 8 : all_bits >> 16U ? 4 : all_bits >> 8U ? 2 : 1;
+
+    out.push_back(exp);
+    out.push_back(width);
+
+    auto offset = out.size();
+    out.resize(offset + sizeof(base) + values.size() * width);
+
+    std::memcpy(out.data() + offset, &base, sizeof(base));
+    offset += sizeof(base);
+
+    for (size_t i = 0; i < values.size(); i++)
+        std::memcpy(out.data() + offset + i * width, &values[i], width);
+}
+
+template <bool Delta, class W, class T>
+static void
+decode_column(
+    const uint8_t* pos, size_t rows, int64_t base, int64_t scale, T* out
+) noexcept
+{
+    int64_t prev = base;
+
+    for (size_t i = 0; i < rows; i++) {
+        W packed{};
+        std::memcpy(&packed, pos + i * sizeof(W), sizeof(W));
+
+        auto value = unzigzag(packed);
+        if constexpr (Delta) {
+            prev += value;
+            value = prev;
+        }
+
+        out[i] = static_cast<T>(value * scale); // NOLINT(*-pointer-arithmetic)
+    }
+}
+
+template <bool Delta, class T>
+static bool
+get_column(
+    const uint8_t*& pos, const uint8_t* end, size_t rows, std::vector<T>& column
+)
+{
+    int64_t base = 0;
+
+    if (end - pos < 2 + static_cast<ptrdiff_t>(sizeof(base)) || pos[0] >= POW10.size())
+        [[unlikely]]
+        return false;
+
+    auto scale = POW10[pos[0]];
+    auto width = pos[1];
+
+    std::memcpy(&base, pos + 2, sizeof(base));
+    pos += 2 + sizeof(base);
+
+    if (static_cast<size_t>(end - pos) < rows * width) [[unlikely]]
+        return false;
+
+    column.resize(rows);
+
+    switch (width) {
+        case 1:
+            decode_column<Delta, uint8_t>(pos, rows, base, scale, column.data());
+            break;
+        case 2:
+            decode_column<Delta, uint16_t>(pos, rows, base, scale, column.data());
+            break;
+        case 4:
+            decode_column<Delta, uint32_t>(pos, rows, base, scale, column.data());
+            break;
+        case 8:
+            decode_column<Delta, uint64_t>(pos, rows, base, scale, column.data());
+            break;
+        [[unlikely]] default:
+            return false;
+    }
+
+    pos += rows * width;
+    return true;
+}
+
+void
+encode_block(const TickColumns& columns, std::string& out)
+{
+    thread_local std::vector<uint8_t> raw;
+
+    raw.clear();
+
+    put_column<true>(raw, columns.timestamps);
+    put_column<true>(raw, columns.ids);
+
+    for (auto side : columns.sides)
+        raw.push_back(static_cast<uint8_t>(side));
+
+    put_column<true>(raw, columns.prices);
+    put_column<false>(raw, columns.sizes);
+
+    // Compress straight into the output, after the header
+    auto bound = compressBound(static_cast<uLong>(raw.size()));
+    auto offset = out.size();
+    out.resize(offset + sizeof(BlockHeader) + bound);
+
+    auto* dest = reinterpret_cast<Bytef*>(out.data() + offset + sizeof(BlockHeader));
+    z_stream stream{};
+    int err = deflateInit2(
+        &stream,
+        COMPRESSION_LEVEL,
+        Z_DEFLATED,
+        WINDOW_BITS,
+        MEM_LEVEL,
+        COMPRESSION_STRATEGY
+    );
+
+    if (err == Z_OK) [[likely]] {
+        stream.next_in = raw.data();
+        stream.avail_in = static_cast<uInt>(raw.size());
+        stream.next_out = dest;
+        stream.avail_out = static_cast<uInt>(bound);
+
+        err = deflate(&stream, Z_FINISH);
+        deflateEnd(&stream);
+    }
+
+    if (err != Z_STREAM_END) [[unlikely]] {
+        log_e(main, "Could not compress tick block: zlib error {}", err);
+        out.resize(offset);
+        return;
+    }
+
+    auto compressed_size = stream.total_out;
+
+    BlockHeader header{
+        .magic = BLOCK_MAGIC,
+        .rows = static_cast<uint32_t>(columns.size()),
+        .raw_size = static_cast<uint32_t>(raw.size()),
+        .compressed_size = static_cast<uint32_t>(compressed_size),
+        .first_timestamp = columns.timestamps.front(),
+        .last_timestamp = columns.timestamps.back(),
+    };
+
+    std::memcpy(out.data() + offset, &header, sizeof(header));
+    out.resize(offset + sizeof(BlockHeader) + compressed_size);
+}
+
+size_t
+decode_block(
+    std::string_view data, TickColumns& columns, std::vector<uint8_t>& scratch
+)
+{
+    if (data.size() < sizeof(BlockHeader)) [[unlikely]]
+        return 0;
+
+    BlockHeader header{};
+    std::memcpy(&header, data.data(), sizeof(header));
+
+    size_t block_size = sizeof(header) + header.compressed_size;
+
+    if (header.magic != BLOCK_MAGIC || block_size > data.size()) [[unlikely]]
+        return 0;
+
+    scratch.resize(header.raw_size);
+    uLongf raw_size = header.raw_size;
+
+    int err = uncompress(
+        scratch.data(),
+        &raw_size,
+        reinterpret_cast<const Bytef*>(data.data() + sizeof(header)),
+        header.compressed_size
+    );
+
+    if (err != Z_OK || raw_size != header.raw_size) [[unlikely]]
+        return 0;
+
+    const uint8_t* pos = scratch.data();
+    const uint8_t* end = pos + raw_size;
+    size_t rows = header.rows;
+
+    if (!get_column<true>(pos, end, rows, columns.timestamps)
+        || !get_column<true>(pos, end, rows, columns.ids)) [[unlikely]]
+        return 0;
+
+    if (static_cast<size_t>(end - pos) < rows) [[unlikely]]
+        return 0;
+
+    columns.sides.resize(rows);
+    for (auto& side : columns.sides)
+        side = static_cast<exchanges::Side>(*pos++);
+
+    if (!get_column<true>(pos, end, rows, columns.prices)
+        || !get_column<false>(pos, end, rows, columns.sizes)) [[unlikely]]
+        return 0;
+
+    return block_size;
+}
+
+std::filesystem::path
+file_path(
+    const std::filesystem::path& root,
+    TickKind kind,
+    exchanges::Venue venue,
+    std::string_view product_id,
+    int64_t timestamp
+)
+{
+    using namespace std::chrono;
+
+    sys_days day{days(timestamp / NANOS_PER_DAY)};
+    year_month_day date{day};
+
+    auto name = fmt::format(
+        "{:04}-{:02}-{:02}.{}",
+        static_cast<int>(date.year()),
+        static_cast<unsigned>(date.month()),
+        static_cast<unsigned>(date.day()),
+        kind == TickKind::DELTA ? "deltas" : "trades"
+    );
+
+    return root / exchanges::venue_name(venue) / product_id / name;
+}
+
+} // namespace ticks
+
+static int64_t
+now_nanos() noexcept
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+TickWriter::TickWriter(
+    std::filesystem::path root,
+    size_t queue_capacity,
+    size_t block_rows,
+    std::chrono::milliseconds flush_interval
+) :
+    root_(std::move(root)),
+    block_rows_(std::max<size_t>(block_rows, 1)),
+    flush_interval_(flush_interval),
+    queue_(queue_capacity, "tick queue"),
+    thread_([this](const std::stop_token& stop) { run_(stop); })
+{}
+
+TickWriter::~TickWriter()
+{
+    thread_.request_stop();
+    thread_.join();
+
+    log_i(
+        main,
+        "Tick writer wrote {} rows in {} bytes, dropped {}",
+        written(),
+        bytes_written(),
+        dropped()
+    );
+}
+
+void
+TickWriter::write(const exchanges::BookDelta& delta) noexcept
+{
+    // Book prices are still doubles, round them onto the fixed point grid
+    constexpr auto SCALE = static_cast<double>(utils::Fixed::SCALE);
+
+    auto timestamp = delta.timestamp ? delta.timestamp : now_nanos();
+
+    for (const auto& change : delta.changes) {
+        TickRow row{
+            .timestamp = timestamp,
+            .id = delta.sequence,
+            .side = change.side,
+            .price = std::llround(change.price * SCALE),
+            .size = std::llround(change.size * SCALE),
+        };
+
+        push_(TickKind::DELTA, delta.venue, delta.product_id, row);
+    }
+}
+
+void
+TickWriter::write(const exchanges::Trade& trade) noexcept
+{
+    TickRow row{
+        .timestamp = trade.timestamp ? trade.timestamp : now_nanos(),
+        .id = trade.trade_id,
+        .side = trade.side,
+        .price = trade.exact_price.raw,
+        .size = trade.exact_size.raw,
+    };
+
+    push_(TickKind::TRADE, trade.venue, trade.product_id, row);
+}
+
+void
+TickWriter::push_(
+    TickKind kind,
+    exchanges::Venue venue,
+    std::string_view product_id,
+    const TickRow& row
+) noexcept
+{
+    queued_row queued{.kind = kind, .venue = venue, .product_id = {}, .row = row};
+
+    auto len = std::min(product_id.size(), MAX_PRODUCT_LEN);
+    std::memcpy(queued.product_id.data(), product_id.data(), len);
+
+    if (!queue_.try_push(queued)) [[unlikely]]
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+TickWriter::run_(const std::stop_token& stop)
+{
+    logging::set_thread_name("ticks");
+
+    queued_row queued{};
+    auto next_flush = std::chrono::steady_clock::now() + flush_interval_;
+
+    while (!stop.stop_requested()) {
+        bool idle = true;
+
+        while (queue_.try_pop(queued)) {
+            append_(queued);
+            idle = false;
+        }
+
+        // Partial blocks too, so a crash loses at most an interval of rows
+        auto now = std::chrono::steady_clock::now();
+
+        if (now >= next_flush) {
+            for (auto& [key, file] : files_)
+                flush_(file);
+
+            next_flush = now + flush_interval_;
+        }
+
+        // Nothing to do, don't spin
+        if (idle)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // Write out everything left
+    while (queue_.try_pop(queued))
+        append_(queued);
+
+    for (auto& [key, file] : files_)
+        flush_(file);
+}
+
+void
+TickWriter::append_(const queued_row& queued)
+{
+    std::string_view product_id(queued.product_id.data());
+
+    // Key by kind, venue and product, without allocating once warmed up
+    key_.assign(product_id);
+    key_ += static_cast<char>('0' + static_cast<int>(queued.kind));
+    key_ += static_cast<char>('0' + static_cast<int>(queued.venue));
+
+    auto it = files_.find(key_);
+    if (it == files_.end()) [[unlikely]]
+        it = files_.emplace(key_, open_file{.path = {}, .day = -1, .block = {}}).first;
+
+    auto& file = it->second;
+    auto day = queued.row.timestamp / NANOS_PER_DAY;
+
+    // New day, new file
+    if (file.day != day) [[unlikely]] {
+        flush_(file);
+
+        file.day = day;
+        file.path = ticks::file_path(
+            root_, queued.kind, queued.venue, product_id, queued.row.timestamp
+        );
+    }
+
+    file.block.push_back(queued.row);
+
+    if (file.block.size() >= block_rows_)
+        flush_(file);
+}
+
+void
+TickWriter::flush_(open_file& file)
+{
+    if (file.block.size() == 0)
+        return;
+
+    encoded_.clear();
+    ticks::encode_block(file.block, encoded_);
+
+    if (encoded_.empty()) [[unlikely]] {
+        file.block.clear();
+        return;
+    }
+
+    std::error_code err;
+    std::filesystem::create_directories(file.path.parent_path(), err);
+
+    std::FILE* out = std::fopen(file.path.c_str(), "ab");
+    if (out == nullptr) [[unlikely]] {
+        log_e(main, "Could not open tick file {}: {}", file.path, strerror(errno));
+        file.block.clear();
+        return;
+    }
+
+    auto wrote = std::fwrite(encoded_.data(), 1, encoded_.size(), out);
+    std::fclose(out);
+
+    if (wrote != encoded_.size()) [[unlikely]] {
+        log_e(main, "Short write to tick file {}", file.path);
+    }
+    else {
+        written_.fetch_add(file.block.size(), std::memory_order_relaxed);
+        bytes_written_.fetch_add(wrote, std::memory_order_relaxed);
+    }
+
+    file.block.clear();
+}
+
+TickReader::TickReader(const std::filesystem::path& path)
+{
+    int fd = open(path.c_str(), O_RDONLY); // NOLINT(*-vararg)
+    if (fd < 0) {
+        log_e(main, "Could not open tick file {}: {}", path, strerror(errno));
+        return;
+    }
+
+    struct stat info {};
+
+    if (fstat(fd, &info) != 0) [[unlikely]] {
+        log_e(main, "Could not stat tick file {}: {}", path, strerror(errno));
+        close(fd);
+        return;
+    }
+
+    size_ = static_cast<size_t>(info.st_size);
+
+    if (size_ > 0) {
+        void* mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (mapped == MAP_FAILED) [[unlikely]] {
+            log_e(main, "Could not map tick file {}: {}", path, strerror(errno));
+            close(fd);
+            return;
+        }
+
+        madvise(mapped, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(mapped);
+    }
+
+    close(fd);
+    valid_ = true;
+}
+
+TickReader::~TickReader()
+{
+    if (data_ != nullptr)
+        munmap(const_cast<char*>(data_), size_); // NOLINT(*-const-cast)
+}
+
+} // namespace storage
+} // namespace raccoon
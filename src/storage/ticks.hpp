@@ -0,0 +1,371 @@
+#pragma once
+
+#include "common.hpp"
+#include "exchanges/events.hpp"
+#include "utils/spsc_queue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <span>
+#include <string_view>
+#include <thread>
+
+namespace raccoon {
+namespace storage {
+
+/**
+ * What a tick file holds.
+ */
+enum class TickKind : uint8_t {
+    DELTA, // one row per changed book level
+    TRADE, // one row per trade
+};
+
+/**
+ * One row of a tick file.
+ *
+ * Prices and sizes are fixed point (utils::Fixed::raw).
+ */
+struct TickRow {
+    int64_t timestamp; // nanoseconds since epoch
+    uint64_t id;       // book sequence number or trade id
+    exchanges::Side side;
+    int64_t price;
+    int64_t size;
+};
+
+/**
+ * A block of rows, stored by column.
+ */
+struct TickColumns {
+    std::vector<int64_t> timestamps;
+    std::vector<uint64_t> ids;
+    std::vector<exchanges::Side> sides;
+    std::vector<int64_t> prices;
+    std::vector<int64_t> sizes;
+
+    void
+    push_back(const TickRow& row)
+    {
+        timestamps.push_back(row.timestamp);
+        ids.push_back(row.id);
+        sides.push_back(row.side);
+        prices.push_back(row.price);
+        sizes.push_back(row.size);
+    }
+
+    [[nodiscard]] TickRow
+    operator[](size_t idx) const noexcept
+    {
+        return {timestamps[idx], ids[idx], sides[idx], prices[idx], sizes[idx]};
+    }
+
+    [[nodiscard]] size_t
+    size() const noexcept
+    {
+        return timestamps.size();
+    }
+
+    void
+    clear() noexcept
+    {
+        timestamps.clear();
+        ids.clear();
+        sides.clear();
+        prices.clear();
+        sizes.clear();
+    }
+};
+
+/**
+ * On-disk format of tick files.
+ *
+ * A file is a sequence of self-contained blocks, so files can be appended to after
+ * a restart. Each block is a header followed by its zlib compressed columns:
+ *
+ *   timestamps  first value, then deltas
+ *   ids         first value, then deltas
+ *   sides       one byte per row
+ *   prices      first value, then deltas
+ *   sizes       values
+ *
+ * Every column but sides starts with a scale byte N, a width byte W and an 8 byte
+ * base that deltas start from. Its values are divided by 10^N, zigzag encoded, and
+ * stored little-endian in W bytes each.
+ *
+ * The header records the time range of the block, so readers can skip blocks
+ * without decompressing them.
+ */
+namespace ticks {
+
+inline constexpr uint32_t BLOCK_MAGIC = 0x314B5452; // "RTK1"
+
+struct BlockHeader {
+    uint32_t magic;
+    uint32_t rows;
+    uint32_t raw_size;
+    uint32_t compressed_size;
+    int64_t first_timestamp;
+    int64_t last_timestamp;
+};
+
+static_assert(sizeof(BlockHeader) == 32);
+
+/**
+ * Encode and compress a block, appending it to a buffer.
+ */
+void encode_block(const TickColumns& columns, std::string& out);
+
+/**
+ * Decompress and decode the block starting at the front of some data.
+ *
+ * @param scratch Reused buffer for the decompressed block.
+ *
+ * @returns size_t Bytes consumed, or 0 if the block is malformed.
+ */
+size_t decode_block(
+    std::string_view data, TickColumns& columns, std::vector<uint8_t>& scratch
+);
+
+/**
+ * Path of the file holding a product's ticks for the day of a timestamp.
+ *
+ * Laid out as {root}/{venue}/{product}/{YYYY-MM-DD}.{deltas,trades}.
+ */
+std::filesystem::path file_path(
+    const std::filesystem::path& root,
+    TickKind kind,
+    exchanges::Venue venue,
+    std::string_view product_id,
+    int64_t timestamp
+);
+
+} // namespace ticks
+
+/**
+ * Writes book deltas and trades to columnar tick files in the background.
+ *
+ * The hot path only copies rows into a lock-free queue; a writer thread groups
+ * them into blocks per file, then encodes, compresses and appends full blocks.
+ * Partial blocks are appended too every flush interval, so rows of quiet products
+ * reach disk. Rows are dropped (and counted) if the writer falls behind and the
+ * queue fills.
+ */
+class TickWriter {
+    // Longest product id we store; longer ones are truncated
+    static constexpr size_t MAX_PRODUCT_LEN = 22;
+
+    /**
+     * A row on its way to the writer thread.
+     */
+    struct queued_row {
+        TickKind kind;
+        exchanges::Venue venue;
+        std::array<char, MAX_PRODUCT_LEN + 1> product_id;
+        TickRow row;
+    };
+
+    /**
+     * A file being written, and the block being built for it.
+     */
+    struct open_file {
+        std::filesystem::path path;
+        int64_t day;
+        TickColumns block;
+    };
+
+    std::filesystem::path root_;
+    size_t block_rows_;
+    std::chrono::milliseconds flush_interval_;
+
+    utils::SpscQueue<queued_row> queue_;
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> written_{0};
+    std::atomic<uint64_t> bytes_written_{0};
+
+    // Only touched by the writer thread
+    std::unordered_map<std::string, open_file> files_;
+    std::string key_;
+    std::string encoded_;
+
+    std::jthread thread_;
+
+public:
+    /**
+     * Create a new tick writer and start its thread.
+     *
+     * @param root Directory to write tick files under.
+     * @param queue_capacity Rows that can be queued before they are dropped.
+     * @param block_rows Rows per compressed block.
+     * @param flush_interval Longest a row waits for its block to fill.
+     */
+    explicit TickWriter(
+        std::filesystem::path root,
+        size_t queue_capacity = TICK_QUEUE_CAPACITY,
+        size_t block_rows = TICK_BLOCK_ROWS,
+        std::chrono::milliseconds flush_interval =
+            std::chrono::milliseconds(TICK_FLUSH_INTERVAL_MS)
+    );
+
+    /**
+     * Stop the writer thread, after writing everything queued.
+     */
+    ~TickWriter();
+
+    TickWriter(const TickWriter&) = delete;
+    TickWriter(TickWriter&&) = delete;
+    TickWriter& operator=(const TickWriter&) = delete;
+    TickWriter& operator=(TickWriter&&) = delete;
+
+    /**
+     * Queue every level change in a book delta.
+     */
+    void write(const exchanges::BookDelta& delta) noexcept;
+
+    /**
+     * Queue a trade.
+     */
+    void write(const exchanges::Trade& trade) noexcept;
+
+    /**
+     * Rows dropped because the queue was full.
+     */
+    [[nodiscard]] uint64_t
+    dropped() const noexcept
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Rows written to disk.
+     */
+    [[nodiscard]] uint64_t
+    written() const noexcept
+    {
+        return written_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Compressed bytes written to disk.
+     */
+    [[nodiscard]] uint64_t
+    bytes_written() const noexcept
+    {
+        return bytes_written_.load(std::memory_order_relaxed);
+    }
+
+private:
+    void push_(
+        TickKind kind,
+        exchanges::Venue venue,
+        std::string_view product_id,
+        const TickRow& row
+    ) noexcept;
+
+    void run_(const std::stop_token& stop);
+    void append_(const queued_row& queued);
+    void flush_(open_file& file);
+};
+
+/**
+ * Reads a tick file through a memory map.
+ */
+class TickReader {
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool valid_ = false;
+
+    TickColumns columns_;
+    std::vector<uint8_t> scratch_;
+
+public:
+    /**
+     * Map a tick file. Check valid() before reading.
+     */
+    explicit TickReader(const std::filesystem::path& path);
+
+    ~TickReader();
+
+    TickReader(const TickReader&) = delete;
+    TickReader(TickReader&&) = delete;
+    TickReader& operator=(const TickReader&) = delete;
+    TickReader& operator=(TickReader&&) = delete;
+
+    /**
+     * If the file was mapped.
+     */
+    [[nodiscard]] bool
+    valid() const noexcept
+    {
+        return valid_;
+    }
+
+    /**
+     * Call a function with every block overlapping a time range.
+     *
+     * Blocks may contain rows just outside the range; use for_each() for exact
+     * bounds.
+     *
+     * @param from First timestamp, inclusive.
+     * @param to Last timestamp, inclusive.
+     * @param func Called with the decoded columns of each block.
+     *
+     * @returns bool False if the file is corrupt past some point.
+     */
+    template <class F>
+    bool
+    for_each_block(int64_t from, int64_t to, F&& func)
+    {
+        std::string_view data(data_, size_);
+
+        while (data.size() >= sizeof(ticks::BlockHeader)) {
+            ticks::BlockHeader header{};
+            std::memcpy(&header, data.data(), sizeof(header));
+
+            if (header.magic != ticks::BLOCK_MAGIC) [[unlikely]]
+                return false;
+
+            size_t block_size = sizeof(header) + header.compressed_size;
+
+            if (block_size > data.size()) [[unlikely]]
+                return false;
+
+            // Skip without decompressing
+            if (header.last_timestamp < from || header.first_timestamp > to) {
+                data.remove_prefix(block_size);
+                continue;
+            }
+
+            if (ticks::decode_block(data, columns_, scratch_) == 0) [[unlikely]]
+                return false;
+
+            func(std::as_const(columns_));
+            data.remove_prefix(block_size);
+        }
+
+        return data.empty();
+    }
+
+    /**
+     * Call a function with every row in a time range.
+     *
+     * @returns bool False if the file is corrupt past some point.
+     */
+    template <class F>
+    bool
+    for_each(int64_t from, int64_t to, F&& func)
+    {
+        return for_each_block(from, to, [&](const TickColumns& columns) {
+            for (size_t i = 0; i < columns.size(); i++) {
+                auto timestamp = columns.timestamps[i];
+
+                if (timestamp >= from && timestamp <= to) [[likely]]
+                    func(columns[i]);
+            }
+        });
+    }
+};
+
+} // namespace storage
+} // namespace raccoon
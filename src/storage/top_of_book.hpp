@@ -0,0 +1,236 @@
+#pragma once
+
+#include "common.hpp"
+#include "exchanges/events.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <span>
+
+namespace raccoon {
+namespace storage {
+
+/**
+ * The best levels of one side of a book, kept sorted best first.
+ *
+ * Holds between `depth` and 2 * `depth` levels, so that removing a level near the
+ * top only needs a rescan of the full side once the slack is used up. It can be
+ * told to keep more, for readers of more than `depth` levels; see keep().
+ *
+ * Invariant: the cache holds exactly the best `size()` levels of the side.
+ *
+ * @tparam Compare Orders prices best first, std::greater<> for bids.
+ */
+template <class Compare>
+class TopLevels {
+    std::vector<exchanges::PriceLevel> levels_;
+    size_t depth_;
+    size_t kept_; // fewest levels held, unless the side has fewer
+
+    // If the cache holds every level on the side
+    bool complete_ = true;
+
+public:
+    explicit TopLevels(size_t depth = BOOK_FEATURE_DEPTH) : depth_(depth), kept_(depth)
+    {
+        levels_.reserve(2 * kept_ + 1);
+    }
+
+    /**
+     * Hold at least this many levels, or `depth` if more, rebuilding from the side.
+     */
+    template <class Levels>
+    void
+    keep(size_t levels, const Levels& side)
+    {
+        kept_ = std::max(depth_, levels);
+        levels_.reserve(2 * kept_ + 1);
+
+        rebuild(side);
+    }
+
+    /**
+     * Apply a change to a level of the side.
+     *
+     * @param side The full side, with the change already applied.
+     */
+    template <class Levels>
+    void
+    on_change(double price, double new_size, const Levels& side)
+    {
+        auto it = find_(price);
+        bool present = it != levels_.end() && !better_(price, it->price)
+                       && !better_(it->price, price);
+
+        if (new_size <= 0.0) {
+            if (!present)
+                return;
+
+            levels_.erase(it);
+
+            if (levels_.size() < kept_ && !complete_) [[unlikely]]
+                rebuild(side);
+
+            return;
+        }
+
+        if (present) {
+            it->size = new_size;
+            return;
+        }
+
+        // Worse than everything we hold, and we don't hold everything
+        if (it == levels_.end() && !complete_)
+            return;
+
+        levels_.insert(it, {price, new_size});
+
+        if (levels_.size() > 2 * kept_) {
+            levels_.pop_back();
+            complete_ = false;
+        }
+    }
+
+    /**
+     * Rebuild from the full side.
+     */
+    template <class Levels>
+    void
+    rebuild(const Levels& side)
+    {
+        levels_.clear();
+
+        for (const auto& [price, size] : side) {
+            if (levels_.size() == 2 * kept_) {
+                if (!better_(price, levels_.back().price))
+                    continue;
+
+                levels_.pop_back();
+            }
+
+            levels_.insert(find_(price), {price, size});
+        }
+
+        complete_ = levels_.size() == side.size();
+    }
+
+    /**
+     * The best level, if any.
+     */
+    [[nodiscard]] const exchanges::PriceLevel*
+    best() const noexcept
+    {
+        return levels_.empty() ? nullptr : &levels_.front();
+    }
+
+    /**
+     * Up to `depth` best levels, best first.
+     */
+    [[nodiscard]] std::span<const exchanges::PriceLevel>
+    top() const noexcept
+    {
+        return {levels_.data(), std::min(depth_, levels_.size())};
+    }
+
+    /**
+     * Up to `count` best levels, best first. Only every one of them when `count` is
+     * at most what it was told to keep.
+     */
+    [[nodiscard]] std::span<const exchanges::PriceLevel>
+    top(size_t count) const noexcept
+    {
+        return {levels_.data(), std::min(count, levels_.size())};
+    }
+
+    [[nodiscard]] size_t
+    size() const noexcept
+    {
+        return levels_.size();
+    }
+
+private:
+    static bool
+    better_(double lhs, double rhs) noexcept
+    {
+        return Compare{}(lhs, rhs);
+    }
+
+    /**
+     * First level that is not better than a price.
+     */
+    auto
+    find_(double price) noexcept
+    {
+        return std::partition_point(
+            levels_.begin(),
+            levels_.end(),
+            [price](const exchanges::PriceLevel& level) {
+                return better_(level.price, price);
+            }
+        );
+    }
+};
+
+/**
+ * Top of book and features derived from it.
+ */
+struct book_features {
+    bool valid = false; // false if either side is empty
+
+    double bid = 0.0;
+    double bid_size = 0.0;
+    double ask = 0.0;
+    double ask_size = 0.0;
+
+    double spread = 0.0;
+    double mid = 0.0;
+    double microprice = 0.0; // mid weighted towards the thinner side
+
+    double bid_depth = 0.0; // cumulative size of the top levels
+    double ask_depth = 0.0;
+    double imbalance = 0.0; // (bid_depth - ask_depth) / (bid_depth + ask_depth)
+};
+
+/**
+ * Compute top of book features from the best levels of each side.
+ */
+template <class BidCompare, class AskCompare>
+book_features
+compute_features(
+    const TopLevels<BidCompare>& bids, const TopLevels<AskCompare>& asks
+) noexcept
+{
+    book_features res;
+
+    for (const auto& level : bids.top())
+        res.bid_depth += level.size;
+    for (const auto& level : asks.top())
+        res.ask_depth += level.size;
+
+    if (double total = res.bid_depth + res.ask_depth; total > 0.0)
+        res.imbalance = (res.bid_depth - res.ask_depth) / total;
+
+    const auto* bid = bids.best();
+    const auto* ask = asks.best();
+
+    if (bid == nullptr || ask == nullptr)
+        return res;
+
+    res.valid = true;
+
+    res.bid = bid->price;
+    res.bid_size = bid->size;
+    res.ask = ask->price;
+    res.ask_size = ask->size;
+
+    res.spread = res.ask - res.bid;
+    res.mid = (res.ask + res.bid) / 2;
+    res.microprice =
+        (res.bid * res.ask_size + res.ask * res.bid_size)
+        / (res.bid_size + res.ask_size);
+
+    return res;
+}
+
+} // namespace storage
+} // namespace raccoon
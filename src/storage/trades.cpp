@@ -1,9 +1,41 @@
 #include "trades.hpp"
 
+#include "utils/fixed_point.hpp"
+
+#include <array>
+
 namespace raccoon {
 namespace storage {
+
+/**
+ * Fill in a trade as it's written under `matches`.
+ */
+static void
+to_record(const exchanges::Trade& trade, MatchRecord& record)
+{
+    using namespace std::chrono;
+
+    // As Coinbase sends it; the fraction is added separately, as {fmt} only
+    // prints it for sub-second times from 10.0 on
+    auto since_epoch = duration_cast<microseconds>(nanoseconds(trade.timestamp));
+    auto whole = floor<seconds>(since_epoch);
+
+    record.time = fmt::format(
+        "{:%FT%H:%M:%S}.{:06}Z",
+        sys_seconds(whole),
+        (since_epoch - whole).count()
+    );
+    record.trade_id = trade.trade_id;
+    record.maker_order_id = trade.maker_order_id;
+    record.taker_order_id = trade.taker_order_id;
+    record.side = trade.side == exchanges::Side::BID ? "sell" : "buy";
+    record.size = utils::to_string(trade.exact_size);
+    record.price = utils::to_string(trade.exact_price);
+    record.product_id = trade.product_id;
+    record.sequence = trade.sequence;
+}
 void
-TradeProcessor::process_incoming_match(const Match& match)
+TradeProcessor::process_incoming_match(const exchanges::Trade& match)
 {
     if (last_reset_ + std::chrono::seconds(1) < std::chrono::system_clock::now()) {
         matches_.clear();
@@ -15,17 +47,38 @@ TradeProcessor::process_incoming_match(const Match& match)
 void
 TradeProcessor::matches_to_redis(redisContext* redis)
 {
-    std::string serialized_matches;
-    glz::write_json(matches_, serialized_matches);
+    // The same fields and types as they've always had
+    records_.resize(matches_.size());
 
-    redisReply* reply = static_cast<redisReply*>(
-        redisCommand(redis, "SET %s %s", "matches", serialized_matches.c_str())
-    );
+    for (size_t i = 0; i < matches_.size(); i++)
+        to_record(matches_[i], records_[i]);
+
+    std::pmr::string serialized_matches(scratch_);
+    glz::write_json(records_, serialized_matches);
+
+    RedisCommand set("SET", scratch_);
+    set.arg("matches").arg(serialized_matches);
 
-    if (reply == nullptr) {
-        log_e(main, "Redis error: {}", redis->errstr);
+    if (notify_ == NotifyMode::NONE || matches_.empty()) [[likely]] {
+        redis_pipeline(redis, std::span(&set, 1));
         return;
     }
+
+    const auto& trade = matches_.back();
+
+    Notification notification(notify_, trade.product_id, scratch_);
+    notification.field("type", "trade")
+        .field("product", trade.product_id)
+        .field("venue", exchanges::venue_name(trade.venue))
+        .field("trade_id", trade.trade_id)
+        .field("sequence", trade.sequence)
+        .field("timestamp", trade.timestamp)
+        .field("side", trade.side == exchanges::Side::BID ? "buy" : "sell")
+        .field("price", trade.price)
+        .field("size", trade.size);
+
+    std::array commands{std::move(set), std::move(notification).finish()};
+    redis_pipeline(redis, commands);
 }
 
 } // namespace storage
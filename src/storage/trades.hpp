@@ -1,35 +1,71 @@
+#pragma once
+
 #include "common.hpp"
+#include "exchanges/events.hpp"
+#include "notify.hpp"
 
 #include <glaze/glaze.hpp>
 #include <hiredis/hiredis.h>
 
 #include <chrono>
+#include <memory_resource>
 
 namespace raccoon {
 namespace storage {
 
-struct Match {
+/**
+ * A trade as written under `matches`, in the shape of a Coinbase match, which its
+ * readers were written against.
+ */
+struct MatchRecord {
     std::string type = "match";
-    std::string time;
-    int trade_id;
+    std::string time; // ISO 8601, to the microsecond
+    uint64_t trade_id{};
     std::string maker_order_id;
     std::string taker_order_id;
-    std::string side;
+    std::string side; // the maker's
     std::string size;
     std::string price;
     std::string product_id;
-    int sequence;
+    uint64_t sequence{};
 };
 
 class TradeProcessor {
 private:
-    std::vector<Match> matches_;
+    std::vector<exchanges::Trade> matches_;
+    std::vector<MatchRecord> records_; // reused between writes
     std::chrono::time_point<std::chrono::system_clock> last_reset_;
+    NotifyMode notify_ = NotifyMode::NONE;
+
+    // Where the serialized matches and commands are built, only until they're sent
+    std::pmr::memory_resource* scratch_ = std::pmr::get_default_resource();
 
 public:
     TradeProcessor() : last_reset_(std::chrono::system_clock::now()) {}
 
-    void process_incoming_match(const Match& match);
+    /**
+     * Build Redis commands in scratch memory, as OrderbookProcessor does.
+     */
+    void
+    set_scratch(std::pmr::memory_resource* scratch) noexcept
+    {
+        scratch_ = scratch;
+    }
+
+    /**
+     * Announce each trade on its product's notifications.
+     */
+    void
+    set_notify(NotifyMode mode) noexcept
+    {
+        notify_ = mode;
+    }
+
+    void process_incoming_match(const exchanges::Trade& match);
+    /**
+     * Write the last second of trades to `matches`, with a notification of the
+     * latest in the same pipeline.
+     */
     void matches_to_redis(redisContext* redis);
 };
 
@@ -37,8 +73,8 @@ public:
 } // namespace raccoon
 
 template <>
-struct glz::meta<raccoon::storage::Match> {
-    using T = raccoon::storage::Match;
+struct glz::meta<raccoon::storage::MatchRecord> {
+    using T = raccoon::storage::MatchRecord;
     static constexpr auto value = object(
         "type",
         &T::type,
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "common.hpp"
+#include "reserved_memory.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <memory_resource>
+
+namespace raccoon {
+namespace utils {
+
+/**
+ * Scratch memory for temporaries that don't outlive a message or a loop cycle,
+ * such as the arguments of Redis commands.
+ *
+ * Allocating moves a pointer through one buffer, freeing does nothing, and reset()
+ * takes it all back at once. What doesn't fit comes from the heap, and the next
+ * reset() grows the buffer to fit it, up to `max_size`, so a steady load stops
+ * going to the heap after a cycle or two. The first buffer is reserved memory, so
+ * growing past it is warned about.
+ */
+class Arena {
+    /**
+     * The heap, counting what's taken from it.
+     */
+    class overflow_resource : public std::pmr::memory_resource {
+        size_t bytes_ = 0;
+
+    public:
+        [[nodiscard]] size_t
+        bytes() const noexcept
+        {
+            return bytes_;
+        }
+
+        void
+        clear() noexcept
+        {
+            bytes_ = 0;
+        }
+
+    private:
+        void*
+        do_allocate(size_t bytes, size_t alignment) override
+        {
+            bytes_ += bytes;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+
+        void
+        do_deallocate(void* ptr, size_t bytes, size_t alignment) override
+        {
+            std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+        }
+
+        [[nodiscard]] bool
+        do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+        {
+            return this == &other;
+        }
+    };
+
+    size_t size_;
+    size_t max_size_;
+    ReservedMemory memory_;
+    std::byte* buffer_;
+
+    overflow_resource overflow_;
+    std::pmr::monotonic_buffer_resource resource_;
+
+    uint64_t overflows_ = 0;
+
+public:
+    /**
+     * @param size The buffer to start with.
+     * @param max_size The buffer never grows past this.
+     */
+    explicit Arena(
+        size_t size = SCRATCH_ARENA_SIZE, size_t max_size = SCRATCH_ARENA_MAX_SIZE
+    ) :
+        size_(size),
+        max_size_(std::max(size, max_size)),
+        memory_("scratch arena", size),
+        buffer_(static_cast<std::byte*>(memory_.allocate(size_))),
+        resource_(buffer_, size_, &overflow_)
+    {}
+
+    ~Arena()
+    {
+        resource_.release();
+        memory_.deallocate(buffer_, size_);
+    }
+
+    /* No copy or move operators, the resource points into us */
+    Arena(const Arena&) = delete;
+    Arena(Arena&&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena& operator=(Arena&&) = delete;
+
+    /**
+     * Where to allocate, for std::pmr containers and strings.
+     */
+    [[nodiscard]] std::pmr::memory_resource*
+    resource() noexcept
+    {
+        return &resource_;
+    }
+
+    /**
+     * Free everything allocated since the last reset, which must no longer be used,
+     * and grow the buffer if it was too small.
+     */
+    void
+    reset()
+    {
+        resource_.release();
+
+        if (overflow_.bytes() == 0) [[likely]]
+            return;
+
+        overflows_++;
+
+        auto size = std::min(size_ + overflow_.bytes(), max_size_);
+        overflow_.clear();
+
+        if (size == size_)
+            return;
+
+        log_d(main, "Growing scratch arena from {} to {} bytes", size_, size);
+
+        std::destroy_at(&resource_);
+        memory_.deallocate(buffer_, size_);
+
+        size_ = size;
+        buffer_ = static_cast<std::byte*>(memory_.allocate(size_));
+
+        std::construct_at(&resource_, buffer_, size_, &overflow_);
+    }
+
+    /**
+     * The size of the buffer.
+     */
+    [[nodiscard]] size_t
+    size() const noexcept
+    {
+        return size_;
+    }
+
+    /**
+     * Resets after which something had to come from the heap.
+     */
+    [[nodiscard]] uint64_t
+    overflows() const noexcept
+    {
+        return overflows_;
+    }
+};
+
+} // namespace utils
+} // namespace raccoon
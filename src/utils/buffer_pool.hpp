@@ -0,0 +1,77 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <vector>
+
+namespace raccoon {
+namespace utils {
+
+/**
+ * A free list of byte buffers, so a buffer that's done with can be used again
+ * without going back to the heap.
+ *
+ * Buffers keep their capacity while they're pooled. Beyond a number of buffers,
+ * or a capacity, they're freed instead.
+ */
+class BufferPool {
+    std::vector<std::vector<uint8_t>> free_;
+    size_t max_buffers_;
+    size_t max_capacity_;
+
+public:
+    /**
+     * Create a new, empty pool.
+     *
+     * @param max_buffers Buffers kept at most.
+     * @param max_capacity Larger buffers are freed rather than kept.
+     */
+    explicit BufferPool(
+        size_t max_buffers = WS_SEND_POOL_BUFFERS,
+        size_t max_capacity = WS_SEND_POOL_MAX_SIZE
+    ) :
+        max_buffers_(max_buffers), max_capacity_(max_capacity)
+    {
+        free_.reserve(max_buffers_);
+    }
+
+    /**
+     * Take an empty buffer, from the pool if there's one.
+     */
+    [[nodiscard]] std::vector<uint8_t>
+    acquire() noexcept
+    {
+        if (free_.empty())
+            return {};
+
+        auto buf = std::move(free_.back());
+        free_.pop_back();
+
+        return buf;
+    }
+
+    /**
+     * Give a buffer back, to be kept if there's room for it.
+     */
+    void
+    release(std::vector<uint8_t> buf) noexcept
+    {
+        if (free_.size() >= max_buffers_ || buf.capacity() > max_capacity_)
+            return; // freed here
+
+        buf.clear();
+        free_.push_back(std::move(buf)); // never grows past what was reserved
+    }
+
+    /**
+     * The number of buffers in the pool.
+     */
+    [[nodiscard]] size_t
+    size() const noexcept
+    {
+        return free_.size();
+    }
+};
+
+} // namespace utils
+} // namespace raccoon
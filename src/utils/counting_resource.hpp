@@ -0,0 +1,73 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <algorithm>
+#include <memory_resource>
+
+namespace raccoon {
+namespace utils {
+
+/**
+ * Another resource, counting the bytes allocated from it and not yet freed.
+ *
+ * Resources chain, so one can count a single book while the next counts them all.
+ */
+class CountingResource : public std::pmr::memory_resource {
+    std::pmr::memory_resource* upstream_;
+    size_t bytes_ = 0;
+    size_t peak_ = 0;
+
+public:
+    explicit CountingResource(
+        std::pmr::memory_resource* upstream = std::pmr::get_default_resource()
+    ) noexcept :
+        upstream_(upstream)
+    {}
+
+    /**
+     * Bytes in use.
+     */
+    [[nodiscard]] size_t
+    bytes() const noexcept
+    {
+        return bytes_;
+    }
+
+    /**
+     * The most bytes ever in use.
+     */
+    [[nodiscard]] size_t
+    peak() const noexcept
+    {
+        return peak_;
+    }
+
+private:
+    void*
+    do_allocate(size_t bytes, size_t alignment) override
+    {
+        auto* ptr = upstream_->allocate(bytes, alignment);
+
+        bytes_ += bytes;
+        peak_ = std::max(peak_, bytes_);
+
+        return ptr;
+    }
+
+    void
+    do_deallocate(void* ptr, size_t bytes, size_t alignment) override
+    {
+        upstream_->deallocate(ptr, bytes, alignment);
+        bytes_ -= bytes;
+    }
+
+    [[nodiscard]] bool
+    do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+} // namespace utils
+} // namespace raccoon
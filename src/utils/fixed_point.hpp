@@ -0,0 +1,143 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <compare>
+#include <string_view>
+
+namespace raccoon {
+namespace utils {
+
+/**
+ * A signed decimal with 8 fractional digits, stored as a scaled integer.
+ *
+ * Exchanges send prices and sizes as decimal strings; parsing them into this type
+ * keeps them exact, so sums and comparisons don't pick up rounding error. The range
+ * is about +-92 billion, which covers every price and size we see.
+ */
+struct Fixed {
+    static constexpr int DIGITS = 8;
+    static constexpr int64_t SCALE = 100'000'000;
+
+    int64_t raw = 0; // value * SCALE
+
+    static constexpr Fixed
+    from_raw(int64_t raw) noexcept
+    {
+        return {raw};
+    }
+
+    [[nodiscard]] constexpr double
+    to_double() const noexcept
+    {
+        return static_cast<double>(raw) / static_cast<double>(SCALE);
+    }
+
+    constexpr Fixed&
+    operator+=(Fixed other) noexcept
+    {
+        raw += other.raw;
+        return *this;
+    }
+
+    constexpr Fixed&
+    operator-=(Fixed other) noexcept
+    {
+        raw -= other.raw;
+        return *this;
+    }
+
+    friend constexpr Fixed
+    operator+(Fixed lhs, Fixed rhs) noexcept
+    {
+        return lhs += rhs;
+    }
+
+    friend constexpr Fixed
+    operator-(Fixed lhs, Fixed rhs) noexcept
+    {
+        return lhs -= rhs;
+    }
+
+    friend constexpr auto operator<=>(Fixed, Fixed) noexcept = default;
+};
+
+/**
+ * Parse a decimal string (e.g. "1234.5678") into a fixed point number.
+ *
+ * Digits past the 8th decimal place are truncated. Exponents are not supported, as
+ * no exchange we read sends them.
+ *
+ * @returns Fixed The parsed value, or 0 if malformed.
+ */
+constexpr Fixed
+parse_fixed(std::string_view str) noexcept
+{
+    bool negative = !str.empty() && str.front() == '-';
+    if (negative)
+        str.remove_prefix(1);
+
+    int64_t whole = 0;
+    int64_t frac = 0;
+    int frac_digits = 0;
+    bool seen_point = false;
+    bool seen_digit = false;
+
+    for (char chr : str) {
+        if (chr == '.' && !seen_point) {
+            seen_point = true;
+            continue;
+        }
+
+        if (chr < '0' || chr > '9') [[unlikely]]
+            return {};
+
+        seen_digit = true;
+        auto digit = static_cast<int64_t>(chr - '0');
+
+        if (!seen_point) {
+            whole = whole * 10 + digit;
+        }
+        else if (frac_digits < Fixed::DIGITS) {
+            frac = frac * 10 + digit;
+            frac_digits++;
+        }
+    }
+
+    if (!seen_digit) [[unlikely]]
+        return {};
+
+    for (; frac_digits < Fixed::DIGITS; frac_digits++)
+        frac *= 10;
+
+    int64_t raw = whole * Fixed::SCALE + frac;
+    return {negative ? -raw : raw};
+}
+
+/**
+ * Format a fixed point number as a decimal string, without trailing zeros.
+ */
+inline std::string
+to_string(Fixed value)
+{
+    auto magnitude = value.raw < 0 ? -value.raw : value.raw;
+
+    auto res = fmt::format(
+        "{}{}.{:0{}}",
+        value.raw < 0 ? "-" : "",
+        magnitude / Fixed::SCALE,
+        magnitude % Fixed::SCALE,
+        Fixed::DIGITS
+    );
+
+    while (res.back() == '0')
+        res.pop_back();
+
+    if (res.back() == '.')
+        res.pop_back();
+
+    return res;
+}
+
+} // namespace utils
+} // namespace raccoon
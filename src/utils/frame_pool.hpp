@@ -0,0 +1,114 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <array>
+#include <new>
+#include <vector>
+
+namespace raccoon {
+namespace utils {
+
+/**
+ * Free lists of memory blocks by size, for coroutine frames, so starting a
+ * coroutine only goes to the heap until a frame of its size was freed.
+ *
+ * Sizes are rounded up to a multiple of `STEP`. Frames beyond `MAX_SIZE`, or
+ * beyond `KEPT` of one size, are freed instead. A frame must be freed on the
+ * thread it was allocated on, as coroutines on a loop are.
+ */
+class FramePool {
+    static constexpr size_t STEP = CORO_FRAME_STEP;
+    static constexpr size_t MAX_SIZE = CORO_FRAME_MAX_SIZE;
+    static constexpr size_t KEPT = CORO_FRAMES_KEPT;
+    static constexpr size_t SIZES = MAX_SIZE / STEP;
+
+    static_assert(STEP % alignof(std::max_align_t) == 0);
+
+    std::array<std::vector<void*>, SIZES> free_;
+
+public:
+    FramePool()
+    {
+        for (auto& frames : free_)
+            frames.reserve(KEPT);
+    }
+
+    ~FramePool()
+    {
+        for (auto& frames : free_)
+            for (auto* frame : frames)
+                ::operator delete(frame);
+    }
+
+    FramePool(const FramePool&) = delete;
+    FramePool(FramePool&&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+    FramePool& operator=(FramePool&&) = delete;
+
+    /**
+     * The pool of the calling thread.
+     */
+    static FramePool&
+    local()
+    {
+        thread_local FramePool pool;
+        return pool;
+    }
+
+    [[nodiscard]] void*
+    allocate(size_t size)
+    {
+        auto index = index_(size);
+
+        if (index >= SIZES) [[unlikely]]
+            return ::operator new(size);
+
+        auto& frames = free_[index];
+
+        if (frames.empty())
+            return ::operator new((index + 1) * STEP);
+
+        auto* frame = frames.back();
+        frames.pop_back();
+
+        return frame;
+    }
+
+    void
+    deallocate(void* frame, size_t size) noexcept
+    {
+        auto index = index_(size);
+
+        if (index >= SIZES || free_[index].size() >= KEPT) {
+            ::operator delete(frame);
+            return;
+        }
+
+        free_[index].push_back(frame); // never grows past what was reserved
+    }
+
+    /**
+     * Frames kept, of every size.
+     */
+    [[nodiscard]] size_t
+    size() const noexcept
+    {
+        size_t res = 0;
+
+        for (const auto& frames : free_)
+            res += frames.size();
+
+        return res;
+    }
+
+private:
+    static constexpr size_t
+    index_(size_t size) noexcept
+    {
+        return (size + STEP - 1) / STEP - 1;
+    }
+};
+
+} // namespace utils
+} // namespace raccoon
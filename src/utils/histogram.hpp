@@ -0,0 +1,93 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+
+namespace raccoon {
+namespace utils {
+
+/**
+ * Counts of durations in power of two buckets of microseconds.
+ *
+ * Recording is a few instructions and never allocates. Percentiles are the top of
+ * the bucket they fall in, so they're at most twice the true value.
+ */
+class Histogram {
+    // Bucket i holds values that take i bits, so the last one starts at ~18 minutes
+    static constexpr size_t BUCKETS = 32;
+
+    std::array<uint64_t, BUCKETS> counts_{};
+    uint64_t count_ = 0;
+    uint64_t max_us_ = 0;
+
+public:
+    /**
+     * Record a value, in microseconds.
+     */
+    void
+    record(uint64_t value_us) noexcept
+    {
+        auto bucket = std::min<size_t>(std::bit_width(value_us), BUCKETS - 1);
+
+        counts_[bucket]++;
+        count_++;
+        max_us_ = std::max(max_us_, value_us);
+    }
+
+    /**
+     * Record a duration.
+     */
+    template <class Rep, class Period>
+    void
+    record(std::chrono::duration<Rep, Period> value) noexcept
+    {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(value).count();
+        record(static_cast<uint64_t>(std::max<decltype(us)>(us, 0)));
+    }
+
+    /**
+     * An upper bound of a percentile, in microseconds; 0 if nothing was recorded.
+     *
+     * @param percentile Between 0 and 100.
+     */
+    [[nodiscard]] uint64_t
+    percentile(double percentile) const noexcept
+    {
+        if (count_ == 0)
+            return 0;
+
+        auto share = percentile / 100; // NOLINT(*-magic-numbers)
+        auto rank = static_cast<uint64_t>(share * static_cast<double>(count_));
+        rank = std::clamp<uint64_t>(rank, 1, count_);
+
+        uint64_t seen = 0;
+
+        for (size_t i = 0; i < BUCKETS; i++) {
+            seen += counts_[i];
+
+            if (seen >= rank)
+                return std::min((uint64_t{1} << i) - 1, max_us_);
+        }
+
+        return max_us_;
+    }
+
+    [[nodiscard]] uint64_t
+    count() const noexcept
+    {
+        return count_;
+    }
+
+    [[nodiscard]] uint64_t
+    max_us() const noexcept
+    {
+        return max_us_;
+    }
+};
+
+} // namespace utils
+} // namespace raccoon
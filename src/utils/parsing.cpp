@@ -0,0 +1,158 @@
+#include "parsing.hpp"
+
+namespace raccoon {
+namespace utils {
+
+/**
+ * Find the position just after `"key":` in some JSON, skipping whitespace.
+ */
+static size_t
+find_value(std::string_view json, std::string_view key) noexcept
+{
+    size_t pos = 0;
+
+    while ((pos = json.find(key, pos)) != std::string_view::npos) {
+        size_t end = pos + key.size();
+
+        // Make sure we matched a whole, quoted key
+        bool quoted = pos > 0 && json[pos - 1] == '"' && end < json.size()
+                      && json[end] == '"';
+        pos = end;
+
+        if (!quoted)
+            continue;
+
+        // Skip to the colon
+        ++end;
+        while (end < json.size() && std::isspace(json[end]))
+            ++end;
+
+        if (end >= json.size() || json[end] != ':')
+            continue;
+
+        // Skip to the value
+        ++end;
+        while (end < json.size() && std::isspace(json[end]))
+            ++end;
+
+        return end;
+    }
+
+    return std::string_view::npos;
+}
+
+/**
+ * Parse a fixed number of decimal digits.
+ */
+static constexpr bool
+parse_digits(std::string_view str, size_t pos, size_t count, int64_t& out) noexcept
+{
+    if (pos + count > str.size())
+        return false;
+
+    int64_t value = 0;
+    for (size_t i = pos; i < pos + count; i++) {
+        if (str[i] < '0' || str[i] > '9')
+            return false;
+
+        value = value * 10 + (str[i] - '0');
+    }
+
+    out = value;
+    return true;
+}
+
+/**
+ * Days since the Unix epoch for a civil date.
+ *
+ * https://howardhinnant.github.io/date_algorithms.html#days_from_civil
+ */
+static constexpr int64_t
+days_from_civil(int64_t year, int64_t month, int64_t day) noexcept
+{
+    year -= month <= 2 ? 1 : 0;
+
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const int64_t yoe = year - era * 400;
+    const int64_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + doe - 719468;
+}
+
+std::string_view
+json_string_field(std::string_view json, std::string_view key) noexcept
+{
+    size_t start = find_value(json, key);
+
+    if (start == std::string_view::npos || json[start] != '"')
+        return {};
+
+    size_t end = json.find('"', ++start);
+    if (end == std::string_view::npos)
+        return {};
+
+    return json.substr(start, end - start);
+}
+
+std::string_view
+json_object_field(std::string_view json, std::string_view key) noexcept
+{
+    size_t start = find_value(json, key);
+
+    if (start == std::string_view::npos || json[start] != '{')
+        return {};
+
+    size_t end = json.rfind('}');
+    if (end == std::string_view::npos || end <= start)
+        return {};
+
+    // Drop the envelope's closing brace
+    end = json.rfind('}', end - 1);
+    if (end == std::string_view::npos || end < start)
+        return {};
+
+    return json.substr(start, end - start + 1);
+}
+
+int64_t
+parse_timestamp(std::string_view timestamp) noexcept
+{
+    constexpr int64_t NANOS_PER_SEC = 1'000'000'000;
+
+    // YYYY-MM-DDTHH:MM:SS
+    int64_t year{}, month{}, day{}, hour{}, minute{}, second{};
+
+    bool ok = parse_digits(timestamp, 0, 4, year)
+              && parse_digits(timestamp, 5, 2, month)
+              && parse_digits(timestamp, 8, 2, day)
+              && parse_digits(timestamp, 11, 2, hour)
+              && parse_digits(timestamp, 14, 2, minute)
+              && parse_digits(timestamp, 17, 2, second);
+
+    if (!ok) [[unlikely]]
+        return 0;
+
+    int64_t seconds = days_from_civil(year, month, day) * 86400 + hour * 3600
+                      + minute * 60 + second;
+
+    // Optional fractional seconds, up to nanosecond precision
+    int64_t nanos = 0;
+    if (timestamp.size() > 19 && timestamp[19] == '.') {
+        int64_t scale = NANOS_PER_SEC;
+
+        for (size_t i = 20; i < timestamp.size(); i++) {
+            char c = timestamp[i];
+            if (c < '0' || c > '9')
+                break;
+
+            scale /= 10;
+            nanos += (c - '0') * scale;
+        }
+    }
+
+    return seconds * NANOS_PER_SEC + nanos;
+}
+
+} // namespace utils
+} // namespace raccoon
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <charconv>
+#include <string_view>
+
+namespace raccoon {
+namespace utils {
+
+/**
+ * Find the value of a top-level string field in a JSON object without parsing it.
+ *
+ * This is a cheap sniff used to route messages before handing them to glaze, and
+ * only looks at the first occurrence of the key.
+ *
+ * @param json The raw JSON text.
+ * @param key The key to look for (without quotes).
+ *
+ * @returns std::string_view The (unescaped) value, or an empty view if not found.
+ */
+std::string_view
+json_string_field(std::string_view json, std::string_view key) noexcept;
+
+/**
+ * Find the raw text of a top-level object field in a JSON object.
+ *
+ * Used to strip envelopes such as Binance's combined stream wrapper. Assumes the
+ * object is the last member of the envelope, which holds for every feed we read.
+ *
+ * @returns std::string_view The raw object text, or an empty view if not found.
+ */
+std::string_view
+json_object_field(std::string_view json, std::string_view key) noexcept;
+
+/**
+ * Parse an ISO 8601 UTC timestamp (e.g. 2023-09-19T17:10:35.123456Z).
+ *
+ * @returns int64_t Nanoseconds since the Unix epoch, or 0 if malformed.
+ */
+int64_t parse_timestamp(std::string_view timestamp) noexcept;
+
+/**
+ * Parse a decimal string into a double without allocating.
+ *
+ * @returns double The parsed value, or 0.0 if malformed.
+ */
+inline double
+parse_double(std::string_view str) noexcept
+{
+    double value = 0.0;
+    std::from_chars(str.data(), str.data() + str.size(), value); // NOLINT(*-arithmetic)
+    return value;
+}
+
+} // namespace utils
+} // namespace raccoon
@@ -0,0 +1,275 @@
+#include "reserved_memory.hpp"
+
+#include <algorithm>
+#include <mutex>
+
+#ifndef _WIN32
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+namespace raccoon {
+namespace utils {
+
+// Of x86-64 and most aarch64 kernels
+static constexpr size_t HUGE_PAGE_SIZE = size_t{1} << 21;
+
+// Reservations that mapped something, for metrics
+static std::mutex registry_mutex;
+static std::vector<const ReservedMemory*> registry;
+
+static constexpr size_t
+round_up(size_t value, size_t multiple) noexcept
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+static constexpr std::string_view
+huge_pages_name(HugePages pages) noexcept
+{
+    switch (pages) {
+        case HugePages::TRANSPARENT:
+            return "transparent huge pages";
+        case HugePages::EXPLICIT:
+            return "huge pages";
+        default:
+            return "regular pages";
+    }
+}
+
+MemoryOptions&
+memory_options() noexcept
+{
+    static MemoryOptions options;
+    return options;
+}
+
+ReservedMemory::ReservedMemory(
+    std::string name, size_t bytes, const MemoryOptions& options
+)
+{
+    reserve(std::move(name), bytes, options);
+}
+
+ReservedMemory::~ReservedMemory()
+{
+    if (base_ == nullptr)
+        return;
+
+    {
+        std::lock_guard lock(registry_mutex);
+        std::erase(registry, this);
+    }
+
+#ifndef _WIN32
+    munmap(base_, size_);
+#endif
+}
+
+bool
+ReservedMemory::reserve(std::string name, size_t bytes, const MemoryOptions& options)
+{
+    if (base_ != nullptr || bytes == 0)
+        return base_ != nullptr;
+
+    name_ = std::move(name);
+
+    if (!map_(bytes, options)) {
+        log_w(main, "Could not reserve {} bytes for {}, using the heap", bytes, name_);
+        return false;
+    }
+
+    asked_ = bytes;
+
+    log_d(
+        main,
+        "Reserved {} bytes for {} in {}{}",
+        size_,
+        name_,
+        huge_pages_name(huge_pages_),
+        locked_ ? ", locked" : ""
+    );
+
+    std::lock_guard lock(registry_mutex);
+    registry.push_back(this);
+
+    return true;
+}
+
+bool
+ReservedMemory::map_(size_t bytes, const MemoryOptions& options)
+{
+#ifdef _WIN32
+    (void)bytes;
+    (void)options;
+    return false;
+#else
+    auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    void* region = MAP_FAILED;
+
+    if (options.huge_pages == HugePages::EXPLICIT) {
+        size_ = round_up(bytes, HUGE_PAGE_SIZE);
+        region = mmap(
+            nullptr,
+            size_,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+            -1,
+            0
+        );
+
+        if (region != MAP_FAILED) {
+            huge_pages_ = HugePages::EXPLICIT;
+        }
+        else {
+            log_w(
+                main,
+                "No huge pages for {}, is vm.nr_hugepages set? Using regular pages",
+                name_
+            );
+        }
+    }
+
+    if (options.huge_pages == HugePages::TRANSPARENT) {
+        // Map an extra huge page, to trim down to a huge page aligned region
+        size_ = round_up(bytes, HUGE_PAGE_SIZE);
+        auto mapped = size_ + HUGE_PAGE_SIZE;
+
+        region = mmap(
+            nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0
+        );
+
+        if (region != MAP_FAILED) {
+            auto start = reinterpret_cast<uintptr_t>(region); // NOLINT
+            auto aligned = round_up(start, HUGE_PAGE_SIZE);
+            auto head = aligned - start;
+
+            region = reinterpret_cast<void*>(aligned); // NOLINT
+            auto* end = static_cast<std::byte*>(region) + size_;
+
+            if (head > 0)
+                munmap(reinterpret_cast<void*>(start), head); // NOLINT
+            if (mapped - head > size_)
+                munmap(end, mapped - head - size_);
+
+            if (madvise(region, size_, MADV_HUGEPAGE) == 0) {
+                huge_pages_ = HugePages::TRANSPARENT;
+            }
+            else {
+                log_w(
+                    main,
+                    "No transparent huge pages for {}: {}",
+                    name_,
+                    std::strerror(errno) // NOLINT(concurrency-*)
+                );
+            }
+        }
+    }
+
+    if (region == MAP_FAILED) {
+        size_ = round_up(bytes, page_size);
+        region = mmap(
+            nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0
+        );
+
+        if (region == MAP_FAILED)
+            return false;
+    }
+
+    base_ = static_cast<std::byte*>(region);
+
+    // Fault every page in now, from the thread that will use them
+    for (size_t offset = 0; offset < size_; offset += page_size)
+        static_cast<volatile std::byte*>(base_)[offset] = std::byte{0};
+
+    if (options.lock) {
+        if (mlock(base_, size_) == 0) {
+            locked_ = true;
+        }
+        else {
+            log_w(
+                main,
+                "Could not lock {} bytes for {}, is RLIMIT_MEMLOCK too low? {}",
+                size_,
+                name_,
+                std::strerror(errno) // NOLINT(concurrency-*)
+            );
+        }
+    }
+
+    return true;
+#endif
+}
+
+void*
+ReservedMemory::do_allocate(size_t bytes, size_t alignment)
+{
+    auto offset = round_up(used_, alignment);
+
+    if (offset + bytes <= size_) [[likely]] {
+        used_ = offset + bytes;
+        return base_ + offset;
+    }
+
+    if (base_ != nullptr) {
+        overflows_++;
+        overflow_bytes_ += bytes;
+
+        // On the first overflow, and every time they double
+        if (overflow_bytes_ >= warn_at_) {
+            log_w(
+                main,
+                "{} grew past its reservation of {} bytes, {} more from the heap",
+                name_,
+                asked_,
+                overflow_bytes_
+            );
+            warn_at_ = overflow_bytes_ * 2;
+        }
+    }
+
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void
+ReservedMemory::do_deallocate(void* ptr, size_t bytes, size_t alignment)
+{
+    auto* byte = static_cast<std::byte*>(ptr);
+
+    // Reserved memory is only given back all at once
+    if (byte >= base_ && byte < base_ + size_)
+        return;
+
+    std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+}
+
+void
+ReservedMemory::for_each(const std::function<void(const ReservedMemory&)>& fn)
+{
+    std::lock_guard lock(registry_mutex);
+
+    for (const auto* memory : registry)
+        fn(*memory);
+}
+
+void
+ReservedMemory::log_all()
+{
+    for_each([](const ReservedMemory& memory) {
+        log_i(
+            main,
+            "Reserved for {}: {} of {} bytes used, in {}{}; {} bytes in {} allocations "
+            "outgrew it",
+            memory.name(),
+            memory.used(),
+            memory.reserved(),
+            huge_pages_name(memory.huge_pages()),
+            memory.locked() ? ", locked" : "",
+            memory.overflow_bytes(),
+            memory.overflows()
+        );
+    });
+}
+
+} // namespace utils
+} // namespace raccoon
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <functional>
+#include <memory_resource>
+#include <string>
+
+namespace raccoon {
+namespace utils {
+
+/**
+ * What backs reserved memory.
+ */
+enum class HugePages : uint8_t {
+    NONE,        // regular pages
+    TRANSPARENT, // ask the kernel to back the region with transparent huge pages
+    EXPLICIT,    // map from the preallocated huge page pool, see vm.nr_hugepages
+};
+
+/**
+ * How memory is reserved, for the whole process.
+ */
+struct MemoryOptions {
+    HugePages huge_pages = HugePages::NONE;
+    bool lock = false; // mlock reservations, so they're never swapped out
+};
+
+/**
+ * The options reservations use by default, set once at startup before anything is
+ * reserved.
+ */
+MemoryOptions& memory_options() noexcept;
+
+/**
+ * Memory reserved up front for a structure on the hot path, such as a ring buffer
+ * or the levels of every book, so it never waits on a page fault or the allocator.
+ *
+ * The region is mapped at once, from huge pages if asked, and every page of it is
+ * touched by the thread reserving it, which also places it on that thread's NUMA
+ * node. Allocating moves a pointer through it and freeing does nothing, which
+ * suits a pool's upstream or a buffer allocated once. What doesn't fit comes from
+ * the heap, and is counted and warned about, since the reservation was too small.
+ *
+ * Before anything is reserved, everything comes from the heap.
+ */
+class ReservedMemory : public std::pmr::memory_resource {
+    std::string name_;
+
+    std::byte* base_ = nullptr;
+    size_t size_ = 0;   // as mapped, rounded up to pages
+    size_t asked_ = 0;  // as reserved
+    size_t used_ = 0;
+
+    HugePages huge_pages_ = HugePages::NONE;
+    bool locked_ = false;
+
+    size_t overflow_bytes_ = 0;
+    uint64_t overflows_ = 0;
+    size_t warn_at_ = 0; // overflow bytes at which to warn again
+
+public:
+    ReservedMemory() = default;
+
+    /**
+     * Reserve memory right away, see reserve().
+     */
+    ReservedMemory(
+        std::string name, size_t bytes, const MemoryOptions& options = memory_options()
+    );
+
+    ~ReservedMemory() override;
+
+    /* No copy or move operators, allocations point into us */
+    ReservedMemory(const ReservedMemory&) = delete;
+    ReservedMemory(ReservedMemory&&) = delete;
+    ReservedMemory& operator=(const ReservedMemory&) = delete;
+    ReservedMemory& operator=(ReservedMemory&&) = delete;
+
+    /**
+     * Map and pre-fault a region, if nothing was reserved yet. Falls back to regular
+     * pages if huge pages can't be had, and to not locking if that's not allowed.
+     *
+     * @param name What the memory is for, in logs and metrics.
+     * @returns bool False if nothing could be mapped, and the heap is used instead.
+     */
+    bool reserve(
+        std::string name, size_t bytes, const MemoryOptions& options = memory_options()
+    );
+
+    [[nodiscard]] const std::string&
+    name() const noexcept
+    {
+        return name_;
+    }
+
+    /**
+     * Bytes reserved, 0 if nothing is.
+     */
+    [[nodiscard]] size_t
+    reserved() const noexcept
+    {
+        return asked_;
+    }
+
+    /**
+     * Bytes of the reservation allocated so far.
+     */
+    [[nodiscard]] size_t
+    used() const noexcept
+    {
+        return used_;
+    }
+
+    /**
+     * Bytes that didn't fit in the reservation, and came from the heap.
+     */
+    [[nodiscard]] size_t
+    overflow_bytes() const noexcept
+    {
+        return overflow_bytes_;
+    }
+
+    /**
+     * Allocations that didn't fit in the reservation.
+     */
+    [[nodiscard]] uint64_t
+    overflows() const noexcept
+    {
+        return overflows_;
+    }
+
+    /**
+     * What the reservation is actually backed by.
+     */
+    [[nodiscard]] HugePages
+    huge_pages() const noexcept
+    {
+        return huge_pages_;
+    }
+
+    [[nodiscard]] bool
+    locked() const noexcept
+    {
+        return locked_;
+    }
+
+    /**
+     * Call a function with every reservation, for metrics.
+     */
+    static void for_each(const std::function<void(const ReservedMemory&)>& fn);
+
+    /**
+     * Log how much of every reservation is used, and what outgrew it.
+     */
+    static void log_all();
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override;
+
+    [[nodiscard]] bool
+    do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    bool map_(size_t bytes, const MemoryOptions& options);
+};
+
+} // namespace utils
+} // namespace raccoon
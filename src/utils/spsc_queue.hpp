@@ -0,0 +1,117 @@
+#pragma once
+
+#include "common.hpp"
+#include "reserved_memory.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+
+namespace raccoon {
+namespace utils {
+
+/**
+ * A bounded, lock-free, single producer single consumer queue.
+ *
+ * Exactly one thread may push and exactly one thread may pop. Both operations are
+ * wait-free and never allocate. The slots are reserved memory, faulted in up front.
+ */
+template <class T>
+class SpscQueue {
+    // Avoid false sharing between the producer and consumer indices
+    static constexpr size_t CACHE_LINE = 64;
+
+    ReservedMemory memory_;
+    std::pmr::vector<T> slots_;
+    size_t mask_;
+
+    alignas(CACHE_LINE) std::atomic<size_t> head_{0}; // next slot to pop
+    alignas(CACHE_LINE) std::atomic<size_t> tail_{0}; // next slot to push
+
+    // Each side's cached copy of the other's index, to avoid touching its line
+    alignas(CACHE_LINE) size_t cached_head_ = 0;
+    alignas(CACHE_LINE) size_t cached_tail_ = 0;
+
+public:
+    /**
+     * Create a new queue.
+     *
+     * @param capacity Minimum number of elements, rounded up to a power of two.
+     * @param name What the queue is for, in memory metrics.
+     */
+    explicit SpscQueue(size_t capacity, std::string name = "queue") :
+        memory_(std::move(name), slots_bytes_(capacity)),
+        slots_(std::bit_ceil(std::max<size_t>(capacity, 2)), &memory_),
+        mask_(slots_.size() - 1)
+    {}
+
+    /**
+     * Push an element, from the producer thread.
+     *
+     * @returns bool False if the queue is full.
+     */
+    bool
+    try_push(const T& value) noexcept(std::is_nothrow_copy_assignable_v<T>)
+    {
+        auto tail = tail_.load(std::memory_order_relaxed);
+
+        if (tail - cached_head_ == slots_.size()) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ == slots_.size()) [[unlikely]]
+                return false;
+        }
+
+        slots_[tail & mask_] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * Pop an element, from the consumer thread.
+     *
+     * @returns bool False if the queue is empty.
+     */
+    bool
+    try_pop(T& value) noexcept(std::is_nothrow_move_assignable_v<T>)
+    {
+        auto head = head_.load(std::memory_order_relaxed);
+
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_)
+                return false;
+        }
+
+        value = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * Number of elements in the queue; only a hint while the other thread runs.
+     */
+    [[nodiscard]] size_t
+    size_approx() const noexcept
+    {
+        return tail_.load(std::memory_order_relaxed)
+               - head_.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] size_t
+    capacity() const noexcept
+    {
+        return slots_.size();
+    }
+
+private:
+    static size_t
+    slots_bytes_(size_t capacity) noexcept
+    {
+        return std::bit_ceil(std::max<size_t>(capacity, 2)) * sizeof(T);
+    }
+};
+
+} // namespace utils
+} // namespace raccoon
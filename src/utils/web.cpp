@@ -2,6 +2,8 @@
 
 #include <curl/curl.h>
 
+#include <string>
+
 namespace raccoon {
 namespace utils {
 
@@ -29,5 +31,72 @@ normalize_url(const std::string& url) noexcept
     return res;
 }
 
+std::optional<url_parts>
+split_url(const std::string& url) noexcept
+{
+    CURLU* handle = curl_url();
+
+    // Websocket schemes are only known to curls built with websocket support
+    if (curl_url_set(handle, CURLUPART_URL, url.c_str(), CURLU_NON_SUPPORT_SCHEME))
+        [[unlikely]]
+    {
+        curl_url_cleanup(handle);
+        return std::nullopt;
+    }
+
+    // Get a part of the URL, empty if it's missing
+    auto get = [handle](CURLUPart what) {
+        char* part{};
+        std::string res;
+
+        if (curl_url_get(handle, what, &part, 0) == CURLUE_OK) {
+            res = part;
+            curl_free(part);
+        }
+
+        return res;
+    };
+
+    url_parts parts{
+        .scheme = get(CURLUPART_SCHEME),
+        .host = get(CURLUPART_HOST),
+        .port = 0,
+        .path = get(CURLUPART_PATH),
+    };
+
+    auto port = get(CURLUPART_PORT);
+    auto query = get(CURLUPART_QUERY);
+
+    curl_url_cleanup(handle);
+
+    if (!query.empty())
+        parts.path += "?" + query;
+
+    if (parts.path.empty())
+        parts.path = "/";
+
+    constexpr int HTTP_PORT = 80;
+    constexpr int HTTPS_PORT = 443;
+
+    if (!port.empty())
+        parts.port = std::stoi(port);
+    else if (parts.scheme == "wss" || parts.scheme == "https")
+        parts.port = HTTPS_PORT;
+    else
+        parts.port = HTTP_PORT;
+
+    log_t3(
+        web,
+        "Split URL `{}` into {} {}:{} {}",
+        url,
+        parts.scheme,
+        parts.host,
+        parts.port,
+        parts.path
+    );
+
+    return parts;
+}
+
 } // namespace utils
 } // namespace raccoon
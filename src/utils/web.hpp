@@ -4,6 +4,8 @@
 
 #include <curl/curl.h>
 
+#include <optional>
+
 namespace raccoon {
 namespace utils {
 
@@ -16,5 +18,24 @@ namespace utils {
  */
 std::string normalize_url(const std::string& url) noexcept;
 
+/**
+ * The parts of a URL needed to open a connection by hand.
+ */
+struct url_parts {
+    std::string scheme;
+    std::string host;
+    int port = 0;     // the scheme's default if the URL has none
+    std::string path; // with the query, if any
+};
+
+/**
+ * Split a URL using libcurl.
+ *
+ * @param url The url.
+ *
+ * @returns std::optional<url_parts> Its parts, or nothing if it couldn't be parsed.
+ */
+std::optional<url_parts> split_url(const std::string& url) noexcept;
+
 } // namespace utils
 } // namespace raccoon
@@ -33,11 +33,18 @@ Connection::Connection(const std::string& url, CURL* curl_handle) :
     curl_easy_setopt(
         curl_handle_,
         CURLOPT_VERBOSE,
-        raccoon::logging::get_libcurl_logger()->should_log<quill::LogLevel::Debug>()
+        raccoon::logging::should_log<quill::LogLevel::Debug>(
+            raccoon::logging::get_libcurl_logger()
+        )
     );
 
     // Provide error buffer for cURL
     curl_easy_setopt(curl_handle_, CURLOPT_ERRORBUFFER, curl_error_buffer_.data());
+
+    // Verify servers against SSL_CERT_FILE if it's set, as OpenSSL and so native
+    // connections do
+    if (auto ca_file = utils::getenv("SSL_CERT_FILE", ""); !ca_file.empty())
+        curl_easy_setopt(curl_handle_, CURLOPT_CAINFO, ca_file.c_str());
 }
 
 int
@@ -90,7 +97,7 @@ Connection::debug_log_callback_(
             return 0;
     }
 
-    if (logging::get_libcurl_logger()->should_log<quill::LogLevel::TraceL3>())
+    if (logging::should_log<quill::LogLevel::TraceL3>(logging::get_libcurl_logger()))
         [[unlikely]]
         log_t3(libcurl, "Hexdump\n{}", utils::hexdump(raw_data, size));
 
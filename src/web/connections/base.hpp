@@ -103,6 +103,17 @@ protected:
      */
     virtual void start_() = 0; // NOLINT(*-naming)
 
+    /**
+     * Called once libcurl reports the transfer as done, before the handle is freed.
+     *
+     * @param result The result of the transfer.
+     */
+    virtual void
+    finish_(CURLcode result) // NOLINT(*-naming)
+    {
+        UNUSED(result);
+    }
+
     /**
      * Clear the libcurl error buffer.
      */
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "common.hpp"
+#include "utils/buffer_pool.hpp"
+
+#include <coroutine>
+#include <deque>
+#include <optional>
+#include <span>
+
+namespace raccoon {
+namespace web {
+
+/**
+ * Messages of a connection, for a coroutine to co_await one at a time.
+ *
+ * A coroutine waiting for a message is resumed with it where it's received, so
+ * it sees the connection's own buffer, as a callback would. Messages received
+ * while nobody waits are copied, into buffers from a pool, and handed out in
+ * order before the next one received.
+ *
+ * Only one coroutine may wait at a time.
+ */
+class MessageChannel {
+    std::coroutine_handle<> waiter_;
+    std::span<const uint8_t> message_; // handed to the waiter
+    bool has_message_ = false;
+
+    std::deque<std::vector<uint8_t>> backlog_;
+    std::vector<uint8_t> held_; // the backlog message last handed out
+    utils::BufferPool pool_;
+
+    bool closed_ = false;
+
+public:
+    /**
+     * Waits for the next message. Gives nothing once the channel is closed and
+     * every message was read.
+     */
+    class next_awaiter {
+        MessageChannel& channel_;
+
+    public:
+        explicit next_awaiter(MessageChannel& channel) noexcept : channel_(channel) {}
+
+        [[nodiscard]] bool
+        await_ready() noexcept
+        {
+            // The caller is done with the last message
+            if (!channel_.held_.empty())
+                channel_.pool_.release(std::move(channel_.held_));
+
+            return !channel_.backlog_.empty() || channel_.closed_;
+        }
+
+        void
+        await_suspend(std::coroutine_handle<> waiter) noexcept
+        {
+            assert(!channel_.waiter_);
+            channel_.waiter_ = waiter;
+        }
+
+        /**
+         * The message, valid until the next co_await.
+         */
+        std::optional<std::span<const uint8_t>>
+        await_resume() noexcept
+        {
+            if (!channel_.backlog_.empty()) {
+                channel_.held_ = std::move(channel_.backlog_.front());
+                channel_.backlog_.pop_front();
+
+                return std::span<const uint8_t>{channel_.held_};
+            }
+
+            if (channel_.has_message_) {
+                channel_.has_message_ = false;
+                return channel_.message_;
+            }
+
+            return std::nullopt;
+        }
+    };
+
+    /**
+     * Hand a message to the coroutine waiting, or keep a copy until one does.
+     */
+    void
+    push(std::span<const uint8_t> message)
+    {
+        if (waiter_ && backlog_.empty()) [[likely]] {
+            message_ = message;
+            has_message_ = true;
+
+            std::exchange(waiter_, {}).resume();
+            return;
+        }
+
+        auto buf = pool_.acquire();
+        buf.assign(message.begin(), message.end());
+        backlog_.push_back(std::move(buf));
+
+        if (backlog_.size() == WS_BACKLOG_WARN) [[unlikely]]
+            log_w(web, "{} messages are waiting to be read", backlog_.size());
+    }
+
+    /**
+     * No more messages will come; the coroutine waiting is resumed with nothing.
+     */
+    void
+    close()
+    {
+        closed_ = true;
+
+        if (waiter_)
+            std::exchange(waiter_, {}).resume();
+    }
+
+    [[nodiscard]] next_awaiter
+    next() noexcept
+    {
+        return next_awaiter{*this};
+    }
+
+    /**
+     * The number of messages copied, waiting to be read.
+     */
+    [[nodiscard]] size_t
+    backlog() const noexcept
+    {
+        return backlog_.size();
+    }
+};
+
+} // namespace web
+} // namespace raccoon
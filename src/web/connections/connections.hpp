@@ -3,4 +3,7 @@
 // Re-exports
 
 #include "base.hpp"
+#include "channel.hpp"
+#include "http.hpp"
+#include "native_ws.hpp"
 #include "ws.hpp"
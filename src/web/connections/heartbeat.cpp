@@ -0,0 +1,112 @@
+#include "heartbeat.hpp"
+
+namespace raccoon {
+namespace web {
+
+void
+Heartbeat::init(
+    uv_loop_t* loop,
+    ping_fn ping,
+    status_fn on_status,
+    uint64_t interval_ms,
+    uint64_t stale_after_ms
+)
+{
+    ping_ = std::move(ping);
+    on_status_ = std::move(on_status);
+    interval_ms_ = interval_ms;
+    stale_after_ms_ = stale_after_ms;
+
+    uv_timer_init(loop, &timer_);
+    timer_.data = this;
+    timer_init_ = true;
+
+    // Only the connections keep the loop running
+    uv_unref(reinterpret_cast<uv_handle_t*>(&timer_)); // NOLINT(*-reinterpret-cast)
+}
+
+void
+Heartbeat::start() noexcept
+{
+    if (!timer_init_ || running_ || interval_ms_ == 0)
+        return;
+
+    running_ = true;
+    awaiting_pong_ = false;
+    last_data_ms_ = uv_now(timer_.loop);
+
+    uv_timer_start(&timer_, tick_, interval_ms_, interval_ms_);
+}
+
+void
+Heartbeat::stop() noexcept
+{
+    if (!running_)
+        return;
+
+    running_ = false;
+    uv_timer_stop(&timer_);
+}
+
+void
+Heartbeat::on_pong() noexcept
+{
+    if (!awaiting_pong_) // unsolicited, or answering a ping from before a reconnect
+        return;
+
+    awaiting_pong_ = false;
+
+    auto rtt = clock::now() - ping_sent_;
+    rtt_.record(rtt);
+
+    log_t1(web, "Pong after {}", std::chrono::duration<double, std::micro>(rtt));
+}
+
+void
+Heartbeat::tick_(uv_timer_t* timer)
+{
+    auto* beat = static_cast<Heartbeat*>(timer->data);
+    auto now = uv_now(timer->loop);
+
+    auto silent_ms = now - beat->last_data_ms_;
+    bool unanswered =
+        beat->awaiting_pong_ && now - beat->ping_sent_ms_ >= beat->stale_after_ms_;
+
+    if (silent_ms >= beat->stale_after_ms_ || unanswered) {
+        // Once per stale_after, to retry
+        if (beat->stale_ && now - beat->last_stale_ms_ < beat->stale_after_ms_)
+            return;
+
+        if (unanswered)
+            log_w(web, "Ping unanswered for {}ms", now - beat->ping_sent_ms_);
+        else if (!beat->stale_)
+            log_w(web, "No data for {}ms, though pings are answered", silent_ms);
+
+        beat->stale_ = true;
+        beat->last_stale_ms_ = now;
+        beat->awaiting_pong_ = false;
+
+        beat->on_status_(true, std::chrono::milliseconds(silent_ms));
+        return;
+    }
+
+    // A stale connection is being reopened, and has nothing to answer with
+    if (beat->stale_ || beat->awaiting_pong_)
+        return;
+
+    beat->ping_sent_ = clock::now();
+    beat->ping_sent_ms_ = now;
+    beat->awaiting_pong_ = true;
+
+    beat->ping_();
+}
+
+void
+Heartbeat::live_(uint64_t now)
+{
+    stale_ = false;
+    on_status_(false, std::chrono::milliseconds(now - last_data_ms_));
+}
+
+} // namespace web
+} // namespace raccoon
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "common.hpp"
+#include "utils/histogram.hpp"
+
+#include <uv.h>
+
+#include <chrono>
+#include <functional>
+
+namespace raccoon {
+namespace web {
+
+/**
+ * Pings a WebSocket connection on a timer, measures the round trip to each pong,
+ * and notices when the connection goes quiet.
+ *
+ * A connection is stale once no data frame arrived for `stale_after`, or a ping
+ * went unanswered for as long. Pongs tell the two apart: a quiet feed on a live
+ * connection still answers them.
+ *
+ * Connections own one, and the Session sets it up. Like the Session's own handles,
+ * the timer stays with the loop, so it must outlive the loop's use of it.
+ */
+class Heartbeat {
+public:
+    using clock = std::chrono::steady_clock;
+
+    /**
+     * Sends a ping on the connection.
+     */
+    using ping_fn = std::function<void()>;
+
+    /**
+     * Told when the connection goes stale, with how long it was silent, and again
+     * for as long as it stays stale, each `stale_after`. Then told once it's live.
+     */
+    using status_fn = std::function<void(bool stale, std::chrono::milliseconds silent)>;
+
+private:
+    uv_timer_t timer_{};
+    bool timer_init_ = false;
+    bool running_ = false;
+
+    ping_fn ping_;
+    status_fn on_status_;
+
+    uint64_t interval_ms_ = WS_PING_INTERVAL_MS;
+    uint64_t stale_after_ms_ = WS_STALE_AFTER_MS;
+
+    // Loop times, so recording a frame doesn't read the clock
+    uint64_t last_data_ms_ = 0;
+    uint64_t last_stale_ms_ = 0; // last told stale
+
+    clock::time_point ping_sent_;
+    uint64_t ping_sent_ms_ = 0;
+    bool awaiting_pong_ = false;
+    bool stale_ = false;
+
+    utils::Histogram rtt_;
+
+public:
+    Heartbeat() = default;
+    ~Heartbeat() = default;
+
+    /* No copy or move operators, libuv points into us */
+    Heartbeat(const Heartbeat&) = delete;
+    Heartbeat(Heartbeat&&) = delete;
+    Heartbeat& operator=(const Heartbeat&) = delete;
+    Heartbeat& operator=(Heartbeat&&) = delete;
+
+    /**
+     * Set up the timer, without starting it.
+     *
+     * @param interval_ms Between pings, 0 to never start.
+     * @param stale_after_ms Silence before the connection is stale.
+     */
+    void init(
+        uv_loop_t* loop,
+        ping_fn ping,
+        status_fn on_status,
+        uint64_t interval_ms,
+        uint64_t stale_after_ms
+    );
+
+    /**
+     * Start pinging and watching, from now. Does nothing if already started.
+     */
+    void start() noexcept;
+
+    /**
+     * Stop pinging and watching.
+     */
+    void stop() noexcept;
+
+    /**
+     * A data frame was received.
+     */
+    void
+    on_data()
+    {
+        if (!running_) [[unlikely]]
+            return;
+
+        auto now = uv_now(timer_.loop);
+
+        if (stale_) [[unlikely]]
+            live_(now);
+
+        last_data_ms_ = now;
+    }
+
+    /**
+     * A pong was received.
+     */
+    void on_pong() noexcept;
+
+    [[nodiscard]] bool
+    running() const noexcept
+    {
+        return running_;
+    }
+
+    [[nodiscard]] bool
+    stale() const noexcept
+    {
+        return stale_;
+    }
+
+    /**
+     * Round trip times from ping to pong.
+     */
+    [[nodiscard]] const utils::Histogram&
+    rtt() const noexcept
+    {
+        return rtt_;
+    }
+
+private:
+    static void tick_(uv_timer_t* timer); // NOLINT(*-naming)
+
+    /**
+     * Data came back after the connection went stale.
+     */
+    void live_(uint64_t now);
+};
+
+} // namespace web
+} // namespace raccoon
@@ -0,0 +1,93 @@
+#include "http.hpp"
+
+#include "common.hpp"
+
+#include <curl/curl.h>
+
+namespace raccoon {
+namespace web {
+
+size_t
+HttpConnection::write_callback_(
+    char* buf, size_t elem_size, size_t length, void* user_data
+)
+{
+    // Compute size
+    size_t size = elem_size * length;
+
+    // Get our connection
+    auto* conn = static_cast<HttpConnection*>(user_data);
+    assert(conn->ready());
+
+    // Populate backtrace
+    log_bt(web, "HTTP write callback for url {} with {} bytes", conn->url(), size);
+    log_t1(web, "HTTP data callback ran for {} ({} bytes)", conn->url(), size);
+
+    // Add data to body
+    conn->body_.append(buf, size);
+
+    // Return "bytes written"
+    return size;
+}
+
+void
+HttpConnection::start_()
+{
+    assert(ready());
+    assert(!open());
+
+    // Populate backtrace
+    log_bt(web, "Setting up HTTP request to {}", url());
+
+    // Clear error buffer
+    clear_error_buffer_();
+
+    // Set url
+    curl_easy_setopt(curl_handle(), CURLOPT_URL, url().c_str());
+    curl_easy_setopt(curl_handle(), CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(curl_handle(), CURLOPT_FOLLOWLOCATION, 1L);
+
+    // Let curl handle compressed responses
+    curl_easy_setopt(curl_handle(), CURLOPT_ACCEPT_ENCODING, "");
+
+    // Set up write function
+    curl_easy_setopt(curl_handle(), CURLOPT_WRITEFUNCTION, write_callback_);
+    curl_easy_setopt(curl_handle(), CURLOPT_WRITEDATA, this);
+
+    // Mark the request as open
+    open() = true;
+    log_d(web, "Set up HTTP request to {}", url());
+}
+
+void
+HttpConnection::finish_(CURLcode result)
+{
+    // Make sure nobody abandoned us
+    if (!open()) [[unlikely]] {
+        log_d(web, "HTTP request to {} finished after close()", url());
+        return;
+    }
+
+    // Get our status code
+    long status = 0;
+    if (result == CURLE_OK)
+        curl_easy_getinfo(curl_handle(), CURLINFO_RESPONSE_CODE, &status);
+
+    log_d(
+        web,
+        "HTTP request to {} finished with status {} ({} bytes)",
+        url(),
+        status,
+        body_.size()
+    );
+
+    // Enter callback
+    if (on_complete_)
+        on_complete_(this, status, body_);
+
+    // Done with the response
+    body_.clear();
+}
+
+} // namespace web
+} // namespace raccoon
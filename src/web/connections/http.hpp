@@ -0,0 +1,97 @@
+#pragma once
+
+#include "base.hpp"
+#include "common.hpp"
+
+#include <functional>
+
+namespace raccoon {
+namespace web {
+
+/**
+ * A one-shot HTTP request.
+ *
+ * The response body is buffered in memory and handed to the callback once the
+ * transfer finishes.
+ *
+ * It is UNDEFINED BEHAVIOR to call any instance methods until
+ * conn->ready() returns true.
+ */
+class HttpConnection : public Connection {
+public:
+    /**
+     * An HTTP completion callback.
+     *
+     * Parameters are this class, the HTTP status code (0 if the transfer failed),
+     * and the response body.
+     */
+    using callback = std::function<void(HttpConnection*, long, const std::string&)>;
+
+private:
+    std::string body_;
+    callback on_complete_;
+
+public:
+    /* No copy operators */
+    HttpConnection(const HttpConnection&) = delete;
+    HttpConnection& operator=(const HttpConnection&) = delete;
+
+    /* Default move operators */
+    HttpConnection(HttpConnection&&) = default;
+    HttpConnection& operator=(HttpConnection&&) = default;
+
+    ~HttpConnection() override = default;
+
+    /**
+     * Abandon this request; the callback will not run.
+     */
+    void
+    close() override
+    {
+        open() = false;
+    }
+
+    /**
+     * Dummy, responses are kept in memory.
+     */
+    [[nodiscard]] FILE*
+    file() const noexcept override
+    {
+        return nullptr;
+    }
+
+    friend class Session;
+
+private:
+    /**
+     * Create a new HTTP request.
+     *
+     * Should only be called by the Session.
+     */
+    HttpConnection(const std::string& url, callback on_complete) :
+        Connection(url), on_complete_(std::move(on_complete))
+    {}
+
+    /**
+     * Start this request.
+     */
+    void start_() override;
+
+    /**
+     * Hand the response to the user callback.
+     */
+    void finish_(CURLcode result) override;
+
+    /**
+     * Receive data from libcurl and append it to the body.
+     */
+    static size_t write_callback_( // NOLINT(*-identifier-naming)
+        char* buf,
+        size_t elem_size,
+        size_t length,
+        void* user_data
+    );
+};
+
+} // namespace web
+} // namespace raccoon
@@ -0,0 +1,1157 @@
+#include "native_ws.hpp"
+
+#include "common.hpp"
+#include "utils/utils.hpp"
+
+#include <openssl/err.h>
+#include <openssl/rand.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <ratio>
+#include <unordered_map>
+
+namespace raccoon {
+namespace web {
+
+// Ends every compressed message, but is stripped before it's sent
+static constexpr std::array<uint8_t, 4> DEFLATE_TAIL = {0x00, 0x00, 0xFF, 0xFF};
+
+// Room left for each read from the socket, at least
+static constexpr size_t MIN_READ_SIZE = 4096;
+
+// Largest upgrade response we wait for the end of
+static constexpr size_t MAX_UPGRADE_RESPONSE = 16384;
+
+/**
+ * Bytes of data written to the socket, until libuv is done with them.
+ */
+struct write_req {
+    uv_write_t req;
+    std::vector<uint8_t> data;
+    utils::BufferPool* pool; // where the data goes back to
+};
+
+/**
+ * The TLS context shared by every connection, which verifies servers against the
+ * system's certificates.
+ */
+static SSL_CTX*
+tls_context()
+{
+    static SSL_CTX* ctx = [] {
+        auto* res = SSL_CTX_new(TLS_client_method());
+
+        SSL_CTX_set_min_proto_version(res, TLS1_2_VERSION);
+        SSL_CTX_set_default_verify_paths(res);
+        SSL_CTX_set_verify(res, SSL_VERIFY_PEER, nullptr);
+
+        // Sessions are kept by server rather than by OpenSSL, see tls_sessions()
+        SSL_CTX_set_session_cache_mode(
+            res, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE
+        );
+        SSL_CTX_sess_set_new_cb(res, detail::new_tls_session);
+
+        return res;
+    }();
+
+    return ctx;
+}
+
+/**
+ * The last TLS session of each server, by host and port, to resume. Shared by
+ * every connection, so a standby or a reopened connection skips the full
+ * handshake; and by every thread, as the context is.
+ */
+struct tls_session_cache {
+    std::mutex mutex;
+    std::unordered_map<std::string, SSL_SESSION*> sessions; // we hold a reference
+};
+
+static tls_session_cache&
+tls_sessions()
+{
+    static tls_session_cache cache;
+    return cache;
+}
+
+static std::string
+tls_session_key(const utils::url_parts& target)
+{
+    return fmt::format("{}:{}", target.host, target.port);
+}
+
+namespace detail {
+
+int
+new_tls_session(SSL* ssl, SSL_SESSION* session)
+{
+    const auto* conn = static_cast<NativeWebSocketConnection*>(SSL_get_app_data(ssl));
+    auto key = tls_session_key(conn->target_);
+
+    auto& cache = tls_sessions();
+    std::scoped_lock lock(cache.mutex);
+
+    auto& kept = cache.sessions[key];
+
+    if (kept != nullptr)
+        SSL_SESSION_free(kept);
+
+    kept = session;
+
+    log_t1(web, "Keeping TLS session for {}", key);
+    return 1; // the reference is ours
+}
+
+} // namespace detail
+
+/**
+ * The last OpenSSL error, as text.
+ */
+static std::string
+tls_error()
+{
+    constexpr size_t ERROR_SIZE = 256;
+
+    std::string res(ERROR_SIZE, '\0');
+    ERR_error_string_n(ERR_get_error(), res.data(), res.size());
+    res.resize(strlen(res.c_str()));
+
+    return res;
+}
+
+/**
+ * Compare ASCII strings, ignoring case.
+ */
+static bool
+iequals(std::string_view lhs, std::string_view rhs)
+{
+    return std::ranges::equal(lhs, rhs, [](char left, char right) {
+        return std::tolower(static_cast<unsigned char>(left))
+               == std::tolower(static_cast<unsigned char>(right));
+    });
+}
+
+NativeWebSocketConnection::~NativeWebSocketConnection() noexcept
+{
+    // Frees both BIOs too
+    if (ssl_)
+        SSL_free(ssl_);
+
+    if (inflater_init_)
+        inflateEnd(&inflater_);
+}
+
+void
+NativeWebSocketConnection::start_(uv_loop_t* loop)
+{
+    assert(state_ == State::IDLE);
+
+    // Populate backtrace
+    log_bt(web, "Setting up native WS connection to {}", url_);
+
+    auto parts = utils::split_url(url_);
+
+    if (!parts || (parts->scheme != "ws" && parts->scheme != "wss")) [[unlikely]] {
+        log_e(web, "Can't open a native WebSocket connection to {}", url_);
+
+        state_ = State::CLOSED;
+        finished_();
+        return;
+    }
+
+    target_ = std::move(*parts);
+    state_ = State::CONNECTING;
+    loop_ = loop;
+
+    rx_.resize(WS_RECV_BUFFER_SIZE);
+
+    // Reopening, where we were last
+    if (address_known_) {
+        log_d(web, "Reconnecting to {} at its last address", url_);
+
+        address_reused_ = true;
+        connect_();
+        return;
+    }
+
+    // Resolve the host
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    auto port = std::to_string(target_.port);
+    resolver_.data = this;
+
+    auto on_resolved = [](uv_getaddrinfo_t* req, int status, addrinfo* res) {
+        auto* conn = static_cast<NativeWebSocketConnection*>(req->data);
+
+        // Closed while resolving
+        if (conn->state_ != State::CONNECTING) [[unlikely]] {
+            uv_freeaddrinfo(res);
+            return;
+        }
+
+        if (status < 0) [[unlikely]] {
+            log_e(
+                web,
+                "Could not resolve {} for {}: {}",
+                conn->target_.host,
+                conn->url_,
+                uv_strerror(status)
+            );
+
+            conn->close_socket_();
+            return;
+        }
+
+        // Connect to the first address, and remember it
+        std::memcpy(&conn->address_, res->ai_addr, res->ai_addrlen);
+        conn->address_known_ = true;
+        conn->address_reused_ = false;
+        uv_freeaddrinfo(res);
+
+        conn->connect_();
+    };
+
+    auto err = uv_getaddrinfo(
+        loop, &resolver_, on_resolved, target_.host.c_str(), port.c_str(), &hints
+    );
+
+    if (err < 0) [[unlikely]] {
+        log_e(web, "Could not resolve {}: {}", target_.host, uv_strerror(err));
+        close_socket_();
+        return;
+    }
+
+    log_d(web, "Set up native web socket connection to {}", url_);
+}
+
+void
+NativeWebSocketConnection::connect_()
+{
+    uv_tcp_init(loop_, &socket_);
+    socket_.data = this;
+    socket_init_ = true;
+
+    connect_req_.data = this;
+
+    auto on_connect = [](uv_connect_t* connect, int connect_status) {
+        auto* conn = static_cast<NativeWebSocketConnection*>(connect->data);
+
+        if (conn->state_ != State::CONNECTING) [[unlikely]]
+            return;
+
+        if (connect_status < 0) [[unlikely]] {
+            log_e(
+                web,
+                "Could not connect to {}: {}",
+                conn->url_,
+                uv_strerror(connect_status)
+            );
+
+            // The host may have moved, so resolve it again rather than give up
+            conn->restart_ = conn->address_reused_;
+            conn->address_known_ = false;
+
+            conn->close_socket_();
+            return;
+        }
+
+        conn->connected_();
+    };
+
+    const auto* addr = reinterpret_cast<const sockaddr*>(&address_); // NOLINT
+    auto err = uv_tcp_connect(&connect_req_, &socket_, addr, on_connect);
+
+    if (err < 0) [[unlikely]] {
+        log_e(web, "Could not connect to {}: {}", url_, uv_strerror(err));
+
+        address_known_ = false;
+        close_socket_();
+    }
+}
+
+void
+NativeWebSocketConnection::connected_()
+{
+    log_d(web, "Connected to {}", url_);
+
+    // Frames are small and latency matters
+    uv_tcp_nodelay(&socket_, 1);
+
+    auto on_alloc = [](uv_handle_t* handle, size_t /* suggested */, uv_buf_t* buf) {
+        auto* conn = static_cast<NativeWebSocketConnection*>(handle->data);
+
+        // Ciphertext goes to its own buffer, plain text straight to rx_
+        if (conn->ssl_) {
+            *buf = uv_buf_init(
+                reinterpret_cast<char*>(conn->tls_buf_.data()), // NOLINT
+                static_cast<unsigned>(conn->tls_buf_.size())
+            );
+            return;
+        }
+
+        conn->reserve_();
+
+        *buf = uv_buf_init(
+            reinterpret_cast<char*>(conn->rx_.data() + conn->rx_size_), // NOLINT
+            static_cast<unsigned>(conn->rx_.size() - conn->rx_size_)
+        );
+    };
+
+    auto on_read = [](uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+        auto* conn = static_cast<NativeWebSocketConnection*>(stream->data);
+
+        if (nread < 0) [[unlikely]] {
+            if (nread == UV_EOF)
+                log_i(web, "Connection to {} closed by the server", conn->url_);
+            else
+                log_e(
+                    web,
+                    "Error reading from {}: {}",
+                    conn->url_,
+                    uv_strerror(static_cast<int>(nread))
+                );
+
+            conn->close_socket_();
+            return;
+        }
+
+        log_t1(web, "Read {} bytes from {}", nread, conn->url_);
+
+        if (conn->ssl_) {
+            conn->received_tls_({
+                reinterpret_cast<const uint8_t*>(buf->base), // NOLINT
+                static_cast<size_t>(nread),
+            });
+            return;
+        }
+
+        conn->rx_size_ += static_cast<size_t>(nread);
+        conn->received_();
+    };
+
+    auto* stream = reinterpret_cast<uv_stream_t*>(&socket_); // NOLINT
+    auto err = uv_read_start(stream, on_alloc, on_read);
+
+    if (err < 0) [[unlikely]] {
+        log_e(web, "Could not read from {}: {}", url_, uv_strerror(err));
+        close_socket_();
+        return;
+    }
+
+    if (target_.scheme != "wss") {
+        send_upgrade_();
+        return;
+    }
+
+    // Start the TLS handshake, and upgrade once it's done
+    log_d(web, "Starting TLS handshake with {}", target_.host);
+
+    tls_buf_.resize(WS_RECV_BUFFER_SIZE);
+
+    ssl_ = SSL_new(tls_context());
+    rbio_ = BIO_new(BIO_s_mem());
+    wbio_ = BIO_new(BIO_s_mem());
+    SSL_set_bio(ssl_, rbio_, wbio_);
+
+    // What SSL_set_tlsext_host_name() expands to, without its C-style cast
+    SSL_ctrl( // NOLINT(*-vararg)
+        ssl_,
+        SSL_CTRL_SET_TLSEXT_HOSTNAME,
+        TLSEXT_NAMETYPE_host_name,
+        const_cast<char*>(target_.host.c_str()) // NOLINT(*-const-cast)
+    );
+    SSL_set1_host(ssl_, target_.host.c_str());
+    SSL_set_connect_state(ssl_);
+    SSL_set_app_data(ssl_, this); // NOLINT(*-vararg)
+
+    // Resume the last session with this server, if there's one
+    {
+        auto& cache = tls_sessions();
+        std::scoped_lock lock(cache.mutex);
+
+        auto it = cache.sessions.find(tls_session_key(target_));
+        if (it != cache.sessions.end())
+            SSL_set_session(ssl_, it->second);
+    }
+
+    SSL_do_handshake(ssl_);
+    flush_tls_();
+}
+
+void
+NativeWebSocketConnection::reserve_()
+{
+    auto want = std::max(rx_needed_, rx_size_ + MIN_READ_SIZE);
+
+    if (want > rx_.size()) [[unlikely]] {
+        log_d(web, "Growing receive buffer for {} to hold {} bytes", url_, want);
+        rx_.resize(std::max(want, rx_.size() * 2));
+    }
+}
+
+void
+NativeWebSocketConnection::received_tls_(std::span<const uint8_t> data)
+{
+    BIO_write(rbio_, data.data(), static_cast<int>(data.size()));
+
+    if (!SSL_is_init_finished(ssl_)) {
+        auto res = SSL_do_handshake(ssl_);
+        flush_tls_();
+
+        if (res != 1) {
+            if (SSL_get_error(ssl_, res) == SSL_ERROR_WANT_READ) [[likely]]
+                return;
+
+            log_e(web, "TLS handshake with {} failed: {}", target_.host, tls_error());
+            close_socket_();
+            return;
+        }
+
+        log_d(
+            web,
+            "TLS handshake with {} done{}",
+            target_.host,
+            SSL_session_reused(ssl_) ? ", session resumed" : ""
+        );
+        send_upgrade_();
+    }
+
+    // Decrypt into rx_, handling as we go
+    while (open()) {
+        reserve_();
+
+        auto size = SSL_read(
+            ssl_,
+            rx_.data() + rx_size_, // NOLINT(*-pointer-arithmetic)
+            static_cast<int>(rx_.size() - rx_size_)
+        );
+
+        if (size <= 0) {
+            auto err = SSL_get_error(ssl_, size);
+
+            if (err == SSL_ERROR_WANT_READ) [[likely]]
+                break;
+
+            if (err == SSL_ERROR_ZERO_RETURN)
+                log_i(web, "Connection to {} closed by the server", url_);
+            else
+                log_e(web, "Error decrypting data from {}: {}", url_, tls_error());
+
+            close_socket_();
+            return;
+        }
+
+        rx_size_ += static_cast<size_t>(size);
+        received_();
+    }
+
+    // Reading may write, for key updates and the like
+    if (open())
+        flush_tls_();
+}
+
+void
+NativeWebSocketConnection::received_()
+{
+    if (state_ == State::UPGRADING && !finish_upgrade_())
+        return;
+
+    if (state_ == State::OPEN || state_ == State::CLOSING) [[likely]]
+        process_frames_();
+}
+
+void
+NativeWebSocketConnection::send_upgrade_()
+{
+    key_ = ws::make_key();
+
+    auto host = target_.host;
+    auto default_port = target_.scheme == "wss" ? 443 : 80; // NOLINT(*-magic-numbers)
+
+    if (target_.port != default_port)
+        host += fmt::format(":{}", target_.port);
+
+    auto request = fmt::format(
+        "GET {} HTTP/1.1\r\n"
+        "Host: {}\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Key: {}\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Extensions: permessage-deflate\r\n"
+        "\r\n",
+        target_.path,
+        host,
+        key_
+    );
+
+    log_t2(web, "Upgrade request to {}:\n{}", url_, request);
+
+    state_ = State::UPGRADING;
+    write_({request.begin(), request.end()});
+}
+
+bool
+NativeWebSocketConnection::finish_upgrade_()
+{
+    std::string_view received(
+        reinterpret_cast<const char*>(rx_.data()), // NOLINT(*-reinterpret-cast)
+        rx_size_
+    );
+
+    auto end = received.find("\r\n\r\n");
+
+    if (end == std::string_view::npos) {
+        if (rx_size_ > MAX_UPGRADE_RESPONSE) [[unlikely]] {
+            log_e(web, "Upgrade response from {} is too long", url_);
+            close_socket_();
+        }
+
+        return false;
+    }
+
+    auto response = received.substr(0, end);
+    log_t2(web, "Upgrade response from {}:\n{}", url_, response);
+
+    // Status line
+    auto line_end = response.find("\r\n");
+    auto status = response.substr(0, line_end);
+
+    if (!status.starts_with("HTTP/1.1 101")) [[unlikely]] {
+        log_e(web, "Server at {} refused the upgrade: {}", url_, status);
+        close_socket_();
+        return false;
+    }
+
+    // Headers
+    std::string_view accept;
+    std::string_view extensions;
+
+    while (line_end != std::string_view::npos) {
+        auto start = line_end + 2;
+        line_end = response.find("\r\n", start);
+
+        auto line = response.substr(start, line_end - start);
+        auto colon = line.find(':');
+
+        if (colon == std::string_view::npos)
+            continue;
+
+        auto name = line.substr(0, colon);
+        auto value = line.substr(colon + 1);
+
+        while (!value.empty() && value.front() == ' ')
+            value.remove_prefix(1);
+
+        if (iequals(name, "Sec-WebSocket-Accept"))
+            accept = value;
+        else if (iequals(name, "Sec-WebSocket-Extensions"))
+            extensions = value;
+    }
+
+    if (accept != ws::accept_key(key_)) [[unlikely]] {
+        log_e(web, "Server at {} sent the wrong accept key", url_);
+        close_socket_();
+        return false;
+    }
+
+    // Compression, if the server agreed to it
+    if (extensions.find("permessage-deflate") != std::string_view::npos) {
+        constexpr int RAW_DEFLATE_WINDOW = -15; // raw deflate, any window size
+
+        if (inflateInit2(&inflater_, RAW_DEFLATE_WINDOW) != Z_OK) [[unlikely]] {
+            log_e(web, "Could not set up inflating messages from {}", url_);
+            close_socket_();
+            return false;
+        }
+
+        inflater_init_ = true;
+        deflate_ = true;
+        reset_inflater_ =
+            extensions.find("server_no_context_takeover") != std::string_view::npos;
+    }
+
+    // Frames may follow in the same read
+    auto used = end + 4;
+    std::memmove(rx_.data(), rx_.data() + used, rx_size_ - used); // NOLINT
+    rx_size_ -= used;
+
+    state_ = State::OPEN;
+    log_i(
+        web,
+        "Opened native WebSocket connection to {}{}",
+        url_,
+        deflate_ ? " with compression" : ""
+    );
+
+    // Send what was sent while we were connecting
+    for (auto& frame : pending_)
+        write_(std::move(frame));
+
+    pending_.clear();
+
+    heartbeat_.start();
+
+    return true;
+}
+
+void
+NativeWebSocketConnection::process_frames_()
+{
+    size_t pos = 0;
+    rx_needed_ = 0;
+
+    while (state_ == State::OPEN || state_ == State::CLOSING) {
+        std::span<uint8_t> data(rx_.data() + pos, rx_size_ - pos); // NOLINT
+
+        ws::FrameHeader header;
+        auto header_size = ws::parse_header(data, header);
+
+        if (header_size == 0)
+            break;
+
+        if (header_size == ws::FRAME_ERROR) [[unlikely]] {
+            fail_(WebSocketCloseStatus::PROTOCOL_ERROR, "malformed frame");
+            return;
+        }
+
+        if (header.payload_size > WS_MAX_MESSAGE_SIZE) [[unlikely]] {
+            fail_(WebSocketCloseStatus::MESSAGE_TOO_BIG, "frame is too big");
+            return;
+        }
+
+        auto frame_size = header_size + header.payload_size;
+
+        // Wait for the rest, with room for it
+        if (data.size() < frame_size) {
+            rx_needed_ = frame_size;
+            break;
+        }
+
+        auto payload = data.subspan(header_size, header.payload_size);
+
+        if (header.masked) [[unlikely]]
+            ws::apply_mask(payload, header.mask);
+
+        pos += frame_size;
+        process_frame_(header, payload);
+    }
+
+    // Keep what's left of the last frame at the front
+    if (pos > 0 && rx_size_ > pos)
+        std::memmove(rx_.data(), rx_.data() + pos, rx_size_ - pos); // NOLINT
+
+    rx_size_ -= std::min(pos, rx_size_);
+}
+
+void
+NativeWebSocketConnection::process_frame_(
+    const ws::FrameHeader& header, std::span<uint8_t> payload
+)
+{
+    log_t2(
+        web,
+        "Frame from {} with opcode {:#x}, {} bytes{}{}",
+        url_,
+        static_cast<uint8_t>(header.opcode),
+        payload.size(),
+        header.fin ? "" : ", fragmented",
+        header.compressed ? ", compressed" : ""
+    );
+
+    // Only the first frame of a message can be compressed
+    if (header.compressed
+        && (!deflate_ || ws::is_control(header.opcode)
+            || header.opcode == ws::Opcode::CONTINUATION)) [[unlikely]]
+    {
+        fail_(WebSocketCloseStatus::PROTOCOL_ERROR, "unexpected compressed frame");
+        return;
+    }
+
+    switch (header.opcode) {
+        [[likely]] case ws::Opcode::TEXT:
+        case ws::Opcode::BINARY:
+            if (fragmented_) [[unlikely]] {
+                fail_(WebSocketCloseStatus::PROTOCOL_ERROR, "interleaved message");
+                return;
+            }
+
+            // Most messages are one frame, handed over where they were received
+            if (header.fin) [[likely]] {
+                deliver_(payload, header.compressed);
+                return;
+            }
+
+            fragmented_ = true;
+            message_compressed_ = header.compressed;
+            message_.assign(payload.begin(), payload.end());
+            return;
+
+        case ws::Opcode::CONTINUATION:
+            if (!fragmented_) [[unlikely]] {
+                fail_(WebSocketCloseStatus::PROTOCOL_ERROR, "unexpected continuation");
+                return;
+            }
+
+            if (message_.size() + payload.size() > WS_MAX_MESSAGE_SIZE) [[unlikely]] {
+                fail_(WebSocketCloseStatus::MESSAGE_TOO_BIG, "message is too big");
+                return;
+            }
+
+            message_.insert(message_.end(), payload.begin(), payload.end());
+
+            if (header.fin) {
+                fragmented_ = false;
+                deliver_(message_, message_compressed_);
+                message_.clear();
+            }
+            return;
+
+        case ws::Opcode::PING:
+            if (state_ == State::OPEN)
+                send_frame_(ws::Opcode::PONG, payload);
+            return;
+
+        case ws::Opcode::PONG:
+            log_t1(web, "Pong from {}", url_);
+            heartbeat_.on_pong();
+            return;
+
+        case ws::Opcode::CLOSE:
+            {
+                uint16_t status = 0;
+
+                if (payload.size() >= 2) // NOLINTNEXTLINE(*-magic-numbers)
+                    status = static_cast<uint16_t>((payload[0] << 8U) | payload[1]);
+
+                log_i(web, "Server at {} closed the connection with {}", url_, status);
+
+                // Answer with its status, unless we asked first
+                if (state_ == State::OPEN) {
+                    auto echo = payload.first(std::min<size_t>(2, payload.size()));
+                    send_frame_(ws::Opcode::CLOSE, echo);
+                }
+
+                close_socket_();
+                return;
+            }
+
+        [[unlikely]] default:
+            fail_(WebSocketCloseStatus::PROTOCOL_ERROR, "unknown opcode");
+            return;
+    }
+}
+
+void
+NativeWebSocketConnection::deliver_(std::span<const uint8_t> message, bool compressed)
+{
+    heartbeat_.on_data();
+
+    if (compressed) {
+        if (!inflate_(message)) [[unlikely]] {
+            fail_(WebSocketCloseStatus::INVALID_PAYLOAD, "could not inflate message");
+            return;
+        }
+
+        message = {inflated_.data(), inflated_size_};
+    }
+
+    if (logging::should_log<quill::LogLevel::TraceL3>(logging::get_web_logger()))
+        [[unlikely]]
+    {
+        log_t3(web, "Data hexdump\n{}", utils::hexdump(message.data(), message.size()));
+    }
+
+    // Time a sample of callbacks, and only when the result would be logged
+    if (logging::should_log<quill::LogLevel::Debug>(logging::get_web_logger())
+        && log_sampler_()) [[unlikely]] {
+        const auto start = std::chrono::steady_clock::now();
+        on_data_(this, message);
+        const auto end = std::chrono::steady_clock::now();
+
+        const std::chrono::duration<double, std::milli> time_in_cb = end - start;
+        log_d(
+            web,
+            "Received {} bytes from {} natively, callback took {} (1 in {} logged)",
+            message.size(),
+            url_,
+            time_in_cb,
+            LOG_SAMPLE_EVERY
+        );
+    }
+    else [[likely]] {
+        on_data_(this, message);
+    }
+}
+
+bool
+NativeWebSocketConnection::inflate_(std::span<const uint8_t> message)
+{
+    size_t out = 0;
+
+    auto run = [this, &out](std::span<const uint8_t> input) {
+        // NOLINTNEXTLINE(*-const-cast)
+        inflater_.next_in = const_cast<Bytef*>(input.data());
+        inflater_.avail_in = static_cast<uInt>(input.size());
+
+        do {
+            if (out == inflated_.size()) {
+                if (inflated_.size() >= WS_MAX_MESSAGE_SIZE) [[unlikely]]
+                    return false;
+
+                inflated_.resize(std::max({
+                    inflated_.size() * 2,
+                    input.size() * 4,
+                    MIN_READ_SIZE,
+                }));
+            }
+
+            inflater_.next_out = inflated_.data() + out; // NOLINT
+            inflater_.avail_out = static_cast<uInt>(inflated_.size() - out);
+
+            auto res = inflate(&inflater_, Z_SYNC_FLUSH);
+            out = inflated_.size() - inflater_.avail_out;
+
+            if (res == Z_STREAM_END)
+                break;
+
+            if (res != Z_OK && res != Z_BUF_ERROR) [[unlikely]]
+                return false;
+
+            // Wants more input, which there isn't
+            if (res == Z_BUF_ERROR && inflater_.avail_out != 0)
+                break;
+        } while (inflater_.avail_in > 0 || inflater_.avail_out == 0);
+
+        return true;
+    };
+
+    bool inflated = run(message) && run(DEFLATE_TAIL);
+    inflated_size_ = out;
+
+    if (reset_inflater_ || !inflated)
+        inflateReset(&inflater_);
+
+    return inflated;
+}
+
+size_t
+NativeWebSocketConnection::close(
+    WebSocketCloseStatus status, std::span<const uint8_t> data
+)
+{
+    // Populate backtrace
+    log_bt(
+        web,
+        "Send native WS close message to {} with status {} and data {}",
+        url_,
+        status,
+        data
+    );
+
+    log_i(web, "Closing WebSocket connection to {} with code {}", url_, status);
+
+    if (state_ != State::OPEN) {
+        if (open()) {
+            // Not opened yet, so there's no one to say goodbye to
+            log_d(web, "Closing {} before it opened", url_);
+            close_socket_();
+        }
+        else {
+            log_w(
+                web,
+                "close() called on closed connection to {} (may have been dropped)",
+                url_
+            );
+        }
+
+        return 0;
+    }
+
+    // Status then data, on the stack as close frames are short
+    ws::ClosePayload payload{};
+    auto size = ws::encode_close(static_cast<uint16_t>(status), data, payload);
+
+    if (size < data.size() + 2) [[unlikely]]
+        log_w(web, "Close data to {} cut to {} bytes", url_, size - 2);
+
+    send_frame_(ws::Opcode::CLOSE, std::span(payload).first(size));
+
+    // The server closes the socket after answering
+    state_ = State::CLOSING;
+
+    return size;
+}
+
+size_t
+NativeWebSocketConnection::send(std::span<const uint8_t> data, ws::Opcode opcode)
+{
+    // Populate backtrace
+    log_bt(
+        web,
+        "Native websocket send to {} with opcode {:#x} and {} bytes: {}",
+        url_,
+        static_cast<uint8_t>(opcode),
+        data.size(),
+        data
+    );
+
+    log_t1(web, "Sending {} bytes to {}", data.size(), url_);
+
+    if (logging::should_log<quill::LogLevel::TraceL3>(logging::get_web_logger()))
+        [[unlikely]]
+    {
+        log_t3(web, "Data hexdump\n{}", utils::hexdump(data.data(), data.size()));
+    }
+
+    if (state_ == State::CLOSING || state_ == State::CLOSED) [[unlikely]] {
+        log_w(web, "send() called on closed connection to {}", url_);
+        return 0;
+    }
+
+    send_frame_(opcode, data);
+    return data.size();
+}
+
+void
+NativeWebSocketConnection::send_frame_(
+    ws::Opcode opcode, std::span<const uint8_t> payload
+)
+{
+    ws::MaskKey mask{};
+    RAND_bytes(mask.data(), static_cast<int>(mask.size()));
+
+    std::array<uint8_t, ws::MAX_HEADER_SIZE> header{};
+    auto header_size = ws::encode_header(opcode, payload.size(), mask, header.data());
+
+    // Header then masked payload, in a buffer from the pool
+    auto frame = send_pool_.acquire();
+    frame.reserve(header_size + payload.size());
+
+    frame.assign(header.begin(), header.begin() + static_cast<ptrdiff_t>(header_size));
+    frame.insert(frame.end(), payload.begin(), payload.end());
+
+    ws::apply_mask(std::span(frame).subspan(header_size), mask);
+
+    // Held until the upgrade, like curl would have
+    if (state_ != State::OPEN && state_ != State::CLOSING) {
+        pending_.push_back(std::move(frame));
+        return;
+    }
+
+    write_(std::move(frame));
+}
+
+void
+NativeWebSocketConnection::write_(std::vector<uint8_t> data)
+{
+    if (!ssl_) {
+        write_socket_(std::move(data));
+        return;
+    }
+
+    // Memory BIOs take everything at once
+    SSL_write(ssl_, data.data(), static_cast<int>(data.size()));
+    send_pool_.release(std::move(data));
+
+    flush_tls_();
+}
+
+void
+NativeWebSocketConnection::write_socket_(std::vector<uint8_t> data)
+{
+    auto* stream = reinterpret_cast<uv_stream_t*>(&socket_); // NOLINT
+
+    // Most writes fit in the socket at once. libuv refuses this while earlier
+    // writes are queued, so they stay in order.
+    auto now = uv_buf_init(
+        reinterpret_cast<char*>(data.data()), // NOLINT(*-reinterpret-cast)
+        static_cast<unsigned>(data.size())
+    );
+
+    auto written = uv_try_write(stream, &now, 1);
+
+    if (written == static_cast<int>(data.size())) [[likely]] {
+        send_pool_.release(std::move(data));
+        return;
+    }
+
+    if (written > 0)
+        data.erase(data.begin(), data.begin() + static_cast<ptrdiff_t>(written));
+
+    log_t1(web, "Socket to {} is full, queueing {} bytes", url_, data.size());
+
+    // The rest goes once the socket is writable
+    auto* req = new write_req{.req = {}, .data = std::move(data), .pool = &send_pool_};
+    req->req.data = req;
+
+    auto buf = uv_buf_init(
+        reinterpret_cast<char*>(req->data.data()), // NOLINT(*-reinterpret-cast)
+        static_cast<unsigned>(req->data.size())
+    );
+
+    auto on_write = [](uv_write_t* write, int status) {
+        auto* done = static_cast<write_req*>(write->data);
+
+        if (status < 0 && status != UV_ECANCELED) [[unlikely]]
+            log_w(web, "Write failed: {}", uv_strerror(status));
+
+        done->pool->release(std::move(done->data));
+        delete done;
+    };
+
+    auto err = uv_write(&req->req, stream, &buf, 1, on_write);
+
+    if (err < 0) [[unlikely]] {
+        log_e(web, "Could not write to {}: {}", url_, uv_strerror(err));
+        delete req;
+    }
+}
+
+void
+NativeWebSocketConnection::flush_tls_()
+{
+    while (BIO_ctrl_pending(wbio_) > 0) {
+        auto data = send_pool_.acquire();
+        data.resize(BIO_ctrl_pending(wbio_));
+
+        auto size = BIO_read(wbio_, data.data(), static_cast<int>(data.size()));
+
+        if (size <= 0) [[unlikely]]
+            break;
+
+        data.resize(static_cast<size_t>(size));
+        write_socket_(std::move(data));
+    }
+}
+
+void
+NativeWebSocketConnection::fail_(WebSocketCloseStatus status, std::string_view reason)
+{
+    log_e(web, "Dropping WebSocket connection to {}: {}", url_, reason);
+
+    if (state_ == State::OPEN) {
+        ws::ClosePayload payload{};
+        auto size = ws::encode_close(static_cast<uint16_t>(status), {}, payload);
+
+        send_frame_(ws::Opcode::CLOSE, std::span(payload).first(size));
+    }
+
+    close_socket_();
+}
+
+void
+NativeWebSocketConnection::close_socket_()
+{
+    if (state_ == State::CLOSED)
+        return;
+
+    state_ = State::CLOSED;
+
+    if (!socket_init_) {
+        finished_();
+        return;
+    }
+
+    auto* stream = reinterpret_cast<uv_stream_t*>(&socket_); // NOLINT
+    uv_read_stop(stream);
+
+    if (ssl_ && SSL_is_init_finished(ssl_)) {
+        SSL_shutdown(ssl_);
+        flush_tls_();
+    }
+
+    // Let queued writes, like a close frame, go out first
+    auto on_shutdown = [](uv_shutdown_t* req, int /* status */) {
+        uv_close(reinterpret_cast<uv_handle_t*>(req->handle), socket_closed_); // NOLINT
+    };
+
+    if (uv_shutdown(&shutdown_req_, stream, on_shutdown) < 0)
+        uv_close(reinterpret_cast<uv_handle_t*>(&socket_), socket_closed_); // NOLINT
+}
+
+void
+NativeWebSocketConnection::socket_closed_(uv_handle_t* handle)
+{
+    static_cast<NativeWebSocketConnection*>(handle->data)->finished_();
+}
+
+void
+NativeWebSocketConnection::reconnect_()
+{
+    // Only once connected; until then, failing to connect closes it
+    if (!socket_init_ || state_ == State::CLOSED) {
+        log_d(web, "Not reopening {}, it isn't connected", url_);
+        return;
+    }
+
+    log_i(web, "Reopening WebSocket connection to {}", url_);
+
+    restart_ = true;
+    state_ = State::CLOSED;
+
+    // Queued writes are dropped, they may never go out
+    auto* stream = reinterpret_cast<uv_stream_t*>(&socket_); // NOLINT
+    uv_read_stop(stream);
+    uv_close(reinterpret_cast<uv_handle_t*>(&socket_), socket_closed_); // NOLINT
+}
+
+void
+NativeWebSocketConnection::reset_()
+{
+    // Frees both BIOs too
+    if (ssl_) {
+        SSL_free(ssl_);
+        ssl_ = nullptr;
+        rbio_ = nullptr;
+        wbio_ = nullptr;
+    }
+
+    if (inflater_init_) {
+        inflateEnd(&inflater_);
+        inflater_init_ = false;
+    }
+
+    deflate_ = false;
+    reset_inflater_ = false;
+    inflated_size_ = 0;
+
+    socket_init_ = false;
+    key_.clear();
+    pending_.clear();
+
+    rx_size_ = 0;
+    rx_needed_ = 0;
+    message_.clear();
+    fragmented_ = false;
+
+    state_ = State::IDLE;
+}
+
+void
+NativeWebSocketConnection::finished_()
+{
+    if (restart_) {
+        restart_ = false;
+
+        reset_();
+        start_(loop_);
+        return;
+    }
+
+    heartbeat_.stop();
+    log_i(web, "Connection to {} finished", url_);
+
+    messages_.close();
+
+    if (on_finish_)
+        on_finish_();
+}
+
+} // namespace web
+} // namespace raccoon
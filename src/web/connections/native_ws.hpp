@@ -0,0 +1,391 @@
+#pragma once
+
+#include "channel.hpp"
+#include "common.hpp"
+#include "heartbeat.hpp"
+#include "utils/buffer_pool.hpp"
+#include "utils/web.hpp"
+#include "ws.hpp"
+#include "ws_frame.hpp"
+
+#include <openssl/ssl.h>
+#include <uv.h>
+#include <zlib.h>
+
+#include <functional>
+#include <span>
+#include <string_view>
+
+namespace raccoon {
+namespace web {
+
+namespace detail {
+
+/**
+ * Keep a TLS session a server gave us, to resume it on the next connection.
+ */
+int new_tls_session(SSL* ssl, SSL_SESSION* session);
+
+} // namespace detail
+
+/**
+ * A websocket connection on a libuv TCP socket, without libcurl.
+ *
+ * Frames are parsed where they're received, and whole messages are handed to the
+ * callback without being copied. Fragmented messages are put back together, and
+ * messages compressed with permessage-deflate are inflated, into buffers that are
+ * kept between messages. wss:// URLs are encrypted with OpenSSL.
+ *
+ * Reopening a connection skips what it can: it connects to the address it last
+ * resolved, and resumes the last TLS session any connection had with the server.
+ *
+ * Connections are opened by the Session, and must live until they're closed.
+ */
+class NativeWebSocketConnection {
+public:
+    /**
+     * A websocket callback function.
+     *
+     * Parameters are this class and the message, which is only valid during the
+     * call.
+     */
+    using callback =
+        std::function<void(NativeWebSocketConnection*, std::span<const uint8_t>)>;
+
+private:
+    enum class State : uint8_t {
+        IDLE,       // not started
+        CONNECTING, // resolving, connecting, or in the TLS handshake
+        UPGRADING,  // waiting for the server to accept the upgrade
+        OPEN,       // exchanging messages
+        CLOSING,    // sent a close frame, waiting for the server's
+        CLOSED,     // socket closed, or never opened
+    };
+
+    std::string url_;
+    callback on_data_;
+    MessageChannel messages_; // without a callback, for next_message()
+    std::function<void()> on_finish_; // set by the Session
+
+    State state_ = State::IDLE;
+    utils::url_parts target_;
+
+    uv_loop_t* loop_ = nullptr;
+    bool restart_ = false; // open again once the socket is closed
+
+    // The address last connected to, so reopening skips resolving
+    sockaddr_storage address_{};
+    bool address_known_ = false;
+    bool address_reused_ = false; // by this attempt
+
+    uv_getaddrinfo_t resolver_{};
+    uv_connect_t connect_req_{};
+    uv_tcp_t socket_{};
+    uv_shutdown_t shutdown_req_{};
+    bool socket_init_ = false;
+
+    // TLS, through memory BIOs so libuv does all the I/O
+    SSL* ssl_ = nullptr;
+    BIO* rbio_ = nullptr; // received ciphertext, for OpenSSL to read
+    BIO* wbio_ = nullptr; // ciphertext written by OpenSSL, to send
+    std::vector<uint8_t> tls_buf_;
+
+    // Opening handshake
+    std::string key_;
+    std::vector<std::vector<uint8_t>> pending_; // frames sent before the upgrade
+
+    // Frames and ciphertext are built in, and written from, buffers kept here
+    utils::BufferPool send_pool_;
+
+    // Frames are received into, and parsed from, rx_[0, rx_size_)
+    std::vector<uint8_t> rx_;
+    size_t rx_size_ = 0;
+    size_t rx_needed_ = 0; // bytes the frame at the front needs, if more than we have
+
+    // Fragmented messages
+    std::vector<uint8_t> message_;
+    bool fragmented_ = false;
+    bool message_compressed_ = false;
+
+    // permessage-deflate
+    bool deflate_ = false;
+    bool reset_inflater_ = false; // server_no_context_takeover
+    bool inflater_init_ = false;
+    z_stream inflater_{};
+    std::vector<uint8_t> inflated_;
+    size_t inflated_size_ = 0;
+
+    logging::Sampler log_sampler_{LOG_SAMPLE_EVERY}; // messages timed and logged
+
+    Heartbeat heartbeat_; // set up by the Session, started once open
+
+    // Hot standby: the other connection of the same feed, if there's one
+    NativeWebSocketConnection* partner_ = nullptr;
+    bool standby_ = false;
+
+public:
+    /* No copy or move operators, libuv points into us */
+    NativeWebSocketConnection(const NativeWebSocketConnection&) = delete;
+    NativeWebSocketConnection(NativeWebSocketConnection&&) = delete;
+    NativeWebSocketConnection& operator=(const NativeWebSocketConnection&) = delete;
+    NativeWebSocketConnection& operator=(NativeWebSocketConnection&&) = delete;
+
+    ~NativeWebSocketConnection() noexcept;
+
+    /**
+     * If the connection is being opened, or is open.
+     */
+    [[nodiscard]] bool
+    open() const noexcept
+    {
+        return state_ != State::IDLE && state_ != State::CLOSED;
+    }
+
+    /**
+     * If messages can be exchanged.
+     */
+    [[nodiscard]] bool
+    ready() const noexcept
+    {
+        return state_ == State::OPEN;
+    }
+
+    /**
+     * If the server agreed to compress messages.
+     */
+    [[nodiscard]] bool
+    compressed() const noexcept
+    {
+        return deflate_;
+    }
+
+    /**
+     * Pings, and how long this connection was silent.
+     */
+    [[nodiscard]] const Heartbeat&
+    heartbeat() const noexcept
+    {
+        return heartbeat_;
+    }
+
+    /**
+     * If this is a feed's standby connection, whose messages should only be used
+     * to subscribe, until the Session promotes it.
+     */
+    [[nodiscard]] bool
+    standby() const noexcept
+    {
+        return standby_;
+    }
+
+    /**
+     * The other connection of the feed, if it has a standby.
+     */
+    [[nodiscard]] NativeWebSocketConnection*
+    partner() const noexcept
+    {
+        return partner_;
+    }
+
+    /**
+     * Wait for the next message, on a connection opened without a callback.
+     *
+     * co_await gives the message, valid until the next co_await, or nothing once
+     * the connection finished.
+     */
+    [[nodiscard]] MessageChannel::next_awaiter
+    next_message() noexcept
+    {
+        return messages_.next();
+    }
+
+    /**
+     * Bytes sent that the socket couldn't take yet, queued in libuv.
+     */
+    [[nodiscard]] size_t
+    queued_bytes() const noexcept
+    {
+        if (!socket_init_)
+            return 0;
+
+        const auto* stream = reinterpret_cast<const uv_stream_t*>(&socket_); // NOLINT
+        return uv_stream_get_write_queue_size(stream);
+    }
+
+    /**
+     * Send buffers kept for reuse.
+     */
+    [[nodiscard]] size_t
+    pooled_buffers() const noexcept
+    {
+        return send_pool_.size();
+    }
+
+    /**
+     * The URL this connection is for.
+     */
+    [[nodiscard]] const auto&
+    url() const noexcept
+    {
+        return url_;
+    }
+
+    /**
+     * Close this websocket connection.
+     */
+    void
+    close()
+    {
+        close(WebSocketCloseStatus::NORMAL);
+    }
+
+    /**
+     * Close this websocket connection with reason.
+     */
+    void
+    close(WebSocketCloseStatus status)
+    {
+        close(status, {});
+    }
+
+    /**
+     * Close this websocket connection with reason and data.
+     *
+     * The data is cut to what fits in a close frame, after the status.
+     *
+     * Returns amount of data written.
+     */
+    size_t close(WebSocketCloseStatus status, std::span<const uint8_t> data);
+
+    /**
+     * Send data to the websocket. Data sent before the connection is open is sent
+     * once it is, and what the socket can't take now is sent once it's writable.
+     * The data is only used during the call.
+     *
+     * Returns the number of bytes sent, or queued to be sent.
+     */
+    size_t send(std::span<const uint8_t> data, ws::Opcode opcode = ws::Opcode::TEXT);
+
+    /**
+     * Send text to the websocket.
+     *
+     * Returns the number of bytes sent, or queued to be sent.
+     */
+    size_t
+    send(std::string_view text, ws::Opcode opcode = ws::Opcode::TEXT)
+    {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(text.data()); // NOLINT
+        return send({bytes, text.size()}, opcode);
+    }
+
+    friend class Session;
+    friend int detail::new_tls_session(SSL* ssl, SSL_SESSION* session);
+
+private:
+    /**
+     * Create a new websocket connection.
+     *
+     * Should only be called by the Session.
+     */
+    NativeWebSocketConnection(std::string url, callback on_data) :
+        url_(std::move(url)), on_data_(std::move(on_data))
+    {
+        if (!on_data_)
+            on_data_ = [](auto* conn, auto message) { conn->messages_.push(message); };
+    }
+
+    /**
+     * Start this websocket connection on a loop.
+     */
+    void start_(uv_loop_t* loop);
+
+    /**
+     * Drop the socket, without a goodbye as the server may be gone, and open the
+     * connection again.
+     */
+    void reconnect_();
+
+    /**
+     * Forget everything about the last socket, before opening another.
+     */
+    void reset_();
+
+    /**
+     * Connect to the address resolved, or last resolved.
+     */
+    void connect_();
+
+    void connected_();
+    void send_upgrade_();
+
+    /**
+     * Make room in the receive buffer for the next read.
+     */
+    void reserve_();
+
+    /**
+     * Handle the TLS handshake and decrypt what was received into rx_.
+     */
+    void received_tls_(std::span<const uint8_t> data);
+
+    /**
+     * Handle what's in rx_: the upgrade response, then frames.
+     */
+    void received_();
+
+    /**
+     * Check the server's upgrade response, once it's all received.
+     *
+     * @returns bool If the connection is open.
+     */
+    bool finish_upgrade_();
+
+    void process_frames_();
+    void process_frame_(const ws::FrameHeader& header, std::span<uint8_t> payload);
+    void deliver_(std::span<const uint8_t> message, bool compressed);
+
+    /**
+     * Inflate a compressed message into inflated_.
+     *
+     * @returns bool If it could be inflated.
+     */
+    bool inflate_(std::span<const uint8_t> message);
+
+    void send_frame_(ws::Opcode opcode, std::span<const uint8_t> payload);
+
+    /**
+     * Write to the connection, encrypting if it's TLS.
+     */
+    void write_(std::vector<uint8_t> data);
+
+    /**
+     * Write to the socket: at once if it can take it all, or queued in libuv
+     * until it's writable.
+     */
+    void write_socket_(std::vector<uint8_t> data);
+
+    /**
+     * Send whatever OpenSSL has written.
+     */
+    void flush_tls_();
+
+    /**
+     * Drop the connection, with a close frame first if it's open.
+     */
+    void fail_(WebSocketCloseStatus status, std::string_view reason);
+
+    /**
+     * Close the socket, and tell the Session once it's closed.
+     */
+    void close_socket_();
+
+    static void socket_closed_(uv_handle_t* handle); // NOLINT(*-naming)
+
+    /**
+     * Called once the socket is closed, or if it never opened.
+     */
+    void finished_();
+};
+
+} // namespace web
+} // namespace raccoon
@@ -2,6 +2,7 @@
 
 #include "common.hpp"
 #include "utils/utils.hpp"
+#include "ws_frame.hpp"
 
 #include <curl/curl.h>
 
@@ -56,8 +57,11 @@ WebSocketConnection::write_callback_(
         frame->bytesleft
     );
 
-    if (logging::get_web_logger()->should_log<quill::LogLevel::TraceL3>()) [[unlikely]]
+    if (logging::should_log<quill::LogLevel::TraceL3>(logging::get_web_logger()))
+        [[unlikely]]
+    {
         log_t3(web, "Data hexdump\n{}", utils::hexdump(buf, length));
+    }
 
     // Make sure this connection isn't closed
     if (!conn->open()) [[unlikely]] {
@@ -66,31 +70,50 @@ WebSocketConnection::write_callback_(
         return size; // piped bytes to /dev/null
     }
 
+    // Control frames are ours: libcurl answers pings and closes itself
+    if (frame->flags & (CURLWS_PING | CURLWS_PONG | CURLWS_CLOSE)) [[unlikely]] {
+        if ((frame->flags & CURLWS_PONG) && frame->bytesleft == 0)
+            conn->heartbeat_.on_pong();
+
+        return size;
+    }
+
     // Add data to write buf
     // NOLINTNEXTLINE(*-pointer-arithmetic)
     conn->write_buf_.insert(conn->write_buf_.end(), buf, buf + size);
 
     if (frame->bytesleft == 0) [[likely]] { // got all data in frame; most are short
-        // log some data
+        // Silence is watched for from the first frame on
+        if (!conn->heartbeat_.running()) [[unlikely]]
+            conn->heartbeat_.start();
+
+        conn->heartbeat_.on_data();
+
         log_bt(web, "Entering user data callback for {}", conn->url());
-        log_d(
-            web,
-            "Received {} bytes from {} over WS, entering user callback",
-            conn->write_buf_.size(),
-            conn->url()
-        );
 
-        // enter callback
-        const auto start = std::chrono::steady_clock::now(); // start time
-        conn->on_data_(conn, conn->write_buf_);              // callback
-        const auto end = std::chrono::steady_clock::now();   // end time
+        // Time a sample of callbacks, and only when the result would be logged
+        if (logging::should_log<quill::LogLevel::Debug>(logging::get_web_logger())
+            && conn->log_sampler_()) [[unlikely]] {
+            const auto start = std::chrono::steady_clock::now();
+            conn->on_data_(conn, conn->write_buf_);
+            const auto end = std::chrono::steady_clock::now();
+
+            const std::chrono::duration<double, std::milli> time_in_cb = end - start;
+            log_d(
+                web,
+                "Received {} bytes from {} over WS, callback took {} (1 in {} logged)",
+                conn->write_buf_.size(),
+                conn->url(),
+                time_in_cb,
+                LOG_SAMPLE_EVERY
+            );
+        }
+        else [[likely]] {
+            conn->on_data_(conn, conn->write_buf_);
+        }
 
         // done with callback, clear write buffer
         conn->write_buf_.clear();
-
-        // Log information about callback
-        const std::chrono::duration<double, std::milli> time_in_cb = end - start;
-        log_d(web, "Time spent in callback: {}", time_in_cb);
     }
 
     // Return "bytes written"
@@ -121,8 +144,47 @@ WebSocketConnection::start_()
     log_d(web, "Set up web socket connection to {}", url());
 }
 
+void
+WebSocketConnection::finish_(CURLcode result)
+{
+    UNUSED(result);
+
+    heartbeat_.stop();
+
+    if (!pending_.empty()) [[unlikely]] {
+        log_w(web, "Dropping {} unsent messages to {}", pending_.size(), url());
+        pending_.clear();
+    }
+
+    messages_.close();
+
+    if (on_finish_)
+        on_finish_(this);
+}
+
+void
+WebSocketConnection::reset_()
+{
+    write_buf_.clear();
+
+    for (auto& waiting : pending_)
+        send_pool_.release(std::move(waiting.data));
+
+    pending_.clear();
+}
+
+void
+WebSocketConnection::ping_()
+{
+    if (!open()) [[unlikely]]
+        return;
+
+    log_t2(web, "Pinging {}", url());
+    send(std::span<const uint8_t>{}, CURLWS_PING);
+}
+
 size_t
-WebSocketConnection::close(WebSocketCloseStatus status, std::vector<uint8_t> data)
+WebSocketConnection::close(WebSocketCloseStatus status, std::span<const uint8_t> data)
 {
     assert(ready());
 
@@ -141,9 +203,9 @@ WebSocketConnection::close(WebSocketCloseStatus status, std::vector<uint8_t> dat
 
     if ( //
         !data.empty()
-        && logging::get_web_logger()->should_log<quill::LogLevel::TraceL2>()
+        && logging::should_log<quill::LogLevel::TraceL2>(logging::get_web_logger())
     ) [[unlikely]] {
-        log_t2(web, "Data hexdump\n{}", utils::hexdump(data));
+        log_t2(web, "Data hexdump\n{}", utils::hexdump(data.data(), data.size()));
     }
 
     // Make sure we're not already closed
@@ -157,32 +219,22 @@ WebSocketConnection::close(WebSocketCloseStatus status, std::vector<uint8_t> dat
         return 0;
     }
 
-    // Make status big endian
-    // NOLINTBEGIN(*-union-access)
-    union {
-        uint16_t val;
-        uint8_t bytes[2]; // NOLINT(*-c-arrays)
-    } status_bytes{};
-
-    status_bytes.val = static_cast<uint16_t>(status);
+    // Status then data, on the stack as close frames are short
+    ws::ClosePayload payload{};
+    auto size = ws::encode_close(static_cast<uint16_t>(status), data, payload);
 
-    if (std::endian::native == std::endian::little)
-        std::swap(status_bytes.bytes[0], status_bytes.bytes[1]);
-
-    // Add status bytes to data
-    data.insert(data.begin(), status_bytes.bytes[1]);
-    data.insert(data.begin(), status_bytes.bytes[0]);
-    // NOLINTEND(*-union-access)
+    if (size < data.size() + 2) [[unlikely]]
+        log_w(web, "Close data to {} cut to {} bytes", url(), size - 2);
 
     // Mark as closed
     open() = false;
 
     // Send the data
-    return send(std::move(data), CURLWS_CLOSE);
+    return send(std::span(payload).first(size), CURLWS_CLOSE);
 }
 
 size_t
-WebSocketConnection::send(std::vector<uint8_t> data, unsigned flags)
+WebSocketConnection::send(std::span<const uint8_t> data, unsigned flags)
 {
     assert(ready());
 
@@ -199,8 +251,17 @@ WebSocketConnection::send(std::vector<uint8_t> data, unsigned flags)
     // Log about arguments
     log_t1(web, "Sending {} bytes to {} with flags {:#b}", data.size(), url(), flags);
 
-    if (logging::get_web_logger()->should_log<quill::LogLevel::TraceL3>()) [[unlikely]]
+    if (logging::should_log<quill::LogLevel::TraceL3>(logging::get_web_logger()))
+        [[unlikely]]
+    {
         log_t3(web, "Data hexdump\n{}", utils::hexdump(data.data(), data.size()));
+    }
+
+    // Behind earlier sends, so they go out in order
+    if (!pending_.empty()) [[unlikely]] {
+        queue_send_(data, flags);
+        return data.size();
+    }
 
     // Clear error buffer
     clear_error_buffer_();
@@ -210,12 +271,73 @@ WebSocketConnection::send(std::vector<uint8_t> data, unsigned flags)
     auto res = curl_ws_send(curl_handle(), data.data(), data.size(), &sent, 0, flags);
 
     // Handle any errors
-    if (res != CURLE_OK)
+    if (res != CURLE_OK && res != CURLE_AGAIN) [[unlikely]] {
         process_curl_error_(res);
+        return 0;
+    }
+
+    // The socket is full, so the rest waits for it
+    if (sent < data.size()) [[unlikely]]
+        queue_send_(data.subspan(sent), flags);
+
+    return data.size();
+}
+
+void
+WebSocketConnection::queue_send_(std::span<const uint8_t> data, unsigned flags)
+{
+    log_d(web, "Queueing {} bytes to {} until it's writable", data.size(), url());
+
+    auto buf = send_pool_.acquire();
+    buf.assign(data.begin(), data.end());
+
+    pending_.push_back({.data = std::move(buf), .flags = flags});
+
+    // The first to wait asks to be told when it can go
+    if (pending_.size() == 1 && on_blocked_)
+        on_blocked_(this);
+}
+
+void
+WebSocketConnection::flush_sends_()
+{
+    log_bt(web, "Flushing {} queued sends to {}", pending_.size(), url());
+
+    while (!pending_.empty()) {
+        auto& front = pending_.front();
+
+        clear_error_buffer_();
+
+        // libcurl carries on with a frame it was part way through
+        size_t sent = 0;
+        auto res = curl_ws_send(
+            curl_handle(), front.data.data(), front.data.size(), &sent, 0, front.flags
+        );
+
+        if (res != CURLE_OK && res != CURLE_AGAIN) [[unlikely]] {
+            process_curl_error_(res);
+
+            pending_.clear();
+            return;
+        }
+
+        if (sent < front.data.size()) {
+            // Still full, so wait again
+            front.data.erase(
+                front.data.begin(), front.data.begin() + static_cast<ptrdiff_t>(sent)
+            );
+
+            if (on_blocked_)
+                on_blocked_(this);
+
+            return;
+        }
+
+        send_pool_.release(std::move(front.data));
+        pending_.pop_front();
+    }
 
-    // Return bytes sent
-    assert(sent == data.size());
-    return sent;
+    log_d(web, "Sent every queued message to {}", url());
 }
 
 } // namespace web
@@ -1,9 +1,15 @@
 #pragma once
 
 #include "base.hpp"
+#include "channel.hpp"
 #include "common.hpp"
+#include "heartbeat.hpp"
+#include "utils/buffer_pool.hpp"
 
+#include <deque>
 #include <functional>
+#include <span>
+#include <string_view>
 
 namespace raccoon {
 namespace web {
@@ -40,17 +46,38 @@ public:
         std::function<void(WebSocketConnection*, const std::vector<uint8_t>&)>;
 
 private:
+    /**
+     * A frame, or what's left of one, waiting for the socket to take it.
+     */
+    struct pending_send {
+        std::vector<uint8_t> data;
+        unsigned flags;
+    };
+
     std::vector<uint8_t> write_buf_;
     callback on_data_;
+    MessageChannel messages_; // without a callback, for next_message()
+
+    // Sends libcurl couldn't take at once, oldest first, in buffers from the pool
+    std::deque<pending_send> pending_;
+    utils::BufferPool send_pool_;
+    std::function<void(WebSocketConnection*)> on_blocked_; // set by the Session
+    std::function<void(WebSocketConnection*)> on_finish_;  // set by the Session
+
+    Heartbeat heartbeat_; // set up by the Session, started by the first frame
+
+    // Hot standby: the other connection of the same feed, if there's one
+    WebSocketConnection* partner_ = nullptr;
+    bool standby_ = false;
+
+    logging::Sampler log_sampler_{LOG_SAMPLE_EVERY}; // frames timed and logged
 
 public:
-    /* No copy operators */
+    /* No copy or move operators, libuv points into the heartbeat */
     WebSocketConnection(const WebSocketConnection&) = delete;
+    WebSocketConnection(WebSocketConnection&&) = delete;
     WebSocketConnection& operator=(const WebSocketConnection&) = delete;
-
-    /* Default move operators */
-    WebSocketConnection(WebSocketConnection&&) = default;
-    WebSocketConnection& operator=(WebSocketConnection&&) = default;
+    WebSocketConnection& operator=(WebSocketConnection&&) = delete;
 
     /**
      * Close this websocket connection.
@@ -82,16 +109,91 @@ public:
     /**
      * Close this websocket connection with reason and data.
      *
+     * The data is cut to what fits in a close frame, after the status.
+     *
      * Returns amount of data written.
      */
-    size_t close(WebSocketCloseStatus status, std::vector<uint8_t> data);
+    size_t close(WebSocketCloseStatus status, std::span<const uint8_t> data);
 
     /**
      * Send data to the websocket.
      *
-     * Returns the number of bytes sent.
+     * Whatever the socket can't take now is copied, and sent in order once it's
+     * writable, so this never blocks. The data is only used during the call.
+     *
+     * Returns the number of bytes sent, or queued to be sent.
+     */
+    size_t send(std::span<const uint8_t> data, unsigned flags = CURLWS_TEXT);
+
+    /**
+     * Send text to the websocket.
+     *
+     * Returns the number of bytes sent, or queued to be sent.
      */
-    size_t send(std::vector<uint8_t> data, unsigned flags = CURLWS_TEXT);
+    size_t
+    send(std::string_view text, unsigned flags = CURLWS_TEXT)
+    {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(text.data()); // NOLINT
+        return send({bytes, text.size()}, flags);
+    }
+
+    /**
+     * Pings, and how long this connection was silent.
+     */
+    [[nodiscard]] const Heartbeat&
+    heartbeat() const noexcept
+    {
+        return heartbeat_;
+    }
+
+    /**
+     * If this is a feed's standby connection, whose messages should only be used
+     * to subscribe, until the Session promotes it.
+     */
+    [[nodiscard]] bool
+    standby() const noexcept
+    {
+        return standby_;
+    }
+
+    /**
+     * The other connection of the feed, if it has a standby.
+     */
+    [[nodiscard]] WebSocketConnection*
+    partner() const noexcept
+    {
+        return partner_;
+    }
+
+    /**
+     * Wait for the next message, on a connection opened without a callback.
+     *
+     * co_await gives the message, valid until the next co_await, or nothing once
+     * the connection finished.
+     */
+    [[nodiscard]] MessageChannel::next_awaiter
+    next_message() noexcept
+    {
+        return messages_.next();
+    }
+
+    /**
+     * The number of sends waiting for the socket.
+     */
+    [[nodiscard]] size_t
+    pending_sends() const noexcept
+    {
+        return pending_.size();
+    }
+
+    /**
+     * Send buffers kept for reuse.
+     */
+    [[nodiscard]] size_t
+    pooled_buffers() const noexcept
+    {
+        return send_pool_.size();
+    }
 
     /**
      * Dummy, websockets don't download to files.
@@ -112,13 +214,46 @@ private:
      */
     WebSocketConnection(const std::string& url, callback on_data) :
         Connection(url), on_data_(std::move(on_data))
-    {}
+    {
+        if (!on_data_)
+            on_data_ = [](auto* conn, const auto& data) { conn->messages_.push(data); };
+    }
 
     /**
      * Start this websocket connection.
      */
     void start_() override;
 
+    /**
+     * Drop any sends still waiting, as the connection is done, end its messages,
+     * and tell the Session.
+     */
+    void finish_(CURLcode result) override;
+
+    /**
+     * Forget the frame being received and any sends waiting, before the Session
+     * opens the connection again.
+     */
+    void reset_();
+
+    /**
+     * Send a ping, for the heartbeat.
+     */
+    void ping_();
+
+    /**
+     * Queue what's left of a send, and have the Session tell us once the socket
+     * is writable.
+     */
+    void queue_send_(std::span<const uint8_t> data, unsigned flags);
+
+    /**
+     * Send what's waiting, oldest first, until the socket can't take any more.
+     *
+     * Called by the Session once the socket is writable.
+     */
+    void flush_sends_();
+
     /**
      * Receive data from libcurl, and pass it on to the user callback.
      */
@@ -0,0 +1,194 @@
+#include "ws_frame.hpp"
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace raccoon {
+namespace web {
+namespace ws {
+
+// Appended to the key before hashing, per RFC 6455
+static constexpr std::string_view HANDSHAKE_GUID =
+    "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// Bytes in a Sec-WebSocket-Key, before encoding
+static constexpr size_t KEY_SIZE = 16;
+
+size_t
+parse_header(std::span<const uint8_t> data, FrameHeader& header) noexcept
+{
+    // NOLINTBEGIN(*-magic-numbers)
+    if (data.size() < 2)
+        return 0;
+
+    auto first = data[0];
+    auto second = data[1];
+
+    // Only RSV1 has a meaning, with permessage-deflate
+    if ((first & 0x30U) != 0) [[unlikely]]
+        return FRAME_ERROR;
+
+    header.fin = (first & 0x80U) != 0;
+    header.compressed = (first & 0x40U) != 0;
+    header.opcode = static_cast<Opcode>(first & 0x0FU);
+    header.masked = (second & 0x80U) != 0;
+
+    size_t pos = 2;
+    uint64_t size = second & 0x7FU;
+
+    if (size >= 126) {
+        size_t extra = size == 126 ? 2 : 8;
+        if (data.size() < pos + extra)
+            return 0;
+
+        size = 0;
+        for (size_t i = 0; i < extra; i++)
+            size = (size << 8U) | data[pos + i];
+
+        pos += extra;
+    }
+
+    // Control frames can't be fragmented or long
+    bool bad_control =
+        is_control(header.opcode) && (!header.fin || size > MAX_CONTROL_PAYLOAD);
+
+    if (bad_control) [[unlikely]]
+        return FRAME_ERROR;
+
+    if (header.masked) {
+        if (data.size() < pos + header.mask.size())
+            return 0;
+
+        std::memcpy(header.mask.data(), &data[pos], header.mask.size());
+        pos += header.mask.size();
+    }
+    // NOLINTEND(*-magic-numbers)
+
+    header.header_size = pos;
+    header.payload_size = size;
+
+    return pos;
+}
+
+size_t
+encode_header(
+    Opcode opcode, uint64_t payload_size, const MaskKey& mask, uint8_t* out
+) noexcept
+{
+    // NOLINTBEGIN(*-magic-numbers, *-pointer-arithmetic)
+    size_t pos = 0;
+    out[pos++] = static_cast<uint8_t>(0x80U | static_cast<uint8_t>(opcode));
+
+    if (payload_size < 126) {
+        out[pos++] = static_cast<uint8_t>(0x80U | payload_size);
+    }
+    else if (payload_size <= UINT16_MAX) {
+        out[pos++] = 0x80U | 126U;
+        out[pos++] = static_cast<uint8_t>(payload_size >> 8U);
+        out[pos++] = static_cast<uint8_t>(payload_size & 0xFFU);
+    }
+    else {
+        out[pos++] = 0x80U | 127U;
+        for (int shift = 56; shift >= 0; shift -= 8)
+            out[pos++] = static_cast<uint8_t>((payload_size >> shift) & 0xFFU);
+    }
+
+    std::memcpy(out + pos, mask.data(), mask.size());
+    // NOLINTEND(*-magic-numbers, *-pointer-arithmetic)
+
+    return pos + mask.size();
+}
+
+size_t
+encode_close(
+    uint16_t status, std::span<const uint8_t> reason, ClosePayload& out
+) noexcept
+{
+    out[0] = static_cast<uint8_t>(status >> 8U);
+    out[1] = static_cast<uint8_t>(status & 0xFFU); // NOLINT(*-magic-numbers)
+
+    auto size = std::min(reason.size(), out.size() - 2);
+    std::memcpy(&out[2], reason.data(), size);
+
+    return size + 2;
+}
+
+void
+apply_mask(std::span<uint8_t> data, const MaskKey& mask) noexcept
+{
+    uint8_t* ptr = data.data();
+    size_t len = data.size();
+
+#if defined(__GNUC__) || defined(__clang__)
+    // The key repeats every 4 bytes, so whole blocks all use it from the start
+    constexpr size_t BLOCK = 32;
+    using block = uint8_t __attribute__((vector_size(BLOCK)));
+
+    block pattern{};
+    for (size_t i = 0; i < BLOCK; i++)
+        pattern[i] = mask[i % mask.size()];
+
+    // NOLINTBEGIN(*-pointer-arithmetic)
+    for (; len >= BLOCK; ptr += BLOCK, len -= BLOCK) {
+        block chunk;
+        std::memcpy(&chunk, ptr, BLOCK);
+        chunk ^= pattern;
+        std::memcpy(ptr, &chunk, BLOCK);
+    }
+    // NOLINTEND(*-pointer-arithmetic)
+#endif
+
+    for (size_t i = 0; i < len; i++)
+        ptr[i] ^= mask[i % mask.size()]; // NOLINT(*-pointer-arithmetic)
+}
+
+/**
+ * Standard base64 encoding, with padding.
+ */
+static std::string
+base64(std::span<const uint8_t> data)
+{
+    std::string res(4 * ((data.size() + 2) / 3), '\0');
+
+    auto len = EVP_EncodeBlock(
+        reinterpret_cast<unsigned char*>(res.data()), // NOLINT(*-reinterpret-cast)
+        data.data(),
+        static_cast<int>(data.size())
+    );
+
+    res.resize(static_cast<size_t>(len));
+    return res;
+}
+
+std::string
+make_key()
+{
+    std::array<uint8_t, KEY_SIZE> bytes{};
+    RAND_bytes(bytes.data(), static_cast<int>(bytes.size()));
+
+    return base64(bytes);
+}
+
+std::string
+accept_key(std::string_view key)
+{
+    std::string input(key);
+    input += HANDSHAKE_GUID;
+
+    std::array<uint8_t, SHA_DIGEST_LENGTH> digest{};
+    SHA1(
+        reinterpret_cast<const unsigned char*>(input.data()), // NOLINT
+        input.size(),
+        digest.data()
+    );
+
+    return base64(digest);
+}
+
+} // namespace ws
+} // namespace web
+} // namespace raccoon
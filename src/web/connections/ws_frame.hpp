@@ -0,0 +1,113 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <array>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace raccoon {
+namespace web {
+
+/**
+ * The client side of the WebSocket framing (RFC 6455), for the native transport.
+ */
+namespace ws {
+
+enum class Opcode : uint8_t {
+    CONTINUATION = 0x0,
+    TEXT = 0x1,
+    BINARY = 0x2,
+    CLOSE = 0x8,
+    PING = 0x9,
+    PONG = 0xA,
+};
+
+/**
+ * If an opcode is for a control frame.
+ */
+constexpr bool
+is_control(Opcode opcode) noexcept
+{
+    return (static_cast<uint8_t>(opcode) & 0x8U) != 0; // NOLINT(*-magic-numbers)
+}
+
+using MaskKey = std::array<uint8_t, 4>;
+
+/**
+ * A frame header, as parsed.
+ */
+struct FrameHeader {
+    Opcode opcode{};
+    bool fin = false;
+    bool compressed = false; // RSV1, with permessage-deflate
+    bool masked = false;     // servers must not mask, but we cope
+    MaskKey mask{};
+
+    size_t header_size = 0;
+    uint64_t payload_size = 0;
+};
+
+// Longest header: 2 bytes, an 8 byte length, then a mask
+inline constexpr size_t MAX_HEADER_SIZE = 14;
+
+// Returned by parse_header() for frames we can't accept
+inline constexpr size_t FRAME_ERROR = SIZE_MAX;
+
+// Largest payload of a control frame: a ping, pong or close
+inline constexpr size_t MAX_CONTROL_PAYLOAD = 125;
+
+using ClosePayload = std::array<uint8_t, MAX_CONTROL_PAYLOAD>;
+
+/**
+ * Parse the frame header at the front of some data.
+ *
+ * @returns size_t The header's size, 0 if it's incomplete, or FRAME_ERROR if it's
+ *          malformed.
+ */
+size_t parse_header(std::span<const uint8_t> data, FrameHeader& header) noexcept;
+
+/**
+ * Write the header of a single, masked client frame.
+ *
+ * @param out At least MAX_HEADER_SIZE bytes.
+ *
+ * @returns size_t Bytes written.
+ */
+size_t encode_header(
+    Opcode opcode, uint64_t payload_size, const MaskKey& mask, uint8_t* out
+) noexcept;
+
+/**
+ * Write a close frame's payload: the status code, big endian, then as much of the
+ * reason as fits in a control frame.
+ *
+ * @returns size_t Bytes written.
+ */
+size_t encode_close(
+    uint16_t status, std::span<const uint8_t> reason, ClosePayload& out
+) noexcept;
+
+/**
+ * XOR data with a mask key in place, which masks and unmasks alike.
+ *
+ * Works on 32 bytes at a time with the compiler's vector extensions, which lower to
+ * SSE2, AVX2 or NEON as the target allows.
+ */
+void apply_mask(std::span<uint8_t> data, const MaskKey& mask) noexcept;
+
+/**
+ * A random Sec-WebSocket-Key for the opening handshake.
+ */
+std::string make_key();
+
+/**
+ * The Sec-WebSocket-Accept value a server must answer a key with.
+ */
+std::string accept_key(std::string_view key);
+
+} // namespace ws
+
+} // namespace web
+} // namespace raccoon
@@ -0,0 +1,216 @@
+#pragma once
+
+#include "common.hpp"
+#include "session.hpp"
+#include "utils/frame_pool.hpp"
+
+#include <uv.h>
+
+#include <chrono>
+#include <coroutine>
+#include <memory>
+#include <string_view>
+
+namespace raccoon {
+namespace web {
+
+/**
+ * A coroutine run on the loop, without anyone waiting for it.
+ *
+ * It starts when called, runs until its first co_await, and is resumed by the loop
+ * from then on. Its frame is freed once it returns, into the thread's FramePool,
+ * so coroutines of the same size started later reuse it. It must not throw.
+ */
+class Task {
+public:
+    struct promise_type {
+        Task
+        get_return_object() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never
+        initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never
+        final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void
+        return_void() noexcept
+        {}
+
+        void
+        unhandled_exception() noexcept
+        {
+            log_c(web, "Unhandled exception in a coroutine, aborting!");
+            abort();
+        }
+
+        static void*
+        operator new(size_t size)
+        {
+            return utils::FramePool::local().allocate(size);
+        }
+
+        static void
+        operator delete(void* frame, size_t size) noexcept
+        {
+            utils::FramePool::local().deallocate(frame, size);
+        }
+    };
+};
+
+/**
+ * Resumes the coroutine on the loop once some time passed.
+ *
+ * The timer lives in the coroutine frame, and keeps the loop running.
+ */
+class Sleep {
+    uv_loop_t* loop_;
+    uint64_t ms_;
+    uv_timer_t timer_{};
+    std::coroutine_handle<> waiter_;
+
+public:
+    Sleep(uv_loop_t* loop, std::chrono::milliseconds duration) noexcept :
+        loop_(loop), ms_(static_cast<uint64_t>(std::max<int64_t>(duration.count(), 0)))
+    {}
+
+    /* No copy or move operators, libuv points into us */
+    Sleep(const Sleep&) = delete;
+    Sleep(Sleep&&) = delete;
+    Sleep& operator=(const Sleep&) = delete;
+    Sleep& operator=(Sleep&&) = delete;
+    ~Sleep() = default;
+
+    /**
+     * Never ready, so even a sleep of 0 lets the loop run first.
+     */
+    [[nodiscard]] bool
+    await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void
+    await_suspend(std::coroutine_handle<> waiter) noexcept
+    {
+        waiter_ = waiter;
+
+        uv_timer_init(loop_, &timer_);
+        timer_.data = this;
+        uv_timer_start(&timer_, fired_, ms_, 0);
+    }
+
+    void
+    await_resume() const noexcept
+    {}
+
+private:
+    static void
+    fired_(uv_timer_t* timer) // NOLINT(*-naming)
+    {
+        // Resumed once libuv is done with the timer, as the frame may go with it
+        uv_close(reinterpret_cast<uv_handle_t*>(timer), closed_); // NOLINT
+    }
+
+    static void
+    closed_(uv_handle_t* handle) // NOLINT(*-naming)
+    {
+        static_cast<Sleep*>(handle->data)->waiter_.resume();
+    }
+};
+
+/**
+ * co_await to let some time pass on a loop.
+ */
+[[nodiscard]] inline Sleep
+sleep(uv_loop_t* loop, std::chrono::milliseconds duration) noexcept
+{
+    return {loop, duration};
+}
+
+/**
+ * The response to an HTTP request made with co_await.
+ */
+struct HttpResponse {
+    long status = 0; // 0 if the transfer failed
+    std::string_view body;
+
+    // Keeps the body, which is the connection's own buffer
+    std::shared_ptr<HttpConnection> conn;
+};
+
+/**
+ * Makes an HTTP GET request, resuming the coroutine with the response once it
+ * completes.
+ *
+ * An abandoned request is never resumed, and neither is its coroutine.
+ */
+class HttpGet {
+    Session& session_;
+    std::string url_;
+    std::coroutine_handle<> waiter_;
+    HttpResponse response_;
+
+public:
+    HttpGet(Session& session, std::string url) :
+        session_(session), url_(std::move(url))
+    {}
+
+    /* No copy or move operators, the callback points to us */
+    HttpGet(const HttpGet&) = delete;
+    HttpGet(HttpGet&&) = delete;
+    HttpGet& operator=(const HttpGet&) = delete;
+    HttpGet& operator=(HttpGet&&) = delete;
+    ~HttpGet() = default;
+
+    [[nodiscard]] bool
+    await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void
+    await_suspend(std::coroutine_handle<> waiter)
+    {
+        waiter_ = waiter;
+
+        response_.conn = session_.http_get(
+            url_,
+            [this](auto*, long status, const std::string& body) {
+                response_.status = status;
+                response_.body = body;
+                waiter_.resume();
+            }
+        );
+    }
+
+    [[nodiscard]] HttpResponse
+    await_resume() noexcept
+    {
+        return std::move(response_);
+    }
+};
+
+inline HttpGet
+Session::http_get(std::string url)
+{
+    return {*this, std::move(url)};
+}
+
+inline Sleep
+Session::sleep(std::chrono::milliseconds duration) noexcept
+{
+    return {loop_, duration};
+}
+
+} // namespace web
+} // namespace raccoon
@@ -1,7 +1,9 @@
 #include "session.hpp"
 
 #include "common.hpp"
+#include "utils/reserved_memory.hpp"
 
+#include <algorithm>
 #include <csignal>
 
 /**
@@ -17,11 +19,17 @@ namespace raccoon {
 namespace web {
 
 Session::Session(uv_loop_t* event_loop) :
-    curl_handle_(curl_multi_init()), loop_(event_loop)
+    curl_handle_(curl_multi_init()), share_(curl_share_init()), loop_(event_loop)
 {
     // Populate backtrace
     log_bt(web, "Creating session for handle {}", fmt::ptr(curl_handle_));
 
+    // Connections, and reopened ones, skip what others already did: resolving the
+    // host and the full TLS handshake. Everything runs on the loop's thread, so
+    // there's nothing to lock.
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
     // Set up callbacks
     curl_multi_setopt(curl_handle_, CURLMOPT_SOCKETFUNCTION, handle_socket_);
     curl_multi_setopt(curl_handle_, CURLMOPT_TIMERFUNCTION, start_timeout_);
@@ -56,6 +64,10 @@ Session::Session(uv_loop_t* event_loop) :
                     if (conn->open())
                         conn->close();
 
+                for (auto& conn : session->native_connections_)
+                    if (conn->open())
+                        conn->close();
+
                 // Update session status
                 session->status_ = STATUS_GRACEFUL_SHUTDOWN;
             }
@@ -98,6 +110,40 @@ Session::Session(uv_loop_t* event_loop) :
             log_i(web, "Loop iteration count: {}", session->metrics_.loop_count);
             log_i(web, "Processed events: {}", session->metrics_.events);
             log_i(web, "Waiting events: {}", session->metrics_.events_waiting);
+
+            // Ping round trips, per WebSocket connection
+            auto log_rtt = [](const std::string& url, const Heartbeat& beat) {
+                const auto& rtt = beat.rtt();
+
+                log_i(
+                    web,
+                    "Ping RTT to {}: p50 {}us, p99 {}us, max {}us over {} pongs{}",
+                    url,
+                    rtt.percentile(50), // NOLINT(*-magic-numbers)
+                    rtt.percentile(99), // NOLINT(*-magic-numbers)
+                    rtt.max_us(),
+                    rtt.count(),
+                    beat.stale() ? " (stale)" : ""
+                );
+            };
+
+            for (auto& conn : session->connections_) {
+                auto* ws = dynamic_cast<WebSocketConnection*>(conn.get());
+
+                if (ws && ws->heartbeat().running())
+                    log_rtt(ws->url(), ws->heartbeat());
+            }
+
+            for (auto& conn : session->native_connections_) {
+                if (conn->heartbeat().running())
+                    log_rtt(conn->url(), conn->heartbeat());
+            }
+
+            // Memory reserved up front, and what outgrew it
+            utils::ReservedMemory::log_all();
+
+            if (session->on_metrics_)
+                session->on_metrics_();
         },
 #ifdef _WIN32
         SIGBREAK
@@ -179,6 +225,9 @@ Session::process_libcurl_messages_()
                         conn->process_curl_error_(err);
                     }
 
+                    // Let the connection know it's done
+                    conn->finish_(err);
+
                     /* Remove the curl handle and clean it up.
                      *
                      * NOTE:
@@ -246,7 +295,9 @@ Session::run_initializations_(uv_timer_t* handle)
         log_bt(web, "Init connection to {}", conn->url());
         log_i(web, "Opening connection to {}", conn->url());
 
-        // Add the connection to the curl multi handle
+        // Add the connection to the curl multi handle, with the shared caches
+        curl_easy_setopt(conn->curl_handle_, CURLOPT_SHARE, session->share_);
+
         auto err = curl_multi_add_handle(session->curl_handle_, conn->curl_handle_);
         if (err) [[unlikely]] {
             log_e(
@@ -266,13 +317,34 @@ Session::run_initializations_(uv_timer_t* handle)
         conn->ready_ = true;
         conn->start_();
 
+        // Running until libcurl says otherwise
+        session->curl_running_++;
+
         // Save it to our connection list
         session->connections_.push_back(std::move(conn));
     }
 }
 
 std::shared_ptr<WebSocketConnection>
-Session::ws(const std::string& url, WebSocketConnection::callback on_data)
+Session::ws(const std::string& url, WebSocketConnection::callback on_data, bool standby)
+{
+    auto conn = open_ws_(url, on_data);
+
+    if (standby) {
+        log_i(web, "Keeping a standby connection to {}", url);
+
+        auto backup = open_ws_(url, std::move(on_data));
+        backup->standby_ = true;
+        backup->partner_ = conn.get();
+        conn->partner_ = backup.get();
+    }
+
+    // Return the connection to the user
+    return conn;
+}
+
+std::shared_ptr<WebSocketConnection>
+Session::open_ws_(const std::string& url, WebSocketConnection::callback on_data)
 {
     // Populate backtrace
     log_bt(web, "Create WS conn to {}", url);
@@ -284,6 +356,160 @@ Session::ws(const std::string& url, WebSocketConnection::callback on_data)
         new WebSocketConnection(url, std::move(on_data))
     );
 
+    // Sends that don't fit wait for the socket
+    conn->on_blocked_ = [this](auto* blocked) { wait_writable_(blocked); };
+
+    // Its standby takes over if it closes
+    conn->on_finish_ = [this](auto* finished) {
+        if (status_ == STATUS_OK)
+            promote_(finished);
+    };
+
+    // Reopen it when it goes quiet
+    auto* raw = conn.get();
+
+    conn->heartbeat_.init(
+        loop_,
+        [raw] { raw->ping_(); },
+        [this, raw](bool stale, auto silent) {
+            health_changed_(raw, stale, silent);
+
+            if (stale && status_ == STATUS_OK)
+                reconnect_(raw);
+        },
+        ping_interval_ms_,
+        stale_after_ms_
+    );
+
+    // Add the connection to our initialization queue
+    connections_to_init_.push(conn);
+
+    // Request that the initialization function runs next iteration
+    uv_timer_start(&init_task_timer_, run_initializations_, 0, 0);
+
+    return conn;
+}
+
+std::shared_ptr<NativeWebSocketConnection>
+Session::native_ws(
+    const std::string& url, NativeWebSocketConnection::callback on_data, bool standby
+)
+{
+    auto conn = open_native_ws_(url, on_data);
+
+    if (standby) {
+        log_i(web, "Keeping a standby connection to {}", url);
+
+        auto backup = open_native_ws_(url, std::move(on_data));
+        backup->standby_ = true;
+        backup->partner_ = conn.get();
+        conn->partner_ = backup.get();
+    }
+
+    // Return the connection to the user
+    return conn;
+}
+
+std::shared_ptr<NativeWebSocketConnection>
+Session::open_native_ws_(
+    const std::string& url, NativeWebSocketConnection::callback on_data
+)
+{
+    // Populate backtrace
+    log_bt(web, "Create native WS conn to {}", url);
+
+    // Create the connection
+    log_i(web, "Creating native WebSocket connection for {}", url);
+
+    auto conn = std::shared_ptr<NativeWebSocketConnection>( // ctor is private
+        new NativeWebSocketConnection(url, std::move(on_data))
+    );
+
+    // Reopen it when it goes quiet
+    auto* raw = conn.get();
+
+    conn->heartbeat_.init(
+        loop_,
+        [raw] { raw->send_frame_(ws::Opcode::PING, {}); },
+        [this, raw](bool stale, auto silent) {
+            health_changed_(raw, stale, silent);
+
+            if (stale && status_ == STATUS_OK)
+                raw->reconnect_();
+        },
+        ping_interval_ms_,
+        stale_after_ms_
+    );
+
+    // libcurl isn't involved, so it can start now; its standby takes over if it
+    // closes
+    conn->on_finish_ = [this, raw] {
+        if (status_ == STATUS_OK)
+            promote_(raw);
+
+        stop_if_idle_();
+    };
+
+    conn->start_(loop_);
+
+    native_connections_.push_back(conn);
+    return conn;
+}
+
+template <class Conn>
+void
+Session::health_changed_(Conn* conn, bool stale, std::chrono::milliseconds silent)
+{
+    const auto& url = conn->url();
+
+    // A standby that took over keeps the feed live
+    if (stale && status_ == STATUS_OK && promote_(conn)) {
+        log_w(web, "{} is stale, silent for {}; reopening it as standby", url, silent);
+
+        if (on_health_)
+            on_health_(url, false, silent);
+
+        return;
+    }
+
+    if (stale)
+        log_w(web, "{} is stale, silent for {}; reopening it", url, silent);
+    else
+        log_i(web, "{} is live again, after {} of silence", url, silent);
+
+    // Standbys aren't what the feed is read from
+    if (on_health_ && !conn->standby_)
+        on_health_(url, stale, silent);
+}
+
+void
+Session::stop_if_idle_()
+{
+    if (curl_running_ > 0 || !connections_to_init_.empty())
+        return;
+
+    auto is_open = [](const auto& conn) { return conn->open(); };
+
+    if (std::ranges::any_of(native_connections_, is_open))
+        return;
+
+    log_i(web, "No open connections, stopping event loop");
+    uv_stop(loop_);
+}
+
+std::shared_ptr<HttpConnection>
+Session::http_get(const std::string& url, HttpConnection::callback on_complete)
+{
+    // Populate backtrace
+    log_bt(web, "Create HTTP GET to {}", url);
+
+    // Create the connection
+    log_d(web, "Creating HTTP GET request for {}", url);
+
+    auto conn = std::shared_ptr<HttpConnection>( // ctor is private to shared_ptr
+        new HttpConnection(url, std::move(on_complete))
+    );
+
     // Add the connection to our initialization queue
     connections_to_init_.push(conn);
 
@@ -317,11 +543,13 @@ process_libcurl_messages(Session* session, int running_handles)
     // All this currently does is free the data for any closed sockets
     session->process_libcurl_messages_();
 
-    // If there are no running handles, we're done
+    // If there are no running handles, and no native connections, we're done
     // So exit the loop
+    session->curl_running_ = running_handles;
+
     if (running_handles == 0) [[unlikely]] { // only happens once
-        log_i(web, "No running handles, stopping event loop");
-        uv_stop(session->loop_);
+        log_i(web, "No running handles");
+        session->stop_if_idle_();
     }
 }
 
@@ -331,6 +559,12 @@ process_libcurl_messages(Session* session, int running_handles)
 struct curl_context_t {
     uv_poll_t poll_handle; // libuv socket polling handle
     curl_socket_t sock_fd; // socket to poll
+    int events;            // libuv events libcurl asked for
+
+    // WebSocket connections with sends waiting for the socket to be writable,
+    // and the ones being flushed, kept to reuse their memory
+    std::vector<WebSocketConnection*> writers;
+    std::vector<WebSocketConnection*> flushing;
 
     Session* session; // web request session
 };
@@ -349,6 +583,7 @@ create_curl_context(curl_socket_t sock_fd, uv_loop_t* loop, Session* session)
 
     // Set the file descriptor
     ctx->sock_fd = sock_fd;
+    ctx->events = 0;
 
     // Allocate the uvloop handle
     uv_poll_init_socket(loop, &ctx->poll_handle, sock_fd);
@@ -378,6 +613,12 @@ destroy_curl_context(curl_context_t* ctx)
     );
 }
 
+void
+flush_writers(Session* session, curl_context_t* curl_ctx)
+{
+    session->flush_writers_(curl_ctx);
+}
+
 static void
 on_poll(uv_poll_t* req, int status, int uv_events)
 {
@@ -395,13 +636,22 @@ on_poll(uv_poll_t* req, int status, int uv_events)
     // Set flags for curl
     uint32_t flags = 0;
     auto events = static_cast<uint32_t>(uv_events);
+    auto wanted = static_cast<uint32_t>(curl_ctx->events);
 
     if (events & UV_READABLE)
         flags |= CURL_CSELECT_IN;
 
-    if (events & UV_WRITABLE)
+    if (events & wanted & UV_WRITABLE)
         flags |= CURL_CSELECT_OUT;
 
+    // Flush queued WebSocket sends, before libcurl can drop this socket
+    if ((events & UV_WRITABLE) && !curl_ctx->writers.empty())
+        flush_writers(curl_ctx->session, curl_ctx);
+
+    // Nothing for libcurl
+    if (flags == 0 && status == 0)
+        return;
+
     // Log the data that we have received
     log_t2(
         web,
@@ -426,6 +676,76 @@ on_poll(uv_poll_t* req, int status, int uv_events)
 
 } // namespace detail
 
+void
+Session::wait_writable_(WebSocketConnection* conn)
+{
+    auto it = polled_.find(conn->curl_handle_);
+
+    if (it == polled_.end()) [[unlikely]] {
+        log_e(web, "No socket to wait on for {}, sends are stuck", conn->url());
+        return;
+    }
+
+    auto* curl_ctx = it->second;
+    curl_ctx->writers.push_back(conn);
+
+    log_t2(web, "Polling socket {} for w, to flush sends", curl_ctx->sock_fd);
+
+    uv_poll_start(
+        &curl_ctx->poll_handle, curl_ctx->events | UV_WRITABLE, detail::on_poll
+    );
+}
+
+void
+Session::flush_writers_(detail::curl_context_t* curl_ctx)
+{
+    log_bt(web, "Flush writers on socket {}", curl_ctx->sock_fd);
+
+    std::swap(curl_ctx->writers, curl_ctx->flushing);
+
+    for (auto* conn : curl_ctx->flushing)
+        conn->flush_sends_(); // waits again, if the socket fills up
+
+    curl_ctx->flushing.clear();
+
+    // Only poll for writes again if libcurl, or someone still waiting, needs it
+    if (curl_ctx->writers.empty())
+        uv_poll_start(&curl_ctx->poll_handle, curl_ctx->events, detail::on_poll);
+}
+
+void
+Session::reconnect_(WebSocketConnection* conn)
+{
+    auto* easy = conn->curl_handle_;
+
+    // Already finished
+    if (!conn->open() || easy == nullptr)
+        return;
+
+    log_i(web, "Reopening WebSocket connection to {}", conn->url());
+
+    // Its queued sends were for the old socket
+    if (auto it = polled_.find(easy); it != polled_.end())
+        std::erase(it->second->writers, conn);
+
+    conn->reset_();
+
+    // Removing it closes the socket; adding it back starts over with the same
+    // options, as it first did
+    curl_multi_remove_handle(curl_handle_, easy);
+
+    auto err = curl_multi_add_handle(curl_handle_, easy);
+    if (err) [[unlikely]] {
+        log_e(
+            web,
+            "Could not reopen {}: {} (Code {})",
+            conn->url(),
+            curl_multi_strerror(err),
+            static_cast<int64_t>(err)
+        );
+    }
+}
+
 int
 Session::handle_socket_(
     CURL* easy,            // easy handle
@@ -435,8 +755,6 @@ Session::handle_socket_(
     void* socket_ptr       // private socket pointer
 )
 {
-    UNUSED(easy);
-
     // Populate backtrace
     log_bt(web, "libcurl action {} on socket {}", action, sock_fd);
 
@@ -462,6 +780,7 @@ Session::handle_socket_(
 
                 // Assign the context to this socket
                 curl_multi_assign(session->curl_handle_, sock_fd, curl_ctx);
+                session->polled_[easy] = curl_ctx;
 
                 // Get our libuv events
                 uint32_t events = 0;
@@ -472,7 +791,13 @@ Session::handle_socket_(
                 if (action != CURL_POLL_OUT)
                     events |= UV_READABLE;
 
-                // Start polling this socket in libuv
+                // Start polling this socket in libuv, for writes too if we're
+                // waiting to send
+                curl_ctx->events = static_cast<int>(events);
+
+                if (!curl_ctx->writers.empty())
+                    events |= UV_WRITABLE;
+
                 uv_poll_start(
                     &curl_ctx->poll_handle, static_cast<int>(events), detail::on_poll
                 );
@@ -497,6 +822,7 @@ Session::handle_socket_(
                     uv_poll_stop(&curl_ctx->poll_handle);
 
                     // Free this socket context
+                    session->polled_.erase(easy);
                     destroy_curl_context(curl_ctx);
 
                     // Clear the data in libcurl
@@ -6,18 +6,24 @@
 #include <curl/curl.h>
 #include <uv.h>
 
+#include <chrono>
 #include <queue>
+#include <unordered_map>
 
 namespace raccoon {
 namespace web {
 
 class Session;
+class HttpGet;
+class Sleep;
 
 /**
  * Implementation details.
  */
 namespace detail {
 
+struct curl_context_t;
+
 /**
  * Friend function to access the handle of the request session.
  */
@@ -28,6 +34,11 @@ CURLM* get_handle(Session* session);
  */
 void process_libcurl_messages(Session* session, int running_handles);
 
+/**
+ * Friend function to flush the sends of WebSocket connections waiting on a socket.
+ */
+void flush_writers(Session* session, curl_context_t* curl_ctx);
+
 } // namespace detail
 
 /**
@@ -44,8 +55,16 @@ public:
         STATUS_FORCED_SHUTDOWN,
     };
 
+    /**
+     * Told when a WebSocket connection goes stale, and while it stays stale, with
+     * how long it was silent; then once it's live again, or its standby took over.
+     */
+    using health_callback = std::function<
+        void(const std::string& url, bool stale, std::chrono::milliseconds silent)>;
+
 private:
     CURLM* curl_handle_; // curl multi handle
+    CURLSH* share_;      // DNS and TLS session caches, shared by every easy handle
     Status status_ = STATUS_OK;
 
     uv_loop_t* loop_;      // uv loop handle
@@ -59,6 +78,21 @@ private:
 
     // list of all initialized connections
     std::vector<std::shared_ptr<Connection>> connections_;
+    int curl_running_ = 0; // handles libcurl is running, as last reported
+
+    // sockets libcurl has us polling, by the easy handle using them
+    std::unordered_map<CURL*, detail::curl_context_t*> polled_;
+
+    // connections that bypass libcurl
+    std::vector<std::shared_ptr<NativeWebSocketConnection>> native_connections_;
+
+    // WebSocket heartbeats, for connections opened after they're set
+    uint64_t ping_interval_ms_ = WS_PING_INTERVAL_MS;
+    uint64_t stale_after_ms_ = WS_STALE_AFTER_MS;
+    health_callback on_health_;
+
+    // the user's own metrics, printed after ours
+    std::function<void()> on_metrics_;
 
     // signal handlers
     uv_signal_t interrupt_signal_{}; // catch SIGINT and gracefully shutdown
@@ -96,13 +130,105 @@ public:
     /**
      * Open a WebSocket connection.
      *
+     * With a standby, a second connection to the same url is kept open beside it.
+     * Both are given to the callback, which should subscribe on either but ignore
+     * the messages of whichever is standby(). When the active connection goes
+     * stale or closes, the standby takes over at once, and a stale one is reopened
+     * as the new standby.
+     *
+     * Without a callback, messages are read by co_awaiting next_message().
+     *
      * @param url The url to open a connection to.
      * @param callback A callback to process received data.
+     * @param standby If a hot standby should be kept.
      *
      * @returns std::shared_ptr<WebSocketConnection> The web socket connection.
      */
-    std::shared_ptr<WebSocketConnection>
-    ws(const std::string& url, WebSocketConnection::callback on_data);
+    std::shared_ptr<WebSocketConnection> ws(
+        const std::string& url,
+        WebSocketConnection::callback on_data = {},
+        bool standby = false
+    );
+
+    /**
+     * Open a WebSocket connection on our own socket, rather than through libcurl.
+     *
+     * Takes a ws:// or wss:// URL, and hands the callback each message without
+     * copying it. Standbys are kept, and messages read without a callback, as for
+     * ws().
+     *
+     * @param url The url to open a connection to.
+     * @param callback A callback to process received data.
+     * @param standby If a hot standby should be kept.
+     *
+     * @returns std::shared_ptr<NativeWebSocketConnection> The web socket connection.
+     */
+    std::shared_ptr<NativeWebSocketConnection> native_ws(
+        const std::string& url,
+        NativeWebSocketConnection::callback on_data = {},
+        bool standby = false
+    );
+
+    /**
+     * Make an HTTP GET request.
+     *
+     * @param url The url to request.
+     * @param on_complete A callback to process the response once it completes.
+     *
+     * @returns std::shared_ptr<HttpConnection> The HTTP connection.
+     */
+    std::shared_ptr<HttpConnection>
+    http_get(const std::string& url, HttpConnection::callback on_complete);
+
+    /**
+     * Make an HTTP GET request from a coroutine.
+     *
+     * co_await gives the HttpResponse once the request completes. Defined in
+     * coro.hpp.
+     */
+    [[nodiscard]] HttpGet http_get(std::string url);
+
+    /**
+     * co_await to let some time pass on the session's loop. Defined in coro.hpp.
+     */
+    [[nodiscard]] Sleep sleep(std::chrono::milliseconds duration) noexcept;
+
+    /**
+     * Set how often WebSocket connections opened from now on are pinged, and how
+     * long they can be silent before they're stale and reopened.
+     *
+     * @param interval Between pings, 0 for no pings, reopening or standbys
+     *                 taking over.
+     * @param stale_after Without data, or a pong, before a connection is stale.
+     */
+    void
+    set_heartbeat(
+        std::chrono::milliseconds interval, std::chrono::milliseconds stale_after
+    )
+    {
+        ping_interval_ms_ = static_cast<uint64_t>(interval.count());
+        stale_after_ms_ = static_cast<uint64_t>(stale_after.count());
+    }
+
+    /**
+     * Be told when WebSocket connections go stale, and come back.
+     *
+     * Stale connections are reopened either way.
+     */
+    void
+    on_health(health_callback callback)
+    {
+        on_health_ = std::move(callback);
+    }
+
+    /**
+     * Print more metrics whenever the session prints its own.
+     */
+    void
+    on_metrics(std::function<void()> callback)
+    {
+        on_metrics_ = std::move(callback);
+    }
 
     /**
      * Get all initialized connections.
@@ -132,6 +258,9 @@ public:
 
     friend void detail::process_libcurl_messages(Session* session, int running_handles);
 
+    friend void
+    detail::flush_writers(Session* session, detail::curl_context_t* curl_ctx);
+
 private:
     static void run_initializations_(uv_timer_t* handle); // NOLINT(*-naming)
 
@@ -150,6 +279,73 @@ private:
     );
 
     void process_libcurl_messages_();
+
+    /**
+     * Poll a WebSocket connection's socket for writability, to flush its queued
+     * sends once it is.
+     */
+    void wait_writable_(WebSocketConnection* conn);
+
+    /**
+     * Flush the sends waiting on a socket, now that it's writable.
+     */
+    void flush_writers_(detail::curl_context_t* curl_ctx);
+
+    /**
+     * Stop the loop once every connection, through libcurl or not, is done.
+     */
+    void stop_if_idle_();
+
+    /**
+     * Create a WebSocket connection, and queue it to be opened.
+     */
+    std::shared_ptr<WebSocketConnection>
+    open_ws_(const std::string& url, WebSocketConnection::callback on_data);
+
+    /**
+     * Create a native WebSocket connection, and open it.
+     */
+    std::shared_ptr<NativeWebSocketConnection> open_native_ws_(
+        const std::string& url, NativeWebSocketConnection::callback on_data
+    );
+
+    /**
+     * Act on a connection's heartbeat: fail over to its standby and reopen it if
+     * it's stale, and tell the user how the feed is doing.
+     */
+    template <class Conn>
+    void health_changed_(Conn* conn, bool stale, std::chrono::milliseconds silent);
+
+    /**
+     * Make a failed connection's standby the active one, if it's receiving.
+     *
+     * @returns bool If it took over.
+     */
+    template <class Conn>
+    bool
+    promote_(Conn* failed)
+    {
+        auto* standby = failed->partner_;
+
+        if (failed->standby_ || standby == nullptr || !standby->open())
+            return false;
+
+        // Only once it's had data, and not since it went quiet
+        const auto& beat = standby->heartbeat_;
+        if (!beat.running() || beat.stale())
+            return false;
+
+        failed->standby_ = true;
+        standby->standby_ = false;
+
+        log_w(web, "Standby connection to {} took over", failed->url());
+        return true;
+    }
+
+    /**
+     * Open a stale connection again, dropping its socket.
+     */
+    void reconnect_(WebSocketConnection* conn);
 };
 
 inline auto
@@ -3,4 +3,5 @@
 // Re-exports
 
 #include "connections/connections.hpp"
+#include "coro.hpp"
 #include "session.hpp"
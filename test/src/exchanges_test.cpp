@@ -0,0 +1,335 @@
+#include "exchanges/exchanges.hpp"
+#include "utils/fixed_point.hpp"
+#include "utils/parsing.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string_view>
+
+using namespace raccoon::exchanges; // NOLINT(*-using-namespace)
+
+namespace {
+
+/**
+ * Handler that keeps a copy of every event it sees.
+ */
+struct recorder {
+    std::vector<BookSnapshot> snapshots;
+    std::vector<BookDelta> deltas;
+    std::vector<Trade> trades;
+
+    void
+    operator()(const BookSnapshot& snapshot)
+    {
+        snapshots.push_back(snapshot);
+    }
+
+    void
+    operator()(const BookDelta& delta)
+    {
+        deltas.push_back(delta);
+    }
+
+    void
+    operator()(const Trade& trade)
+    {
+        trades.push_back(trade);
+    }
+};
+
+/*
+ * Messages recorded from the live feeds.
+ */
+
+constexpr std::string_view COINBASE_SNAPSHOT =
+    R"({"type":"snapshot","product_id":"ETH-USD",)"
+    R"("asks":[["1646.50","2.5"],["1646.51","0.1"]],)"
+    R"("bids":[["1646.47","1.25"]],"time":"2023-09-19T17:10:35.000000Z"})";
+
+constexpr std::string_view COINBASE_L2UPDATE =
+    R"({"type":"l2update","product_id":"ETH-USD",)"
+    R"("changes":[["buy","1646.48","0.50000000"],)"
+    R"(["sell","1646.50","0.00000000"]],)"
+    R"("time":"2023-09-19T17:10:35.123456Z"})";
+
+constexpr std::string_view COINBASE_MATCH =
+    R"({"type":"match","trade_id":475348218,)"
+    R"("maker_order_id":"4c3c0a54-8ab6-4cd8-b75a-f5da3bd6ee5f",)"
+    R"("taker_order_id":"be9b7bfd-5c0c-4e7a-9c0b-dc3e5a8e9f77","side":"buy",)"
+    R"("size":"0.01537","price":"1646.47","product_id":"ETH-USD",)"
+    R"("sequence":51563738497,"time":"2023-09-19T17:10:35.531622Z"})";
+
+constexpr std::string_view COINBASE_SUBSCRIPTIONS =
+    R"({"type":"subscriptions",)"
+    R"("channels":[{"name":"matches","product_ids":["ETH-USD"]}]})";
+
+constexpr std::string_view BINANCE_DIFF_1 =
+    R"({"e":"depthUpdate","E":1695143435100,"s":"ETHUSDT","U":157,"u":160,)"
+    R"("b":[["1645.12000000","10.00000000"]],)"
+    R"("a":[["1645.13000000","100.00000000"]]})";
+
+constexpr std::string_view BINANCE_DIFF_2 =
+    R"({"e":"depthUpdate","E":1695143435200,"s":"ETHUSDT","U":161,"u":165,)"
+    R"("b":[["1645.12000000","0.00000000"]],"a":[]})";
+
+constexpr std::string_view BINANCE_DIFF_3 =
+    R"({"e":"depthUpdate","E":1695143435300,"s":"ETHUSDT","U":166,"u":170,)"
+    R"("b":[["1645.10000000","3.00000000"]],"a":[]})";
+
+constexpr std::string_view BINANCE_DIFF_GAP =
+    R"({"e":"depthUpdate","E":1695143435400,"s":"ETHUSDT","U":180,"u":182,)"
+    R"("b":[],"a":[["1645.20000000","1.00000000"]]})";
+
+constexpr std::string_view BINANCE_SNAPSHOT =
+    R"({"lastUpdateId":162,"bids":[["1645.11000000","4.00000000"]],)"
+    R"("asks":[["1645.13000000","12.00000000"],)"
+    R"(["1645.14000000","1.50000000"]]})";
+
+constexpr std::string_view BINANCE_OLD_SNAPSHOT =
+    R"({"lastUpdateId":100,"bids":[],"asks":[]})";
+
+constexpr std::string_view BINANCE_TRADE =
+    R"({"stream":"ethusdt@trade","data":{"e":"trade","E":1695143435531,)"
+    R"("s":"ETHUSDT","t":1234567,"p":"1645.13000000","q":"0.25000000",)"
+    R"("b":88,"a":50,"T":1695143435530,"m":true,"M":true}})";
+
+} // namespace
+
+/******************************************************************************
+ *                                 PARSING                                    *
+ *****************************************************************************/
+
+TEST(ParsingTest, StringField)
+{
+    using raccoon::utils::json_string_field;
+
+    EXPECT_EQ(json_string_field(R"({"type": "match"})", "type"), "match");
+    EXPECT_EQ(json_string_field(R"({"e":"trade","E":1})", "e"), "trade");
+    EXPECT_EQ(json_string_field(R"({"E":1,"e":"trade"})", "e"), "trade");
+    EXPECT_EQ(json_string_field(R"({"types":"x"})", "type"), "");
+}
+
+TEST(ParsingTest, Timestamp)
+{
+    using raccoon::utils::parse_timestamp;
+
+    EXPECT_EQ(parse_timestamp("1970-01-01T00:00:00Z"), 0);
+    EXPECT_EQ(parse_timestamp("2023-09-19T17:10:35Z"), 1695143435'000000000);
+    EXPECT_EQ(parse_timestamp("2023-09-19T17:10:35.123456Z"), 1695143435'123456000);
+    EXPECT_EQ(parse_timestamp("garbage"), 0);
+}
+
+TEST(ParsingTest, FixedPoint)
+{
+    using raccoon::utils::Fixed;
+    using raccoon::utils::parse_fixed;
+
+    EXPECT_EQ(parse_fixed("1234.5678").raw, 1234'56780000);
+    EXPECT_EQ(parse_fixed("0.00000001").raw, 1);
+    EXPECT_EQ(parse_fixed("-2.5").raw, -2'50000000);
+    EXPECT_EQ(parse_fixed("7").raw, 7'00000000);
+    EXPECT_EQ(parse_fixed("0.123456789").raw, 12345678); // truncated
+    EXPECT_EQ(parse_fixed("1e5").raw, 0);
+    EXPECT_EQ(parse_fixed("").raw, 0);
+
+    // Exact where doubles are not
+    EXPECT_EQ(parse_fixed("0.1") + parse_fixed("0.2"), parse_fixed("0.3"));
+
+    EXPECT_EQ(raccoon::utils::to_string(parse_fixed("1234.5000")), "1234.5");
+    EXPECT_EQ(raccoon::utils::to_string(parse_fixed("-0.01")), "-0.01");
+    EXPECT_EQ(raccoon::utils::to_string(Fixed{}), "0");
+}
+
+/******************************************************************************
+ *                                 COINBASE                                   *
+ *****************************************************************************/
+
+TEST(CoinbaseAdapterTest, Snapshot)
+{
+    CoinbaseAdapter adapter;
+    recorder events;
+
+    ASSERT_TRUE(adapter.parse(COINBASE_SNAPSHOT, events));
+    ASSERT_EQ(events.snapshots.size(), 1U);
+
+    const auto& snapshot = events.snapshots[0];
+    EXPECT_EQ(snapshot.venue, Venue::COINBASE);
+    EXPECT_EQ(snapshot.product_id, "ETH-USD");
+    ASSERT_EQ(snapshot.asks.size(), 2U);
+    ASSERT_EQ(snapshot.bids.size(), 1U);
+    EXPECT_DOUBLE_EQ(snapshot.asks[0].price, 1646.50);
+    EXPECT_DOUBLE_EQ(snapshot.asks[0].size, 2.5);
+    EXPECT_DOUBLE_EQ(snapshot.bids[0].price, 1646.47);
+}
+
+TEST(CoinbaseAdapterTest, Update)
+{
+    CoinbaseAdapter adapter;
+    recorder events;
+
+    ASSERT_TRUE(adapter.parse(COINBASE_L2UPDATE, events));
+    ASSERT_EQ(events.deltas.size(), 1U);
+
+    const auto& delta = events.deltas[0];
+    EXPECT_EQ(delta.timestamp, 1695143435'123456000);
+    ASSERT_EQ(delta.changes.size(), 2U);
+    EXPECT_EQ(delta.changes[0].side, Side::BID);
+    EXPECT_DOUBLE_EQ(delta.changes[0].size, 0.5);
+    EXPECT_EQ(delta.changes[1].side, Side::ASK);
+    EXPECT_DOUBLE_EQ(delta.changes[1].size, 0.0);
+}
+
+TEST(CoinbaseAdapterTest, Match)
+{
+    CoinbaseAdapter adapter;
+    recorder events;
+
+    ASSERT_TRUE(adapter.parse(COINBASE_MATCH, events));
+    ASSERT_EQ(events.trades.size(), 1U);
+
+    const auto& trade = events.trades[0];
+    EXPECT_EQ(trade.trade_id, 475348218U);
+    EXPECT_EQ(trade.sequence, 51563738497U);
+    EXPECT_EQ(trade.side, Side::ASK); // maker bought, so taker sold
+    EXPECT_DOUBLE_EQ(trade.price, 1646.47);
+    EXPECT_DOUBLE_EQ(trade.size, 0.01537);
+}
+
+TEST(CoinbaseAdapterTest, IgnoresControlMessages)
+{
+    CoinbaseAdapter adapter;
+    recorder events;
+
+    EXPECT_TRUE(adapter.parse(COINBASE_SUBSCRIPTIONS, events));
+    EXPECT_TRUE(events.snapshots.empty());
+    EXPECT_TRUE(events.deltas.empty());
+    EXPECT_TRUE(events.trades.empty());
+}
+
+/******************************************************************************
+ *                                  BINANCE                                   *
+ *****************************************************************************/
+
+TEST(DepthSyncTest, Sequencing)
+{
+    using Action = binance::DepthSync::Action;
+
+    binance::DepthSync sync;
+    EXPECT_EQ(sync.on_diff(157, 160), Action::BUFFER);
+
+    sync.on_snapshot(162);
+    EXPECT_EQ(sync.on_diff(157, 160), Action::DROP);   // contained in snapshot
+    EXPECT_EQ(sync.on_diff(161, 165), Action::APPLY);  // straddles lastUpdateId
+    EXPECT_EQ(sync.on_diff(166, 170), Action::APPLY);  // continues from u
+    EXPECT_EQ(sync.on_diff(180, 182), Action::RESYNC); // gap
+    EXPECT_FALSE(sync.synced());
+}
+
+TEST(BinanceAdapterTest, BuffersUntilSnapshot)
+{
+    std::vector<std::string> requests;
+    BinanceAdapter adapter([&](const std::string& symbol) {
+        requests.push_back(symbol);
+    });
+    recorder events;
+
+    // Diffs are held back, and only one snapshot is requested
+    ASSERT_TRUE(adapter.parse(BINANCE_DIFF_1, events));
+    ASSERT_TRUE(adapter.parse(BINANCE_DIFF_2, events));
+    EXPECT_TRUE(events.deltas.empty());
+    ASSERT_EQ(requests.size(), 1U);
+    EXPECT_EQ(requests[0], "ETHUSDT");
+
+    // The snapshot drops the first diff and replays the second
+    ASSERT_TRUE(adapter.on_snapshot("ETHUSDT", BINANCE_SNAPSHOT, events));
+    EXPECT_TRUE(adapter.synced("ETHUSDT"));
+
+    ASSERT_EQ(events.snapshots.size(), 1U);
+    EXPECT_EQ(events.snapshots[0].venue, Venue::BINANCE);
+    EXPECT_EQ(events.snapshots[0].sequence, 162U);
+    EXPECT_EQ(events.snapshots[0].asks.size(), 2U);
+
+    ASSERT_EQ(events.deltas.size(), 1U);
+    EXPECT_EQ(events.deltas[0].sequence, 165U);
+    ASSERT_EQ(events.deltas[0].changes.size(), 1U);
+    EXPECT_EQ(events.deltas[0].changes[0].side, Side::BID);
+    EXPECT_DOUBLE_EQ(events.deltas[0].changes[0].size, 0.0);
+
+    // Live diffs now flow straight through
+    ASSERT_TRUE(adapter.parse(BINANCE_DIFF_3, events));
+    ASSERT_EQ(events.deltas.size(), 2U);
+    EXPECT_EQ(events.deltas[1].sequence, 170U);
+    EXPECT_EQ(events.deltas[1].timestamp, 1695143435300'000000);
+}
+
+TEST(BinanceAdapterTest, RefetchesStaleSnapshot)
+{
+    size_t requests = 0;
+    BinanceAdapter adapter([&](const std::string& /* unused */) { ++requests; });
+    recorder events;
+
+    ASSERT_TRUE(adapter.parse(BINANCE_DIFF_2, events));
+    ASSERT_EQ(requests, 1U);
+
+    // Snapshot ends before the first buffered diff starts
+    EXPECT_FALSE(adapter.on_snapshot("ETHUSDT", BINANCE_OLD_SNAPSHOT, events));
+    EXPECT_TRUE(events.snapshots.empty());
+    EXPECT_EQ(requests, 2U);
+    EXPECT_FALSE(adapter.synced("ETHUSDT"));
+}
+
+TEST(BinanceAdapterTest, RefetchesMalformedSnapshot)
+{
+    size_t requests = 0;
+    BinanceAdapter adapter([&](const std::string& /* unused */) { ++requests; });
+    recorder events;
+
+    ASSERT_TRUE(adapter.parse(BINANCE_DIFF_2, events));
+    ASSERT_EQ(requests, 1U);
+
+    // A truncated snapshot is as good as none
+    auto truncated = R"({"lastUpdateId":162,"bids":[)";
+    EXPECT_FALSE(adapter.on_snapshot("ETHUSDT", truncated, events));
+    EXPECT_TRUE(events.snapshots.empty());
+    EXPECT_EQ(requests, 2U);
+    EXPECT_FALSE(adapter.synced("ETHUSDT"));
+
+    // And the next one still syncs the book
+    ASSERT_TRUE(adapter.on_snapshot("ETHUSDT", BINANCE_SNAPSHOT, events));
+    EXPECT_TRUE(adapter.synced("ETHUSDT"));
+}
+
+TEST(BinanceAdapterTest, ResyncsOnGap)
+{
+    size_t requests = 0;
+    BinanceAdapter adapter([&](const std::string& /* unused */) { ++requests; });
+    recorder events;
+
+    ASSERT_TRUE(adapter.parse(BINANCE_DIFF_2, events));
+    ASSERT_TRUE(adapter.on_snapshot("ETHUSDT", BINANCE_SNAPSHOT, events));
+    ASSERT_EQ(events.deltas.size(), 1U);
+
+    // Skipping 166-179 must not be applied, and asks for a new snapshot
+    ASSERT_TRUE(adapter.parse(BINANCE_DIFF_GAP, events));
+    EXPECT_EQ(events.deltas.size(), 1U);
+    EXPECT_EQ(requests, 2U);
+    EXPECT_FALSE(adapter.synced("ETHUSDT"));
+}
+
+TEST(BinanceAdapterTest, CombinedStreamTrade)
+{
+    BinanceAdapter adapter(nullptr);
+    recorder events;
+
+    ASSERT_TRUE(adapter.parse(BINANCE_TRADE, events));
+    ASSERT_EQ(events.trades.size(), 1U);
+
+    const auto& trade = events.trades[0];
+    EXPECT_EQ(trade.venue, Venue::BINANCE);
+    EXPECT_EQ(trade.product_id, "ETHUSDT");
+    EXPECT_EQ(trade.trade_id, 1234567U);
+    EXPECT_EQ(trade.timestamp, 1695143435530'000000);
+    EXPECT_EQ(trade.side, Side::ASK); // buyer was maker, so seller was aggressor
+    EXPECT_DOUBLE_EQ(trade.price, 1645.13);
+    EXPECT_DOUBLE_EQ(trade.size, 0.25);
+}
@@ -0,0 +1,2011 @@
+#include "exchanges/exchanges.hpp"
+#include "mcast_receiver/receiver.hpp"
+#include "raccoon/packed_book.hpp"
+#include "resp_server/server.hpp"
+#include "storage/bars.hpp"
+#include "storage/conflation.hpp"
+#include "storage/consolidated.hpp"
+#include "storage/multicast.hpp"
+#include "storage/orderbook.hpp"
+#include "storage/processing.hpp"
+#include "storage/sink.hpp"
+#include "storage/staleness.hpp"
+#include "storage/ticks.hpp"
+#include "storage/trades.hpp"
+
+#include <arpa/inet.h>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <future>
+#include <limits>
+#include <thread>
+
+using namespace raccoon::exchanges; // NOLINT(*-using-namespace)
+using namespace raccoon::storage;   // NOLINT(*-using-namespace)
+
+namespace {
+
+using clock_type = ConsolidatedBook::clock;
+
+constexpr auto COINBASE_BIT = ConsolidatedBook::venue_mask{1U << 0U};
+constexpr auto BINANCE_BIT = ConsolidatedBook::venue_mask{1U << 1U};
+
+TEST(SymbolsTest, NormalizesAcrossVenues)
+{
+    EXPECT_EQ(normalize_symbol(Venue::COINBASE, "ETH-USD"), "ETH-USD");
+    EXPECT_EQ(normalize_symbol(Venue::BINANCE, "ETHUSDT"), "ETH-USD");
+    EXPECT_EQ(normalize_symbol(Venue::BINANCE, "ethbtc"), "ETH-BTC");
+}
+
+TEST(OrderbookProcessorTest, RecordsLevelChanges)
+{
+    OrderbookProcessor books;
+
+    BookSnapshot snapshot{
+        .venue = Venue::BINANCE,
+        .product_id = "ETHUSDT",
+        .bids = {{100.0, 1.0}},
+        .asks = {{101.0, 2.0}},
+    };
+    const auto& tracker = books.process_incoming_snapshot(snapshot);
+
+    EXPECT_EQ(tracker.venue, Venue::BINANCE);
+    EXPECT_EQ(tracker.symbol, "ETH-USD");
+    EXPECT_EQ(books.changes().size(), 2U);
+
+    BookDelta delta{
+        .venue = Venue::BINANCE,
+        .product_id = "ETHUSDT",
+        .changes = {{Side::BID, 100.0, 0.0}, {Side::ASK, 101.0, 3.0}},
+    };
+    books.process_incoming_update(delta);
+
+    auto changes = books.changes();
+    ASSERT_EQ(changes.size(), 2U);
+    EXPECT_DOUBLE_EQ(changes[0].old_size, 1.0);
+    EXPECT_DOUBLE_EQ(changes[0].new_size, 0.0);
+    EXPECT_DOUBLE_EQ(changes[1].old_size, 2.0);
+    EXPECT_DOUBLE_EQ(changes[1].new_size, 3.0);
+}
+
+TEST(TopLevelsTest, TracksBestLevelsWithoutRescanning)
+{
+    std::unordered_map<double, double> side;
+    TopLevels<std::greater<>> top(2);
+
+    auto set = [&](double price, double size) {
+        if (size > 0.0)
+            side[price] = size;
+        else
+            side.erase(price);
+
+        top.on_change(price, size, side);
+    };
+
+    for (int i = 1; i <= 10; i++)
+        set(static_cast<double>(i), 1.0);
+
+    // Holds twice the depth, best first
+    ASSERT_EQ(top.size(), 4U);
+    EXPECT_DOUBLE_EQ(top.best()->price, 10.0);
+    ASSERT_EQ(top.top().size(), 2U);
+    EXPECT_DOUBLE_EQ(top.top()[1].price, 9.0);
+
+    // Worse levels are ignored, better ones pushed in
+    set(0.5, 1.0);
+    set(11.0, 2.0);
+    EXPECT_DOUBLE_EQ(top.best()->price, 11.0);
+    EXPECT_EQ(top.size(), 4U);
+
+    // Removing the touch falls back to the next level
+    set(11.0, 0.0);
+    set(10.0, 0.0);
+    EXPECT_DOUBLE_EQ(top.best()->price, 9.0);
+
+    // Dropping below the depth rescans the side
+    set(9.0, 0.0);
+    ASSERT_EQ(top.top().size(), 2U);
+    EXPECT_DOUBLE_EQ(top.top()[0].price, 8.0);
+    EXPECT_DOUBLE_EQ(top.top()[1].price, 7.0);
+}
+
+TEST(OrderbookProcessorTest, MaintainsFeatures)
+{
+    OrderbookProcessor books;
+
+    BookSnapshot snapshot{
+        .venue = Venue::COINBASE,
+        .product_id = "ETH-USD",
+        .bids = {{100.0, 3.0}, {99.0, 1.0}},
+        .asks = {{101.0, 1.0}, {102.0, 1.0}},
+    };
+    const auto& tracker = books.process_incoming_snapshot(snapshot);
+
+    const auto& features = tracker.features;
+    ASSERT_TRUE(features.valid);
+    EXPECT_DOUBLE_EQ(features.spread, 1.0);
+    EXPECT_DOUBLE_EQ(features.mid, 100.5);
+    EXPECT_DOUBLE_EQ(features.microprice, (100.0 * 1.0 + 101.0 * 3.0) / 4.0);
+    EXPECT_DOUBLE_EQ(features.bid_depth, 4.0);
+    EXPECT_DOUBLE_EQ(features.ask_depth, 2.0);
+    EXPECT_DOUBLE_EQ(features.imbalance, 2.0 / 6.0);
+
+    BookDelta delta{
+        .venue = Venue::COINBASE,
+        .product_id = "ETH-USD",
+        .changes = {{Side::ASK, 101.0, 0.0}, {Side::BID, 100.5, 1.0}},
+    };
+    books.process_incoming_update(delta);
+
+    EXPECT_DOUBLE_EQ(features.bid, 100.5);
+    EXPECT_DOUBLE_EQ(features.ask, 102.0);
+    EXPECT_DOUBLE_EQ(features.spread, 1.5);
+}
+
+TEST(ConsolidatedBookTest, MergesVenuesWithAttribution)
+{
+    ConsolidatedBook book;
+    auto now = clock_type::now();
+
+    book.apply(Venue::COINBASE, Side::BID, 100.0, 1.0, now);
+    book.apply(Venue::BINANCE, Side::BID, 100.0, 2.0, now);
+    book.apply(Venue::BINANCE, Side::BID, 99.0, 5.0, now);
+    book.apply(Venue::COINBASE, Side::ASK, 101.0, 1.5, now);
+
+    EXPECT_EQ(book.venue_count(), 2U);
+
+    auto bid = book.best_bid();
+    ASSERT_TRUE(bid.valid);
+    EXPECT_DOUBLE_EQ(bid.price, 100.0);
+    EXPECT_DOUBLE_EQ(bid.size, 3.0);
+    EXPECT_EQ(bid.venues, COINBASE_BIT | BINANCE_BIT);
+
+    auto ask = book.best_ask();
+    ASSERT_TRUE(ask.valid);
+    EXPECT_DOUBLE_EQ(ask.price, 101.0);
+    EXPECT_EQ(ask.venues, COINBASE_BIT);
+
+    // Excluding a venue skips levels only it quotes
+    auto binance_only = book.best_bid(COINBASE_BIT);
+    EXPECT_DOUBLE_EQ(binance_only.price, 100.0);
+    EXPECT_DOUBLE_EQ(binance_only.size, 2.0);
+    EXPECT_FALSE(book.best_ask(COINBASE_BIT).valid);
+}
+
+TEST(ConsolidatedBookTest, RemovesLevelsIncrementally)
+{
+    ConsolidatedBook book;
+    auto now = clock_type::now();
+
+    book.apply(Venue::COINBASE, Side::ASK, 101.0, 1.0, now);
+    book.apply(Venue::BINANCE, Side::ASK, 101.0, 2.0, now);
+
+    book.apply(Venue::COINBASE, Side::ASK, 101.0, 0.0, now);
+    ASSERT_EQ(book.asks().size(), 1U);
+    EXPECT_DOUBLE_EQ(book.asks().begin()->second.total, 2.0);
+
+    book.apply(Venue::BINANCE, Side::ASK, 101.0, 0.0, now);
+    EXPECT_TRUE(book.asks().empty());
+}
+
+TEST(ConsolidatedBookTest, FlagsStaleVenues)
+{
+    ConsolidatedBook book;
+    auto now = clock_type::now();
+
+    book.apply(Venue::COINBASE, Side::BID, 100.0, 1.0, now);
+    book.apply(Venue::BINANCE, Side::BID, 99.0, 1.0, now + std::chrono::seconds(10));
+
+    auto stale =
+        book.stale_venues(std::chrono::seconds(5), now + std::chrono::seconds(11));
+    EXPECT_EQ(stale, COINBASE_BIT);
+
+    auto bid = book.best_bid(stale);
+    EXPECT_DOUBLE_EQ(bid.price, 99.0);
+    EXPECT_EQ(bid.venues, BINANCE_BIT);
+}
+
+TEST(ConsolidatedProcessorTest, FollowsPerVenueBooks)
+{
+    OrderbookProcessor books;
+    ConsolidatedProcessor consolidated;
+
+    BookSnapshot coinbase{
+        .venue = Venue::COINBASE,
+        .product_id = "ETH-USD",
+        .bids = {{100.0, 1.0}},
+        .asks = {{102.0, 1.0}},
+    };
+    BookSnapshot binance{
+        .venue = Venue::BINANCE,
+        .product_id = "ETHUSDT",
+        .bids = {{100.5, 2.0}},
+        .asks = {{101.5, 2.0}},
+    };
+
+    // Changes are only valid after the book has been updated
+    auto apply = [&](const BookSnapshot& snapshot) {
+        const auto& tracker = books.process_incoming_snapshot(snapshot);
+        consolidated.process_changes(tracker, books.changes());
+    };
+
+    apply(coinbase);
+    apply(binance);
+
+    const auto* book = consolidated.book("ETH-USD");
+    ASSERT_NE(book, nullptr);
+    EXPECT_EQ(book->venue_count(), 2U);
+    EXPECT_DOUBLE_EQ(book->best_bid().price, 100.5);
+    EXPECT_DOUBLE_EQ(book->best_ask().price, 101.5);
+
+    // A new snapshot replaces only that venue's levels
+    binance.bids = {{99.0, 1.0}};
+    apply(binance);
+
+    EXPECT_DOUBLE_EQ(book->best_bid().price, 100.0);
+    EXPECT_EQ(book->bids().size(), 2U);
+}
+
+Trade
+make_trade(int64_t seconds, std::string_view price, std::string_view size, Side side)
+{
+    constexpr int64_t NANOS = 1'000'000'000;
+
+    return {
+        .product_id = "ETH-USD",
+        .timestamp = seconds * NANOS,
+        .side = side,
+        .exact_price = raccoon::utils::parse_fixed(price),
+        .exact_size = raccoon::utils::parse_fixed(size),
+    };
+}
+
+TEST(BarProcessorTest, BuildsBarsPerInterval)
+{
+    using std::chrono::seconds;
+    using raccoon::utils::parse_fixed;
+
+    BarProcessor bars({seconds(1), seconds(60)});
+
+    bars.process_trade(make_trade(60, "100", "1", Side::BID));
+    bars.process_trade(make_trade(60, "102", "2", Side::ASK));
+    bars.process_trade(make_trade(60, "99", "1", Side::BID));
+    EXPECT_TRUE(bars.closed().empty());
+
+    // Next second closes the 1s bar only
+    bars.process_trade(make_trade(61, "101", "4", Side::ASK));
+    ASSERT_EQ(bars.closed().size(), 1U);
+
+    const auto& bar = bars.closed()[0].bar;
+    EXPECT_EQ(bars.closed()[0].product_id, "ETH-USD");
+    EXPECT_EQ(interval_name(bar.interval), "1s");
+    EXPECT_EQ(bar.start, 60'000'000'000);
+    EXPECT_EQ(bar.open, parse_fixed("100"));
+    EXPECT_EQ(bar.high, parse_fixed("102"));
+    EXPECT_EQ(bar.low, parse_fixed("99"));
+    EXPECT_EQ(bar.close, parse_fixed("99"));
+    EXPECT_EQ(bar.volume, parse_fixed("4"));
+    EXPECT_EQ(bar.buy_volume, parse_fixed("2"));
+    EXPECT_EQ(bar.sell_volume, parse_fixed("2"));
+    EXPECT_EQ(bar.trades, 3U);
+    EXPECT_DOUBLE_EQ(bar.vwap(), (100.0 + 204.0 + 99.0) / 4.0);
+
+    // Quiet products are closed by time
+    bars.close_expired(120'000'000'000);
+    ASSERT_EQ(bars.closed().size(), 3U);
+    EXPECT_EQ(interval_name(bars.closed()[2].bar.interval), "1m");
+    EXPECT_EQ(bars.closed()[2].bar.trades, 4U);
+}
+
+TEST(DataProcessorTest, PublishesBarsOfQuietProducts)
+{
+    using raccoon::resp::Command;
+    using namespace std::chrono;
+
+    raccoon::resp::RespServer server;
+    ASSERT_TRUE(server.start());
+
+    redisContext* redis = redisConnect("127.0.0.1", server.port());
+    ASSERT_TRUE(redis != nullptr && redis->err == 0);
+
+    {
+        DataProcessor processor(redis);
+
+        // A trade from longer ago than any bar interval, then silence
+        auto then = system_clock::now() - minutes(10);
+        auto trade = make_trade(0, "100", "1", Side::BID);
+        trade.timestamp = duration_cast<nanoseconds>(then.time_since_epoch()).count();
+
+        processor.process_event(trade);
+        auto published = server.stats().count(Command::XADD);
+
+        // One bar per interval, closed by the loop rather than another trade
+        processor.flush();
+        EXPECT_EQ(server.stats().count(Command::XADD), published + 3);
+
+        processor.flush();
+        EXPECT_EQ(server.stats().count(Command::XADD), published + 3);
+    }
+
+    // Too late for the bars just closed, so into the next ones
+    BarProcessor bars({seconds(1)});
+    bars.process_trade(make_trade(60, "100", "1", Side::BID));
+    bars.close_expired(62'000'000'000);
+    bars.process_trade(make_trade(60, "101", "1", Side::BID));
+    bars.close_expired(63'000'000'000);
+
+    ASSERT_EQ(bars.closed().size(), 2U);
+    EXPECT_EQ(bars.closed()[0].bar.start, 60'000'000'000);
+    EXPECT_EQ(bars.closed()[1].bar.start, 61'000'000'000);
+
+    redisFree(redis);
+    server.stop();
+}
+
+TEST(TickStoreTest, BlocksRoundTrip)
+{
+    TickColumns columns;
+
+    for (int64_t i = 0; i < 1000; i++) {
+        columns.push_back({
+            .timestamp = 1'700'000'000'000'000'000 + i * 1'000'000,
+            .id = static_cast<uint64_t>(500 + i),
+            .side = i % 3 ? Side::BID : Side::ASK,
+            .price = 2000'00000000 + (i % 7) * 1'000'000 - (i % 5) * 1'000'000,
+            .size = i % 11 ? 12'50000000 : 0,
+        });
+    }
+
+    std::string encoded;
+    ticks::encode_block(columns, encoded);
+    EXPECT_LT(encoded.size(), columns.size() * sizeof(TickRow) / 4);
+
+    TickColumns decoded;
+    std::vector<uint8_t> scratch;
+    ASSERT_EQ(ticks::decode_block(encoded, decoded, scratch), encoded.size());
+
+    EXPECT_EQ(decoded.timestamps, columns.timestamps);
+    EXPECT_EQ(decoded.ids, columns.ids);
+    EXPECT_EQ(decoded.sides, columns.sides);
+    EXPECT_EQ(decoded.prices, columns.prices);
+    EXPECT_EQ(decoded.sizes, columns.sizes);
+
+    // Truncated data is rejected rather than misread
+    EXPECT_EQ(ticks::decode_block(encoded.substr(0, 40), decoded, scratch), 0U);
+}
+
+TEST(TickStoreTest, WritesAndReadsTimeRanges)
+{
+    auto root = std::filesystem::temp_directory_path() / "raccoon_tick_test";
+    std::filesystem::remove_all(root);
+
+    constexpr int64_t START = 1'700'000'000'000'000'000; // 2023-11-14
+    constexpr int64_t STEP = 1'000'000;
+
+    {
+        TickWriter writer(root, 1024, 100);
+
+        for (int64_t i = 0; i < 1000; i++) {
+            writer.write(Trade{
+                .venue = Venue::COINBASE,
+                .product_id = "ETH-USD",
+                .trade_id = static_cast<uint64_t>(i),
+                .timestamp = START + i * STEP,
+                .side = Side::BID,
+                .exact_price = raccoon::utils::Fixed::from_raw(i),
+                .exact_size = raccoon::utils::Fixed::from_raw(1),
+            });
+
+            // Stay under the queue capacity
+            if (i % 500 == 499)
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    } // flushes on destruction
+
+    auto path =
+        ticks::file_path(root, TickKind::TRADE, Venue::COINBASE, "ETH-USD", START);
+    EXPECT_EQ(path.filename(), "2023-11-14.trades");
+
+    TickReader reader(path);
+    ASSERT_TRUE(reader.valid());
+
+    std::vector<uint64_t> ids;
+    bool ok = reader.for_each(START + 250 * STEP, START + 349 * STEP, [&](auto row) {
+        ids.push_back(row.id);
+    });
+
+    EXPECT_TRUE(ok);
+    ASSERT_EQ(ids.size(), 100U);
+    EXPECT_EQ(ids.front(), 250U);
+    EXPECT_EQ(ids.back(), 349U);
+
+    std::filesystem::remove_all(root);
+}
+
+TEST(TickStoreTest, FlushesPartialBlocksOnTime)
+{
+    auto root = std::filesystem::temp_directory_path() / "raccoon_tick_flush_test";
+    std::filesystem::remove_all(root);
+
+    constexpr int64_t START = 1'700'000'000'000'000'000; // 2023-11-14
+
+    {
+        TickWriter writer(root, 1024, 4096, std::chrono::milliseconds(10));
+
+        // One row of a block that would take hours to fill
+        writer.write(Trade{
+            .venue = Venue::COINBASE,
+            .product_id = "ETH-USD",
+            .trade_id = 7,
+            .timestamp = START,
+            .side = Side::BID,
+            .exact_price = raccoon::utils::Fixed::from_raw(100),
+            .exact_size = raccoon::utils::Fixed::from_raw(1),
+        });
+
+        for (int i = 0; i < 200 && writer.written() == 0; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+        // On disk while the writer is still running
+        EXPECT_EQ(writer.written(), 1U);
+
+        auto path =
+            ticks::file_path(root, TickKind::TRADE, Venue::COINBASE, "ETH-USD", START);
+        TickReader reader(path);
+        ASSERT_TRUE(reader.valid());
+
+        std::vector<uint64_t> ids;
+        EXPECT_TRUE(reader.for_each(START, START, [&](auto row) {
+            ids.push_back(row.id);
+        }));
+        EXPECT_EQ(ids, (std::vector<uint64_t>{7}));
+    }
+
+    std::filesystem::remove_all(root);
+}
+
+TEST(ConflatorTest, SwitchesOnWriteLatency)
+{
+    using std::chrono::microseconds;
+
+    Conflator conflator(microseconds(1000), 100);
+    std::vector<std::string> written;
+
+    auto write_book = [&](const std::string& product_id) {
+        written.push_back(product_id);
+    };
+    auto write_symbol = [](const std::string& /* symbol */) {};
+
+    // Slow writes switch it on at the end of the cycle
+    for (int i = 0; i < 10; i++) {
+        EXPECT_TRUE(conflator.on_update("ETH-USD", "ETH-USD"));
+        conflator.on_write(microseconds(5000));
+    }
+
+    conflator.flush(write_book, write_symbol);
+    EXPECT_TRUE(conflator.conflating());
+    EXPECT_TRUE(written.empty());
+
+    // Then each book is written once per cycle
+    for (int i = 0; i < 10; i++) {
+        EXPECT_FALSE(conflator.on_update("ETH-USD", "ETH-USD"));
+        EXPECT_FALSE(conflator.on_update("BTC-USD", "BTC-USD"));
+    }
+
+    EXPECT_EQ(conflator.pending(), 2U);
+
+    auto fast_write = [&](const std::string& product_id) {
+        write_book(product_id);
+        conflator.on_write(microseconds(100));
+    };
+    conflator.flush(fast_write, write_symbol);
+
+    std::ranges::sort(written);
+    EXPECT_EQ(written, (std::vector<std::string>{"BTC-USD", "ETH-USD"}));
+    EXPECT_EQ(conflator.pending(), 0U);
+
+    // Fast writes switch it back off, once well under the threshold
+    for (int i = 0; i < 50; i++)
+        conflator.on_write(microseconds(100));
+
+    conflator.flush(write_book, write_symbol);
+    EXPECT_FALSE(conflator.conflating());
+    EXPECT_TRUE(conflator.on_update("ETH-USD", "ETH-USD"));
+
+    const auto& stats = conflator.stats();
+    EXPECT_EQ(stats.updates, 31U);
+    EXPECT_EQ(stats.writes, 62U);
+    EXPECT_EQ(stats.episodes, 1U);
+}
+
+TEST(ConflatorTest, SwitchesOnBacklog)
+{
+    Conflator conflator(std::chrono::seconds(1), 100);
+    auto ignore = [](const std::string& /* key */) {};
+
+    for (int i = 0; i < 101; i++)
+        conflator.on_update("ETH-USD", "ETH-USD");
+
+    conflator.flush(ignore, ignore);
+    EXPECT_TRUE(conflator.conflating());
+
+    // A quiet cycle clears the backlog
+    conflator.on_update("ETH-USD", "ETH-USD");
+    conflator.flush(ignore, ignore);
+    EXPECT_FALSE(conflator.conflating());
+}
+
+TEST(DataProcessorTest, ConflatesBooksWhenRedisIsSlow)
+{
+    using raccoon::resp::Command;
+
+    // Every reply held back long enough that a book write passes the threshold
+    raccoon::resp::RespServer server({.latency_ms = 3});
+    ASSERT_TRUE(server.start());
+
+    redisContext* redis = redisConnect("127.0.0.1", server.port());
+    ASSERT_TRUE(redis != nullptr && redis->err == 0);
+
+    {
+        DataProcessor processor(redis);
+
+        processor.process_event(BookSnapshot{
+            .venue = Venue::COINBASE,
+            .product_id = "ETH-USD",
+            .bids = {{100.0, 1.0}},
+            .asks = {{101.0, 1.0}},
+        });
+
+        auto update = [&](int i) {
+            processor.process_event(BookDelta{
+                .venue = Venue::COINBASE,
+                .product_id = "ETH-USD",
+                .changes = {{Side::BID, 100.0, 1.0 + i}},
+            });
+        };
+
+        // Written as they come, until the cycle ends
+        for (int i = 0; i < 3; i++)
+            update(i);
+
+        processor.flush();
+        ASSERT_TRUE(processor.conflating());
+        EXPECT_EQ(server.stats().count(Command::HMSET), 8U);
+
+        // Now books wait for the flush, but trades don't
+        for (int i = 0; i < 100; i++) {
+            update(i);
+
+            if (i % 20 == 0) {
+                processor.process_event(Trade{
+                    .venue = Venue::COINBASE,
+                    .product_id = "ETH-USD",
+                    .trade_id = static_cast<uint64_t>(i),
+                    .side = Side::BID,
+                    .price = 100.0,
+                    .size = 1.0,
+                });
+            }
+        }
+
+        EXPECT_EQ(server.stats().count(Command::HMSET), 8U);
+        EXPECT_EQ(server.stats().count(Command::SET), 5U);
+
+        processor.flush();
+        EXPECT_EQ(server.stats().count(Command::HMSET), 10U);
+
+        const auto& stats = processor.conflation();
+        EXPECT_EQ(stats.updates, 104U);
+        EXPECT_EQ(stats.writes, 5U);
+        EXPECT_GT(stats.ratio(), 20.0);
+    }
+
+    redisFree(redis);
+    server.stop();
+}
+
+TEST(DataProcessorTest, WritesConflationMetrics)
+{
+    raccoon::resp::RespServer server({.store = true});
+    ASSERT_TRUE(server.start());
+
+    redisContext* redis = redisConnect("127.0.0.1", server.port());
+    ASSERT_TRUE(redis != nullptr && redis->err == 0);
+
+    {
+        DataProcessor processor(redis);
+
+        processor.process_event(BookSnapshot{
+            .venue = Venue::COINBASE,
+            .product_id = "ETH-USD",
+            .bids = {{100.0, 1.0}},
+            .asks = {{101.0, 1.0}},
+        });
+        processor.flush();
+    }
+
+    auto* reply = static_cast<redisReply*>(
+        redisCommand(redis, "HMGET CONFLATION updates writes ratio conflating")
+    );
+    ASSERT_TRUE(reply != nullptr);
+    ASSERT_EQ(reply->elements, 4U);
+
+    std::vector<std::string> values;
+    for (size_t i = 0; i < reply->elements; i++)
+        values.emplace_back(reply->element[i]->str, reply->element[i]->len);
+
+    EXPECT_EQ(values[0], "1");
+    EXPECT_EQ(values[1], "1");
+    EXPECT_DOUBLE_EQ(std::stod(values[2]), 1.0);
+    EXPECT_EQ(values[3], "0");
+
+    freeReplyObject(reply);
+    redisFree(redis);
+    server.stop();
+}
+
+TEST(ArenaTest, GrowsToFitACycle)
+{
+    raccoon::utils::Arena arena(256, 4096); // NOLINT(*-magic-numbers)
+
+    auto cycle = [&](size_t bytes) {
+        std::pmr::vector<char> scratch(bytes, 'x', arena.resource());
+        arena.reset();
+    };
+
+    cycle(100); // NOLINT(*-magic-numbers)
+    EXPECT_EQ(arena.overflows(), 0U);
+
+    // Too big once, then it fits
+    cycle(1000); // NOLINT(*-magic-numbers)
+    EXPECT_EQ(arena.overflows(), 1U);
+    EXPECT_GE(arena.size(), 1000U);
+
+    cycle(1000); // NOLINT(*-magic-numbers)
+    EXPECT_EQ(arena.overflows(), 1U);
+
+    // But never past the limit
+    cycle(10000); // NOLINT(*-magic-numbers)
+    EXPECT_EQ(arena.size(), 4096U);
+}
+
+TEST(ReservedMemoryTest, CountsWhatOutgrowsIt)
+{
+    raccoon::utils::ReservedMemory memory("test", 4096); // NOLINT(*-magic-numbers)
+    ASSERT_EQ(memory.reserved(), 4096U);
+
+    bool listed = false;
+    raccoon::utils::ReservedMemory::for_each([&](const auto& reserved) {
+        listed = listed || &reserved == &memory;
+    });
+    EXPECT_TRUE(listed);
+
+    {
+        std::pmr::vector<char> fits(4000, 'x', &memory); // NOLINT(*-magic-numbers)
+        EXPECT_EQ(memory.overflows(), 0U);
+
+        std::pmr::vector<char> spills(1000, 'x', &memory); // NOLINT(*-magic-numbers)
+        EXPECT_EQ(memory.overflows(), 1U);
+        EXPECT_EQ(memory.overflow_bytes(), 1000U);
+    }
+
+    // Nothing reserved, so the heap is just the heap
+    raccoon::utils::ReservedMemory none;
+    std::pmr::vector<char> heap(1000, 'x', &none); // NOLINT(*-magic-numbers)
+    EXPECT_EQ(none.overflows(), 0U);
+}
+
+TEST(OrderbookProcessorTest, KeepsLevelsInReservedMemory)
+{
+    OrderbookProcessor books;
+    books.reserve(1, 100); // NOLINT(*-magic-numbers)
+
+    BookSnapshot snapshot{.venue = Venue::COINBASE, .product_id = "ETH-USD"};
+
+    for (int i = 0; i < 100; i++) { // NOLINT(*-magic-numbers)
+        snapshot.bids.push_back({100.0 - i, 1.0});
+        snapshot.asks.push_back({101.0 + i, 1.0});
+    }
+
+    books.process_incoming_snapshot(snapshot);
+
+    EXPECT_GT(books.reserved().used(), 0U);
+    EXPECT_EQ(books.reserved().overflows(), 0U);
+}
+
+TEST(OrderbookProcessorTest, TrimsToDepthLimits)
+{
+    OrderbookProcessor books;
+    books.set_depth_limits({.max_levels = 60}); // NOLINT(*-magic-numbers)
+
+    BookSnapshot snapshot{.venue = Venue::COINBASE, .product_id = "ETH-USD"};
+
+    for (int i = 0; i < 200; i++) { // NOLINT(*-magic-numbers)
+        snapshot.bids.push_back({100.0 - i, 1.0});
+        snapshot.asks.push_back({101.0 + i, 1.0});
+    }
+
+    // Snapshots are trimmed right away, best levels kept
+    const auto& tracker = books.process_incoming_snapshot(snapshot);
+    EXPECT_EQ(tracker.bids.size(), 60U);
+    EXPECT_EQ(tracker.asks.size(), 60U);
+    EXPECT_TRUE(tracker.bids.contains(100.0));
+    EXPECT_FALSE(tracker.bids.contains(40.0));
+    EXPECT_DOUBLE_EQ(tracker.features.bid, 100.0);
+    EXPECT_EQ(books.trimmed(), 280U);
+
+    // Updates a batch at a time
+    BookDelta delta{.venue = Venue::COINBASE, .product_id = "ETH-USD"};
+
+    for (int i = 0; i < BOOK_TRIM_SLACK; i++)
+        delta.changes.push_back({Side::BID, 30.0 - i, 1.0});
+
+    books.process_incoming_update(delta);
+    EXPECT_EQ(tracker.bids.size(), 60U + BOOK_TRIM_SLACK);
+
+    delta.changes = {{Side::BID, 99.5, 2.0}};
+    books.process_incoming_update(delta);
+    EXPECT_EQ(tracker.bids.size(), 60U);
+    EXPECT_TRUE(tracker.bids.contains(99.5));
+
+    // Removals are told to whoever follows the changes
+    auto changes = books.changes();
+    auto removed = std::ranges::count_if(changes, [](const auto& change) {
+        return change.new_size <= 0.0;
+    });
+    EXPECT_EQ(removed, BOOK_TRIM_SLACK + 1);
+
+    // Too far from the mid, however deep, but never the best levels
+    books.set_depth_limits({.max_levels = 0, .max_distance = 0.1});
+    books.process_incoming_snapshot(snapshot);
+    EXPECT_EQ(tracker.bids.size(), static_cast<size_t>(PACKED_BOOK_DEPTH));
+    EXPECT_EQ(tracker.asks.size(), static_cast<size_t>(PACKED_BOOK_DEPTH));
+}
+
+TEST(OrderbookProcessorTest, TrimsBooksOverTheMemoryBudget)
+{
+    OrderbookProcessor books;
+
+    BookSnapshot snapshot{.venue = Venue::COINBASE, .product_id = "ETH-USD"};
+
+    for (int i = 0; i < 1000; i++) { // NOLINT(*-magic-numbers)
+        snapshot.bids.push_back({1000.0 - i, 1.0});
+        snapshot.asks.push_back({1001.0 + i, 1.0});
+    }
+
+    const auto& tracker = books.process_incoming_snapshot(snapshot);
+    EXPECT_EQ(tracker.bids.size(), 1000U);
+    EXPECT_GT(tracker.memory.bytes(), 0U);
+    EXPECT_EQ(tracker.memory.bytes(), books.memory().bytes());
+
+    // Half of what the book takes now
+    books.set_memory_budget(tracker.memory.bytes() / 2);
+    books.process_incoming_update({.venue = Venue::COINBASE, .product_id = "ETH-USD"});
+
+    EXPECT_TRUE(tracker.over_budget);
+    EXPECT_LT(tracker.bids.size(), 600U);
+    EXPECT_GE(tracker.bids.size(), static_cast<size_t>(PACKED_BOOK_DEPTH));
+    EXPECT_DOUBLE_EQ(tracker.features.bid, 1000.0);
+}
+
+TEST(OrderbookProcessorTest, BuildsDeepSnapshotsBesideTheBook)
+{
+    OrderbookProcessor books;
+
+    auto deep_snapshot = [] {
+        BookSnapshot snapshot{.venue = Venue::COINBASE, .product_id = "ETH-USD"};
+
+        for (int i = 0; i < 3000; i++) { // NOLINT(*-magic-numbers)
+            snapshot.bids.push_back({1000.0 - i, 1.0});
+            snapshot.asks.push_back({1001.0 + i, 1.0});
+        }
+
+        return snapshot;
+    };
+
+    size_t applied = 0;
+    auto on_applied = [&applied](const std::string& product_id, const auto&) {
+        EXPECT_EQ(product_id, "ETH-USD");
+        applied++;
+    };
+
+    const auto& tracker = books.process_incoming_snapshot(deep_snapshot());
+    EXPECT_TRUE(tracker.rebuilding());
+    EXPECT_TRUE(tracker.bids.empty());
+
+    books.continue_snapshots(std::numeric_limits<size_t>::max(), on_applied);
+    EXPECT_EQ(applied, 1U);
+    EXPECT_EQ(tracker.bids.size(), 3000U);
+    EXPECT_FALSE(books.rebuilding());
+
+    // The same book, but for a few levels
+    auto snapshot = deep_snapshot();
+    snapshot.bids[0].size = 2.0;
+    snapshot.bids.erase(snapshot.bids.begin() + 1);
+    snapshot.asks.push_back({1001.5, 1.0});
+
+    books.process_incoming_snapshot(snapshot);
+    EXPECT_TRUE(books.rebuilding());
+    EXPECT_TRUE(books.changes().empty());
+
+    // Updates wait for the snapshot, while the live book stays as it was
+    books.process_incoming_update({
+        .venue = Venue::COINBASE,
+        .product_id = "ETH-USD",
+        .changes = {{Side::ASK, 1002.0, 0.0}},
+    });
+    EXPECT_TRUE(books.changes().empty());
+    EXPECT_DOUBLE_EQ(tracker.bids.at(1000.0), 1.0);
+    EXPECT_TRUE(tracker.asks.contains(1002.0));
+
+    while (tracker.rebuilding())
+        books.continue_snapshots(SNAPSHOT_CHUNK_LEVELS, on_applied);
+
+    EXPECT_EQ(applied, 2U);
+    EXPECT_DOUBLE_EQ(tracker.bids.at(1000.0), 2.0);
+    EXPECT_FALSE(tracker.bids.contains(999.0));
+    EXPECT_FALSE(tracker.asks.contains(1002.0));
+    EXPECT_TRUE(tracker.asks.contains(1001.5));
+
+    // Only what differs
+    auto changes = books.changes();
+    ASSERT_EQ(changes.size(), 4U);
+
+    auto change_at = [&changes](double price) {
+        auto it = std::ranges::find_if(changes, [price](const auto& change) {
+            return std::abs(change.price - price) < 1e-9; // NOLINT(*-magic-numbers)
+        });
+        return it != changes.end() ? std::pair{it->old_size, it->new_size}
+                                   : std::pair{-1.0, -1.0};
+    };
+
+    EXPECT_EQ(change_at(1000.0), (std::pair{1.0, 2.0}));
+    EXPECT_EQ(change_at(999.0), (std::pair{1.0, 0.0}));
+    EXPECT_EQ(change_at(1001.5), (std::pair{0.0, 1.0}));
+    EXPECT_EQ(change_at(1002.0), (std::pair{1.0, 0.0}));
+
+    // The old book's levels are freed afterwards, a chunk at a time
+    auto bytes = tracker.memory.bytes();
+    books.continue_snapshots(std::numeric_limits<size_t>::max(), on_applied);
+
+    EXPECT_FALSE(books.rebuilding());
+    EXPECT_EQ(tracker.build, nullptr);
+    EXPECT_LT(tracker.memory.bytes(), bytes);
+    EXPECT_EQ(applied, 2U);
+}
+
+TEST(OrderbookProcessorTest, SwapsInOnlyTheirOwnChanges)
+{
+    OrderbookProcessor books;
+
+    BookSnapshot deep{.venue = Venue::COINBASE, .product_id = "ETH-USD"};
+
+    for (int i = 0; i < 3000; i++) { // NOLINT(*-magic-numbers)
+        deep.bids.push_back({1000.0 - i, 1.0});
+        deep.asks.push_back({1001.0 + i, 1.0});
+    }
+
+    const auto& eth = books.process_incoming_snapshot(deep);
+    ASSERT_TRUE(eth.rebuilding());
+
+    books.process_incoming_snapshot({
+        .venue = Venue::COINBASE,
+        .product_id = "BTC-USD",
+        .bids = {{50000.0, 1.0}},
+        .asks = {{50001.0, 1.0}},
+    });
+
+    // Another product's update is the last thing applied before the swap
+    books.process_incoming_update({
+        .venue = Venue::COINBASE,
+        .product_id = "BTC-USD",
+        .changes = {{Side::BID, 50000.5, 2.0}, {Side::ASK, 50001.0, 0.0}},
+    });
+    ASSERT_EQ(books.changes().size(), 2U);
+
+    size_t applied = 0;
+    auto on_applied = [&](const std::string& product_id, const auto&) {
+        EXPECT_EQ(product_id, "ETH-USD");
+        applied++;
+
+        for (const auto& change : books.changes())
+            EXPECT_LT(change.price, 5000.0) << change.price;
+    };
+
+    while (eth.rebuilding())
+        books.continue_snapshots(SNAPSHOT_CHUNK_LEVELS, on_applied);
+
+    EXPECT_EQ(applied, 1U);
+    ASSERT_NE(eth.top_bids.best(), nullptr);
+    ASSERT_NE(eth.top_asks.best(), nullptr);
+    EXPECT_DOUBLE_EQ(eth.top_bids.best()->price, 1000.0);
+    EXPECT_DOUBLE_EQ(eth.top_asks.best()->price, 1001.0);
+    EXPECT_EQ(eth.bids.size(), 3000U);
+}
+
+TEST(DataProcessorTest, WritesFromScratchMemory)
+{
+    raccoon::resp::RespServer server({.store = true});
+    ASSERT_TRUE(server.start());
+
+    redisContext* redis = redisConnect("127.0.0.1", server.port());
+    ASSERT_TRUE(redis != nullptr && redis->err == 0);
+
+    auto read = [redis](const char* command) {
+        auto* reply = static_cast<redisReply*>(redisCommand(redis, command));
+        std::vector<std::string> res;
+
+        for (size_t i = 0; reply != nullptr && i < reply->elements; i++) {
+            const auto* element = reply->element[i];
+            res.emplace_back(std::string_view(element->str, element->len));
+        }
+
+        freeReplyObject(reply);
+        return res;
+    };
+
+    {
+        DataProcessor processor(redis);
+
+        // Deep enough that the first cycle's writes don't fit in the arena
+        std::vector<PriceLevel> bids;
+        for (int i = 0; i < 5000; i++) // NOLINT(*-magic-numbers)
+            bids.push_back({1000.0 - i * 0.01, 1.5});
+
+        for (int cycle = 0; cycle < 3; cycle++) {
+            processor.process_event(BookSnapshot{
+                .venue = Venue::COINBASE,
+                .product_id = "ETH-USD",
+                .bids = bids,
+                .asks = {{1001.25, 2.0}},
+            });
+            processor.flush();
+        }
+
+        // Grown once, then reused
+        EXPECT_EQ(processor.scratch().overflows(), 1U);
+        EXPECT_GT(processor.scratch().size(), SCRATCH_ARENA_SIZE);
+    }
+
+    // Formatted as before
+    using strings = std::vector<std::string>;
+    EXPECT_EQ(read("HGETALL ETH-USD-ASKS"), (strings{"1001.250000", "2.000000"}));
+    EXPECT_EQ(read("HMGET ETH-USD-BIDS 1000.000000"), (strings{"1.500000"}));
+
+    redisFree(redis);
+    server.stop();
+}
+
+TEST(TradeProcessorTest, WritesMatchesAsBefore)
+{
+    raccoon::resp::RespServer server({.store = true});
+    ASSERT_TRUE(server.start());
+
+    redisContext* redis = redisConnect("127.0.0.1", server.port());
+    ASSERT_TRUE(redis != nullptr && redis->err == 0);
+
+    Trade trade{
+        .venue = Venue::COINBASE,
+        .product_id = "ETH-USD",
+        .trade_id = 7,
+        .sequence = 42,
+        .timestamp = 1'704'164'645'000'456'789,
+        .side = Side::BID, // the taker bought, from a maker selling
+        .price = 1234.5,
+        .size = 0.25,
+        .exact_price = raccoon::utils::parse_fixed("1234.50"),
+        .exact_size = raccoon::utils::parse_fixed("0.25"),
+        .maker_order_id = "maker",
+        .taker_order_id = "taker",
+    };
+
+    TradeProcessor trades;
+    trades.process_incoming_match(trade);
+    trades.matches_to_redis(redis);
+
+    auto* reply = static_cast<redisReply*>(redisCommand(redis, "GET matches"));
+    ASSERT_NE(reply, nullptr);
+    std::string json(reply->str, reply->len);
+    freeReplyObject(reply);
+
+    // The Coinbase match fields, with strings where Coinbase has them
+    EXPECT_EQ(
+        json,
+        R"([{"type":"match","time":"2024-01-02T03:04:05.000456Z","trade_id":7,)"
+        R"("maker_order_id":"maker","taker_order_id":"taker","side":"sell",)"
+        R"("size":"0.25","price":"1234.5","product_id":"ETH-USD","sequence":42}])"
+    );
+
+    redisFree(redis);
+    server.stop();
+}
+
+TEST(DataProcessorTest, RemovesLevelsFromHashes)
+{
+    raccoon::resp::RespServer server({.store = true});
+    ASSERT_TRUE(server.start());
+
+    redisContext* redis = redisConnect("127.0.0.1", server.port());
+    ASSERT_TRUE(redis != nullptr && redis->err == 0);
+
+    auto fields = [redis](const char* key) {
+        auto* reply = static_cast<redisReply*>(redisCommand(redis, "HGETALL %s", key));
+        auto count = reply != nullptr ? reply->elements / 2 : 0;
+
+        freeReplyObject(reply);
+        return count;
+    };
+
+    // Left over from before, and replaced by the first write
+    freeReplyObject(redisCommand(redis, "HSET ETH-USD-BIDS 1.000000 1.000000"));
+
+    {
+        DataProcessor processor(redis);
+
+        processor.process_event(BookSnapshot{
+            .venue = Venue::COINBASE,
+            .product_id = "ETH-USD",
+            .bids = {{100.0, 1.0}, {99.0, 1.0}, {98.0, 1.0}},
+            .asks = {{101.0, 1.0}},
+        });
+        EXPECT_EQ(fields("ETH-USD-BIDS"), 3U);
+
+        // Removed as they go, including sizes that only round to zero
+        processor.process_event(BookDelta{
+            .venue = Venue::COINBASE,
+            .product_id = "ETH-USD",
+            .changes = {{Side::BID, 99.0, 0.0}, {Side::BID, 98.0, 1e-12}},
+        });
+        EXPECT_EQ(fields("ETH-USD-BIDS"), 1U);
+
+        // And a snapshot replaces whatever was there
+        processor.process_event(BookSnapshot{
+            .venue = Venue::COINBASE,
+            .product_id = "ETH-USD",
+            .bids = {{97.0, 1.0}, {96.0, 1.0}},
+            .asks = {{101.0, 1.0}},
+        });
+        EXPECT_EQ(fields("ETH-USD-BIDS"), 2U);
+    }
+
+    redisFree(redis);
+    server.stop();
+}
+
+TEST(DataProcessorTest, NotifiesChanges)
+{
+    using raccoon::resp::Command;
+
+    raccoon::resp::RespServer server;
+    ASSERT_TRUE(server.start());
+
+    redisContext* redis = redisConnect("127.0.0.1", server.port());
+    ASSERT_TRUE(redis != nullptr && redis->err == 0);
+
+    {
+        DataProcessor processor(redis);
+
+        processor.process_event(BookSnapshot{
+            .venue = Venue::COINBASE,
+            .product_id = "ETH-USD",
+            .bids = {{100.0, 1.0}},
+            .asks = {{101.0, 1.0}},
+        });
+        EXPECT_EQ(server.stats().count(Command::PUBLISH), 0U);
+
+        // One per book write and per trade
+        processor.set_notify(NotifyMode::PUBLISH);
+
+        processor.process_event(BookDelta{
+            .venue = Venue::COINBASE,
+            .product_id = "ETH-USD",
+            .changes = {{Side::BID, 100.0, 2.0}},
+        });
+        processor.process_event(Trade{
+            .venue = Venue::COINBASE,
+            .product_id = "ETH-USD",
+            .trade_id = 1,
+            .side = Side::ASK,
+            .price = 100.0,
+            .size = 0.5,
+        });
+        EXPECT_EQ(server.stats().count(Command::PUBLISH), 2U);
+
+        processor.set_notify(NotifyMode::STREAM);
+
+        processor.process_event(BookDelta{
+            .venue = Venue::COINBASE,
+            .product_id = "ETH-USD",
+            .changes = {{Side::ASK, 101.0, 2.0}},
+        });
+
+        auto stats = server.stats();
+        EXPECT_EQ(stats.count(Command::PUBLISH), 2U);
+        EXPECT_EQ(stats.count(Command::XADD), 1U);
+        EXPECT_EQ(stats.errors, 0U);
+    }
+
+    redisFree(redis);
+    server.stop();
+}
+
+/**
+ * Keeps a copy of what it receives, in a log shared with the test.
+ */
+struct RecordingSink {
+    struct log {
+        std::vector<std::string> books;    // product and change count
+        std::vector<double> bids;          // best bid after each change
+        std::vector<uint64_t> trades;      // trade ids
+        std::vector<std::string> statuses; // feed and whether it's stale
+        size_t flushes = 0;
+        std::atomic<size_t> levels = 0; // changed, safe to read while it runs
+    };
+
+    log* out;
+
+    void
+    on_book(const BookChange& book)
+    {
+        auto summary = fmt::format(
+            "{} {}{}", book.product_id, book.changes.size(), book.reset ? " reset" : ""
+        );
+
+        out->books.push_back(std::move(summary));
+        out->bids.push_back(book.l1.bid);
+        out->levels += book.changes.size();
+    }
+
+    void
+    on_trade(const Trade& trade)
+    {
+        out->trades.push_back(trade.trade_id);
+    }
+
+    void
+    on_status(const FeedStatus& status)
+    {
+        out->statuses.push_back(
+            fmt::format("{} {}", status.feed, status.stale ? "stale" : "live")
+        );
+    }
+
+    void
+    flush()
+    {
+        out->flushes++;
+    }
+};
+
+TEST(SinkTest, FeedsSinksWithoutRedis)
+{
+    RecordingSink::log log;
+
+    DataProcessor processor(nullptr);
+    processor.add_sink(std::make_unique<SinkGroup<RecordingSink, NullSink>>(
+        RecordingSink{&log}, NullSink{}
+    ));
+
+    processor.process_event(BookSnapshot{
+        .venue = Venue::COINBASE,
+        .product_id = "ETH-USD",
+        .bids = {{100.0, 1.0}, {99.0, 1.0}},
+        .asks = {{101.0, 1.0}},
+    });
+    processor.process_event(BookDelta{
+        .venue = Venue::COINBASE,
+        .product_id = "ETH-USD",
+        .changes = {{Side::BID, 100.0, 0.0}},
+    });
+    processor.process_event(Trade{
+        .venue = Venue::COINBASE,
+        .product_id = "ETH-USD",
+        .trade_id = 7,
+    });
+    processor.flush();
+
+    EXPECT_EQ(log.books, (std::vector<std::string>{"ETH-USD 3", "ETH-USD 1"}));
+    EXPECT_EQ(log.bids, (std::vector<double>{100.0, 99.0}));
+    EXPECT_EQ(log.trades, std::vector<uint64_t>{7});
+    EXPECT_EQ(log.flushes, 1U);
+}
+
+TEST(SinkTest, AsyncSinkDropsRatherThanBlock)
+{
+    // Holds its thread until released
+    struct StuckSink : RecordingSink {
+        std::atomic<bool>* released;
+
+        void
+        on_book(const BookChange& book)
+        {
+            while (!released->load())
+                std::this_thread::yield();
+
+            RecordingSink::on_book(book);
+        }
+    };
+
+    RecordingSink::log log;
+    std::atomic<bool> released = false;
+
+    AsyncSink<StuckSink> sink(16, StuckSink{{&log}, &released});
+
+    std::vector<level_update> levels(3, {Side::BID, 100.0, 0.0, 1.0});
+    BookChange book;
+    book.product_id = "ETH-USD";
+    book.changes = levels;
+
+    // Four slots each, so at most five fit, the first being stuck in the sink
+    for (int i = 0; i < 10; i++)
+        sink.on_book(book);
+
+    EXPECT_GE(sink.dropped(), 5U);
+
+    released = true;
+    sink.stop();
+
+    EXPECT_EQ(sink.delivered() + sink.dropped(), 10U);
+    EXPECT_EQ(log.books.size(), sink.delivered());
+    EXPECT_EQ(log.books.front(), "ETH-USD 3");
+    EXPECT_GE(log.flushes, 1U);
+}
+
+TEST(SinkTest, SendsBooksDeeperThanTheQueueInParts)
+{
+    RecordingSink::log log;
+
+    {
+        DataProcessor processor(nullptr);
+        auto sink = std::make_unique<AsyncSink<RecordingSink>>(16, RecordingSink{&log});
+        const auto& async = *sink;
+        processor.add_sink(std::move(sink));
+
+        BookSnapshot deep{.venue = Venue::COINBASE, .product_id = "ETH-USD"};
+        for (int i = 0; i < 50; i++) {
+            deep.bids.push_back({1000.0 - i, 1.0});
+            deep.asks.push_back({1001.0 + i, 1.0});
+        }
+
+        // Never fits whole, so it's dropped rather than waited for
+        processor.process_event(deep);
+        EXPECT_EQ(async.dropped(), 1U);
+
+        for (int i = 0; i < 1000 && log.levels < 100; i++) {
+            processor.flush();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        EXPECT_EQ(async.dropped(), 1U);
+    }
+
+    // Then goes out in parts, the first resetting the book
+    ASSERT_GE(log.books.size(), 7U);
+    EXPECT_TRUE(log.books[0].ends_with(" reset"));
+
+    for (size_t i = 1; i < log.books.size(); i++)
+        EXPECT_FALSE(log.books[i].ends_with(" reset")) << log.books[i];
+
+    EXPECT_EQ(log.levels, 100U);
+}
+
+TEST(SinkTest, SendsDroppedBooksAgain)
+{
+    // Holds its thread on the first book until released
+    struct StuckSink : RecordingSink {
+        std::atomic<bool>* released;
+
+        void
+        on_book(const BookChange& book)
+        {
+            while (!released->load())
+                std::this_thread::yield();
+
+            RecordingSink::on_book(book);
+        }
+    };
+
+    RecordingSink::log log;
+    std::atomic<bool> released = false;
+
+    {
+        using Sink = AsyncSink<StuckSink>;
+
+        DataProcessor processor(nullptr);
+        auto sink = std::make_unique<Sink>(16, StuckSink{{&log}, &released});
+        const auto& async = *sink;
+        processor.add_sink(std::move(sink));
+
+        processor.process_event(BookSnapshot{
+            .venue = Venue::COINBASE,
+            .product_id = "BTC-USD",
+            .bids = {{50000.0, 1.0}},
+        });
+
+        // Deeper than the queue, while nothing makes room
+        BookSnapshot deep{.venue = Venue::COINBASE, .product_id = "ETH-USD"};
+        for (int i = 0; i < 20; i++) {
+            deep.bids.push_back({1000.0 - i, 1.0});
+            deep.asks.push_back({1001.0 + i, 1.0});
+        }
+
+        processor.process_event(deep);
+        EXPECT_EQ(async.dropped(), 1U);
+
+        // Sent again whole, once the sink has caught up
+        released = true;
+
+        for (int i = 0; i < 1000 && log.levels < 41; i++) {
+            processor.flush();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    ASSERT_GE(log.books.size(), 2U);
+    EXPECT_EQ(log.books[0], "BTC-USD 1");
+    EXPECT_TRUE(log.books[1].starts_with("ETH-USD ")) << log.books[1];
+    EXPECT_TRUE(log.books[1].ends_with(" reset")) << log.books[1];
+    EXPECT_DOUBLE_EQ(log.bids[1], 1000.0);
+    EXPECT_EQ(log.levels, 41U);
+}
+
+TEST(SinkTest, PassesStatusesThroughQueues)
+{
+    RecordingSink::log log;
+
+    {
+        using Sink = AsyncSink<SinkGroup<RecordingSink, NullSink>>;
+
+        DataProcessor processor(nullptr);
+        processor.add_sink(std::make_unique<Sink>(16, RecordingSink{&log}, NullSink{}));
+
+        processor.feed_status({
+            .venue = Venue::BINANCE,
+            .feed = "binance",
+            .connection = true,
+            .stale = true,
+            .silent_ms = 15000,
+        });
+        processor.feed_status({.venue = Venue::COINBASE, .feed = "ETH-USD"});
+
+        // The sink's thread is stopped, after draining, with the processor
+    }
+
+    EXPECT_EQ(
+        log.statuses, (std::vector<std::string>{"binance stale", "ETH-USD live"})
+    );
+}
+
+TEST(StalenessTrackerTest, MarksSilentProducts)
+{
+    using std::chrono::milliseconds;
+
+    StalenessTracker tracker(milliseconds(1000), milliseconds(100));
+    std::vector<std::string> changes;
+
+    auto record = [&changes](const FeedStatus& status) {
+        changes.push_back(fmt::format("{} {}", status.feed, status.silent_ms));
+    };
+
+    auto start = StalenessTracker::clock::now();
+    tracker.on_event(Venue::COINBASE, "ETH-USD");
+    tracker.on_event(Venue::COINBASE, "BTC-USD");
+    tracker.check(start, record);
+
+    // Only one keeps trading
+    for (int i = 1; i <= 12; i++) {
+        tracker.on_event(Venue::COINBASE, "ETH-USD");
+        tracker.check(start + milliseconds(100 * i), record);
+    }
+
+    EXPECT_EQ(changes, std::vector<std::string>{"BTC-USD 1000"});
+
+    // Checks in between are skipped
+    tracker.on_event(Venue::COINBASE, "BTC-USD");
+    tracker.check(start + milliseconds(1250), record);
+    EXPECT_EQ(changes.size(), 1U);
+
+    tracker.check(start + milliseconds(1300), record);
+    ASSERT_EQ(changes.size(), 2U);
+    EXPECT_EQ(changes[1], "BTC-USD 1300");
+    EXPECT_EQ(tracker.size(), 2U);
+}
+
+/**
+ * Run `fn` on another thread, serving the sink's recovery socket meanwhile.
+ */
+template <class Fn>
+auto
+serve_recovery_while(MulticastSink& sink, Fn&& fn)
+{
+    auto result = std::async(std::launch::async, std::forward<Fn>(fn));
+
+    while (result.wait_for(std::chrono::milliseconds(1)) != std::future_status::ready)
+        sink.idle();
+
+    return result.get();
+}
+
+/**
+ * Poll until the receiver has `count` messages, or a second passes.
+ */
+void
+receive_messages(raccoon::mcast::Receiver& receiver, uint64_t count)
+{
+    for (int i = 0; i < 100 && receiver.stats().messages < count; i++)
+        receiver.poll(10);
+}
+
+BookChange
+book_change(const std::vector<level_update>& levels, uint64_t sequence, bool snapshot)
+{
+    BookChange book;
+    book.venue = Venue::COINBASE;
+    book.product_id = "ETH-USD";
+    book.sequence = sequence;
+    book.snapshot = snapshot;
+    book.changes = levels;
+    return book;
+}
+
+TEST(MulticastTest, DeliversOverLoopback)
+{
+    multicast_config config;
+    config.port = 31901;
+    config.recovery_port = 0;
+    config.max_datagram = 256; // a few messages per packet
+
+    MulticastSink sink(config);
+    ASSERT_TRUE(sink.ok());
+    ASSERT_GT(sink.recovery_port(), 0);
+
+    raccoon::mcast::ReceiverConfig follow;
+    follow.port = config.port;
+
+    raccoon::mcast::Receiver receiver(follow);
+    ASSERT_TRUE(receiver.ok());
+
+    std::vector<level_update> snapshot{
+        {Side::BID, 100.0, 0.0, 1.5},
+        {Side::BID, 99.0, 0.0, 2.0},
+        {Side::ASK, 101.0, 0.0, 0.25},
+    };
+    std::vector<level_update> update{
+        {Side::BID, 100.0, 1.5, 0.0},
+        {Side::ASK, 102.0, 0.0, 3.0},
+    };
+
+    auto book = book_change(snapshot, 1, true);
+    book.l1.bid = 100.0;
+    book.l1.bid_size = 1.5;
+    book.l1.ask = 101.0;
+    book.l1.ask_size = 0.25;
+    sink.on_book(book);
+
+    sink.on_trade(Trade{
+        .venue = Venue::COINBASE,
+        .product_id = "ETH-USD",
+        .trade_id = 7,
+        .side = Side::ASK,
+        .price = 100.0,
+        .size = 0.5,
+    });
+
+    auto l1 = book.l1;
+    book = book_change(update, 2, false);
+    book.l1 = l1;
+    book.l1.bid = 99.0;
+    book.l1.bid_size = 2.0;
+    sink.on_book(book);
+    sink.flush();
+
+    // Five levels, a trade and two tops
+    receive_messages(receiver, 8);
+
+    const auto& stats = receiver.stats();
+    EXPECT_EQ(stats.messages, 8U);
+    EXPECT_EQ(stats.levels, 5U);
+    EXPECT_EQ(stats.tops, 2U);
+    EXPECT_EQ(stats.trades, 1U);
+    EXPECT_EQ(stats.gaps, 0U);
+    EXPECT_GT(stats.packets, 1U);
+    EXPECT_EQ(sink.stats().messages, 8U);
+
+    const auto& received = receiver.books().at("ETH-USD");
+    constexpr int64_t ONE = 100'000'000;
+
+    EXPECT_EQ(received.bids.size(), 1U);
+    EXPECT_EQ(received.bids.at(99 * ONE), 2 * ONE);
+    EXPECT_EQ(received.asks.size(), 2U);
+    EXPECT_EQ(received.asks.at(102 * ONE), 3 * ONE);
+    EXPECT_EQ(received.top.values[0], 99 * ONE);
+    EXPECT_EQ(received.top.id, 2U);
+
+    // A late joiner catches up with a snapshot, then follows along
+    raccoon::mcast::Receiver late({
+        .group = config.group,
+        .port = config.port,
+        .recovery_host = "127.0.0.1",
+        .recovery_port = sink.recovery_port(),
+    });
+
+    auto snapshot_taken =
+        serve_recovery_while(sink, [&late] { return late.request_snapshot(); });
+
+    ASSERT_TRUE(snapshot_taken);
+    EXPECT_EQ(late.expected(), receiver.expected());
+
+    const auto& caught_up = late.books().at("ETH-USD");
+    EXPECT_EQ(caught_up.bids, received.bids);
+    EXPECT_EQ(caught_up.asks, received.asks);
+    EXPECT_EQ(caught_up.top.values, received.top.values);
+
+    sink.on_trade(Trade{.venue = Venue::COINBASE, .product_id = "ETH-USD"});
+    sink.flush();
+
+    receive_messages(receiver, 9);
+    receive_messages(late, late.stats().messages + 1);
+
+    EXPECT_EQ(late.stats().trades, 1U);
+    EXPECT_EQ(late.stats().gaps, 0U);
+    EXPECT_EQ(late.expected(), receiver.expected());
+}
+
+TEST(MulticastTest, RetransmitsMissedPackets)
+{
+    multicast_config config;
+    config.port = 31902;
+    config.recovery_port = 0;
+
+    MulticastSink sink(config);
+    ASSERT_TRUE(sink.ok());
+
+    // Raw packets, so the test can lose one
+    int capture = ::socket(AF_INET, SOCK_DGRAM, 0);
+    int reuse = 1;
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(config.port));
+
+    ip_mreq membership{};
+    inet_pton(AF_INET, config.group.c_str(), &membership.imr_multiaddr);
+    inet_pton(AF_INET, config.interface.c_str(), &membership.imr_interface);
+    address.sin_addr = membership.imr_multiaddr;
+
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    auto* addr = reinterpret_cast<sockaddr*>(&address);
+
+    ASSERT_EQ(setsockopt(capture, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)), 0);
+    ASSERT_EQ(bind(capture, addr, sizeof(address)), 0);
+    ASSERT_EQ(
+        setsockopt(
+            capture, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)
+        ),
+        0
+    );
+
+    // A packet per flush
+    std::vector<level_update> levels{{Side::BID, 100.0, 0.0, 1.0}};
+    std::vector<std::string> packets;
+
+    for (uint64_t seq = 1; seq <= 3; seq++) {
+        levels[0].price = 100.0 + static_cast<double>(seq);
+        sink.on_book(book_change(levels, seq, false));
+        sink.flush();
+
+        pollfd pfd{.fd = capture, .events = POLLIN, .revents = 0};
+        ASSERT_EQ(poll(&pfd, 1, 1000), 1);
+
+        std::string packet(2048, '\0');
+        auto nread = recv(capture, packet.data(), packet.size(), 0);
+        ASSERT_GT(nread, 0);
+
+        packet.resize(static_cast<size_t>(nread));
+        packets.push_back(std::move(packet));
+    }
+
+    close(capture);
+
+    raccoon::mcast::Receiver receiver({
+        .group = config.group,
+        .port = config.port,
+        .recovery_host = "127.0.0.1",
+        .recovery_port = sink.recovery_port(),
+    });
+
+    // The second packet is lost, and asked for again on seeing the third
+    receiver.handle(packets[0]);
+    serve_recovery_while(sink, [&receiver, &packets] { receiver.handle(packets[2]); });
+
+    const auto& stats = receiver.stats();
+    EXPECT_EQ(stats.gaps, 1U);
+    EXPECT_EQ(stats.missed, 2U); // a level and a top
+    EXPECT_EQ(stats.recovered, 2U);
+    EXPECT_EQ(stats.messages, 6U);
+    EXPECT_EQ(receiver.expected(), 7U);
+    EXPECT_EQ(receiver.books().at("ETH-USD").bids.size(), 3U);
+    EXPECT_EQ(sink.stats().retransmissions, 1U);
+}
+
+TEST(MulticastTest, ReplacesBooksSentWholeAgain)
+{
+    multicast_config config;
+    config.port = 31903;
+    config.recovery_port = 0;
+
+    MulticastSink sink(config);
+    ASSERT_TRUE(sink.ok());
+
+    raccoon::mcast::ReceiverConfig follow;
+    follow.port = config.port;
+
+    raccoon::mcast::Receiver receiver(follow);
+    ASSERT_TRUE(receiver.ok());
+
+    std::vector<level_update> snapshot{
+        {Side::BID, 100.0, 0.0, 1.0},
+        {Side::BID, 99.0, 0.0, 1.0},
+        {Side::ASK, 101.0, 0.0, 1.0},
+    };
+    sink.on_book(book_change(snapshot, 1, true));
+
+    // Some changes were lost on the way, so the book comes again whole
+    std::vector<level_update> whole{
+        {Side::BID, 98.0, 0.0, 2.0},
+        {Side::ASK, 101.0, 0.0, 3.0},
+    };
+    auto book = book_change(whole, 5, true);
+    book.reset = true;
+    sink.on_book(book);
+    sink.flush();
+
+    receive_messages(receiver, 7);
+    EXPECT_EQ(receiver.stats().resets, 1U);
+
+    constexpr int64_t ONE = 100'000'000;
+    const auto& received = receiver.books().at("ETH-USD");
+
+    EXPECT_EQ(received.bids.size(), 1U);
+    EXPECT_EQ(received.bids.at(98 * ONE), 2 * ONE);
+    EXPECT_EQ(received.asks.size(), 1U);
+    EXPECT_EQ(received.asks.at(101 * ONE), 3 * ONE);
+
+    // And so do snapshots of it
+    raccoon::mcast::Receiver late({
+        .group = config.group,
+        .port = config.port,
+        .recovery_host = "127.0.0.1",
+        .recovery_port = sink.recovery_port(),
+    });
+
+    auto snapshot_taken =
+        serve_recovery_while(sink, [&late] { return late.request_snapshot(); });
+
+    ASSERT_TRUE(snapshot_taken);
+    EXPECT_EQ(late.books().at("ETH-USD").bids, received.bids);
+    EXPECT_EQ(late.books().at("ETH-USD").asks, received.asks);
+}
+
+TEST(MulticastTest, DropsSlowRecoveryClients)
+{
+    multicast_config config;
+    config.port = 31904;
+    config.recovery_port = 0;
+    config.recovery_timeout = std::chrono::milliseconds(200);
+
+    MulticastSink sink(config);
+    ASSERT_TRUE(sink.ok());
+
+    // A snapshot bigger than the socket buffers
+    std::vector<level_update> levels;
+    for (int i = 0; i < 100'000; i++)
+        levels.push_back({Side::BID, 1000.0 + i, 0.0, 1.0});
+
+    sink.on_book(book_change(levels, 1, true));
+    sink.flush();
+
+    // A client that asks for it, and never reads
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int buffer = 4096;
+    ASSERT_EQ(setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer)), 0);
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(sink.recovery_port()));
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    ASSERT_EQ(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    ASSERT_EQ(send(fd, "SNAPSHOT\n", 9, 0), 9);
+
+    // Serving it doesn't block, and it's dropped once it's too slow
+    using clock = std::chrono::steady_clock;
+    auto give_up = clock::now() + std::chrono::seconds(5);
+
+    while (sink.stats().slow_clients == 0 && clock::now() < give_up) {
+        sink.idle();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    EXPECT_EQ(sink.stats().slow_clients, 1U);
+    close(fd);
+
+    // And the feed carries on
+    raccoon::mcast::ReceiverConfig follow;
+    follow.port = config.port;
+
+    raccoon::mcast::Receiver receiver(follow);
+    ASSERT_TRUE(receiver.ok());
+
+    sink.on_book(book_change({{Side::ASK, 2000.0, 0.0, 1.0}}, 2, false));
+    sink.flush();
+
+    receive_messages(receiver, 2);
+    EXPECT_EQ(receiver.stats().messages, 2U);
+}
+
+TEST(PackedBookTest, RoundTrips)
+{
+    namespace packed = raccoon::packed;
+
+    packed::Book book{
+        .venue = 1,
+        .sequence = 42,
+        .timestamp = 1'700'000'000'000'000'000,
+        .bids = {{164650000000, 150000000}, {164649000000, 25000000}},
+        .asks = {{164651000000, 300000000}},
+    };
+
+    std::string data;
+    packed::encode(book, data);
+    ASSERT_EQ(data.size(), packed::encoded_size(2, 1));
+
+    packed::Book decoded;
+    ASSERT_TRUE(packed::decode(data, decoded));
+
+    EXPECT_EQ(decoded.venue, 1U);
+    EXPECT_EQ(decoded.exponent, packed::EXPONENT);
+    EXPECT_EQ(decoded.sequence, 42U);
+    EXPECT_EQ(decoded.timestamp, book.timestamp);
+    ASSERT_EQ(decoded.bids.size(), 2U);
+    ASSERT_EQ(decoded.asks.size(), 1U);
+    EXPECT_EQ(decoded.bids[1].price, 164649000000);
+    EXPECT_DOUBLE_EQ(decoded.to_double(decoded.asks[0].price), 1646.51);
+    EXPECT_DOUBLE_EQ(decoded.to_double(decoded.asks[0].size), 3.0);
+
+    // Anything short or foreign is refused
+    data.pop_back();
+    EXPECT_FALSE(packed::decode(data, decoded));
+    EXPECT_FALSE(packed::decode("not a book at all, not a book at all", decoded));
+}
+
+TEST(OrderbookProcessorTest, PacksTheBestLevelsItKeeps)
+{
+    namespace packed = raccoon::packed;
+
+    raccoon::resp::RespServer server({.store = true});
+    ASSERT_TRUE(server.start());
+
+    redisContext* redis = redisConnect("127.0.0.1", server.port());
+    ASSERT_TRUE(redis != nullptr && redis->err == 0);
+
+    auto read = [redis](std::vector<double>& bids, std::vector<double>& asks) {
+        auto* reply = static_cast<redisReply*>(redisCommand(redis, "GET ETH-USD-BOOK"));
+        ASSERT_TRUE(reply != nullptr && reply->type == REDIS_REPLY_STRING);
+
+        packed::Book book;
+        ASSERT_TRUE(packed::decode({reply->str, reply->len}, book));
+        freeReplyObject(reply);
+
+        bids.clear();
+        asks.clear();
+
+        for (const auto& level : book.bids)
+            bids.push_back(book.to_double(level.price));
+        for (const auto& level : book.asks)
+            asks.push_back(book.to_double(level.price));
+    };
+
+    OrderbookProcessor books;
+    books.set_format(BookFormat::PACKED, 3);
+
+    BookSnapshot snapshot{.venue = Venue::COINBASE, .product_id = "ETH-USD"};
+    for (int i = 0; i < 20; i++) {
+        snapshot.bids.push_back({100.0 - i, 1.0});
+        snapshot.asks.push_back({101.0 + i, 1.0});
+    }
+
+    books.process_incoming_snapshot(snapshot);
+    books.ob_to_redis(redis, "ETH-USD");
+
+    std::vector<double> bids;
+    std::vector<double> asks;
+
+    read(bids, asks);
+    EXPECT_EQ(bids, (std::vector<double>{100.0, 99.0, 98.0}));
+    EXPECT_EQ(asks, (std::vector<double>{101.0, 102.0, 103.0}));
+
+    // Emptying the levels held falls back to the ones below them
+    BookDelta update{.venue = Venue::COINBASE, .product_id = "ETH-USD"};
+    for (int i = 0; i < 7; i++)
+        update.changes.push_back({Side::BID, 100.0 - i, 0.0});
+    update.changes.push_back({Side::ASK, 100.5, 2.0});
+
+    books.process_incoming_update(update);
+    books.ob_to_redis(redis, "ETH-USD");
+
+    read(bids, asks);
+    EXPECT_EQ(bids, (std::vector<double>{93.0, 92.0, 91.0}));
+    EXPECT_EQ(asks, (std::vector<double>{100.5, 101.0, 102.0}));
+
+    redisFree(redis);
+    server.stop();
+}
+
+TEST(OrderbookProcessorTest, NotifiesInTheBookWritesPipeline)
+{
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    auto* addr = reinterpret_cast<sockaddr*>(&address);
+
+    ASSERT_EQ(bind(listener, addr, sizeof(address)), 0);
+    ASSERT_EQ(listen(listener, 1), 0);
+    ASSERT_EQ(getsockname(listener, addr, &length), 0);
+
+    // Holds every reply back until the notification arrives, which it only does
+    // if it was queued with the book's writes rather than after their replies
+    auto received = std::async(std::launch::async, [listener] {
+        int client = accept(listener, nullptr, nullptr);
+        std::string data;
+        pollfd readable{.fd = client, .events = POLLIN, .revents = 0};
+        std::array<char, 4096> buffer{};
+
+        while (data.find("PUBLISH") == std::string::npos
+               && poll(&readable, 1, 1000) > 0) {
+            auto count = read(client, buffer.data(), buffer.size());
+            if (count <= 0)
+                break;
+
+            data.append(buffer.data(), static_cast<size_t>(count));
+        }
+
+        std::string_view replies = "+OK\r\n:11\r\n:0\r\n";
+        auto written = write(client, replies.data(), replies.size());
+        EXPECT_EQ(written, static_cast<ssize_t>(replies.size()));
+
+        // Until the writer is done reading the replies
+        while (read(client, buffer.data(), buffer.size()) > 0) {}
+
+        close(client);
+        return data;
+    });
+
+    redisContext* redis = redisConnect("127.0.0.1", ntohs(address.sin_port));
+    ASSERT_TRUE(redis != nullptr && redis->err == 0);
+
+    OrderbookProcessor books;
+    books.set_format(BookFormat::PACKED, 3);
+    books.set_notify(NotifyMode::PUBLISH);
+
+    books.process_incoming_snapshot({
+        .venue = Venue::COINBASE,
+        .product_id = "ETH-USD",
+        .bids = {{100.0, 1.0}},
+        .asks = {{101.0, 1.0}},
+    });
+    books.ob_to_redis(redis, "ETH-USD");
+    redisFree(redis);
+
+    auto data = received.get();
+    close(listener);
+
+    // The book, then its L1 hash, then the notification
+    auto book = data.find("ETH-USD-BOOK");
+    auto l1 = data.find("ETH-USD-L1");
+    auto notification = data.find("PUBLISH");
+
+    ASSERT_NE(notification, std::string::npos);
+    EXPECT_LT(book, l1);
+    EXPECT_LT(l1, notification);
+}
+
+TEST(OrderbookProcessorTest, WritesSortedSetsIncrementally)
+{
+    using raccoon::resp::Command;
+
+    raccoon::resp::RespServer server({.store = true});
+    ASSERT_TRUE(server.start());
+
+    redisContext* redis = redisConnect("127.0.0.1", server.port());
+    ASSERT_TRUE(redis != nullptr && redis->err == 0);
+
+    auto read = [redis](const char* command) {
+        auto* reply = static_cast<redisReply*>(redisCommand(redis, command));
+        std::vector<std::string> res;
+
+        // Nil elements come back empty
+        for (size_t i = 0; reply != nullptr && i < reply->elements; i++) {
+            const auto* element = reply->element[i];
+            res.emplace_back(std::string_view(element->str, element->len));
+        }
+
+        freeReplyObject(reply);
+        return res;
+    };
+
+    OrderbookProcessor books;
+    books.set_format(BookFormat::ZSET);
+
+    books.process_incoming_snapshot({
+        .venue = Venue::COINBASE,
+        .product_id = "ETH-USD",
+        .bids = {{100.0, 1.0}, {99.0, 2.0}, {98.0, 3.0}},
+        .asks = {{101.0, 1.0}, {102.0, 2.0}},
+    });
+    books.ob_to_redis(redis, "ETH-USD");
+
+    EXPECT_EQ(server.stats().count(Command::DEL), 1U);
+    EXPECT_EQ(server.stats().count(Command::ZADD), 2U);
+
+    // Only the changed levels go out
+    books.process_incoming_update({
+        .venue = Venue::COINBASE,
+        .product_id = "ETH-USD",
+        .changes = {{Side::BID, 99.0, 0.0}, {Side::BID, 100.0, 5.0}},
+    });
+    books.process_incoming_update({
+        .venue = Venue::COINBASE,
+        .product_id = "ETH-USD",
+        .changes = {{Side::ASK, 101.5, 4.0}},
+    });
+    books.ob_to_redis(redis, "ETH-USD");
+
+    auto stats = server.stats();
+    EXPECT_EQ(stats.count(Command::DEL), 1U);
+    EXPECT_EQ(stats.count(Command::ZADD), 4U);
+    EXPECT_EQ(stats.count(Command::ZREM), 1U);
+    EXPECT_EQ(stats.count(Command::MULTI), 2U);
+
+    // Nothing to write, so only the L1 hash is
+    books.ob_to_redis(redis, "ETH-USD");
+    EXPECT_EQ(server.stats().count(Command::MULTI), 2U);
+
+    using strings = std::vector<std::string>;
+
+    EXPECT_EQ(
+        read("ZREVRANGEBYSCORE ETH-USD-ZBIDS +inf -inf WITHSCORES LIMIT 0 2"),
+        (strings{"100", "100", "98", "98"})
+    );
+    EXPECT_EQ(read("HMGET ETH-USD-ZBIDS-SIZES 100 99 98"), (strings{"5", "", "3"}));
+    EXPECT_EQ(
+        read("ZRANGEBYSCORE ETH-USD-ZASKS -inf (102"), (strings{"101", "101.5"})
+    );
+
+    // A snapshot starts the book over
+    books.process_incoming_snapshot({
+        .venue = Venue::COINBASE,
+        .product_id = "ETH-USD",
+        .bids = {{97.0, 1.0}},
+        .asks = {{103.0, 1.0}},
+    });
+    books.ob_to_redis(redis, "ETH-USD");
+
+    EXPECT_EQ(read("ZRANGEBYSCORE ETH-USD-ZBIDS -inf +inf"), (strings{"97"}));
+    EXPECT_EQ(read("HGETALL ETH-USD-ZASKS-SIZES"), (strings{"103", "1"}));
+
+    redisFree(redis);
+    server.stop();
+}
+
+} // namespace
@@ -0,0 +1,1080 @@
+#include "exchanges/coinbase.hpp"
+#include "mock_exchange/server.hpp"
+#include "utils/buffer_pool.hpp"
+#include "utils/frame_pool.hpp"
+#include "utils/histogram.hpp"
+#include "web/connections/heartbeat.hpp"
+#include "web/connections/ws_frame.hpp"
+#include "web/coro.hpp"
+#include "web/session.hpp"
+
+#include <gtest/gtest.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <random>
+
+using namespace raccoon::web; // NOLINT(*-using-namespace)
+
+namespace {
+
+TEST(WsFrameTest, RoundTripsHeaders)
+{
+    ws::MaskKey mask = {0x12, 0x34, 0x56, 0x78};
+
+    for (uint64_t size : {0UL, 125UL, 126UL, 300UL, 65535UL, 65536UL, 70000UL}) {
+        std::array<uint8_t, ws::MAX_HEADER_SIZE> out{};
+        auto written = ws::encode_header(ws::Opcode::BINARY, size, mask, out.data());
+
+        ws::FrameHeader header;
+        auto parsed = ws::parse_header(std::span(out).first(written), header);
+
+        EXPECT_EQ(parsed, written) << size;
+        EXPECT_EQ(header.payload_size, size);
+        EXPECT_EQ(header.opcode, ws::Opcode::BINARY);
+        EXPECT_TRUE(header.fin);
+        EXPECT_TRUE(header.masked);
+        EXPECT_FALSE(header.compressed);
+        EXPECT_EQ(header.mask, mask);
+
+        // Any less is incomplete
+        EXPECT_EQ(ws::parse_header(std::span(out).first(written - 1), header), 0);
+    }
+}
+
+TEST(WsFrameTest, ParsesServerFrames)
+{
+    ws::FrameHeader header;
+
+    // Compressed, unmasked text
+    std::array<uint8_t, 2> compressed = {0xC1, 0x05};
+    EXPECT_EQ(ws::parse_header(compressed, header), 2);
+    EXPECT_TRUE(header.compressed);
+    EXPECT_FALSE(header.masked);
+    EXPECT_EQ(header.payload_size, 5);
+
+    // First of a fragmented message
+    std::array<uint8_t, 2> fragment = {0x01, 0x05};
+    EXPECT_EQ(ws::parse_header(fragment, header), 2);
+    EXPECT_FALSE(header.fin);
+
+    // RSV2 means nothing to us
+    std::array<uint8_t, 2> reserved = {0xA1, 0x05};
+    EXPECT_EQ(ws::parse_header(reserved, header), ws::FRAME_ERROR);
+
+    // Control frames can't be fragmented, or long
+    std::array<uint8_t, 2> fragmented_ping = {0x09, 0x00};
+    EXPECT_EQ(ws::parse_header(fragmented_ping, header), ws::FRAME_ERROR);
+
+    std::array<uint8_t, 4> long_ping = {0x89, 0x7E, 0x01, 0x00};
+    EXPECT_EQ(ws::parse_header(long_ping, header), ws::FRAME_ERROR);
+}
+
+TEST(WsFrameTest, MasksEveryLength)
+{
+    ws::MaskKey mask = {0xDE, 0xAD, 0xBE, 0xEF};
+    std::mt19937 rng(42); // NOLINT(*-magic-numbers)
+
+    for (size_t size = 0; size < 200; size++) { // NOLINT(*-magic-numbers)
+        std::vector<uint8_t> data(size);
+        for (auto& byte : data)
+            byte = static_cast<uint8_t>(rng());
+
+        auto masked = data;
+        ws::apply_mask(masked, mask);
+
+        for (size_t i = 0; i < size; i++)
+            ASSERT_EQ(masked[i], data[i] ^ mask[i % 4]) << size << " " << i;
+
+        // Masking again unmasks
+        ws::apply_mask(masked, mask);
+        EXPECT_EQ(masked, data);
+    }
+}
+
+TEST(WsFrameTest, AcceptsKey)
+{
+    // From RFC 6455
+    EXPECT_EQ(
+        ws::accept_key("dGhlIHNhbXBsZSBub25jZQ=="), "s3pPLMBiTxaQ9kYGzzhZRbK+xOo="
+    );
+
+    EXPECT_EQ(ws::make_key().size(), 24);
+    EXPECT_NE(ws::make_key(), ws::make_key());
+}
+
+TEST(WsFrameTest, EncodesClose)
+{
+    ws::ClosePayload payload{};
+
+    std::array<uint8_t, 3> reason = {'b', 'y', 'e'};
+    EXPECT_EQ(ws::encode_close(1001, reason, payload), 5); // NOLINT(*-magic-numbers)
+    EXPECT_EQ(payload[0], 0x03);
+    EXPECT_EQ(payload[1], 0xE9);
+    EXPECT_EQ(payload[2], 'b');
+
+    // Longer reasons are cut to fit a control frame
+    std::vector<uint8_t> reason_long(200, 'x'); // NOLINT(*-magic-numbers)
+    EXPECT_EQ(ws::encode_close(1000, reason_long, payload), ws::MAX_CONTROL_PAYLOAD);
+}
+
+TEST(BufferPoolTest, ReusesBuffers)
+{
+    raccoon::utils::BufferPool pool(2, 1024); // NOLINT(*-magic-numbers)
+
+    auto buf = pool.acquire();
+    buf.resize(100); // NOLINT(*-magic-numbers)
+    const auto* data = buf.data();
+
+    pool.release(std::move(buf));
+    EXPECT_EQ(pool.size(), 1);
+
+    // Same memory, emptied
+    auto again = pool.acquire();
+    EXPECT_TRUE(again.empty());
+    EXPECT_EQ(again.data(), data);
+    EXPECT_EQ(pool.size(), 0);
+
+    // Too big to keep
+    std::vector<uint8_t> big(2048); // NOLINT(*-magic-numbers)
+    pool.release(std::move(big));
+    EXPECT_EQ(pool.size(), 0);
+
+    // Or too many
+    for (int i = 0; i < 3; i++)
+        pool.release(std::vector<uint8_t>(10)); // NOLINT(*-magic-numbers)
+
+    EXPECT_EQ(pool.size(), 2);
+}
+
+TEST(FramePoolTest, ReusesFrames)
+{
+    raccoon::utils::FramePool pool;
+
+    auto* frame = pool.allocate(100); // NOLINT(*-magic-numbers)
+    pool.deallocate(frame, 100);      // NOLINT(*-magic-numbers)
+    EXPECT_EQ(pool.size(), 1);
+
+    // Any size in the same step
+    EXPECT_EQ(pool.allocate(CORO_FRAME_STEP * 2), frame);
+    EXPECT_EQ(pool.size(), 0);
+    pool.deallocate(frame, CORO_FRAME_STEP * 2);
+
+    // But not another
+    auto* small = pool.allocate(1);
+    EXPECT_NE(small, frame);
+    pool.deallocate(small, 1);
+    EXPECT_EQ(pool.size(), 2);
+
+    // Too big to keep
+    auto* big = pool.allocate(CORO_FRAME_MAX_SIZE + 1);
+    pool.deallocate(big, CORO_FRAME_MAX_SIZE + 1);
+    EXPECT_EQ(pool.size(), 2);
+}
+
+raccoon::web::Task
+sleep_then_count(uv_loop_t* loop, std::chrono::milliseconds duration, int& woken)
+{
+    co_await raccoon::web::sleep(loop, duration);
+    woken++;
+}
+
+TEST(CoroutineTest, SleepsOnTheLoop)
+{
+    using clock = std::chrono::steady_clock;
+
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+
+    auto& frames = raccoon::utils::FramePool::local();
+    int woken = 0;
+
+    // Runs until it sleeps
+    sleep_then_count(&loop, std::chrono::milliseconds(20), woken); // NOLINT
+    sleep_then_count(&loop, std::chrono::milliseconds(0), woken);
+    EXPECT_EQ(woken, 0);
+
+    auto start = clock::now();
+    uv_run(&loop, UV_RUN_DEFAULT);
+
+    EXPECT_EQ(woken, 2);
+    EXPECT_GE(clock::now() - start, std::chrono::milliseconds(20)); // NOLINT
+
+    // Both frames were kept, and the next coroutine takes one
+    auto kept = frames.size();
+    EXPECT_GE(kept, 2);
+
+    sleep_then_count(&loop, std::chrono::milliseconds(0), woken);
+    EXPECT_EQ(frames.size(), kept - 1);
+
+    uv_run(&loop, UV_RUN_DEFAULT);
+    EXPECT_EQ(woken, 3);
+    EXPECT_EQ(frames.size(), kept);
+
+    EXPECT_EQ(uv_loop_close(&loop), 0);
+}
+
+TEST(HistogramTest, BoundsPercentiles)
+{
+    raccoon::utils::Histogram histogram;
+    EXPECT_EQ(histogram.percentile(99), 0); // NOLINT(*-magic-numbers)
+
+    for (uint64_t us = 1; us <= 100; us++) // NOLINT(*-magic-numbers)
+        histogram.record(us);
+
+    histogram.record(std::chrono::milliseconds(5)); // NOLINT(*-magic-numbers)
+
+    EXPECT_EQ(histogram.count(), 101);
+    EXPECT_EQ(histogram.max_us(), 5000);
+
+    // Within a factor of two above
+    auto p50 = histogram.percentile(50); // NOLINT(*-magic-numbers)
+    EXPECT_GE(p50, 50);
+    EXPECT_LT(p50, 100);
+
+    EXPECT_EQ(histogram.percentile(100), 5000); // NOLINT(*-magic-numbers)
+}
+
+TEST(HeartbeatTest, PingsThenGoesStale)
+{
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+
+    Heartbeat beat;
+    int pings = 0;
+    std::vector<bool> statuses;
+
+    beat.init(
+        &loop,
+        [&pings] { pings++; },
+        [&](bool stale, auto /* silent */) {
+            statuses.push_back(stale);
+
+            // Answered once it's stale, as a reopened connection would
+            if (stale)
+                beat.on_data();
+        },
+        10, // NOLINT(*-magic-numbers)
+        50  // NOLINT(*-magic-numbers)
+    );
+
+    beat.start();
+    EXPECT_TRUE(beat.running());
+
+    // The timer doesn't keep the loop alive on its own
+    auto* stopper = new uv_timer_t; // NOLINT(*-owning-memory)
+    uv_timer_init(&loop, stopper);
+    uv_timer_start(stopper, [](uv_timer_t* timer) { uv_stop(timer->loop); }, 200, 0);
+
+    // A pong to the first ping, then silence
+    while (pings == 0)
+        uv_run(&loop, UV_RUN_ONCE);
+
+    beat.on_pong();
+    EXPECT_EQ(beat.rtt().count(), 1);
+
+    uv_run(&loop, UV_RUN_DEFAULT);
+
+    // Went stale, then was live again on data
+    ASSERT_GE(statuses.size(), 2);
+    EXPECT_TRUE(statuses[0]);
+    EXPECT_FALSE(statuses[1]);
+    EXPECT_FALSE(beat.stale());
+
+    beat.stop();
+    EXPECT_FALSE(beat.running());
+}
+
+struct native_run {
+    std::vector<std::string> messages;
+    bool compressed = false;
+};
+
+/**
+ * Subscribe to the mock exchange with a native WebSocket connection, and close it
+ * after some messages.
+ */
+native_run
+receive_from_mock(int port, bool deflate, size_t count)
+{
+    // Neither the session nor the server can be torn down, so each run's live on
+    // NOLINTBEGIN(*-owning-memory)
+    auto* loop = new uv_loop_t;
+    uv_loop_init(loop);
+
+    raccoon::mock::TrafficConfig config;
+    config.rate = 5000; // NOLINT(*-magic-numbers)
+
+    auto* server = new raccoon::mock::MockServer(loop, config);
+    server->set_deflate(deflate);
+
+    if (!server->listen("127.0.0.1", port))
+        return {};
+
+    auto* session = new Session(loop);
+    // NOLINTEND(*-owning-memory)
+
+    native_run run;
+
+    auto on_data = [&](NativeWebSocketConnection* conn, std::span<const uint8_t> data) {
+        std::string message(data.begin(), data.end());
+
+        if (message == PROXY_FIRST_MESSAGE) {
+            std::string subscribe =
+                R"({"type":"subscribe","product_ids":["ETH-USD"],)"
+                R"("channels":["level2_batch","matches"]})";
+
+            conn->send(subscribe);
+            return;
+        }
+
+        // Messages may still arrive until the server answers our close
+        if (!conn->ready())
+            return;
+
+        run.messages.push_back(std::move(message));
+
+        if (run.messages.size() == count)
+            conn->close();
+    };
+
+    auto conn =
+        session->native_ws(fmt::format("ws://127.0.0.1:{}/feed", port), on_data);
+
+    // Give up rather than hang
+    auto* timeout = new uv_timer_t; // NOLINT(*-owning-memory)
+    uv_timer_init(loop, timeout);
+
+    uv_timer_start(
+        timeout,
+        [](uv_timer_t* timer) {
+            ADD_FAILURE() << "Timed out";
+            uv_stop(timer->loop);
+        },
+        5000, // NOLINT(*-magic-numbers)
+        0
+    );
+
+    // Stops once the connection is closed
+    uv_run(loop, UV_RUN_DEFAULT);
+
+    EXPECT_FALSE(conn->open());
+    run.compressed = conn->compressed();
+
+    return run;
+}
+
+void
+expect_feed(const native_run& run, size_t count)
+{
+    ASSERT_EQ(run.messages.size(), count);
+
+    EXPECT_TRUE(run.messages[0].starts_with(R"({"type":"subscriptions")"));
+    EXPECT_TRUE(run.messages[1].starts_with(R"({"type":"snapshot")"));
+
+    for (size_t i = 2; i < count; i++) {
+        const auto& message = run.messages[i];
+
+        EXPECT_TRUE(
+            message.starts_with(R"({"type":"l2update")")
+            || message.starts_with(R"({"type":"match")")
+        ) << message;
+
+        EXPECT_EQ(message.back(), '}');
+    }
+}
+
+TEST(NativeWebSocketTest, ReceivesFromMockExchange)
+{
+    constexpr size_t COUNT = 200;
+
+    auto run = receive_from_mock(28675, false, COUNT); // NOLINT(*-magic-numbers)
+
+    EXPECT_FALSE(run.compressed);
+    expect_feed(run, COUNT);
+}
+
+TEST(NativeWebSocketTest, InflatesCompressedMessages)
+{
+    constexpr size_t COUNT = 200;
+
+    auto run = receive_from_mock(28676, true, COUNT); // NOLINT(*-magic-numbers)
+
+    EXPECT_TRUE(run.compressed);
+    expect_feed(run, COUNT);
+}
+
+TEST(NativeWebSocketTest, StandbyTakesOver)
+{
+    using clock = std::chrono::steady_clock;
+    constexpr size_t COUNT = 100;
+    constexpr int PORT = 28677;
+
+    // NOLINTBEGIN(*-owning-memory)
+    auto* loop = new uv_loop_t;
+    uv_loop_init(loop);
+
+    raccoon::mock::TrafficConfig config;
+    config.rate = 5000; // NOLINT(*-magic-numbers)
+
+    auto* server = new raccoon::mock::MockServer(loop, config);
+    ASSERT_TRUE(server->listen("127.0.0.1", PORT));
+
+    auto* session = new Session(loop);
+    // NOLINTEND(*-owning-memory)
+
+    std::vector<NativeWebSocketConnection*> senders;
+    clock::time_point last_before;
+    clock::duration blackout{};
+
+    auto on_data = [&](NativeWebSocketConnection* conn, std::span<const uint8_t> data) {
+        std::string message(data.begin(), data.end());
+
+        // Both subscribe, but only one is read from
+        if (message == PROXY_FIRST_MESSAGE) {
+            conn->send(
+                R"({"type":"subscribe","product_ids":["ETH-USD"],)"
+                R"("channels":["level2_batch"]})"
+            );
+            return;
+        }
+
+        if (conn->standby() || !conn->ready())
+            return;
+
+        if (!senders.empty() && senders.back() != conn)
+            blackout = clock::now() - last_before;
+
+        senders.push_back(conn);
+        last_before = clock::now();
+
+        // Fail the active one, then stop once the standby has been read from
+        if (senders.size() == COUNT || senders.size() == 2 * COUNT)
+            conn->close();
+    };
+
+    auto conn =
+        session->native_ws(fmt::format("ws://127.0.0.1:{}/feed", PORT), on_data, true);
+
+    auto* timeout = new uv_timer_t; // NOLINT(*-owning-memory)
+    uv_timer_init(loop, timeout);
+
+    uv_timer_start(
+        timeout,
+        [](uv_timer_t* timer) {
+            ADD_FAILURE() << "Timed out";
+            uv_stop(timer->loop);
+        },
+        5000, // NOLINT(*-magic-numbers)
+        0
+    );
+
+    uv_run(loop, UV_RUN_DEFAULT);
+
+    ASSERT_EQ(senders.size(), 2 * COUNT);
+    EXPECT_EQ(senders.front(), conn.get());
+    EXPECT_NE(senders.back(), conn.get());
+    EXPECT_TRUE(conn->standby());
+
+    // Only as long as it took the first to close, without reconnecting
+    EXPECT_GT(blackout, clock::duration::zero());
+    EXPECT_LT(blackout, std::chrono::milliseconds(500)); // NOLINT(*-magic-numbers)
+
+    auto blackout_ms = std::chrono::duration<double, std::milli>(blackout).count();
+    RecordProperty("blackout_ms", fmt::format("{:.3f}", blackout_ms));
+}
+
+/**
+ * A book built from a feed's level2 messages.
+ */
+struct feed_book {
+    raccoon::exchanges::CoinbaseAdapter adapter;
+    std::map<double, double> bids;
+    std::map<double, double> asks;
+    size_t snapshots = 0;
+
+    void
+    apply(std::string_view message)
+    {
+        using namespace raccoon::exchanges; // NOLINT(*-using-namespace)
+
+        adapter.parse(message, [this](const auto& event) {
+            using Event = std::decay_t<decltype(event)>;
+
+            if constexpr (std::is_same_v<Event, BookSnapshot>) {
+                bids.clear();
+                asks.clear();
+                snapshots++;
+
+                for (const auto& level : event.bids)
+                    bids[level.price] = level.size;
+                for (const auto& level : event.asks)
+                    asks[level.price] = level.size;
+            }
+            else if constexpr (std::is_same_v<Event, BookDelta>) {
+                for (const auto& change : event.changes) {
+                    auto& side = change.side == Side::BID ? bids : asks;
+
+                    if (change.size > 0)
+                        side[change.price] = change.size;
+                    else
+                        side.erase(change.price);
+                }
+            }
+        });
+    }
+};
+
+TEST(NativeWebSocketTest, StandbySubscribesAgainAfterTakingOver)
+{
+    constexpr int PORT = 28679;
+    constexpr size_t BEFORE = 200; // read before the active connection stalls
+    constexpr size_t AFTER = 500;  // read from the standby once it took over
+
+    constexpr std::string_view SUBSCRIBE =
+        R"({"type":"subscribe","product_ids":["ETH-USD"],)"
+        R"("channels":["level2_batch"]})";
+    constexpr std::string_view UNSUBSCRIBE =
+        R"({"type":"unsubscribe","product_ids":["ETH-USD"],)"
+        R"("channels":["level2_batch"]})";
+
+    // NOLINTBEGIN(*-owning-memory)
+    auto* loop = new uv_loop_t;
+    uv_loop_init(loop);
+
+    raccoon::mock::TrafficConfig config;
+    config.rate = 5000; // NOLINT(*-magic-numbers)
+
+    auto* server = new raccoon::mock::MockServer(loop, config);
+    ASSERT_TRUE(server->listen("127.0.0.1", PORT));
+
+    auto* session = new Session(loop);
+    // NOLINTEND(*-owning-memory)
+
+    // Quick to go stale, so the standby takes over soon after the stall
+    using std::chrono::milliseconds;
+    session->set_heartbeat(milliseconds(20), milliseconds(150)); // NOLINT(*-magic-*)
+
+    std::shared_ptr<NativeWebSocketConnection> feed;
+    feed_book book;
+    feed_book reference;
+
+    // The active connection subscribes first, so it's the one stalled
+    std::vector<NativeWebSocketConnection*> waiting;
+    bool first_subscribed = false;
+
+    auto greeted = [&](NativeWebSocketConnection* conn) {
+        if (conn == feed.get() || first_subscribed)
+            conn->send(SUBSCRIBE);
+        else
+            waiting.push_back(conn);
+    };
+
+    auto subscribed = [&](std::string_view message) {
+        if (first_subscribed || !message.starts_with(R"({"type":"subscriptions")"))
+            return;
+
+        first_subscribed = true;
+
+        for (auto* conn : waiting)
+            conn->send(SUBSCRIBE);
+    };
+
+    NativeWebSocketConnection* reading = nullptr;
+    size_t took_over_at = 0; // snapshots by then
+    size_t read_before = 0;
+    size_t read_after = 0;
+
+    auto on_data = [&](NativeWebSocketConnection* conn, std::span<const uint8_t> data) {
+        std::string message(data.begin(), data.end());
+
+        if (message == PROXY_FIRST_MESSAGE) {
+            greeted(conn);
+            return;
+        }
+
+        subscribed(message);
+
+        if (conn->standby() || !conn->ready())
+            return;
+
+        // As read_coinbase() does, after missing what came while the other stalled
+        if (reading != nullptr && reading != conn) {
+            conn->send(UNSUBSCRIBE);
+            conn->send(SUBSCRIBE);
+            took_over_at = book.snapshots;
+        }
+
+        reading = conn;
+        book.apply(message);
+
+        if (conn == feed.get() && ++read_before == BEFORE)
+            server->stall(0);
+
+        // Once it started over, read some more, then let the feed settle to compare
+        bool started_over = took_over_at != 0 && book.snapshots > took_over_at;
+
+        if (started_over && ++read_after == AFTER) {
+            server->set_rate(0);
+
+            auto* settle = new uv_timer_t; // NOLINT(*-owning-memory)
+            uv_timer_init(loop, settle);
+            uv_timer_start(
+                settle,
+                [](uv_timer_t* timer) { uv_stop(timer->loop); },
+                100, // NOLINT(*-magic-numbers)
+                0
+            );
+        }
+    };
+
+    auto on_reference = [&](NativeWebSocketConnection* conn, auto data) {
+        std::string message(data.begin(), data.end());
+
+        if (message == PROXY_FIRST_MESSAGE)
+            greeted(conn);
+        else if (conn->ready())
+            reference.apply(message);
+    };
+
+    auto url = fmt::format("ws://127.0.0.1:{}/feed", PORT);
+    feed = session->native_ws(url, on_data, true);
+    auto other = session->native_ws(url, on_reference);
+
+    auto* timeout = new uv_timer_t; // NOLINT(*-owning-memory)
+    uv_timer_init(loop, timeout);
+
+    uv_timer_start(
+        timeout,
+        [](uv_timer_t* timer) {
+            ADD_FAILURE() << "Timed out";
+            uv_stop(timer->loop);
+        },
+        5000, // NOLINT(*-magic-numbers)
+        0
+    );
+
+    uv_run(loop, UV_RUN_DEFAULT);
+
+    ASSERT_GE(read_after, AFTER);
+    EXPECT_TRUE(feed->standby());
+
+    // A snapshot on subscribing, and another on subscribing again
+    EXPECT_GE(book.snapshots, 2U);
+    EXPECT_FALSE(reference.bids.empty());
+    EXPECT_EQ(book.bids, reference.bids);
+    EXPECT_EQ(book.asks, reference.asks);
+}
+
+/**
+ * Read a feed with co_await, falling behind for a while halfway.
+ */
+raccoon::web::Task
+read_feed(
+    Session& session,
+    NativeWebSocketConnection* conn,
+    size_t count,
+    native_run& run,
+    bool& finished
+)
+{
+    while (auto data = co_await conn->next_message()) {
+        std::string message(data->begin(), data->end());
+
+        if (message == PROXY_FIRST_MESSAGE) {
+            conn->send(
+                R"({"type":"subscribe","product_ids":["ETH-USD"],)"
+                R"("channels":["level2_batch","matches"]})"
+            );
+            continue;
+        }
+
+        if (!conn->ready() || run.messages.size() == count)
+            continue;
+
+        run.messages.push_back(std::move(message));
+
+        if (run.messages.size() == count / 2)
+            co_await session.sleep(std::chrono::milliseconds(20)); // NOLINT
+
+        if (run.messages.size() == count)
+            conn->close();
+    }
+
+    finished = true;
+}
+
+TEST(NativeWebSocketTest, ReadsWithCoroutine)
+{
+    constexpr size_t COUNT = 200;
+    constexpr int PORT = 28678;
+
+    // NOLINTBEGIN(*-owning-memory)
+    auto* loop = new uv_loop_t;
+    uv_loop_init(loop);
+
+    raccoon::mock::TrafficConfig config;
+    config.rate = 5000; // NOLINT(*-magic-numbers)
+
+    auto* server = new raccoon::mock::MockServer(loop, config);
+    ASSERT_TRUE(server->listen("127.0.0.1", PORT));
+
+    auto* session = new Session(loop);
+    // NOLINTEND(*-owning-memory)
+
+    auto conn = session->native_ws(fmt::format("ws://127.0.0.1:{}/feed", PORT));
+
+    native_run run;
+    bool finished = false;
+
+    read_feed(*session, conn.get(), COUNT, run, finished);
+
+    uv_run(loop, UV_RUN_DEFAULT);
+
+    // Every message in order, the ones received while asleep from the backlog
+    expect_feed(run, COUNT);
+    EXPECT_TRUE(finished);
+}
+
+constexpr size_t SENT_COUNT = 4096;
+constexpr size_t SENT_SIZE = 8192; // 32 MiB in all, more than loopback buffers take
+
+/**
+ * A message of SENT_SIZE bytes, starting with its number.
+ */
+std::string
+numbered_message(size_t number)
+{
+    auto message = fmt::format("{:06} ", number);
+    message.resize(SENT_SIZE, static_cast<char>('a' + number % 26)); // NOLINT
+    return message;
+}
+
+struct send_run {
+    bool queued = false; // some sends had to wait for the socket
+    size_t pooled = 0;   // send buffers back in the pool once closed
+};
+
+/**
+ * Once subscribed, send the mock exchange more than the socket takes while it
+ * isn't reading, then let it read everything and close.
+ */
+template <class Connection>
+raccoon::web::Task
+send_while_stalled(
+    Session& session,
+    raccoon::mock::MockServer& server,
+    Connection* conn,
+    send_run& run
+)
+{
+    bool subscribed = false;
+
+    while (auto data = co_await conn->next_message()) {
+        std::string message(data->begin(), data->end());
+
+        if (message == PROXY_FIRST_MESSAGE) {
+            conn->send(
+                R"({"type":"subscribe","product_ids":["ETH-USD"],)"
+                R"("channels":["matches"]})"
+            );
+            continue;
+        }
+
+        if (message.starts_with(R"({"type":"subscriptions")")) {
+            subscribed = true;
+            break;
+        }
+    }
+
+    if (!subscribed)
+        co_return;
+
+    server.set_reading(0, false);
+
+    for (size_t i = 0; i < SENT_COUNT; ++i)
+        conn->send(numbered_message(i));
+
+    if constexpr (std::is_same_v<Connection, NativeWebSocketConnection>)
+        run.queued = conn->queued_bytes() > 0;
+    else
+        run.queued = conn->pending_sends() > 0;
+
+    // The socket stays full for a while, then everything is read
+    co_await session.sleep(std::chrono::milliseconds(20)); // NOLINT
+    server.set_reading(0, true);
+
+    while (server.received().size() < SENT_COUNT)
+        co_await session.sleep(std::chrono::milliseconds(5)); // NOLINT
+
+    conn->close();
+}
+
+/**
+ * Run send_while_stalled() against a mock exchange on the port.
+ *
+ * @param open Opens a connection to a URL from the Session, without a callback.
+ */
+template <class Open>
+send_run
+send_to_stalled_mock(int port, Open open)
+{
+    // NOLINTBEGIN(*-owning-memory)
+    auto* loop = new uv_loop_t;
+    uv_loop_init(loop);
+
+    // No traffic, the server only reads
+    raccoon::mock::TrafficConfig config;
+    config.rate = 0;
+
+    auto* server = new raccoon::mock::MockServer(loop, config);
+
+    if (!server->listen("127.0.0.1", port))
+        return {};
+
+    auto* session = new Session(loop);
+    // NOLINTEND(*-owning-memory)
+
+    auto conn = open(*session, fmt::format("ws://127.0.0.1:{}/feed", port));
+
+    send_run run;
+    send_while_stalled(*session, *server, conn.get(), run);
+
+    auto* timeout = new uv_timer_t; // NOLINT(*-owning-memory)
+    uv_timer_init(loop, timeout);
+
+    uv_timer_start(
+        timeout,
+        [](uv_timer_t* timer) {
+            ADD_FAILURE() << "Timed out";
+            uv_stop(timer->loop);
+        },
+        5000, // NOLINT(*-magic-numbers)
+        0
+    );
+
+    // Stops once the connection is closed
+    uv_run(loop, UV_RUN_DEFAULT);
+
+    run.pooled = conn->pooled_buffers();
+
+    // Every message whole, in the order sent
+    const auto& received = server->received();
+    EXPECT_EQ(received.size(), SENT_COUNT);
+
+    for (size_t i = 0; i < std::min(received.size(), SENT_COUNT); ++i) {
+        if (received[i] != numbered_message(i)) {
+            ADD_FAILURE() << "Message " << i << " is " << received[i].substr(0, 7);
+            break;
+        }
+    }
+
+    return run;
+}
+
+TEST(NativeWebSocketTest, QueuesWhatTheSocketCantTake)
+{
+    auto run = send_to_stalled_mock(28680, [](Session& session, const auto& url) {
+        return session.native_ws(url);
+    });
+
+    EXPECT_TRUE(run.queued);
+
+    // More frames were out at once than the pool keeps, and it filled up again
+    EXPECT_EQ(run.pooled, WS_SEND_POOL_BUFFERS);
+}
+
+TEST(WebSocketTest, QueuesWhatCurlCantTake)
+{
+    const auto* info = curl_version_info(CURLVERSION_NOW);
+    bool has_ws = false;
+
+    for (const auto* const* protocol = info->protocols; *protocol; ++protocol)
+        has_ws = has_ws || std::string_view(*protocol) == "ws";
+
+    if (!has_ws)
+        GTEST_SKIP() << "libcurl was built without WebSockets";
+
+    auto run = send_to_stalled_mock(28681, [](Session& session, const auto& url) {
+        return session.ws(url);
+    });
+
+    EXPECT_TRUE(run.queued);
+    EXPECT_EQ(run.pooled, WS_SEND_POOL_BUFFERS);
+}
+
+TEST(NativeWebSocketTest, FailsOnBadUrl)
+{
+    auto* loop = new uv_loop_t; // NOLINT(*-owning-memory)
+    uv_loop_init(loop);
+
+    auto* session = new Session(loop); // NOLINT(*-owning-memory)
+
+    auto conn = session->native_ws("http://127.0.0.1:1/", [](auto*, auto) {});
+    EXPECT_FALSE(conn->open());
+}
+
+/**
+ * Write a self-signed certificate for 127.0.0.1, and its key, as PEM files in the
+ * temporary directory.
+ *
+ * @returns std::pair<std::string, std::string> The certificate and key paths.
+ */
+std::pair<std::string, std::string>
+write_test_certificate()
+{
+    constexpr long VALID_FOR_S = 3600;
+
+    auto dir = std::filesystem::temp_directory_path();
+    auto cert_path = (dir / "raccoon_test_cert.pem").string();
+    auto key_path = (dir / "raccoon_test_key.pem").string();
+
+    EVP_PKEY* key = EVP_EC_gen("P-256"); // NOLINT(*-cstyle-cast)
+    X509* cert = X509_new();
+
+    X509_set_version(cert, 2); // v3, for the extension
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), VALID_FOR_S);
+    X509_set_pubkey(cert, key);
+
+    auto* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(
+        name,
+        "CN",
+        MBSTRING_ASC,
+        reinterpret_cast<const unsigned char*>("raccoon test"), // NOLINT
+        -1,
+        -1,
+        0
+    );
+    X509_set_issuer_name(cert, name);
+
+    // Both clients check the address they connect to against this
+    X509V3_CTX ctx{};
+    X509V3_set_ctx(&ctx, cert, cert, nullptr, nullptr, 0);
+
+    auto* san =
+        X509V3_EXT_conf_nid(nullptr, &ctx, NID_subject_alt_name, "IP:127.0.0.1");
+    X509_add_ext(cert, san, -1);
+    X509_EXTENSION_free(san);
+
+    X509_sign(cert, key, EVP_sha256());
+
+    FILE* cert_file = std::fopen(cert_path.c_str(), "w");
+    PEM_write_X509(cert_file, cert);
+    std::fclose(cert_file);
+
+    FILE* key_file = std::fopen(key_path.c_str(), "w");
+    PEM_write_PrivateKey(key_file, key, nullptr, nullptr, 0, nullptr, nullptr);
+    std::fclose(key_file);
+
+    X509_free(cert);
+    EVP_PKEY_free(key);
+
+    return {cert_path, key_path};
+}
+
+/**
+ * Start a mock exchange serving TLS with a new certificate, which clients trust
+ * through SSL_CERT_FILE. Call before any TLS connection, the native client reads
+ * it once.
+ */
+raccoon::mock::MockServer*
+listen_with_tls(uv_loop_t* loop, int port)
+{
+    auto [cert, key] = write_test_certificate();
+    setenv("SSL_CERT_FILE", cert.c_str(), 1); // NOLINT(concurrency-*)
+
+    raccoon::mock::TrafficConfig config;
+    config.rate = 0;
+
+    auto* server = new raccoon::mock::MockServer(loop, config); // NOLINT
+
+    if (!server->set_tls(cert, key) || !server->listen("127.0.0.1", port))
+        return nullptr;
+
+    return server;
+}
+
+/**
+ * Open a connection twice in a row, each closed once it's upgraded.
+ */
+raccoon::web::Task
+upgrade_twice(Session& session, std::string url, size_t& upgraded)
+{
+    for (int i = 0; i < 2; i++) {
+        auto conn = session.native_ws(url);
+
+        if (co_await conn->next_message())
+            upgraded++;
+
+        conn->close();
+    }
+}
+
+TEST(NativeWebSocketTest, ResumesTlsSessions)
+{
+    constexpr int PORT = 28682;
+
+    auto* loop = new uv_loop_t; // NOLINT(*-owning-memory)
+    uv_loop_init(loop);
+
+    auto* server = listen_with_tls(loop, PORT);
+    ASSERT_NE(server, nullptr);
+
+    auto* session = new Session(loop); // NOLINT(*-owning-memory)
+
+    size_t upgraded = 0;
+    upgrade_twice(*session, fmt::format("wss://127.0.0.1:{}/feed", PORT), upgraded);
+
+    // Stops once the second connection is closed
+    uv_run(loop, UV_RUN_DEFAULT);
+
+    // The second handshake resumed the session the first was given
+    EXPECT_EQ(upgraded, 2);
+    EXPECT_EQ(server->tls_resumed(), 1);
+}
+
+/**
+ * Make a request twice in a row, counting the responses.
+ */
+raccoon::web::Task
+get_twice(Session& session, std::string url, size_t& answered)
+{
+    for (int i = 0; i < 2; i++) {
+        // The mock only speaks WebSocket, so turns these away once it has them
+        auto response = co_await session.http_get(url);
+
+        if (response.status == 400) // NOLINT(*-magic-numbers)
+            answered++;
+    }
+}
+
+TEST(HttpTest, ResumesTlsSessionsThroughTheShare)
+{
+    constexpr int PORT = 28683;
+
+    auto* loop = new uv_loop_t; // NOLINT(*-owning-memory)
+    uv_loop_init(loop);
+
+    auto* server = listen_with_tls(loop, PORT);
+    ASSERT_NE(server, nullptr);
+
+    auto* session = new Session(loop); // NOLINT(*-owning-memory)
+
+    size_t answered = 0;
+    get_twice(*session, fmt::format("https://127.0.0.1:{}/", PORT), answered);
+
+    // Stops once the second request is done
+    uv_run(loop, UV_RUN_DEFAULT);
+
+    // Each request is its own easy handle, so only the share has the session
+    EXPECT_EQ(answered, 2);
+    EXPECT_EQ(server->tls_resumed(), 1);
+}
+
+} // namespace
@@ -0,0 +1,49 @@
+#include "latency.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace raccoon {
+namespace latency {
+
+static constexpr double NANOS_PER_MICRO = 1e3;
+
+/**
+ * Nearest-rank percentile of sorted samples, in microseconds.
+ */
+static double
+percentile(const std::vector<int64_t>& sorted, double fraction)
+{
+    auto count = static_cast<double>(sorted.size());
+    auto rank = static_cast<size_t>(std::ceil(fraction * count));
+    auto index = std::clamp<size_t>(rank, 1, sorted.size()) - 1;
+
+    return static_cast<double>(sorted[index]) / NANOS_PER_MICRO;
+}
+
+LatencySummary
+LatencyRecorder::summarize()
+{
+    if (samples_.empty())
+        return {};
+
+    std::ranges::sort(samples_);
+
+    auto total = std::accumulate(samples_.begin(), samples_.end(), 0.0);
+    auto count = static_cast<double>(samples_.size());
+
+    // NOLINTBEGIN(*-magic-numbers)
+    return {
+        .count = samples_.size(),
+        .mean_us = total / count / NANOS_PER_MICRO,
+        .p50_us = percentile(samples_, 0.5),
+        .p99_us = percentile(samples_, 0.99),
+        .p999_us = percentile(samples_, 0.999),
+        .max_us = static_cast<double>(samples_.back()) / NANOS_PER_MICRO,
+    };
+    // NOLINTEND(*-magic-numbers)
+}
+
+} // namespace latency
+} // namespace raccoon
@@ -0,0 +1,195 @@
+#pragma once
+
+#include "common.hpp"
+#include "exchanges/adapter.hpp"
+
+#include <glaze/glaze.hpp>
+
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace raccoon {
+namespace latency {
+
+/**
+ * Wraps an adapter to note the exchange timestamp of every book delta and trade it
+ * decodes, before storage sees them.
+ *
+ * Snapshots are left out; they're rare and far larger than anything else.
+ */
+template <exchanges::ExchangeAdapter Inner>
+class StampedAdapter {
+    Inner inner_;
+    std::vector<int64_t> stamps_;
+
+public:
+    static constexpr exchanges::Venue VENUE = Inner::VENUE;
+
+    template <exchanges::EventHandler Handler>
+    bool
+    parse(std::string_view data, Handler&& handler)
+    {
+        return inner_.parse(data, [this, &handler](const auto& event) {
+            using Event = std::remove_cvref_t<decltype(event)>;
+
+            if constexpr (!std::is_same_v<Event, exchanges::BookSnapshot>)
+                stamps_.push_back(event.timestamp);
+
+            handler(event);
+        });
+    }
+
+    /**
+     * Timestamps noted so far, in nanoseconds since the epoch. Clear them once used.
+     */
+    [[nodiscard]] std::vector<int64_t>&
+    stamps() noexcept
+    {
+        return stamps_;
+    }
+};
+
+/**
+ * Percentiles of a set of latencies, in microseconds.
+ */
+struct LatencySummary {
+    uint64_t count = 0;
+    double mean_us = 0;
+    double p50_us = 0;
+    double p99_us = 0;
+    double p999_us = 0;
+    double max_us = 0;
+};
+
+/**
+ * Collects latencies, in nanoseconds.
+ */
+class LatencyRecorder {
+    std::vector<int64_t> samples_;
+
+public:
+    void
+    add(int64_t nanos)
+    {
+        samples_.push_back(nanos);
+    }
+
+    void
+    clear() noexcept
+    {
+        samples_.clear();
+    }
+
+    [[nodiscard]] size_t
+    size() const noexcept
+    {
+        return samples_.size();
+    }
+
+    /**
+     * Summarize the samples so far. Sorts them.
+     */
+    LatencySummary summarize();
+};
+
+/**
+ * One rate the feed was held at.
+ */
+struct StepResult {
+    double target_rate = 0;   // messages per second sent
+    double achieved_rate = 0; // events stored per second
+    bool sustained = false;   // kept up, within the latency limit
+
+    LatencySummary tick_to_store; // exchange timestamp to Redis write acknowledged
+    LatencySummary processing;    // socket read to Redis write acknowledged
+};
+
+/**
+ * Everything a run found, written out as JSON.
+ */
+struct Report {
+    std::string version;
+    std::string commit;
+    bool dirty = false;
+
+    // Setup
+    size_t products = 0;
+    double match_ratio = 0;
+    size_t depth = 0;
+    uint64_t redis_latency_ms = 0;
+    double step_seconds = 0;
+    double max_p99_us = 0;
+
+    std::vector<StepResult> steps;
+    double max_sustainable_rate = 0; // highest sustained target rate, 0 for none
+};
+
+} // namespace latency
+} // namespace raccoon
+
+template <>
+struct glz::meta<raccoon::latency::LatencySummary> {
+    using T = raccoon::latency::LatencySummary;
+    static constexpr auto value = object(
+        "count",
+        &T::count,
+        "mean_us",
+        &T::mean_us,
+        "p50_us",
+        &T::p50_us,
+        "p99_us",
+        &T::p99_us,
+        "p999_us",
+        &T::p999_us,
+        "max_us",
+        &T::max_us
+    );
+};
+
+template <>
+struct glz::meta<raccoon::latency::StepResult> {
+    using T = raccoon::latency::StepResult;
+    static constexpr auto value = object(
+        "target_rate",
+        &T::target_rate,
+        "achieved_rate",
+        &T::achieved_rate,
+        "sustained",
+        &T::sustained,
+        "tick_to_store",
+        &T::tick_to_store,
+        "processing",
+        &T::processing
+    );
+};
+
+template <>
+struct glz::meta<raccoon::latency::Report> {
+    using T = raccoon::latency::Report;
+    static constexpr auto value = object(
+        "version",
+        &T::version,
+        "commit",
+        &T::commit,
+        "dirty",
+        &T::dirty,
+        "products",
+        &T::products,
+        "match_ratio",
+        &T::match_ratio,
+        "depth",
+        &T::depth,
+        "redis_latency_ms",
+        &T::redis_latency_ms,
+        "step_seconds",
+        &T::step_seconds,
+        "max_p99_us",
+        &T::max_p99_us,
+        "steps",
+        &T::steps,
+        "max_sustainable_rate",
+        &T::max_sustainable_rate
+    );
+};
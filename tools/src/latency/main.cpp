@@ -0,0 +1,443 @@
+#include "common.hpp"
+#include "exchanges/exchanges.hpp"
+#include "git.h"
+#include "latency.hpp"
+#include "mock_exchange/server.hpp"
+#include "resp_server/server.hpp"
+#include "storage/storage.hpp"
+#include "web/web.hpp"
+
+#include <argparse/argparse.hpp>
+#include <curl/curl.h>
+#include <hiredis/hiredis.h>
+#include <uv.h>
+
+#include <fstream>
+#include <iostream>
+#include <ranges>
+#include <thread>
+
+using raccoon::latency::LatencyRecorder;
+using raccoon::latency::Report;
+using raccoon::latency::StampedAdapter;
+using raccoon::latency::StepResult;
+
+static constexpr uint64_t RAMP_TICK_MS = 100;
+static constexpr double MS_PER_SEC = 1e3;
+
+// The feed sends every product whatever we ask for
+static constexpr std::string_view SUBSCRIBE =
+    R"({"type":"subscribe","channels":[{"name":"matches"},{"name":"level2_batch"}]})";
+
+// Share of the target rate that must be stored for a step to count as kept up
+static constexpr double MIN_DELIVERED = 0.95;
+
+struct Options {
+    uint8_t verbosity = 0;
+
+    raccoon::mock::TrafficConfig traffic;
+    raccoon::resp::ServerConfig redis;
+    int feed_port = 0;
+    bool native_ws = false;
+
+    std::vector<double> rates;
+    double step_seconds = 0;
+    double warmup_seconds = 0;
+    double max_p99_us = 0;
+
+    std::string output;
+};
+
+static Options
+process_arguments(int argc, const char** argv)
+{
+    argparse::ArgumentParser program(
+        "raccoon-latency", VERSION, argparse::default_arguments::help
+    );
+
+    program.add_description(
+        "Runs raccoon against a local feed and Redis stand-in at increasing rates, "
+        "measuring how long each event takes to reach Redis."
+    );
+
+    Options options;
+
+    program.add_argument("-v", "--verbose")
+        .help("increase output verbosity")
+        .action([&](const auto& /* unused */) { ++options.verbosity; })
+        .append()
+        .default_value(false)
+        .implicit_value(true)
+        .nargs(0);
+
+    program.add_argument("--rates")
+        .help("comma separated feed rates to step through, in messages per second")
+        .default_value(std::string("1000,2000,5000,10000,20000,50000,100000,200000"));
+
+    program.add_argument("--step")
+        .help("seconds measured at each rate")
+        .default_value(5.0) // NOLINT(*-magic-numbers)
+        .scan<'g', double>();
+
+    program.add_argument("--warmup")
+        .help("seconds at each rate before measuring")
+        .default_value(1.0)
+        .scan<'g', double>();
+
+    program.add_argument("--max-p99")
+        .help("p99 tick-to-store latency a rate may reach and still count, in us")
+        .default_value(1000.0) // NOLINT(*-magic-numbers)
+        .scan<'g', double>();
+
+    program.add_argument("--products")
+        .help("comma separated products to generate")
+        .default_value(std::string("ETH-USD"));
+
+    program.add_argument("--synthetic")
+        .help("extra generated products, named SYN<n>-USD")
+        .default_value(size_t{0})
+        .scan<'u', size_t>();
+
+    program.add_argument("--match-ratio")
+        .help("fraction of messages that are matches")
+        .default_value(0.1) // NOLINT(*-magic-numbers)
+        .scan<'g', double>();
+
+    program.add_argument("--depth")
+        .help("levels per side in each book")
+        .default_value(size_t{200}) // NOLINT(*-magic-numbers)
+        .scan<'u', size_t>();
+
+    program.add_argument("--redis-latency")
+        .help("milliseconds the Redis stand-in holds back replies")
+        .default_value(uint64_t{0})
+        .scan<'u', uint64_t>();
+
+    program.add_argument("--feed-port")
+        .help("port for the local feed")
+        .default_value(8676) // NOLINT(*-magic-numbers)
+        .scan<'i', int>();
+
+    program.add_argument("--native-ws")
+        .help("read the feed with the native WebSocket client, rather than libcurl")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("-o", "--output")
+        .help("file to write the JSON report to")
+        .default_value(std::string("latency.json"));
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        exit(1); // NOLINT(concurrency-*)
+    }
+
+    auto& traffic = options.traffic;
+    traffic.products.clear();
+
+    auto products = program.get<std::string>("--products");
+
+    for (auto product : std::views::split(products, ',')) {
+        if (!product.empty())
+            traffic.products.emplace_back(product.begin(), product.end());
+    }
+
+    for (size_t i = 0; i < program.get<size_t>("--synthetic"); i++)
+        traffic.products.push_back(fmt::format("SYN{}-USD", i));
+
+    traffic.rate = 0; // until the ramp starts
+    traffic.match_ratio = program.get<double>("--match-ratio");
+    traffic.depth = std::max<size_t>(program.get<size_t>("--depth"), 1);
+
+    options.redis.latency_ms = program.get<uint64_t>("--redis-latency");
+    options.feed_port = program.get<int>("--feed-port");
+
+    auto rates = program.get<std::string>("--rates");
+
+    for (auto rate : std::views::split(rates, ',')) {
+        if (!rate.empty())
+            options.rates.push_back(std::stod(std::string(rate.begin(), rate.end())));
+    }
+
+    options.step_seconds = program.get<double>("--step");
+    options.warmup_seconds = program.get<double>("--warmup");
+    options.max_p99_us = program.get<double>("--max-p99");
+    options.output = program.get<std::string>("--output");
+
+    return options;
+}
+
+/**
+ * Steps the feed through each rate, measuring once it has settled, until a rate
+ * can't be kept up with.
+ */
+struct Ramp {
+    const Options& options;
+    raccoon::mock::MockServer& feed;
+    std::shared_ptr<raccoon::web::WebSocketConnection> ws{};
+    std::shared_ptr<raccoon::web::NativeWebSocketConnection> native_ws{};
+
+    bool subscribed = false;
+    bool measuring = false;
+    bool finished = false;
+
+    size_t step = 0;
+    uint64_t step_start_ms = 0; // loop time, 0 before the first step
+
+    LatencyRecorder tick_to_store{};
+    LatencyRecorder processing{};
+    std::vector<StepResult> results{};
+
+    void
+    start_step(uint64_t now)
+    {
+        auto rate = options.rates[step];
+        log_i(main, "Feeding {} msg/s", rate);
+
+        feed.set_rate(rate);
+        step_start_ms = now;
+        measuring = false;
+    }
+
+    void
+    finish_step()
+    {
+        auto stored = static_cast<double>(tick_to_store.size());
+
+        StepResult result{
+            .target_rate = options.rates[step],
+            .achieved_rate = stored / options.step_seconds,
+            .tick_to_store = tick_to_store.summarize(),
+            .processing = processing.summarize(),
+        };
+
+        result.sustained = result.achieved_rate >= result.target_rate * MIN_DELIVERED
+                           && result.tick_to_store.p99_us <= options.max_p99_us;
+
+        log_i(
+            main,
+            "{} msg/s: stored {:.0f}/s, tick-to-store p50 {:.1f}us p99 {:.1f}us "
+            "p99.9 {:.1f}us max {:.1f}us{}",
+            result.target_rate,
+            result.achieved_rate,
+            result.tick_to_store.p50_us,
+            result.tick_to_store.p99_us,
+            result.tick_to_store.p999_us,
+            result.tick_to_store.max_us,
+            result.sustained ? "" : ", falling behind"
+        );
+
+        results.push_back(result);
+    }
+
+    static void
+    on_tick(uv_timer_t* timer)
+    {
+        auto* ramp = static_cast<Ramp*>(timer->data);
+
+        if (!ramp->subscribed)
+            return;
+
+        auto now = uv_now(timer->loop);
+
+        if (ramp->step_start_ms == 0) {
+            ramp->start_step(now);
+            return;
+        }
+
+        auto elapsed = static_cast<double>(now - ramp->step_start_ms) / MS_PER_SEC;
+        const auto& options = ramp->options;
+
+        if (!ramp->measuring) {
+            if (elapsed >= options.warmup_seconds) {
+                ramp->tick_to_store.clear();
+                ramp->processing.clear();
+                ramp->measuring = true;
+            }
+            return;
+        }
+
+        if (elapsed < options.warmup_seconds + options.step_seconds)
+            return;
+
+        ramp->finish_step();
+
+        // Stop at the first rate we can't keep up with
+        if (ramp->results.back().sustained && ++ramp->step < options.rates.size()) {
+            ramp->start_step(now);
+            return;
+        }
+
+        ramp->feed.set_rate(0);
+        ramp->finished = true;
+        if (ramp->native_ws)
+            ramp->native_ws->close();
+        else
+            ramp->ws->close();
+
+        uv_timer_stop(timer);
+        uv_close(reinterpret_cast<uv_handle_t*>(timer), nullptr); // NOLINT
+    }
+};
+
+static bool
+write_report(const Options& options, const std::vector<StepResult>& results)
+{
+    Report report{
+        .version = VERSION,
+        .commit = git_CommitSHA1(),
+        .dirty = git_AnyUncommittedChanges(),
+        .products = options.traffic.products.size(),
+        .match_ratio = options.traffic.match_ratio,
+        .depth = options.traffic.depth,
+        .redis_latency_ms = options.redis.latency_ms,
+        .step_seconds = options.step_seconds,
+        .max_p99_us = options.max_p99_us,
+        .steps = results,
+    };
+
+    for (const auto& step : results) {
+        if (step.sustained) {
+            report.max_sustainable_rate =
+                std::max(report.max_sustainable_rate, step.target_rate);
+        }
+    }
+
+    std::string json;
+    glz::write_json(report, json);
+
+    std::ofstream file(options.output);
+    file << json << '\n';
+
+    if (!file) {
+        log_e(main, "Could not write report to {}", options.output);
+        return false;
+    }
+
+    log_i(
+        main,
+        "Max sustainable rate {} msg/s; report written to {}",
+        report.max_sustainable_rate,
+        options.output
+    );
+    return true;
+}
+
+int
+main(int argc, const char** argv)
+{
+    auto options = process_arguments(argc, argv);
+
+    raccoon::logging::init(options.verbosity);
+
+    if (options.traffic.products.empty() || options.rates.empty()) {
+        log_c(main, "Need at least one product and one rate");
+        return 1;
+    }
+
+    // Redis stand-in, on its own thread
+    raccoon::resp::RespServer redis_server(options.redis);
+
+    if (!redis_server.start())
+        return 1;
+
+    redisContext* redis = redisConnect("127.0.0.1", redis_server.port());
+
+    if (redis == nullptr || redis->err) [[unlikely]] {
+        log_c(main, "Could not connect to the Redis stand-in");
+        return 1;
+    }
+
+    // Feed, on its own loop and thread
+    uv_loop_t feed_loop{};
+    uv_loop_init(&feed_loop);
+
+    raccoon::mock::MockServer feed(&feed_loop, options.traffic);
+
+    if (!feed.listen("127.0.0.1", options.feed_port))
+        return 1;
+
+    uv_async_t feed_stop{};
+    uv_async_init(&feed_loop, &feed_stop, [](uv_async_t* handle) {
+        uv_stop(handle->loop);
+    });
+
+    std::jthread feed_thread([&feed_loop] { uv_run(&feed_loop, UV_RUN_DEFAULT); });
+
+    // raccoon, wired as in its main()
+    if (curl_global_init(CURL_GLOBAL_ALL)) {
+        log_c(main, "Could not initialize cURL");
+        return 1;
+    }
+
+    raccoon::web::Session session;
+    raccoon::storage::DataProcessor prox(redis);
+    StampedAdapter<raccoon::exchanges::CoinbaseAdapter> adapter;
+
+    Ramp ramp{.options = options, .feed = feed};
+
+    auto data_cb = [&](auto* conn, const auto& data) {
+        if (memcmp(data.data(), PROXY_FIRST_MESSAGE, PROXY_FIRST_MESSAGE_LEN) == 0)
+            [[unlikely]]
+        {
+            conn->send(SUBSCRIBE);
+            ramp.subscribed = true;
+            return;
+        }
+
+        auto received = raccoon::mock::unix_nanos();
+        prox.process_incoming_data(adapter, data);
+        auto stored = raccoon::mock::unix_nanos();
+
+        auto& stamps = adapter.stamps();
+
+        if (ramp.measuring) {
+            for (auto stamp : stamps) {
+                ramp.tick_to_store.add(stored - stamp);
+                ramp.processing.add(stored - received);
+            }
+        }
+
+        stamps.clear();
+    };
+
+    auto feed_url = fmt::format("ws://127.0.0.1:{}", options.feed_port);
+
+    if (options.native_ws)
+        ramp.native_ws = session.native_ws(feed_url, data_cb);
+    else
+        ramp.ws = session.ws(feed_url, data_cb);
+
+    uv_timer_t ramp_timer{};
+    uv_timer_init(uv_default_loop(), &ramp_timer);
+    ramp_timer.data = &ramp;
+    uv_timer_start(&ramp_timer, Ramp::on_tick, RAMP_TICK_MS, RAMP_TICK_MS);
+
+    auto status = session.run();
+
+    if (!ramp.finished)
+        log_w(main, "Stopped early with status {}, reporting what we have", status);
+
+    // Cleanup, closing whatever the feed still has open once its thread is done
+    uv_async_send(&feed_stop);
+    feed_thread.join();
+
+    uv_walk(
+        &feed_loop,
+        [](uv_handle_t* handle, void* /* arg */) {
+            if (!uv_is_closing(handle))
+                uv_close(handle, nullptr);
+        },
+        nullptr
+    );
+    uv_run(&feed_loop, UV_RUN_DEFAULT);
+    uv_loop_close(&feed_loop);
+
+    redisFree(redis);
+    redis_server.stop();
+
+    return write_report(options, ramp.results) ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+#include "common.hpp"
+#include "receiver.hpp"
+
+#include <argparse/argparse.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+
+using raccoon::mcast::Receiver;
+using raccoon::mcast::ReceiverConfig;
+using raccoon::mcast::ReceiverStats;
+
+// How long each poll waits, so reports and ^C aren't held up
+static constexpr int POLL_TIMEOUT_MS = 100;
+
+// NOLINTNEXTLINE(*-avoid-non-const-global-variables)
+static volatile std::sig_atomic_t interrupted = 0;
+
+struct Options {
+    uint8_t verbosity = 0;
+    ReceiverConfig config;
+    double duration = 0;
+};
+
+static Options
+process_arguments(int argc, const char** argv)
+{
+    argparse::ArgumentParser program(
+        "raccoon-mcast-receiver", VERSION, argparse::default_arguments::help
+    );
+
+    program.add_description(
+        "Joins raccoon's market data multicast group and reports what it receives "
+        "once a second: rates, sequence gaps and send to receipt latency."
+    );
+
+    Options options;
+
+    program.add_argument("-v", "--verbose")
+        .help("increase output verbosity")
+        .action([&](const auto& /* unused */) { ++options.verbosity; })
+        .append()
+        .default_value(false)
+        .implicit_value(true)
+        .nargs(0);
+
+    program.add_argument("--group")
+        .help("multicast group to join")
+        .default_value(std::string(MULTICAST_GROUP));
+
+    program.add_argument("--port")
+        .help("port the group is sent to")
+        .default_value(MULTICAST_PORT)
+        .scan<'i', int>();
+
+    program.add_argument("--interface")
+        .help("local address to join the group on")
+        .default_value(std::string("127.0.0.1"));
+
+    program.add_argument("--recovery")
+        .help("raccoon's recovery socket, host:port, to catch up and fill gaps from")
+        .default_value(std::string());
+
+    program.add_argument("--duration")
+        .help("seconds to run for, until ^C if 0")
+        .default_value(0.0)
+        .scan<'g', double>();
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        exit(1); // NOLINT(concurrency-*)
+    }
+
+    options.config.group = program.get<std::string>("--group");
+    options.config.port = program.get<int>("--port");
+    options.config.interface = program.get<std::string>("--interface");
+    options.duration = program.get<double>("--duration");
+
+    auto recovery = program.get<std::string>("--recovery");
+
+    if (auto colon = recovery.rfind(':'); colon != std::string::npos) {
+        options.config.recovery_host = recovery.substr(0, colon);
+        options.config.recovery_port = std::stoi(recovery.substr(colon + 1));
+    }
+    else if (!recovery.empty()) {
+        std::cerr << "--recovery takes host:port" << std::endl;
+        exit(1); // NOLINT(concurrency-*)
+    }
+
+    return options;
+}
+
+/**
+ * Log what was received since the last report.
+ */
+static void
+report(
+    const ReceiverStats& now, const ReceiverStats& last, std::vector<int64_t>& latencies
+)
+{
+    constexpr double NS_PER_US = 1e3;
+
+    auto percentile = [&latencies](double pct) {
+        if (latencies.empty())
+            return 0.0;
+
+        auto idx = static_cast<size_t>(pct * static_cast<double>(latencies.size() - 1));
+        return static_cast<double>(latencies[idx]) / NS_PER_US;
+    };
+
+    std::sort(latencies.begin(), latencies.end());
+
+    log_i(
+        main,
+        "{} pkt/s, {} msg/s ({} levels, {} tops, {} trades); {} gaps, {} missed, "
+        "{} recovered so far; latency p50 {:.1f} us, p99 {:.1f} us, max {:.1f} us",
+        now.packets - last.packets,
+        now.messages - last.messages,
+        now.levels - last.levels,
+        now.tops - last.tops,
+        now.trades - last.trades,
+        now.gaps,
+        now.missed,
+        now.recovered,
+        percentile(0.5),  // NOLINT(*-magic-numbers)
+        percentile(0.99), // NOLINT(*-magic-numbers)
+        percentile(1.0)
+    );
+
+    latencies.clear();
+}
+
+int
+main(int argc, const char** argv)
+{
+    auto options = process_arguments(argc, argv);
+
+    raccoon::logging::init(options.verbosity);
+
+    bool recovery = !options.config.recovery_host.empty();
+    Receiver receiver(std::move(options.config));
+
+    if (!receiver.ok())
+        return 1;
+
+    // Joined first, so nothing sent after the snapshot is missed
+    if (recovery && !receiver.request_snapshot())
+        return 1;
+
+    std::signal(SIGINT, [](int /* signum */) { interrupted = 1; });
+
+    using clock = std::chrono::steady_clock;
+
+    auto start = clock::now();
+    auto end = start + std::chrono::duration<double>(options.duration);
+    auto next_report = start + std::chrono::seconds(1);
+    auto last = receiver.stats();
+
+    while (interrupted == 0 && (options.duration <= 0 || clock::now() < end)) {
+        receiver.poll(POLL_TIMEOUT_MS);
+
+        if (clock::now() < next_report)
+            continue;
+
+        report(receiver.stats(), last, receiver.latencies());
+        last = receiver.stats();
+        next_report += std::chrono::seconds(1);
+    }
+
+    const auto& stats = receiver.stats();
+
+    log_i(
+        main,
+        "Received {} packets, {} messages; {} gaps, {} missed, {} recovered, "
+        "{} duplicates, {} invalid",
+        stats.packets,
+        stats.messages,
+        stats.gaps,
+        stats.missed,
+        stats.recovered,
+        stats.duplicates,
+        stats.invalid
+    );
+
+    // Missed messages that weren't recovered mean the books are wrong
+    return stats.missed == stats.recovered ? 0 : 2;
+}
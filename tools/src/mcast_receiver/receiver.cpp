@@ -0,0 +1,401 @@
+#include "receiver.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+
+namespace raccoon {
+namespace mcast {
+
+using market_data::Message;
+using market_data::MessageType;
+using market_data::PacketHeader;
+
+// Largest datagram accepted
+static constexpr size_t MAX_DATAGRAM = 65536;
+
+// Kernel receive buffer asked for, so bursts aren't dropped while we're busy
+static constexpr int RECEIVE_BUFFER = 4 << 20;
+
+// How long the recovery socket may take to reply
+static constexpr long RECOVERY_TIMEOUT_SEC = 5;
+
+static int64_t
+now_nanos()
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+/**
+ * Read exactly `len` bytes from a blocking socket into `out`.
+ */
+static bool
+read_exact(int fd, std::string& out, size_t len)
+{
+    out.resize(len);
+    size_t done = 0;
+
+    while (done < len) {
+        auto nread = ::recv(fd, out.data() + done, len - done, 0);
+
+        if (nread < 0 && errno == EINTR)
+            continue;
+        if (nread <= 0)
+            return false;
+
+        done += static_cast<size_t>(nread);
+    }
+
+    return true;
+}
+
+Receiver::Receiver(ReceiverConfig config) : config_(std::move(config))
+{
+    buf_.resize(MAX_DATAGRAM);
+
+    ip_mreq membership{};
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(config_.port));
+
+    if (inet_pton(AF_INET, config_.group.c_str(), &membership.imr_multiaddr) != 1 ||
+        inet_pton(AF_INET, config_.interface.c_str(), &membership.imr_interface) != 1) {
+        log_e(
+            main,
+            "Invalid multicast address {} or {}",
+            config_.group,
+            config_.interface
+        );
+        return;
+    }
+
+    // Bound to the group, so other traffic to the port isn't received
+    address.sin_addr = membership.imr_multiaddr;
+
+    int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    int buffer = RECEIVE_BUFFER;
+
+    // NOLINTBEGIN(*-reinterpret-cast)
+    bool ok = fd >= 0 &&
+              ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == 0 &&
+              ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer)) == 0 &&
+              ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 &&
+              ::setsockopt(
+                  fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)
+              ) == 0;
+    // NOLINTEND(*-reinterpret-cast)
+
+    if (!ok) {
+        log_e(
+            main,
+            "Can't join {}:{} on {}: {}",
+            config_.group,
+            config_.port,
+            config_.interface,
+            std::strerror(errno)
+        );
+
+        if (fd >= 0)
+            ::close(fd);
+        return;
+    }
+
+    socket_ = fd;
+}
+
+Receiver::~Receiver()
+{
+    if (socket_ >= 0)
+        ::close(socket_);
+}
+
+size_t
+Receiver::poll(int timeout_ms)
+{
+    if (!ok())
+        return 0;
+
+    pollfd pfd{.fd = socket_, .events = POLLIN, .revents = 0};
+    if (::poll(&pfd, 1, timeout_ms) <= 0)
+        return 0;
+
+    size_t count = 0;
+
+    while (true) {
+        auto nread = ::recv(socket_, buf_.data(), buf_.size(), MSG_DONTWAIT);
+        if (nread < 0)
+            break;
+
+        handle({buf_.data(), static_cast<size_t>(nread)});
+        count++;
+    }
+
+    return count;
+}
+
+void
+Receiver::handle(std::string_view packet)
+{
+    PacketHeader header;
+
+    if (!market_data::decode_header(packet, header) || header.flags != 0) {
+        stats_.invalid++;
+        return;
+    }
+
+    stats_.packets++;
+    latencies_.push_back(now_nanos() - header.send_time);
+
+    if (header.count == 0)
+        return;
+
+    // Ask for what we missed first, so messages are applied in order
+    if (expected_ != 0 && header.sequence > expected_) {
+        stats_.gaps++;
+        stats_.missed += header.sequence - expected_;
+
+        if (!config_.recovery_host.empty())
+            retransmit_(expected_, header.sequence - 1);
+    }
+
+    // Whatever's still missing is skipped
+    if (expected_ < header.sequence)
+        expected_ = header.sequence;
+
+    auto sequence = header.sequence;
+
+    bool whole = market_data::for_each_message(
+        packet,
+        header,
+        [this, &sequence](const Message& message) {
+            if (sequence++ < expected_) {
+                stats_.duplicates++;
+                return;
+            }
+
+            apply_(message);
+            expected_ = sequence;
+        }
+    );
+
+    if (!whole)
+        stats_.invalid++;
+}
+
+bool
+Receiver::request_snapshot()
+{
+    bool started = false;
+    uint64_t sequence = 0;
+
+    bool ok = fetch_("SNAPSHOT", [this, &started, &sequence](std::string_view packet) {
+        PacketHeader header;
+
+        if (!market_data::decode_header(packet, header) ||
+            (header.flags & market_data::PACKET_SNAPSHOT) == 0) {
+            stats_.invalid++;
+            return;
+        }
+
+        if (!started) {
+            books_.clear();
+            started = true;
+        }
+
+        sequence = header.sequence;
+        market_data::for_each_message(packet, header, [this](const Message& message) {
+            apply_(message);
+        });
+    });
+
+    if (!ok || !started) {
+        log_w(main, "Couldn't get a snapshot from the recovery socket");
+        return false;
+    }
+
+    expected_ = sequence + 1;
+    stats_.snapshots++;
+    return true;
+}
+
+void
+Receiver::apply_(const Message& message)
+{
+    stats_.messages++;
+    bool reset = (message.flags & market_data::MESSAGE_RESET) != 0;
+
+    switch (message.type) {
+        case MessageType::LEVEL: {
+            stats_.levels++;
+            key_ = message.product_id();
+            auto& book = books_[key_];
+
+            // The first level of a book sent whole again replaces ours
+            if (reset && resetting_ != key_) {
+                book.bids.clear();
+                book.asks.clear();
+                resetting_ = key_;
+                stats_.resets++;
+            }
+
+            auto update = [&message](auto& side) {
+                if (message.values[1] == 0)
+                    side.erase(message.values[0]);
+                else
+                    side[message.values[0]] = message.values[1];
+            };
+
+            if (message.side == 0)
+                update(book.bids);
+            else
+                update(book.asks);
+            break;
+        }
+
+        case MessageType::TOP: {
+            stats_.tops++;
+            key_ = message.product_id();
+            auto& book = books_[key_];
+
+            // Sent whole again, but empty
+            if (reset && resetting_ != key_) {
+                book.bids.clear();
+                book.asks.clear();
+                stats_.resets++;
+            }
+
+            book.top = message;
+            resetting_.clear();
+            break;
+        }
+
+        case MessageType::TRADE:
+            stats_.trades++;
+            break;
+
+        case MessageType::STATUS: {
+            stats_.statuses++;
+            bool stale = (message.flags & market_data::MESSAGE_STALE) != 0;
+
+            if (stale)
+                log_w(main, "{} stale for {}ms", message.product_id(), message.id);
+            else
+                log_i(main, "{} live after {}ms", message.product_id(), message.id);
+            break;
+        }
+    }
+}
+
+bool
+Receiver::retransmit_(uint64_t first, uint64_t last)
+{
+    auto request = fmt::format("RETRANSMIT {} {}", first, last);
+
+    return fetch_(request, [this, last](std::string_view packet) {
+        PacketHeader header;
+
+        if (!market_data::decode_header(packet, header) ||
+            (header.flags & market_data::PACKET_RETRANSMIT) == 0) {
+            stats_.invalid++;
+            return;
+        }
+
+        // Only what follows on from what we have is any use
+        if (header.sequence > expected_)
+            return;
+
+        auto sequence = header.sequence;
+
+        market_data::for_each_message(
+            packet,
+            header,
+            [this, &sequence, last](const Message& message) {
+                auto current = sequence++;
+                if (current < expected_ || current > last)
+                    return;
+
+                apply_(message);
+                stats_.recovered++;
+                expected_ = sequence;
+            }
+        );
+    });
+}
+
+bool
+Receiver::fetch_(
+    std::string_view request, const std::function<void(std::string_view)>& fn
+)
+{
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(config_.recovery_port));
+
+    if (inet_pton(AF_INET, config_.recovery_host.c_str(), &address.sin_addr) != 1) {
+        log_e(main, "Invalid recovery address {}", config_.recovery_host);
+        return false;
+    }
+
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    timeval timeout{.tv_sec = RECOVERY_TIMEOUT_SEC, .tv_usec = 0};
+
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    const auto* addr = reinterpret_cast<const sockaddr*>(&address);
+
+    if (fd < 0 ||
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0 ||
+        ::connect(fd, addr, sizeof(address)) != 0) {
+        log_e(
+            main,
+            "Can't connect to recovery socket {}:{}: {}",
+            config_.recovery_host,
+            config_.recovery_port,
+            std::strerror(errno)
+        );
+
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+
+    auto line = fmt::format("{}\n", request);
+    bool ok = ::send(fd, line.data(), line.size(), MSG_NOSIGNAL) ==
+              static_cast<ssize_t>(line.size());
+
+    std::string length;
+    std::string packet;
+
+    // Packets follow until the socket is closed
+    while (ok) {
+        errno = 0;
+
+        // Closed, or timed out
+        if (!read_exact(fd, length, sizeof(uint32_t))) {
+            ok = errno == 0;
+            break;
+        }
+
+        auto size = packed::detail::get<uint32_t>(length.data());
+
+        if (size > MAX_DATAGRAM || !read_exact(fd, packet, size)) {
+            ok = false;
+            break;
+        }
+
+        fn(packet);
+    }
+
+    ::close(fd);
+    return ok;
+}
+
+} // namespace mcast
+} // namespace raccoon
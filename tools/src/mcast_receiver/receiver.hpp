@@ -0,0 +1,156 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <raccoon/market_data.hpp>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace raccoon {
+namespace mcast {
+
+struct ReceiverConfig {
+    std::string group = MULTICAST_GROUP;
+    int port = MULTICAST_PORT;
+    std::string interface = "127.0.0.1"; // local address to join the group on
+
+    // raccoon's recovery socket, to catch up from and fill gaps with; none if empty
+    std::string recovery_host;
+    int recovery_port = 0;
+};
+
+/**
+ * What a receiver saw so far.
+ */
+struct ReceiverStats {
+    uint64_t packets = 0;
+    uint64_t messages = 0;
+    uint64_t levels = 0;
+    uint64_t tops = 0;
+    uint64_t trades = 0;
+    uint64_t statuses = 0;
+
+    uint64_t gaps = 0;        // times messages were missed
+    uint64_t missed = 0;      // messages missed
+    uint64_t recovered = 0;   // of those, received again
+    uint64_t duplicates = 0;  // messages received before
+    uint64_t invalid = 0;     // packets that couldn't be decoded
+    uint64_t snapshots = 0;   // snapshots applied
+    uint64_t resets = 0;      // books sent whole again, replacing ours
+};
+
+/**
+ * A book kept from level messages.
+ */
+struct ReceivedBook {
+    std::map<int64_t, int64_t, std::greater<>> bids; // best first
+    std::map<int64_t, int64_t> asks;                 // best first
+    market_data::Message top;                        // last top of book
+};
+
+/**
+ * Receives raccoon's binary market data from a multicast group, keeping its books
+ * and counting gaps in the sequence numbers.
+ *
+ * With a recovery socket, it catches up with a snapshot when asked, and asks for
+ * missed packets again as soon as it sees a gap, so its books stay whole.
+ */
+class Receiver {
+    ReceiverConfig config_;
+    int socket_ = -1;
+
+    uint64_t expected_ = 0; // next sequence number, 0 before the first packet
+    ReceiverStats stats_;
+    std::vector<int64_t> latencies_;
+
+    std::unordered_map<std::string, ReceivedBook> books_;
+    std::string buf_;
+    std::string key_;
+    std::string resetting_; // product whose book is being sent whole again
+
+public:
+    /**
+     * Join the group. Errors are logged, and leave the receiver receiving nothing.
+     */
+    explicit Receiver(ReceiverConfig config);
+
+    ~Receiver();
+
+    Receiver(const Receiver&) = delete;
+    Receiver(Receiver&&) = delete;
+    Receiver& operator=(const Receiver&) = delete;
+    Receiver& operator=(Receiver&&) = delete;
+
+    [[nodiscard]] bool
+    ok() const noexcept
+    {
+        return socket_ >= 0;
+    }
+
+    /**
+     * Handle datagrams received, waiting up to `timeout_ms` for the first.
+     *
+     * @returns size_t Packets handled.
+     */
+    size_t poll(int timeout_ms);
+
+    /**
+     * Handle one packet, as received from the group.
+     */
+    void handle(std::string_view packet);
+
+    /**
+     * Replace the books with a snapshot from the recovery socket, and carry on
+     * from the sequence number it's as of.
+     *
+     * @returns bool If a snapshot was received.
+     */
+    bool request_snapshot();
+
+    [[nodiscard]] const ReceiverStats&
+    stats() const noexcept
+    {
+        return stats_;
+    }
+
+    [[nodiscard]] const std::unordered_map<std::string, ReceivedBook>&
+    books() const noexcept
+    {
+        return books_;
+    }
+
+    /**
+     * Send to receipt times of packets received since the last call, in
+     * nanoseconds. Clear them once used.
+     */
+    [[nodiscard]] std::vector<int64_t>&
+    latencies() noexcept
+    {
+        return latencies_;
+    }
+
+    /**
+     * Next sequence number expected, 0 before the first packet.
+     */
+    [[nodiscard]] uint64_t
+    expected() const noexcept
+    {
+        return expected_;
+    }
+
+private:
+    void apply_(const market_data::Message& message);
+
+    bool retransmit_(uint64_t first, uint64_t last);
+
+    bool fetch_(
+        std::string_view request, const std::function<void(std::string_view)>& fn
+    );
+};
+
+} // namespace mcast
+} // namespace raccoon
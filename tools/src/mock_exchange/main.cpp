@@ -0,0 +1,180 @@
+#include "common.hpp"
+#include "server.hpp"
+#include "traffic.hpp"
+
+#include <argparse/argparse.hpp>
+#include <uv.h>
+
+#include <iostream>
+#include <ranges>
+
+using raccoon::mock::MockServer;
+using raccoon::mock::TrafficConfig;
+
+static std::
+    tuple<uint8_t, std::string, int, bool, std::string, std::string, TrafficConfig>
+process_arguments(int argc, const char** argv)
+{
+    argparse::ArgumentParser program(
+        "raccoon-mock-exchange", VERSION, argparse::default_arguments::help
+    );
+
+    program.add_description(
+        "Serves synthetic Coinbase traffic over WebSocket, behind the same first "
+        "message as the exchange proxy."
+    );
+
+    uint8_t verbosity = 0;
+    program.add_argument("-v", "--verbose")
+        .help("increase output verbosity")
+        .action([&](const auto& /* unused */) { ++verbosity; })
+        .append()
+        .default_value(false)
+        .implicit_value(true)
+        .nargs(0);
+
+    program.add_argument("--host").help("address to listen on").default_value(
+        std::string("127.0.0.1")
+    );
+
+    program.add_argument("--port")
+        .help("port to listen on")
+        .default_value(8675) // NOLINT(*-magic-numbers)
+        .scan<'i', int>();
+
+    program.add_argument("--products")
+        .help("comma separated products to generate")
+        .default_value(std::string("ETH-USD"));
+
+    program.add_argument("--synthetic")
+        .help("extra generated products, named SYN<n>-USD")
+        .default_value(size_t{0})
+        .scan<'u', size_t>();
+
+    program.add_argument("--rate")
+        .help("messages per second, across all products")
+        .default_value(1000.0) // NOLINT(*-magic-numbers)
+        .scan<'g', double>();
+
+    program.add_argument("--match-ratio")
+        .help("fraction of messages that are matches")
+        .default_value(0.1) // NOLINT(*-magic-numbers)
+        .scan<'g', double>();
+
+    program.add_argument("--depth")
+        .help("levels per side in each book")
+        .default_value(size_t{200}) // NOLINT(*-magic-numbers)
+        .scan<'u', size_t>();
+
+    program.add_argument("--changes")
+        .help("level changes per l2update")
+        .default_value(size_t{1})
+        .scan<'u', size_t>();
+
+    program.add_argument("--burst-every")
+        .help("milliseconds between bursts, 0 for none")
+        .default_value(0U)
+        .scan<'u', unsigned>();
+
+    program.add_argument("--burst-size")
+        .help("extra messages in each burst")
+        .default_value(size_t{0})
+        .scan<'u', size_t>();
+
+    program.add_argument("--drop")
+        .help("probability a message is never sent")
+        .default_value(0.0)
+        .scan<'g', double>();
+
+    program.add_argument("--reorder")
+        .help("probability a message is sent after the next one")
+        .default_value(0.0)
+        .scan<'g', double>();
+
+    program.add_argument("--seed")
+        .help("random seed, for reproducible traffic")
+        .default_value(uint64_t{42}) // NOLINT(*-magic-numbers)
+        .scan<'u', uint64_t>();
+
+    program.add_argument("--deflate")
+        .help("compress messages for clients that offer permessage-deflate")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("--cert")
+        .help("PEM certificate to serve wss:// with, rather than ws://")
+        .default_value(std::string());
+
+    program.add_argument("--key")
+        .help("PEM private key, if it isn't in the certificate's file")
+        .default_value(std::string());
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        exit(1); // NOLINT(concurrency-*)
+    }
+
+    TrafficConfig config;
+    config.products.clear();
+
+    auto products = program.get<std::string>("--products");
+
+    for (auto product : std::views::split(products, ',')) {
+        if (!product.empty())
+            config.products.emplace_back(product.begin(), product.end());
+    }
+
+    for (size_t i = 0; i < program.get<size_t>("--synthetic"); i++)
+        config.products.push_back(fmt::format("SYN{}-USD", i));
+
+    config.rate = program.get<double>("--rate");
+    config.match_ratio = program.get<double>("--match-ratio");
+    config.depth = std::max<size_t>(program.get<size_t>("--depth"), 1);
+    config.changes = std::max<size_t>(program.get<size_t>("--changes"), 1);
+    config.burst_every_ms = program.get<unsigned>("--burst-every");
+    config.burst_size = program.get<size_t>("--burst-size");
+    config.drop = program.get<double>("--drop");
+    config.reorder = program.get<double>("--reorder");
+    config.seed = program.get<uint64_t>("--seed");
+
+    return std::make_tuple(
+        verbosity,
+        program.get<std::string>("--host"),
+        program.get<int>("--port"),
+        program.get<bool>("--deflate"),
+        program.get<std::string>("--cert"),
+        program.get<std::string>("--key"),
+        std::move(config)
+    );
+}
+
+int
+main(int argc, const char** argv)
+{
+    auto [verbosity, host, port, deflate, cert, key, config] =
+        process_arguments(argc, argv);
+
+    raccoon::logging::init(verbosity);
+
+    if (config.products.empty()) {
+        log_c(main, "No products to generate");
+        return 1;
+    }
+
+    uv_loop_t* loop = uv_default_loop();
+    MockServer server(loop, std::move(config));
+    server.set_deflate(deflate);
+
+    if (!cert.empty() && !server.set_tls(cert, key.empty() ? cert : key))
+        return 1;
+
+    if (!server.listen(host, port))
+        return 1;
+
+    uv_run(loop, UV_RUN_DEFAULT);
+
+    return 0;
+}
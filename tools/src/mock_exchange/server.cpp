@@ -0,0 +1,602 @@
+#include "server.hpp"
+
+#include <openssl/err.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <csignal>
+
+namespace raccoon {
+namespace mock {
+
+static constexpr size_t READ_CHUNK_SIZE = 64 * 1024;
+static constexpr int LISTEN_BACKLOG = 16;
+static constexpr double NANOS_PER_SEC = 1e9;
+static constexpr uint64_t NANOS_PER_MS = 1'000'000;
+
+MockServer::MockServer(uv_loop_t* loop, TrafficConfig config) :
+    loop_(loop), traffic_(std::move(config)), rate_(traffic_.config().rate),
+    read_chunk_(READ_CHUNK_SIZE, '\0')
+{}
+
+bool
+MockServer::listen(const std::string& host, int port)
+{
+    sockaddr_in addr{};
+
+    if (int err = uv_ip4_addr(host.c_str(), port, &addr)) {
+        log_e(web, "Invalid address {}:{}: {}", host, port, uv_strerror(err));
+        return false;
+    }
+
+    uv_tcp_init(loop_, &listener_);
+    listener_.data = this;
+
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    int err = uv_tcp_bind(&listener_, reinterpret_cast<const sockaddr*>(&addr), 0);
+
+    if (err == 0) {
+        err = uv_listen(
+            reinterpret_cast<uv_stream_t*>(&listener_), // NOLINT(*-reinterpret-cast)
+            LISTEN_BACKLOG,
+            on_connection_
+        );
+    }
+
+    if (err != 0) {
+        log_e(web, "Could not listen on {}:{}: {}", host, port, uv_strerror(err));
+        return false;
+    }
+
+    // Generate traffic
+    last_tick_ns_ = last_burst_ns_ = uv_hrtime();
+
+    uv_timer_init(loop_, &tick_timer_);
+    tick_timer_.data = this;
+    uv_timer_start(&tick_timer_, on_tick_, TICK_MS, TICK_MS);
+
+    uv_timer_init(loop_, &stats_timer_);
+    stats_timer_.data = this;
+    uv_timer_start(&stats_timer_, on_stats_, STATS_MS, STATS_MS);
+
+    // Stop on ^C
+    uv_signal_init(loop_, &interrupt_signal_);
+    interrupt_signal_.data = this;
+
+    uv_signal_start(
+        &interrupt_signal_,
+        [](uv_signal_t* handle, int /* signum */) {
+            log_w(main, "Received SIGINT, shutting down");
+            uv_stop(static_cast<MockServer*>(handle->data)->loop_);
+        },
+        SIGINT
+    );
+
+    const auto& config = traffic_.config();
+
+    log_i(
+        web,
+        "Mock exchange listening on {}://{}:{} with {} products at {} msg/s",
+        tls_ ? "wss" : "ws",
+        host,
+        port,
+        config.products.size(),
+        rate_.load(std::memory_order_relaxed)
+    );
+
+    return true;
+}
+
+bool
+MockServer::set_tls(const std::string& cert_file, const std::string& key_file)
+{
+    tls_.reset(SSL_CTX_new(TLS_server_method()));
+    SSL_CTX_set_min_proto_version(tls_.get(), TLS1_2_VERSION);
+
+    if (SSL_CTX_use_certificate_chain_file(tls_.get(), cert_file.c_str()) != 1
+        || SSL_CTX_use_PrivateKey_file(tls_.get(), key_file.c_str(), SSL_FILETYPE_PEM)
+               != 1) {
+        std::array<char, 256> error{}; // NOLINT(*-magic-numbers)
+        ERR_error_string_n(ERR_get_error(), error.data(), error.size());
+
+        log_e(web, "Could not load {} and {}: {}", cert_file, key_file, error.data());
+        tls_.reset();
+        return false;
+    }
+
+    return true;
+}
+
+bool
+MockServer::stall(size_t order)
+{
+    for (auto& conn : clients_) {
+        if (conn->order == order && !conn->closing) {
+            log_i(web, "Stalling client {}", order);
+            conn->stalled = true;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool
+MockServer::set_reading(size_t order, bool reading)
+{
+    for (auto& conn : clients_) {
+        if (conn->order != order || conn->closing)
+            continue;
+
+        log_i(web, "{} client {}", reading ? "Reading from" : "Not reading", order);
+
+        auto* stream = reinterpret_cast<uv_stream_t*>(&conn->handle); // NOLINT
+
+        if (reading)
+            uv_read_start(stream, on_alloc_, on_read_);
+        else
+            uv_read_stop(stream);
+
+        return true;
+    }
+
+    return false;
+}
+
+void
+MockServer::on_connection_(uv_stream_t* listener, int status)
+{
+    auto* server = static_cast<MockServer*>(listener->data);
+
+    if (status < 0) [[unlikely]] {
+        log_e(web, "Error accepting connection: {}", uv_strerror(status));
+        return;
+    }
+
+    auto& conn = server->clients_.emplace_back(std::make_unique<client>());
+    conn->server = server;
+
+    uv_tcp_init(server->loop_, &conn->handle);
+    conn->handle.data = conn.get();
+
+    auto* stream = reinterpret_cast<uv_stream_t*>(&conn->handle); // NOLINT
+
+    if (uv_accept(listener, stream) != 0) [[unlikely]] {
+        server->close_(*conn);
+        return;
+    }
+
+    // We write in large batches; don't wait on acks
+    uv_tcp_nodelay(&conn->handle, 1);
+
+    if (server->tls_) {
+        conn->ssl = SSL_new(server->tls_.get());
+        conn->rbio = BIO_new(BIO_s_mem());
+        conn->wbio = BIO_new(BIO_s_mem());
+        SSL_set_bio(conn->ssl, conn->rbio, conn->wbio);
+        SSL_set_accept_state(conn->ssl);
+    }
+
+    uv_read_start(stream, on_alloc_, on_read_);
+
+    log_i(web, "Client connected ({} total)", server->clients_.size());
+}
+
+void
+MockServer::on_alloc_(uv_handle_t* handle, size_t /* suggested */, uv_buf_t* buf)
+{
+    auto* reader = static_cast<client*>(handle->data);
+    auto& chunk = reader->server->read_chunk_;
+
+    *buf = uv_buf_init(chunk.data(), static_cast<unsigned>(chunk.size()));
+}
+
+void
+MockServer::on_read_(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf)
+{
+    auto* conn = static_cast<client*>(stream->data);
+
+    if (nread < 0) {
+        if (nread != UV_EOF)
+            log_w(web, "Client read error: {}", uv_strerror(static_cast<int>(nread)));
+
+        conn->server->close_(*conn);
+        return;
+    }
+
+    std::string_view data(buf->base, static_cast<size_t>(nread));
+
+    if (conn->ssl == nullptr)
+        conn->read_buf.append(data);
+    else if (!conn->server->decrypt_(*conn, data)) {
+        conn->server->close_(*conn);
+        return;
+    }
+
+    conn->server->handle_input_(*conn);
+}
+
+bool
+MockServer::decrypt_(client& conn, std::string_view data)
+{
+    BIO_write(conn.rbio, data.data(), static_cast<int>(data.size()));
+
+    if (!SSL_is_init_finished(conn.ssl)) {
+        auto res = SSL_do_handshake(conn.ssl);
+        flush_(conn);
+
+        if (res != 1) {
+            if (SSL_get_error(conn.ssl, res) == SSL_ERROR_WANT_READ)
+                return true;
+
+            log_w(web, "TLS handshake with a client failed");
+            return false;
+        }
+
+        bool resumed = SSL_session_reused(conn.ssl) == 1;
+        tls_resumed_ += resumed ? 1 : 0;
+
+        log_i(web, "TLS handshake done{}", resumed ? ", session resumed" : "");
+    }
+
+    // What we were given is in the BIO, so the chunk can take the plaintext
+    bool open = true;
+
+    while (true) {
+        auto size = SSL_read(
+            conn.ssl, read_chunk_.data(), static_cast<int>(read_chunk_.size())
+        );
+
+        if (size <= 0) {
+            // Anything but wanting more is the end, close_notify included
+            open = SSL_get_error(conn.ssl, size) == SSL_ERROR_WANT_READ;
+            break;
+        }
+
+        conn.read_buf.append(read_chunk_.data(), static_cast<size_t>(size));
+    }
+
+    // Reading may write, session tickets among others
+    flush_(conn);
+
+    return open;
+}
+
+void
+MockServer::handle_input_(client& conn)
+{
+    // Opening handshake
+    if (!conn.upgraded) {
+        auto end = conn.read_buf.find("\r\n\r\n");
+        if (end == std::string::npos)
+            return;
+
+        auto request = std::string_view(conn.read_buf).substr(0, end + 4);
+
+        conn.deflate = deflate_ && ws::offers_deflate(request);
+        auto response = ws::handshake_response(request, conn.deflate);
+
+        if (!response) {
+            log_w(web, "Rejecting non-WebSocket request");
+            conn.pending = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+            flush_(conn);
+            close_(conn);
+            return;
+        }
+
+        conn.read_buf.erase(0, end + 4);
+        conn.pending = std::move(*response);
+        conn.upgraded = true;
+
+        // What the proxy sends before forwarding anything
+        send_(
+            conn,
+            ws::Opcode::TEXT,
+            std::string_view(PROXY_FIRST_MESSAGE, PROXY_FIRST_MESSAGE_LEN)
+        );
+    }
+
+    // Frames
+    std::string_view data(conn.read_buf);
+
+    while (!conn.closing) {
+        auto used = ws::decode_frame(data, conn.frame);
+
+        if (used == 0)
+            break;
+
+        if (used == ws::FRAME_ERROR) [[unlikely]] {
+            log_w(web, "Closing client after a malformed frame");
+            close_(conn);
+            return;
+        }
+
+        data.remove_prefix(used);
+        handle_frame_(conn);
+    }
+
+    conn.read_buf.erase(0, conn.read_buf.size() - data.size());
+    flush_(conn);
+}
+
+void
+MockServer::handle_frame_(client& conn)
+{
+    const auto& frame = conn.frame;
+
+    switch (frame.opcode) {
+        case ws::Opcode::TEXT:
+        case ws::Opcode::BINARY:
+            break;
+
+        case ws::Opcode::PING:
+            send_(conn, ws::Opcode::PONG, frame.payload);
+            return;
+
+        case ws::Opcode::CLOSE:
+            send_(conn, ws::Opcode::CLOSE, frame.payload);
+            flush_(conn);
+            close_(conn);
+            return;
+
+        default:
+            return;
+    }
+
+    // Only subscriptions are expected; any product ids are ignored, every
+    // client gets every product
+    const auto& msg = frame.payload;
+
+    // Nor are channels, everything is unsubscribed from
+    if (msg.find(R"("unsubscribe")") != std::string::npos) {
+        conn.subscribed = conn.wants_books = conn.wants_matches = false;
+        send_(conn, ws::Opcode::TEXT, R"({"type":"subscriptions","channels":[]})");
+
+        log_i(web, "Client unsubscribed");
+        return;
+    }
+
+    if (msg.find(R"("subscribe")") == std::string::npos) {
+        log_d(web, "Keeping a client message of {} bytes", msg.size());
+        received_.push_back(msg);
+        return;
+    }
+
+    conn.wants_books = msg.find(R"("level2)") != std::string::npos;
+    conn.wants_matches = msg.find(R"("matches")") != std::string::npos;
+
+    std::vector<std::string_view> channels;
+    if (conn.wants_books)
+        channels.emplace_back(R"({"name":"level2_batch"})");
+    if (conn.wants_matches)
+        channels.emplace_back(R"({"name":"matches"})");
+
+    send_(
+        conn,
+        ws::Opcode::TEXT,
+        fmt::format(
+            R"({{"type":"subscriptions","channels":[{}]}})", fmt::join(channels, ",")
+        )
+    );
+
+    if (conn.wants_books) {
+        traffic_.snapshots([&](std::string_view snapshot) {
+            send_(conn, ws::Opcode::TEXT, snapshot);
+        });
+    }
+
+    conn.subscribed = true;
+
+    if (!conn.order)
+        conn.order = subscriptions_++;
+
+    log_i(
+        web,
+        "Client subscribed (books: {}, matches: {})",
+        conn.wants_books,
+        conn.wants_matches
+    );
+}
+
+void
+MockServer::on_tick_(uv_timer_t* timer)
+{
+    auto* server = static_cast<MockServer*>(timer->data);
+    const auto& config = server->traffic_.config();
+
+    auto now = uv_hrtime();
+    auto elapsed = static_cast<double>(now - server->last_tick_ns_) / NANOS_PER_SEC;
+    server->last_tick_ns_ = now;
+
+    // Messages due at the steady rate, carrying over fractions
+    server->budget_ += server->rate_.load(std::memory_order_relaxed) * elapsed;
+
+    auto count = static_cast<size_t>(std::floor(server->budget_));
+    server->budget_ -= static_cast<double>(count);
+
+    // Plus any burst
+    if (config.burst_every_ms != 0
+        && now - server->last_burst_ns_ >= config.burst_every_ms * NANOS_PER_MS) {
+        count += config.burst_size;
+        server->last_burst_ns_ = now;
+    }
+
+    count = std::min(count, MAX_MESSAGES_PER_TICK);
+
+    bool any_subscribed = std::ranges::any_of(server->clients_, [](const auto& conn) {
+        return conn->subscribed;
+    });
+
+    // Keep the books still until someone is watching
+    if (count == 0 || !any_subscribed)
+        return;
+
+    server->traffic_.set_time(unix_nanos());
+    server->traffic_.generate(count, [server](std::string_view message) {
+        server->broadcast_(message);
+    });
+
+    server->generated_ += count;
+
+    for (auto& conn : server->clients_)
+        server->flush_(*conn);
+}
+
+void
+MockServer::broadcast_(std::string_view message)
+{
+    bool is_match = message.starts_with(R"({"type":"match")");
+
+    // Encode once for every client, and compress once for those that want it
+    frame_.clear();
+    ws::encode_frame(ws::Opcode::TEXT, message, frame_);
+
+    compressed_frame_.clear();
+
+    for (auto& conn : clients_) {
+        if (!conn->subscribed || conn->closing)
+            continue;
+
+        if (is_match ? !conn->wants_matches : !conn->wants_books)
+            continue;
+
+        auto* stream = reinterpret_cast<uv_stream_t*>(&conn->handle); // NOLINT
+        auto backlog = uv_stream_get_write_queue_size(stream) + conn->pending.size();
+
+        if (backlog > MAX_BACKLOG) [[unlikely]] {
+            backlog_skips_++;
+            continue;
+        }
+
+        if (!conn->deflate) [[likely]] {
+            conn->pending += frame_;
+            continue;
+        }
+
+        if (compressed_frame_.empty()) {
+            auto compressed = compressor_.compress(message);
+            ws::encode_frame(ws::Opcode::TEXT, compressed, compressed_frame_, true);
+        }
+
+        conn->pending += compressed_frame_;
+    }
+}
+
+void
+MockServer::send_(client& conn, ws::Opcode opcode, std::string_view payload)
+{
+    // Control frames are never compressed
+    bool data = opcode == ws::Opcode::TEXT || opcode == ws::Opcode::BINARY;
+
+    if (conn.deflate && data) {
+        auto compressed = compressor_.compress(payload);
+        ws::encode_frame(opcode, compressed, conn.pending, true);
+        return;
+    }
+
+    ws::encode_frame(opcode, payload, conn.pending);
+}
+
+void
+MockServer::flush_(client& conn)
+{
+    if (conn.stalled) [[unlikely]]
+        conn.pending.clear();
+
+    bool no_ciphertext = conn.ssl == nullptr || BIO_ctrl_pending(conn.wbio) == 0;
+    bool nothing_to_write = conn.pending.empty() && no_ciphertext;
+
+    if (nothing_to_write || conn.closing)
+        return;
+
+    auto* req = new write_req; // NOLINT(*-owning-memory)
+
+    if (conn.ssl == nullptr) [[likely]]
+        req->data.swap(conn.pending);
+    else {
+        // Memory BIOs take everything at once
+        if (!conn.pending.empty()) {
+            SSL_write(
+                conn.ssl, conn.pending.data(), static_cast<int>(conn.pending.size())
+            );
+            conn.pending.clear();
+        }
+
+        req->data.resize(BIO_ctrl_pending(conn.wbio));
+        BIO_read(conn.wbio, req->data.data(), static_cast<int>(req->data.size()));
+    }
+
+    req->req.data = req;
+
+    bytes_written_ += req->data.size();
+
+    auto buf = uv_buf_init(req->data.data(), static_cast<unsigned>(req->data.size()));
+
+    int err = uv_write(
+        &req->req,
+        reinterpret_cast<uv_stream_t*>(&conn.handle), // NOLINT(*-reinterpret-cast)
+        &buf,
+        1,
+        [](uv_write_t* write, int /* status */) {
+            delete static_cast<write_req*>(write->data); // NOLINT(*-owning-memory)
+        }
+    );
+
+    if (err != 0) [[unlikely]] {
+        delete req; // NOLINT(*-owning-memory)
+        close_(conn);
+    }
+}
+
+void
+MockServer::close_(client& conn)
+{
+    if (conn.closing)
+        return;
+
+    conn.closing = true;
+
+    uv_close(
+        reinterpret_cast<uv_handle_t*>(&conn.handle), // NOLINT(*-reinterpret-cast)
+        [](uv_handle_t* handle) {
+            auto* closed = static_cast<client*>(handle->data);
+            auto& clients = closed->server->clients_;
+
+            SSL_free(closed->ssl); // and its BIOs
+
+            std::erase_if(clients, [closed](const auto& other) {
+                return other.get() == closed;
+            });
+
+            log_i(web, "Client disconnected ({} left)", clients.size());
+        }
+    );
+}
+
+void
+MockServer::on_stats_(uv_timer_t* timer)
+{
+    auto* server = static_cast<MockServer*>(timer->data);
+
+    if (server->clients_.empty())
+        return;
+
+    log_i(
+        web,
+        "{} clients, {} msg/s, {:.1f} MB/s; {} dropped, {} reordered, {} skipped by "
+        "slow clients so far",
+        server->clients_.size(),
+        server->generated_,
+        static_cast<double>(server->bytes_written_) / 1e6, // NOLINT(*-magic-numbers)
+        server->traffic_.dropped(),
+        server->traffic_.reordered(),
+        server->backlog_skips_
+    );
+
+    server->generated_ = 0;
+    server->bytes_written_ = 0;
+}
+
+} // namespace mock
+} // namespace raccoon
@@ -0,0 +1,216 @@
+#pragma once
+
+#include "common.hpp"
+#include "traffic.hpp"
+#include "websocket.hpp"
+
+#include <openssl/ssl.h>
+#include <uv.h>
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace raccoon {
+namespace mock {
+
+/**
+ * A WebSocket server that stands in for the exchange proxy.
+ *
+ * Each client gets the proxy's first message on connect, then speaks the Coinbase
+ * protocol: after it subscribes, it gets a snapshot of every book (if it asked for
+ * a level2 channel), then the shared stream of updates and matches. Unsubscribing
+ * stops all of it, and subscribing again starts over with new snapshots.
+ *
+ * Traffic is generated on a 1 ms timer at the configured rate, and written to each
+ * client once per tick. Clients that fall too far behind skip messages rather than
+ * buffer without bound; those are counted.
+ *
+ * Anything else clients send is kept, for tests to look at; see received().
+ *
+ * With a certificate, see set_tls(), clients connect over TLS instead, and may
+ * resume their sessions.
+ */
+class MockServer {
+    // A client may have this much unsent data before it skips messages
+    static constexpr size_t MAX_BACKLOG = 64UL * 1024 * 1024;
+
+    // Most messages generated in one tick, so a stall can't snowball
+    static constexpr size_t MAX_MESSAGES_PER_TICK = 100'000;
+
+    static constexpr uint64_t TICK_MS = 1;
+    static constexpr uint64_t STATS_MS = 1000;
+
+    struct client {
+        MockServer* server;
+        uv_tcp_t handle{};
+
+        bool upgraded = false;
+        bool subscribed = false;
+        bool wants_books = false;
+        bool wants_matches = false;
+        bool deflate = false; // agreed to permessage-deflate
+        bool closing = false;
+        bool stalled = false; // written nothing more, pongs included
+
+        std::optional<size_t> order; // clients that subscribed before it
+
+        // TLS, through memory BIOs as in the native client
+        SSL* ssl = nullptr;
+        BIO* rbio = nullptr; // received ciphertext, for OpenSSL to read
+        BIO* wbio = nullptr; // ciphertext written by OpenSSL, to send
+
+        std::string read_buf;
+        std::string pending; // frames written on the next flush
+        ws::Frame frame;
+    };
+
+    struct write_req {
+        uv_write_t req{};
+        std::string data;
+    };
+
+    uv_loop_t* loop_;
+    TrafficGenerator traffic_;
+
+    uv_tcp_t listener_{};
+    uv_timer_t tick_timer_{};
+    uv_timer_t stats_timer_{};
+    uv_signal_t interrupt_signal_{};
+
+    std::vector<std::unique_ptr<client>> clients_;
+    size_t subscriptions_ = 0; // clients that ever subscribed
+
+    std::vector<std::string> received_; // from clients, besides subscriptions
+
+    // Pacing
+    std::atomic<double> rate_;
+    uint64_t last_tick_ns_ = 0;
+    uint64_t last_burst_ns_ = 0;
+    double budget_ = 0;
+
+    // Compression, for clients that offer it
+    bool deflate_ = false;
+    ws::Compressor compressor_;
+
+    // TLS, if there's a certificate
+    std::unique_ptr<SSL_CTX, decltype(&SSL_CTX_free)> tls_{nullptr, SSL_CTX_free};
+    size_t tls_resumed_ = 0; // handshakes that resumed a session
+
+    // Reused buffers
+    std::string read_chunk_;
+    std::string frame_;
+    std::string compressed_frame_;
+
+    // Stats since the last report
+    uint64_t generated_ = 0;
+    uint64_t bytes_written_ = 0;
+    uint64_t backlog_skips_ = 0;
+
+public:
+    /**
+     * Create a new server on an event loop. Call listen() to start it.
+     */
+    MockServer(uv_loop_t* loop, TrafficConfig config);
+
+    ~MockServer() = default;
+
+    MockServer(const MockServer&) = delete;
+    MockServer(MockServer&&) = delete;
+    MockServer& operator=(const MockServer&) = delete;
+    MockServer& operator=(MockServer&&) = delete;
+
+    /**
+     * Start accepting connections and generating traffic.
+     *
+     * @returns bool If the server is listening.
+     */
+    bool listen(const std::string& host, int port);
+
+    /**
+     * Change the message rate, from any thread.
+     */
+    void
+    set_rate(double rate) noexcept
+    {
+        rate_.store(rate, std::memory_order_relaxed);
+    }
+
+    /**
+     * Compress messages for clients that offer permessage-deflate. Call before
+     * listen().
+     */
+    void
+    set_deflate(bool deflate) noexcept
+    {
+        deflate_ = deflate;
+    }
+
+    /**
+     * Serve clients over TLS, with a certificate and its private key, both PEM
+     * files. Call before listen().
+     *
+     * @returns bool If both were loaded.
+     */
+    bool set_tls(const std::string& cert_file, const std::string& key_file);
+
+    /**
+     * TLS handshakes that resumed an earlier session, rather than start a new one.
+     */
+    [[nodiscard]] size_t
+    tls_resumed() const noexcept
+    {
+        return tls_resumed_;
+    }
+
+    /**
+     * Stop writing anything to a client, pongs included, as a connection that's
+     * still open but gone quiet would. For tests of what clients do about it.
+     *
+     * @param order Which client, by when it first subscribed, from 0.
+     *
+     * @returns bool If there's such a client.
+     */
+    bool stall(size_t order);
+
+    /**
+     * Stop reading what a client sends, or start again, so its writes back up as
+     * they would to a server slow to read them. For tests of how clients write.
+     *
+     * @param order Which client, by when it first subscribed, from 0.
+     *
+     * @returns bool If there's such a client.
+     */
+    bool set_reading(size_t order, bool reading);
+
+    /**
+     * Messages clients sent other than (un)subscriptions, in the order they
+     * arrived.
+     */
+    [[nodiscard]] const std::vector<std::string>&
+    received() const noexcept
+    {
+        return received_;
+    }
+
+private:
+    static void on_connection_(uv_stream_t* listener, int status);
+    static void on_alloc_(uv_handle_t* handle, size_t suggested, uv_buf_t* buf);
+    static void on_read_(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf);
+    static void on_tick_(uv_timer_t* timer);
+    static void on_stats_(uv_timer_t* timer);
+
+    bool decrypt_(client& conn, std::string_view data);
+    void handle_input_(client& conn);
+    void handle_frame_(client& conn);
+
+    void broadcast_(std::string_view message);
+    void send_(client& conn, ws::Opcode opcode, std::string_view payload);
+    void flush_(client& conn);
+    void close_(client& conn);
+};
+
+} // namespace mock
+} // namespace raccoon
@@ -0,0 +1,296 @@
+#include "traffic.hpp"
+
+#include <chrono>
+#include <ranges>
+
+namespace raccoon {
+namespace mock {
+
+// Prices start here, in ticks
+static constexpr int64_t START_MID = 100'000;
+
+// Chance the mid moves a tick before an update
+static constexpr double MID_MOVE_CHANCE = 0.05;
+
+// Chance an update removes its level
+static constexpr double REMOVE_CHANCE = 0.2;
+
+// How quickly update activity falls off away from the touch
+static constexpr double LEVEL_FALLOFF = 0.15;
+
+static void
+append_price(std::string& out, int64_t ticks)
+{
+    fmt::format_to(std::back_inserter(out), "\"{}.{:02}\"", ticks / 100, ticks % 100);
+}
+
+static void
+append_level(std::string& out, std::string_view side, int64_t ticks, double size)
+{
+    fmt::format_to(std::back_inserter(out), "[\"{}\",", side);
+    append_price(out, ticks);
+    fmt::format_to(std::back_inserter(out), ",\"{:.8f}\"]", size);
+}
+
+int64_t
+unix_nanos() noexcept
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+TrafficGenerator::TrafficGenerator(TrafficConfig config) :
+    config_(std::move(config)), rng_(config_.seed)
+{
+    std::uniform_real_distribution<double> size_dist(0.01, 5.0);
+
+    for (const auto& product : config_.products) {
+        product_book book{.id = product, .mid = START_MID};
+
+        for (size_t level = 1; level <= config_.depth; level++) {
+            auto offset = static_cast<int64_t>(level);
+
+            book.bids[book.mid - offset] = size_dist(rng_);
+            book.asks[book.mid + offset] = size_dist(rng_);
+        }
+
+        books_.push_back(std::move(book));
+    }
+
+    set_time(unix_nanos());
+}
+
+void
+TrafficGenerator::set_time(int64_t nanos)
+{
+    using namespace std::chrono; // NOLINT(*-using-namespace)
+
+    sys_time<nanoseconds> now{nanoseconds(nanos)};
+    auto day = floor<days>(now);
+
+    year_month_day date{day};
+    hh_mm_ss time{floor<microseconds>(now - day)};
+
+    time_ = fmt::format(
+        "{:04}-{:02}-{:02}T{:02}:{:02}:{:02}.{:06}Z",
+        static_cast<int>(date.year()),
+        static_cast<unsigned>(date.month()),
+        static_cast<unsigned>(date.day()),
+        time.hours().count(),
+        time.minutes().count(),
+        time.seconds().count(),
+        time.subseconds().count()
+    );
+}
+
+bool
+TrafficGenerator::chance_(double probability)
+{
+    if (probability <= 0.0)
+        return false;
+
+    return std::uniform_real_distribution<double>(0.0, 1.0)(rng_) < probability;
+}
+
+void
+TrafficGenerator::generate(size_t count, const sink& out)
+{
+    if (books_.empty()) [[unlikely]]
+        return;
+
+    std::uniform_int_distribution<size_t> product_dist(0, books_.size() - 1);
+
+    for (size_t i = 0; i < count; i++) {
+        auto& book = books_[product_dist(rng_)];
+
+        if (chance_(config_.match_ratio))
+            match_(book);
+        else
+            update_(book);
+
+        generated_++;
+        deliver_(out);
+    }
+}
+
+void
+TrafficGenerator::deliver_(const sink& out)
+{
+    if (chance_(config_.drop)) {
+        dropped_++;
+        return;
+    }
+
+    // Send the newer message first, then the one we held back
+    if (held_) {
+        out(message_);
+        out(*held_);
+        held_.reset();
+        return;
+    }
+
+    if (chance_(config_.reorder)) {
+        held_ = message_;
+        reordered_++;
+        return;
+    }
+
+    out(message_);
+}
+
+void
+TrafficGenerator::update_(product_book& book)
+{
+    std::uniform_real_distribution<double> size_dist(0.01, 5.0);
+    std::geometric_distribution<int64_t> level_dist(LEVEL_FALLOFF);
+
+    message_ = R"({"type":"l2update","product_id":")";
+    message_ += book.id;
+    message_ += R"(","changes":[)";
+
+    bool first = true;
+
+    auto add = [&](std::string_view side, int64_t price, double size) {
+        if (!first)
+            message_ += ',';
+
+        append_level(message_, side, price, size);
+        first = false;
+    };
+
+    // Move the mid, removing any levels it crossed
+    if (chance_(MID_MOVE_CHANCE)) {
+        bool up = chance_(0.5); // NOLINT(*-magic-numbers)
+
+        // Keep prices positive
+        if (book.mid <= static_cast<int64_t>(config_.depth) + 1)
+            up = true;
+
+        book.mid += up ? 1 : -1;
+
+        if (up) {
+            while (!book.asks.empty() && book.asks.begin()->first <= book.mid) {
+                add("sell", book.asks.begin()->first, 0.0);
+                book.asks.erase(book.asks.begin());
+            }
+        }
+        else {
+            while (!book.bids.empty() && book.bids.rbegin()->first >= book.mid) {
+                add("buy", book.bids.rbegin()->first, 0.0);
+                book.bids.erase(std::prev(book.bids.end()));
+            }
+        }
+    }
+
+    auto max_offset = static_cast<int64_t>(config_.depth);
+
+    for (size_t i = 0; i < config_.changes; i++) {
+        bool bid = chance_(0.5); // NOLINT(*-magic-numbers)
+        auto offset = 1 + std::min(level_dist(rng_), max_offset - 1);
+        auto price = bid ? book.mid - offset : book.mid + offset;
+        auto& side = bid ? book.bids : book.asks;
+
+        auto level = side.find(price);
+
+        if (level != side.end() && chance_(REMOVE_CHANCE)) {
+            side.erase(level);
+            add(bid ? "buy" : "sell", price, 0.0);
+            continue;
+        }
+
+        auto size = size_dist(rng_);
+        side[price] = size;
+        add(bid ? "buy" : "sell", price, size);
+
+        // Keep the book at its configured depth
+        if (side.size() > config_.depth) {
+            auto farthest = bid ? side.begin() : std::prev(side.end());
+            add(bid ? "buy" : "sell", farthest->first, 0.0);
+            side.erase(farthest);
+        }
+    }
+
+    message_ += R"(],"time":")";
+    message_ += time_;
+    message_ += "\"}";
+}
+
+void
+TrafficGenerator::match_(product_book& book)
+{
+    std::uniform_real_distribution<double> size_dist(0.0001, 1.0);
+
+    // Coinbase reports the maker's side
+    bool maker_buy = chance_(0.5); // NOLINT(*-magic-numbers)
+
+    int64_t price = book.mid;
+    if (maker_buy && !book.bids.empty())
+        price = book.bids.rbegin()->first;
+    else if (!maker_buy && !book.asks.empty())
+        price = book.asks.begin()->first;
+
+    message_ = fmt::format(
+        R"({{"type":"match","trade_id":{},)"
+        R"("maker_order_id":"4c3c0a54-8ab6-4cd8-b75a-f5da3bd6ee5f",)"
+        R"("taker_order_id":"be9b7bfd-5c0c-4e7a-9c0b-dc3e5a8e9f77",)"
+        R"("side":"{}","size":"{:.8f}","price":)",
+        book.trade_id++,
+        maker_buy ? "buy" : "sell",
+        size_dist(rng_)
+    );
+
+    append_price(message_, price);
+
+    fmt::format_to(
+        std::back_inserter(message_),
+        R"(,"product_id":"{}","sequence":{},"time":"{}"}})",
+        book.id,
+        sequence_++,
+        time_
+    );
+}
+
+void
+TrafficGenerator::snapshots(const sink& out)
+{
+    std::string snapshot;
+
+    for (const auto& book : books_) {
+        snapshot = R"({"type":"snapshot","product_id":")";
+        snapshot += book.id;
+        snapshot += R"(","asks":[)";
+
+        bool first = true;
+        for (const auto& [price, size] : book.asks) {
+            if (!first)
+                snapshot += ',';
+
+            snapshot += '[';
+            append_price(snapshot, price);
+            fmt::format_to(std::back_inserter(snapshot), ",\"{:.8f}\"]", size);
+            first = false;
+        }
+
+        snapshot += R"(],"bids":[)";
+
+        first = true;
+        for (const auto& [price, size] : std::ranges::reverse_view(book.bids)) {
+            if (!first)
+                snapshot += ',';
+
+            snapshot += '[';
+            append_price(snapshot, price);
+            fmt::format_to(std::back_inserter(snapshot), ",\"{:.8f}\"]", size);
+            first = false;
+        }
+
+        snapshot += R"(],"time":")";
+        snapshot += time_;
+        snapshot += "\"}";
+
+        out(snapshot);
+    }
+}
+
+} // namespace mock
+} // namespace raccoon
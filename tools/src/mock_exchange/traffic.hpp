@@ -0,0 +1,141 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <functional>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace raccoon {
+namespace mock {
+
+/**
+ * Current time, in nanoseconds since the epoch.
+ */
+int64_t unix_nanos() noexcept;
+
+/**
+ * Shape of the synthetic feed.
+ */
+struct TrafficConfig {
+    std::vector<std::string> products{"ETH-USD"};
+
+    double rate = 1000;        // messages per second, across all products
+    double match_ratio = 0.1;  // fraction of messages that are matches
+    size_t depth = 200;        // levels per side in each book
+    size_t changes = 1;        // level changes per l2update
+
+    uint32_t burst_every_ms = 0; // extra burst interval, 0 for none
+    size_t burst_size = 0;       // messages per burst
+
+    double drop = 0.0;    // probability a message is never sent
+    double reorder = 0.0; // probability a message is swapped with the next one
+
+    uint64_t seed = 42;
+};
+
+/**
+ * Generates Coinbase style level2 and match traffic for a set of products.
+ *
+ * Each product has a real book behind it: updates change levels near the touch,
+ * the mid price wanders, and levels crossed by a move are removed, so a client
+ * applying every message ends up with the generator's book. Drops and reordering
+ * are applied after generation, to break that on purpose.
+ */
+class TrafficGenerator {
+public:
+    /**
+     * Receives each message to send, as JSON.
+     */
+    using sink = std::function<void(std::string_view)>;
+
+private:
+    static constexpr int64_t TICKS_PER_UNIT = 100; // prices are in cents
+
+    struct product_book {
+        std::string id;
+        int64_t mid;                      // in ticks
+        std::map<int64_t, double> bids{}; // ticks to size
+        std::map<int64_t, double> asks{}; // ticks to size
+        uint64_t trade_id = 1;
+    };
+
+    TrafficConfig config_;
+    std::vector<product_book> books_;
+    std::mt19937_64 rng_;
+
+    uint64_t sequence_ = 1;
+    std::string time_;    // timestamp for messages generated now
+    std::string message_; // message being built
+
+    // Message held back to be sent out of order
+    std::optional<std::string> held_;
+
+    uint64_t generated_ = 0;
+    uint64_t dropped_ = 0;
+    uint64_t reordered_ = 0;
+
+public:
+    explicit TrafficGenerator(TrafficConfig config);
+
+    [[nodiscard]] const TrafficConfig&
+    config() const noexcept
+    {
+        return config_;
+    }
+
+    /**
+     * Set the timestamp used by messages generated from now on.
+     *
+     * @param nanos Nanoseconds since the epoch.
+     */
+    void set_time(int64_t nanos);
+
+    /**
+     * Generate messages, applying drops and reordering.
+     *
+     * @param count Messages to generate.
+     * @param out Called with each message that should be sent, in order.
+     */
+    void generate(size_t count, const sink& out);
+
+    /**
+     * Write a level2 snapshot of every book.
+     */
+    void snapshots(const sink& out);
+
+    /**
+     * Messages generated, including dropped ones.
+     */
+    [[nodiscard]] uint64_t
+    generated() const noexcept
+    {
+        return generated_;
+    }
+
+    [[nodiscard]] uint64_t
+    dropped() const noexcept
+    {
+        return dropped_;
+    }
+
+    [[nodiscard]] uint64_t
+    reordered() const noexcept
+    {
+        return reordered_;
+    }
+
+private:
+    void update_(product_book& book);
+    void match_(product_book& book);
+    void deliver_(const sink& out);
+
+    bool chance_(double probability);
+};
+
+} // namespace mock
+} // namespace raccoon
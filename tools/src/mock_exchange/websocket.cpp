@@ -0,0 +1,348 @@
+#include "websocket.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+
+namespace raccoon {
+namespace mock {
+namespace ws {
+
+// Appended to the client's key before hashing, per RFC 6455
+static constexpr std::string_view HANDSHAKE_GUID =
+    "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+std::array<uint8_t, 20>
+sha1(std::string_view data)
+{
+    // NOLINTBEGIN(*-magic-numbers)
+    std::array<uint32_t, 5> state{
+        0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0
+    };
+
+    // Pad to a multiple of 64 bytes, ending in the length in bits
+    std::string msg(data);
+    uint64_t bit_length = static_cast<uint64_t>(data.size()) * 8;
+
+    msg.push_back(static_cast<char>(0x80));
+    while (msg.size() % 64 != 56)
+        msg.push_back('\0');
+
+    for (int shift = 56; shift >= 0; shift -= 8)
+        msg.push_back(static_cast<char>((bit_length >> shift) & 0xFF));
+
+    for (size_t chunk = 0; chunk < msg.size(); chunk += 64) {
+        std::array<uint32_t, 80> words{};
+
+        for (size_t i = 0; i < 16; i++) {
+            for (size_t j = 0; j < 4; j++) {
+                auto byte = static_cast<uint8_t>(msg[chunk + i * 4 + j]);
+                words[i] = (words[i] << 8U) | byte;
+            }
+        }
+
+        for (size_t i = 16; i < 80; i++) {
+            auto mixed = words[i - 3] ^ words[i - 8] ^ words[i - 14] ^ words[i - 16];
+            words[i] = std::rotl(mixed, 1);
+        }
+
+        auto [a, b, c, d, e] = state;
+
+        for (size_t i = 0; i < 80; i++) {
+            uint32_t f = 0;
+            uint32_t k = 0;
+
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            }
+            else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            }
+            else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            }
+            else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+
+            uint32_t temp = std::rotl(a, 5) + f + e + k + words[i];
+            e = d;
+            d = c;
+            c = std::rotl(b, 30);
+            b = a;
+            a = temp;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+
+    std::array<uint8_t, 20> digest{};
+
+    for (size_t i = 0; i < state.size(); i++) {
+        for (size_t j = 0; j < 4; j++)
+            digest[i * 4 + j] = static_cast<uint8_t>(state[i] >> (24 - j * 8));
+    }
+    // NOLINTEND(*-magic-numbers)
+
+    return digest;
+}
+
+std::string
+base64(std::span<const uint8_t> data)
+{
+    constexpr std::string_view ALPHABET =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    std::string res;
+    res.reserve((data.size() + 2) / 3 * 4);
+
+    for (size_t i = 0; i < data.size(); i += 3) {
+        uint32_t group = static_cast<uint32_t>(data[i]) << 16U;
+
+        if (i + 1 < data.size())
+            group |= static_cast<uint32_t>(data[i + 1]) << 8U;
+        if (i + 2 < data.size())
+            group |= data[i + 2];
+
+        res.push_back(ALPHABET[(group >> 18U) & 0x3FU]);
+        res.push_back(ALPHABET[(group >> 12U) & 0x3FU]);
+        res.push_back(i + 1 < data.size() ? ALPHABET[(group >> 6U) & 0x3FU] : '=');
+        res.push_back(i + 2 < data.size() ? ALPHABET[group & 0x3FU] : '=');
+    }
+
+    return res;
+}
+
+std::string
+accept_key(std::string_view client_key)
+{
+    std::string input(client_key);
+    input += HANDSHAKE_GUID;
+
+    return base64(sha1(input));
+}
+
+/**
+ * Find the value of an HTTP header, matching its name case-insensitively.
+ */
+static std::optional<std::string_view>
+header_value(std::string_view request, std::string_view name)
+{
+    auto equal = [](char lhs, char rhs) {
+        return std::tolower(static_cast<unsigned char>(lhs))
+               == std::tolower(static_cast<unsigned char>(rhs));
+    };
+
+    // Skip the request line
+    auto pos = request.find("\r\n");
+
+    while (pos != std::string_view::npos) {
+        pos += 2;
+        auto end = request.find("\r\n", pos);
+
+        if (end == std::string_view::npos || end == pos)
+            break;
+
+        auto line = request.substr(pos, end - pos);
+        auto colon = line.find(':');
+
+        if (colon != std::string_view::npos
+            && std::ranges::equal(line.substr(0, colon), name, equal)) {
+            auto value = line.substr(colon + 1);
+
+            while (!value.empty() && value.front() == ' ')
+                value.remove_prefix(1);
+            while (!value.empty() && value.back() == ' ')
+                value.remove_suffix(1);
+
+            return value;
+        }
+
+        pos = end;
+    }
+
+    return std::nullopt;
+}
+
+bool
+offers_deflate(std::string_view request)
+{
+    auto extensions = header_value(request, "Sec-WebSocket-Extensions");
+    return extensions && extensions->find("permessage-deflate") != std::string::npos;
+}
+
+std::optional<std::string>
+handshake_response(std::string_view request, bool deflate)
+{
+    auto upgrade = header_value(request, "Upgrade");
+    auto key = header_value(request, "Sec-WebSocket-Key");
+
+    auto is_websocket = [](std::string_view value) {
+        auto equal = [](char lhs, char rhs) {
+            return std::tolower(static_cast<unsigned char>(lhs)) == rhs;
+        };
+
+        return std::ranges::equal(value, std::string_view("websocket"), equal);
+    };
+
+    if (!upgrade || !key || !is_websocket(*upgrade))
+        return std::nullopt;
+
+    return fmt::format(
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: {}\r\n"
+        "{}"
+        "\r\n",
+        accept_key(*key),
+        deflate ? "Sec-WebSocket-Extensions: permessage-deflate; "
+                  "server_no_context_takeover; client_no_context_takeover\r\n"
+                : ""
+    );
+}
+
+void
+encode_frame(Opcode opcode, std::string_view payload, std::string& out, bool compressed)
+{
+    // NOLINTBEGIN(*-magic-numbers)
+    auto first = 0x80U | static_cast<uint8_t>(opcode);
+
+    if (compressed)
+        first |= 0x40U;
+
+    out.push_back(static_cast<char>(first));
+
+    auto size = payload.size();
+
+    if (size < 126) {
+        out.push_back(static_cast<char>(size));
+    }
+    else if (size <= UINT16_MAX) {
+        out.push_back(static_cast<char>(126));
+        out.push_back(static_cast<char>(size >> 8U));
+        out.push_back(static_cast<char>(size & 0xFFU));
+    }
+    else {
+        out.push_back(static_cast<char>(127));
+        for (int shift = 56; shift >= 0; shift -= 8)
+            out.push_back(static_cast<char>((size >> shift) & 0xFFU));
+    }
+    // NOLINTEND(*-magic-numbers)
+
+    out += payload;
+}
+
+size_t
+decode_frame(std::string_view data, Frame& frame)
+{
+    // NOLINTBEGIN(*-magic-numbers)
+    if (data.size() < 2)
+        return 0;
+
+    auto first = static_cast<uint8_t>(data[0]);
+    auto second = static_cast<uint8_t>(data[1]);
+
+    // Clients must mask their frames
+    if ((second & 0x80U) == 0) [[unlikely]]
+        return FRAME_ERROR;
+
+    size_t pos = 2;
+    uint64_t size = second & 0x7FU;
+
+    if (size >= 126) {
+        size_t extra = size == 126 ? 2 : 8;
+        if (data.size() < pos + extra)
+            return 0;
+
+        size = 0;
+        for (size_t i = 0; i < extra; i++)
+            size = (size << 8U) | static_cast<uint8_t>(data[pos + i]);
+
+        pos += extra;
+    }
+
+    if (size > MAX_CLIENT_FRAME) [[unlikely]]
+        return FRAME_ERROR;
+
+    if (data.size() < pos + 4 + size)
+        return 0;
+
+    auto mask = data.substr(pos, 4);
+    pos += 4;
+
+    frame.fin = (first & 0x80U) != 0;
+    frame.opcode = static_cast<Opcode>(first & 0x0FU);
+    frame.payload.assign(data.substr(pos, size));
+
+    for (size_t i = 0; i < frame.payload.size(); i++)
+        frame.payload[i] = static_cast<char>(frame.payload[i] ^ mask[i % 4]);
+    // NOLINTEND(*-magic-numbers)
+
+    return pos + size;
+}
+
+Compressor::Compressor()
+{
+    // Raw deflate, as permessage-deflate wants
+    constexpr int WINDOW_BITS = -15;
+    constexpr int MEMORY_LEVEL = 8;
+
+    ok_ = deflateInit2(
+              &stream_,
+              Z_BEST_SPEED,
+              Z_DEFLATED,
+              WINDOW_BITS,
+              MEMORY_LEVEL,
+              Z_DEFAULT_STRATEGY
+          )
+          == Z_OK;
+
+    if (!ok_) [[unlikely]]
+        log_e(web, "Could not set up compression");
+}
+
+Compressor::~Compressor()
+{
+    if (ok_)
+        deflateEnd(&stream_);
+}
+
+std::string_view
+Compressor::compress(std::string_view message)
+{
+    // Never sent, as the receiver adds it back
+    constexpr size_t TAIL_SIZE = 4;
+
+    if (!ok_) [[unlikely]]
+        return {};
+
+    out_.resize(deflateBound(&stream_, static_cast<uLong>(message.size())) + TAIL_SIZE);
+
+    // NOLINTBEGIN(*-reinterpret-cast, *-const-cast)
+    stream_.next_in =
+        reinterpret_cast<Bytef*>(const_cast<char*>(message.data()));
+    stream_.avail_in = static_cast<uInt>(message.size());
+    stream_.next_out = reinterpret_cast<Bytef*>(out_.data());
+    stream_.avail_out = static_cast<uInt>(out_.size());
+    // NOLINTEND(*-reinterpret-cast, *-const-cast)
+
+    deflate(&stream_, Z_SYNC_FLUSH);
+
+    auto size = out_.size() - stream_.avail_out;
+    deflateReset(&stream_);
+
+    return std::string_view(out_).substr(0, size - TAIL_SIZE);
+}
+
+} // namespace ws
+} // namespace mock
+} // namespace raccoon
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <zlib.h>
+
+#include <array>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace raccoon {
+namespace mock {
+
+/**
+ * The server side of the WebSocket protocol (RFC 6455), as much as the mock
+ * exchange needs: the opening handshake, unfragmented frames, and compressing them
+ * with permessage-deflate (RFC 7692).
+ */
+namespace ws {
+
+enum class Opcode : uint8_t {
+    CONTINUATION = 0x0,
+    TEXT = 0x1,
+    BINARY = 0x2,
+    CLOSE = 0x8,
+    PING = 0x9,
+    PONG = 0xA,
+};
+
+/**
+ * A frame received from a client, unmasked.
+ */
+struct Frame {
+    Opcode opcode{};
+    bool fin{};
+    std::string payload;
+};
+
+// Returned by decode_frame() for frames we can't accept
+inline constexpr size_t FRAME_ERROR = SIZE_MAX;
+
+// Largest client frame we accept; clients only send subscriptions and pings
+inline constexpr size_t MAX_CLIENT_FRAME = 1 << 20;
+
+/**
+ * SHA-1 digest of some data, for the handshake only.
+ */
+std::array<uint8_t, 20> sha1(std::string_view data);
+
+/**
+ * Standard base64 encoding, with padding.
+ */
+std::string base64(std::span<const uint8_t> data);
+
+/**
+ * The Sec-WebSocket-Accept value for a client's Sec-WebSocket-Key.
+ */
+std::string accept_key(std::string_view client_key);
+
+/**
+ * If a client's opening handshake offers permessage-deflate.
+ */
+bool offers_deflate(std::string_view request);
+
+/**
+ * Build the 101 response to a client's opening handshake.
+ *
+ * @param request The full HTTP request, up to and including the blank line.
+ * @param deflate If permessage-deflate is accepted, without context takeover.
+ *
+ * @returns std::optional<std::string> The response, or nothing if the request is
+ *          not a WebSocket upgrade.
+ */
+std::optional<std::string>
+handshake_response(std::string_view request, bool deflate = false);
+
+/**
+ * Append a single, unmasked frame to a buffer.
+ *
+ * @param compressed If the payload was compressed, which sets RSV1.
+ */
+void encode_frame(
+    Opcode opcode, std::string_view payload, std::string& out, bool compressed = false
+);
+
+/**
+ * Compresses messages for permessage-deflate, each on its own, so one compressed
+ * frame can be sent to every client.
+ */
+class Compressor {
+    z_stream stream_{};
+    bool ok_ = false;
+    std::string out_;
+
+public:
+    Compressor();
+    ~Compressor();
+
+    Compressor(const Compressor&) = delete;
+    Compressor(Compressor&&) = delete;
+    Compressor& operator=(const Compressor&) = delete;
+    Compressor& operator=(Compressor&&) = delete;
+
+    /**
+     * Compress a message.
+     *
+     * @returns std::string_view The payload to send, valid until the next call.
+     */
+    std::string_view compress(std::string_view message);
+};
+
+/**
+ * Decode the client frame at the front of some data.
+ *
+ * @returns size_t Bytes consumed, 0 if the frame is incomplete, or FRAME_ERROR if
+ *          it's malformed, unmasked or too large.
+ */
+size_t decode_frame(std::string_view data, Frame& frame);
+
+} // namespace ws
+
+} // namespace mock
+} // namespace raccoon
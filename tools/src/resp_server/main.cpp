@@ -0,0 +1,151 @@
+#include "common.hpp"
+#include "server.hpp"
+
+#include <argparse/argparse.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <thread>
+
+using raccoon::resp::Command;
+using raccoon::resp::COMMAND_COUNT;
+using raccoon::resp::RespServer;
+using raccoon::resp::ServerConfig;
+using raccoon::resp::ServerStats;
+
+// NOLINTNEXTLINE(*-avoid-non-const-global-variables)
+static volatile std::sig_atomic_t interrupted = 0;
+
+static std::tuple<uint8_t, ServerConfig>
+process_arguments(int argc, const char** argv)
+{
+    argparse::ArgumentParser program(
+        "raccoon-resp-server", VERSION, argparse::default_arguments::help
+    );
+
+    program.add_description(
+        "Accepts Redis writes, counting commands and bytes, optionally replying late. "
+        "Writes are dropped unless --store is given."
+    );
+
+    uint8_t verbosity = 0;
+    program.add_argument("-v", "--verbose")
+        .help("increase output verbosity")
+        .action([&](const auto& /* unused */) { ++verbosity; })
+        .append()
+        .default_value(false)
+        .implicit_value(true)
+        .nargs(0);
+
+    program.add_argument("--host").help("address to listen on").default_value(
+        std::string("127.0.0.1")
+    );
+
+    program.add_argument("--port")
+        .help("port to listen on, away from a real Redis by default")
+        .default_value(6380) // NOLINT(*-magic-numbers)
+        .scan<'i', int>();
+
+    program.add_argument("--latency")
+        .help("milliseconds to hold back each batch of replies")
+        .default_value(uint64_t{0})
+        .scan<'u', uint64_t>();
+
+    program.add_argument("--jitter")
+        .help("up to this many more milliseconds, at random")
+        .default_value(uint64_t{0})
+        .scan<'u', uint64_t>();
+
+    program.add_argument("--seed")
+        .help("random seed, for reproducible jitter")
+        .default_value(uint64_t{42}) // NOLINT(*-magic-numbers)
+        .scan<'u', uint64_t>();
+
+    program.add_argument("--store")
+        .help("keep strings, hashes and sorted sets, so they can be read back")
+        .default_value(false)
+        .implicit_value(true);
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        exit(1); // NOLINT(concurrency-*)
+    }
+
+    ServerConfig config;
+    config.host = program.get<std::string>("--host");
+    config.port = program.get<int>("--port");
+    config.latency_ms = program.get<uint64_t>("--latency");
+    config.jitter_ms = program.get<uint64_t>("--jitter");
+    config.seed = program.get<uint64_t>("--seed");
+    config.store = program.get<bool>("--store");
+
+    return std::make_tuple(verbosity, std::move(config));
+}
+
+/**
+ * Log the traffic since the last report, by command.
+ */
+static void
+report(const ServerStats& now, const ServerStats& last)
+{
+    auto commands = now.total_commands() - last.total_commands();
+
+    if (commands == 0)
+        return;
+
+    std::vector<std::string> by_command;
+
+    for (size_t i = 0; i < COMMAND_COUNT; i++) {
+        auto count = now.commands[i] - last.commands[i];
+        auto name = raccoon::resp::command_name(static_cast<Command>(i));
+
+        if (count != 0)
+            by_command.push_back(fmt::format("{} {}", name, count));
+    }
+
+    log_i(
+        redis,
+        "{} cmd/s ({}), {:.1f} MB/s in, {:.1f} MB/s out; {} errors so far",
+        commands,
+        fmt::format("{}", fmt::join(by_command, ", ")),
+        static_cast<double>(now.bytes_in - last.bytes_in) / 1e6,   // NOLINT
+        static_cast<double>(now.bytes_out - last.bytes_out) / 1e6, // NOLINT
+        now.errors
+    );
+}
+
+int
+main(int argc, const char** argv)
+{
+    auto [verbosity, config] = process_arguments(argc, argv);
+
+    raccoon::logging::init(verbosity);
+
+    RespServer server(std::move(config));
+
+    if (!server.start())
+        return 1;
+
+    std::signal(SIGINT, [](int /* signum */) { interrupted = 1; });
+
+    // Report once a second until ^C
+    auto last = server.stats();
+
+    while (interrupted == 0) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        auto now = server.stats();
+        report(now, last);
+        last = now;
+    }
+
+    log_w(main, "Received SIGINT, shutting down");
+    server.stop();
+
+    return 0;
+}
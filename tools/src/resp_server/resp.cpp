@@ -0,0 +1,78 @@
+#include "resp.hpp"
+
+#include <charconv>
+
+namespace raccoon {
+namespace resp {
+
+// Guard against garbage lengths
+static constexpr size_t MAX_ARGS = 1 << 20;
+static constexpr size_t MAX_BULK = 512UL * 1024 * 1024;
+
+/**
+ * Parse a length line like "*3\r\n" or "$5\r\n" at the front of some data.
+ *
+ * @returns size_t Bytes consumed, 0 if incomplete, or PARSE_ERROR.
+ */
+static size_t
+parse_length(std::string_view data, char type, size_t& length)
+{
+    if (data.empty())
+        return 0;
+
+    if (data.front() != type) [[unlikely]]
+        return PARSE_ERROR;
+
+    auto end = data.find("\r\n");
+    if (end == std::string_view::npos)
+        return 0;
+
+    auto [ptr, err] = std::from_chars(data.data() + 1, data.data() + end, length);
+
+    if (err != std::errc{} || ptr != data.data() + end) [[unlikely]]
+        return PARSE_ERROR;
+
+    return end + 2;
+}
+
+size_t
+parse_command(std::string_view data, std::vector<std::string_view>& args)
+{
+    args.clear();
+
+    size_t count = 0;
+    size_t pos = parse_length(data, '*', count);
+
+    if (pos == 0 || pos == PARSE_ERROR)
+        return pos;
+
+    if (count == 0 || count > MAX_ARGS) [[unlikely]]
+        return PARSE_ERROR;
+
+    for (size_t i = 0; i < count; i++) {
+        size_t length = 0;
+        size_t used = parse_length(data.substr(pos), '$', length);
+
+        if (used == 0 || used == PARSE_ERROR)
+            return used;
+
+        if (length > MAX_BULK) [[unlikely]]
+            return PARSE_ERROR;
+
+        pos += used;
+
+        if (data.size() < pos + length + 2)
+            return 0;
+
+        if (data.substr(pos + length, 2) != "\r\n") [[unlikely]]
+            return PARSE_ERROR;
+
+        args.push_back(data.substr(pos, length));
+        pos += length + 2;
+    }
+
+    return pos;
+}
+
+} // namespace resp
+} // namespace raccoon
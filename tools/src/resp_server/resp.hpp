@@ -0,0 +1,66 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace raccoon {
+namespace resp {
+
+// Returned by parse_command() for input that isn't a RESP command
+inline constexpr size_t PARSE_ERROR = SIZE_MAX;
+
+/**
+ * Parse the command at the front of some data.
+ *
+ * Commands are arrays of bulk strings, which is all clients send. The arguments
+ * point into the data.
+ *
+ * @returns size_t Bytes consumed, 0 if the command is incomplete, or PARSE_ERROR.
+ */
+size_t parse_command(std::string_view data, std::vector<std::string_view>& args);
+
+/*
+ * Reply encoding
+ */
+
+inline void
+append_status(std::string& out, std::string_view status)
+{
+    out += '+';
+    out += status;
+    out += "\r\n";
+}
+
+inline void
+append_error(std::string& out, std::string_view error)
+{
+    out += '-';
+    out += error;
+    out += "\r\n";
+}
+
+inline void
+append_integer(std::string& out, int64_t value)
+{
+    fmt::format_to(std::back_inserter(out), ":{}\r\n", value);
+}
+
+inline void
+append_bulk(std::string& out, std::string_view value)
+{
+    fmt::format_to(std::back_inserter(out), "${}\r\n", value.size());
+    out += value;
+    out += "\r\n";
+}
+
+inline void
+append_array_header(std::string& out, size_t size)
+{
+    fmt::format_to(std::back_inserter(out), "*{}\r\n", size);
+}
+
+} // namespace resp
+} // namespace raccoon
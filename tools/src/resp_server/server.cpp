@@ -0,0 +1,706 @@
+#include "server.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+
+namespace raccoon {
+namespace resp {
+
+static constexpr size_t READ_CHUNK_SIZE = 64 * 1024;
+static constexpr int LISTEN_BACKLOG = 16;
+
+static constexpr std::array<std::string_view, COMMAND_COUNT> COMMAND_NAMES{
+    "HSET",
+    "HMSET",
+    "HDEL",
+    "DEL",
+    "SET",
+    "XADD",
+    "PUBLISH",
+    "ZADD",
+    "ZREM",
+    "GET",
+    "HGETALL",
+    "HMGET",
+    "ZRANGEBYSCORE",
+    "ZREVRANGEBYSCORE",
+    "MULTI",
+    "EXEC",
+    "DISCARD",
+    "PING",
+    "OTHER",
+};
+
+std::string_view
+command_name(Command command)
+{
+    return COMMAND_NAMES[static_cast<size_t>(command)];
+}
+
+/**
+ * Compare a name against an upper case one, ignoring case.
+ */
+static bool
+is_named(std::string_view name, std::string_view upper)
+{
+    auto equal = [](char lhs, char rhs) {
+        return std::toupper(static_cast<unsigned char>(lhs)) == rhs;
+    };
+
+    return std::ranges::equal(name, upper, equal);
+}
+
+Command
+lookup_command(std::string_view name)
+{
+    for (size_t i = 0; i + 1 < COMMAND_COUNT; i++) {
+        if (is_named(name, COMMAND_NAMES[i]))
+            return static_cast<Command>(i);
+    }
+
+    return Command::OTHER;
+}
+
+uint64_t
+ServerStats::total_commands() const noexcept
+{
+    uint64_t total = 0;
+    for (auto count : commands)
+        total += count;
+
+    return total;
+}
+
+RespServer::RespServer(ServerConfig config) :
+    config_(std::move(config)), rng_(config_.seed), read_chunk_(READ_CHUNK_SIZE, '\0')
+{}
+
+RespServer::~RespServer()
+{
+    stop();
+}
+
+bool
+RespServer::start()
+{
+    sockaddr_in addr{};
+
+    if (int err = uv_ip4_addr(config_.host.c_str(), config_.port, &addr)) {
+        log_e(redis, "Invalid address {}: {}", config_.host, uv_strerror(err));
+        return false;
+    }
+
+    uv_loop_init(&loop_);
+    uv_tcp_init(&loop_, &listener_);
+    listener_.data = this;
+
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    int err = uv_tcp_bind(&listener_, reinterpret_cast<const sockaddr*>(&addr), 0);
+
+    if (err == 0) {
+        err = uv_listen(
+            reinterpret_cast<uv_stream_t*>(&listener_), // NOLINT(*-reinterpret-cast)
+            LISTEN_BACKLOG,
+            on_connection_
+        );
+    }
+
+    if (err != 0) {
+        log_e(
+            redis,
+            "Could not listen on {}:{}: {}",
+            config_.host,
+            config_.port,
+            uv_strerror(err)
+        );
+
+        uv_close(reinterpret_cast<uv_handle_t*>(&listener_), nullptr); // NOLINT
+        uv_run(&loop_, UV_RUN_DEFAULT);
+        uv_loop_close(&loop_);
+        return false;
+    }
+
+    // Find the port we got
+    sockaddr_storage bound{};
+    int length = sizeof(bound);
+
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    uv_tcp_getsockname(&listener_, reinterpret_cast<sockaddr*>(&bound), &length);
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    port_ = ntohs(reinterpret_cast<sockaddr_in*>(&bound)->sin_port);
+
+    // For stop(), from other threads
+    uv_async_init(&loop_, &stop_async_, [](uv_async_t* handle) {
+        auto* server = static_cast<RespServer*>(handle->data);
+
+        uv_close(reinterpret_cast<uv_handle_t*>(&server->listener_), nullptr); // NOLINT
+        uv_close(reinterpret_cast<uv_handle_t*>(handle), nullptr); // NOLINT
+
+        for (auto& conn : server->clients_)
+            server->close_(*conn);
+    });
+    stop_async_.data = this;
+
+    thread_ = std::jthread([this] {
+        uv_run(&loop_, UV_RUN_DEFAULT);
+        uv_loop_close(&loop_);
+    });
+
+    log_i(redis, "RESP server listening on {}:{}", config_.host, port_);
+    return true;
+}
+
+void
+RespServer::stop()
+{
+    if (!thread_.joinable())
+        return;
+
+    uv_async_send(&stop_async_);
+    thread_.join();
+}
+
+ServerStats
+RespServer::stats() const
+{
+    ServerStats stats;
+
+    for (size_t i = 0; i < COMMAND_COUNT; i++)
+        stats.commands[i] = commands_[i].load(std::memory_order_relaxed);
+
+    stats.bytes_in = bytes_in_.load(std::memory_order_relaxed);
+    stats.bytes_out = bytes_out_.load(std::memory_order_relaxed);
+    stats.connections = connections_.load(std::memory_order_relaxed);
+    stats.errors = errors_.load(std::memory_order_relaxed);
+
+    return stats;
+}
+
+void
+RespServer::reset_stats()
+{
+    for (auto& count : commands_)
+        count.store(0, std::memory_order_relaxed);
+
+    bytes_in_.store(0, std::memory_order_relaxed);
+    bytes_out_.store(0, std::memory_order_relaxed);
+    connections_.store(0, std::memory_order_relaxed);
+    errors_.store(0, std::memory_order_relaxed);
+}
+
+void
+RespServer::on_connection_(uv_stream_t* listener, int status)
+{
+    auto* server = static_cast<RespServer*>(listener->data);
+
+    if (status < 0) [[unlikely]] {
+        log_e(redis, "Error accepting connection: {}", uv_strerror(status));
+        return;
+    }
+
+    auto& conn = server->clients_.emplace_back(std::make_unique<client>());
+    conn->server = server;
+
+    uv_tcp_init(&server->loop_, &conn->handle);
+    conn->handle.data = conn.get();
+
+    uv_timer_init(&server->loop_, &conn->delay_timer);
+    conn->delay_timer.data = conn.get();
+
+    auto* stream = reinterpret_cast<uv_stream_t*>(&conn->handle); // NOLINT
+
+    if (uv_accept(listener, stream) != 0) [[unlikely]] {
+        server->close_(*conn);
+        return;
+    }
+
+    // Replies should leave as soon as they're written, like Redis's
+    uv_tcp_nodelay(&conn->handle, 1);
+
+    uv_read_start(
+        stream,
+        [](uv_handle_t* handle, size_t /* suggested */, uv_buf_t* buf) {
+            auto* reader = static_cast<client*>(handle->data);
+            auto& chunk = reader->server->read_chunk_;
+
+            *buf = uv_buf_init(chunk.data(), static_cast<unsigned>(chunk.size()));
+        },
+        on_read_
+    );
+
+    server->connections_.fetch_add(1, std::memory_order_relaxed);
+    log_d(redis, "Client connected ({} total)", server->clients_.size());
+}
+
+void
+RespServer::on_read_(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf)
+{
+    auto* conn = static_cast<client*>(stream->data);
+
+    if (nread < 0) {
+        if (nread != UV_EOF)
+            log_w(redis, "Client read error: {}", uv_strerror(static_cast<int>(nread)));
+
+        conn->server->close_(*conn);
+        return;
+    }
+
+    auto bytes = static_cast<size_t>(nread);
+    conn->server->bytes_in_.fetch_add(bytes, std::memory_order_relaxed);
+
+    conn->read_buf.append(buf->base, bytes);
+    conn->server->handle_input_(*conn);
+}
+
+void
+RespServer::handle_input_(client& conn)
+{
+    // Reply to every complete command, keeping any partial one
+    std::string_view data(conn.read_buf);
+
+    while (true) {
+        auto used = parse_command(data, args_);
+
+        if (used == 0)
+            break;
+
+        if (used == PARSE_ERROR) [[unlikely]] {
+            log_w(redis, "Closing client after a malformed command");
+            errors_.fetch_add(1, std::memory_order_relaxed);
+
+            append_error(conn.pending, "ERR Protocol error");
+            flush_(conn);
+            close_(conn);
+            return;
+        }
+
+        data.remove_prefix(used);
+        handle_command_(conn, conn.pending);
+    }
+
+    conn.read_buf.erase(0, conn.read_buf.size() - data.size());
+
+    if (conn.pending.empty())
+        return;
+
+    if (config_.latency_ms == 0 && config_.jitter_ms == 0) {
+        flush_(conn);
+        return;
+    }
+
+    // Hold this batch of replies back, but never past a later one
+    auto delay = config_.latency_ms;
+    if (config_.jitter_ms != 0)
+        delay += std::uniform_int_distribution<uint64_t>(0, config_.jitter_ms)(rng_);
+
+    auto due = std::max(uv_now(&loop_) + delay, conn.last_due_ms);
+    conn.last_due_ms = due;
+
+    conn.delayed_replies.push_back({due, std::move(conn.pending)});
+    conn.pending.clear();
+
+    if (conn.delayed_replies.size() == 1)
+        schedule_(conn);
+}
+
+void
+RespServer::handle_command_(client& conn, std::string& out)
+{
+    auto command = lookup_command(args_.front());
+    commands_[static_cast<size_t>(command)].fetch_add(1, std::memory_order_relaxed);
+
+    switch (command) {
+        case Command::MULTI:
+            if (conn.in_multi) [[unlikely]] {
+                errors_.fetch_add(1, std::memory_order_relaxed);
+                append_error(out, "ERR MULTI calls can not be nested");
+                return;
+            }
+
+            conn.in_multi = true;
+            append_status(out, "OK");
+            return;
+
+        case Command::EXEC:
+        case Command::DISCARD:
+            if (!conn.in_multi) [[unlikely]] {
+                errors_.fetch_add(1, std::memory_order_relaxed);
+                append_error(
+                    out, fmt::format("ERR {} without MULTI", command_name(command))
+                );
+                return;
+            }
+
+            if (command == Command::EXEC) {
+                append_array_header(out, conn.queued_count);
+                out += conn.queued;
+            }
+            else {
+                append_status(out, "OK");
+            }
+
+            conn.in_multi = false;
+            conn.queued_count = 0;
+            conn.queued.clear();
+            return;
+
+        default:
+            break;
+    }
+
+    // Inside a transaction, replies wait for EXEC
+    if (conn.in_multi) {
+        reply_(command, conn.queued);
+        conn.queued_count++;
+
+        append_status(out, "QUEUED");
+        return;
+    }
+
+    reply_(command, out);
+}
+
+void
+RespServer::reply_(Command command, std::string& out)
+{
+    auto argc = static_cast<int64_t>(args_.size());
+
+    auto wrong_arity = [&] {
+        errors_.fetch_add(1, std::memory_order_relaxed);
+        append_error(
+            out,
+            fmt::format(
+                "ERR wrong number of arguments for '{}' command", command_name(command)
+            )
+        );
+    };
+
+    auto fail = [&](std::string_view error) {
+        errors_.fetch_add(1, std::memory_order_relaxed);
+        append_error(out, error);
+    };
+
+    // Field and value pairs after a key
+    auto pairs = [argc] { return argc >= 4 && argc % 2 == 0; };
+
+    // Arguments from `first` on
+    auto rest = [this](size_t first) {
+        return std::span<const std::string_view>(args_).subspan(first);
+    };
+
+    switch (command) {
+        case Command::HSET:
+            if (!pairs())
+                return wrong_arity();
+
+            if (config_.store)
+                append_integer(out, store_.hset(args_[1], rest(2)));
+            else
+                append_integer(out, (argc - 2) / 2);
+            break;
+
+        case Command::HMSET:
+            if (!pairs())
+                return wrong_arity();
+
+            if (config_.store)
+                store_.hset(args_[1], rest(2));
+
+            append_status(out, "OK");
+            break;
+
+        case Command::HDEL:
+            if (argc < 3)
+                return wrong_arity();
+
+            if (config_.store)
+                append_integer(out, store_.hdel(args_[1], rest(2)));
+            else
+                append_integer(out, argc - 2);
+            break;
+
+        case Command::DEL:
+            if (argc < 2)
+                return wrong_arity();
+
+            if (config_.store)
+                append_integer(out, store_.del(rest(1)));
+            else
+                append_integer(out, argc - 1);
+            break;
+
+        case Command::SET:
+            if (argc < 3)
+                return wrong_arity();
+
+            if (config_.store)
+                store_.set(args_[1], args_[2]);
+
+            append_status(out, "OK");
+            break;
+
+        case Command::XADD:
+            if (argc < 5)
+                return wrong_arity();
+
+            append_bulk(out, next_stream_id_());
+            break;
+
+        case Command::PUBLISH:
+            if (argc != 3)
+                return wrong_arity();
+
+            // Nobody is subscribed
+            append_integer(out, 0);
+            break;
+
+        case Command::ZADD: {
+            // Plain score and member pairs, no NX/XX/GT/LT/CH/INCR
+            if (!pairs())
+                return wrong_arity();
+
+            score_bound score;
+
+            for (size_t i = 2; i < args_.size(); i += 2) {
+                if (!score_bound::parse(args_[i], score) || score.exclusive)
+                    return fail("ERR value is not a valid float");
+            }
+
+            if (config_.store)
+                append_integer(out, store_.zadd(args_[1], rest(2)));
+            else
+                append_integer(out, (argc - 2) / 2);
+            break;
+        }
+
+        case Command::ZREM:
+            if (argc < 3)
+                return wrong_arity();
+
+            if (config_.store)
+                append_integer(out, store_.zrem(args_[1], rest(2)));
+            else
+                append_integer(out, argc - 2);
+            break;
+
+        /*
+         * Reads answer from the store, which stays empty unless enabled
+         */
+
+        case Command::GET:
+            if (argc != 2)
+                return wrong_arity();
+
+            store_.get(args_[1], out);
+            break;
+
+        case Command::HGETALL:
+            if (argc != 2)
+                return wrong_arity();
+
+            store_.hgetall(args_[1], out);
+            break;
+
+        case Command::HMGET:
+            if (argc < 3)
+                return wrong_arity();
+
+            store_.hmget(args_[1], rest(2), out);
+            break;
+
+        case Command::ZRANGEBYSCORE:
+        case Command::ZREVRANGEBYSCORE: {
+            if (argc < 4)
+                return wrong_arity();
+
+            auto error = range_by_score_(command == Command::ZREVRANGEBYSCORE, out);
+            if (!error.empty())
+                return fail(error);
+            break;
+        }
+
+        case Command::PING:
+            if (argc > 2)
+                return wrong_arity();
+
+            if (argc == 2)
+                append_bulk(out, args_[1]);
+            else
+                append_status(out, "PONG");
+            break;
+
+        default:
+            errors_.fetch_add(1, std::memory_order_relaxed);
+            append_error(out, fmt::format("ERR unknown command '{}'", args_.front()));
+            break;
+    }
+}
+
+std::string_view
+RespServer::range_by_score_(bool reverse, std::string& out)
+{
+    // ZREVRANGEBYSCORE takes the bounds the other way around
+    score_bound min;
+    score_bound max;
+
+    if (!score_bound::parse(args_[reverse ? 3 : 2], min)
+        || !score_bound::parse(args_[reverse ? 2 : 3], max)) {
+        return "ERR min or max is not a float";
+    }
+
+    bool with_scores = false;
+    size_t offset = 0;
+    int64_t count = -1;
+
+    for (size_t i = 4; i < args_.size(); i++) {
+        if (is_named(args_[i], "WITHSCORES")) {
+            with_scores = true;
+            continue;
+        }
+
+        if (!is_named(args_[i], "LIMIT") || i + 2 >= args_.size())
+            return "ERR syntax error";
+
+        auto parse = [](std::string_view str, auto& value) {
+            const auto* end = str.data() + str.size();
+            auto [ptr, err] = std::from_chars(str.data(), end, value);
+
+            return err == std::errc() && ptr == end;
+        };
+
+        int64_t start = 0;
+
+        if (!parse(args_[i + 1], start) || !parse(args_[i + 2], count))
+            return "ERR value is not an integer or out of range";
+
+        // A negative offset returns nothing, like Redis
+        if (start < 0)
+            count = 0;
+
+        offset = static_cast<size_t>(std::max<int64_t>(start, 0));
+        i += 2;
+    }
+
+    store_.zrange_by_score(
+        args_[1], min, max, reverse, with_scores, offset, count, out
+    );
+    return {};
+}
+
+std::string
+RespServer::next_stream_id_()
+{
+    // Ids are <milliseconds>-<sequence>, always increasing like Redis's
+    auto now = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()
+        )
+            .count()
+    );
+
+    if (now > last_stream_ms_) {
+        last_stream_ms_ = now;
+        stream_seq_ = 0;
+    }
+    else {
+        stream_seq_++;
+    }
+
+    return fmt::format("{}-{}", last_stream_ms_, stream_seq_);
+}
+
+void
+RespServer::on_delay_(uv_timer_t* timer)
+{
+    auto* conn = static_cast<client*>(timer->data);
+    auto* server = conn->server;
+    auto now = uv_now(&server->loop_);
+
+    auto& replies = conn->delayed_replies;
+
+    while (!replies.empty() && replies.front().due_ms <= now) {
+        conn->pending += replies.front().data;
+        replies.pop_front();
+    }
+
+    server->flush_(*conn);
+
+    if (!replies.empty())
+        server->schedule_(*conn);
+}
+
+void
+RespServer::schedule_(client& conn)
+{
+    auto now = uv_now(&loop_);
+    auto due = conn.delayed_replies.front().due_ms;
+
+    uv_timer_start(&conn.delay_timer, on_delay_, due > now ? due - now : 0, 0);
+}
+
+void
+RespServer::flush_(client& conn)
+{
+    if (conn.pending.empty() || conn.closing)
+        return;
+
+    auto* req = new write_req; // NOLINT(*-owning-memory)
+    req->data.swap(conn.pending);
+    req->req.data = req;
+
+    bytes_out_.fetch_add(req->data.size(), std::memory_order_relaxed);
+
+    auto buf = uv_buf_init(req->data.data(), static_cast<unsigned>(req->data.size()));
+
+    int err = uv_write(
+        &req->req,
+        reinterpret_cast<uv_stream_t*>(&conn.handle), // NOLINT(*-reinterpret-cast)
+        &buf,
+        1,
+        [](uv_write_t* write, int /* status */) {
+            delete static_cast<write_req*>(write->data); // NOLINT(*-owning-memory)
+        }
+    );
+
+    if (err != 0) [[unlikely]] {
+        delete req; // NOLINT(*-owning-memory)
+        close_(conn);
+    }
+}
+
+void
+RespServer::close_(client& conn)
+{
+    if (conn.closing)
+        return;
+
+    conn.closing = true;
+    uv_timer_stop(&conn.delay_timer);
+
+    // The timer closes after the socket, then the client goes
+    uv_close(
+        reinterpret_cast<uv_handle_t*>(&conn.handle), // NOLINT(*-reinterpret-cast)
+        [](uv_handle_t* handle) {
+            auto* closed = static_cast<client*>(handle->data);
+
+            uv_close(
+                reinterpret_cast<uv_handle_t*>(&closed->delay_timer), // NOLINT
+                [](uv_handle_t* timer) {
+                    auto* gone = static_cast<client*>(timer->data);
+                    auto& clients = gone->server->clients_;
+
+                    std::erase_if(clients, [gone](const auto& other) {
+                        return other.get() == gone;
+                    });
+
+                    log_d(redis, "Client disconnected ({} left)", clients.size());
+                }
+            );
+        }
+    );
+}
+
+} // namespace resp
+} // namespace raccoon
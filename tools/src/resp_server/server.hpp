@@ -0,0 +1,227 @@
+#pragma once
+
+#include "common.hpp"
+#include "resp.hpp"
+#include "store.hpp"
+
+#include <uv.h>
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace raccoon {
+namespace resp {
+
+/**
+ * Commands the server understands. Anything else gets an error.
+ */
+enum class Command : uint8_t {
+    HSET,
+    HMSET,
+    HDEL,
+    DEL,
+    SET,
+    XADD,
+    PUBLISH,
+    ZADD,
+    ZREM,
+    GET,
+    HGETALL,
+    HMGET,
+    ZRANGEBYSCORE,
+    ZREVRANGEBYSCORE,
+    MULTI,
+    EXEC,
+    DISCARD,
+    PING,
+    OTHER,
+};
+
+inline constexpr size_t COMMAND_COUNT = static_cast<size_t>(Command::OTHER) + 1;
+
+std::string_view command_name(Command command);
+
+/**
+ * Look up a command by name, ignoring case.
+ */
+Command lookup_command(std::string_view name);
+
+struct ServerConfig {
+    std::string host = "127.0.0.1";
+    int port = 0; // 0 picks a free one
+
+    // Delay before replies are sent, plus up to `jitter_ms` more at random
+    uint64_t latency_ms = 0;
+    uint64_t jitter_ms = 0;
+    uint64_t seed = 42; // NOLINT(*-magic-numbers)
+
+    // Keep what's written, so reads see it
+    bool store = false;
+};
+
+/**
+ * Counters since the server started, or since the last reset.
+ */
+struct ServerStats {
+    std::array<uint64_t, COMMAND_COUNT> commands{};
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    uint64_t connections = 0;
+    uint64_t errors = 0;
+
+    [[nodiscard]] uint64_t total_commands() const noexcept;
+
+    [[nodiscard]] uint64_t
+    count(Command command) const noexcept
+    {
+        return commands[static_cast<size_t>(command)];
+    }
+};
+
+/**
+ * A stand-in for Redis, for end-to-end tests and benchmarks that shouldn't depend on
+ * an outside server.
+ *
+ * It speaks enough RESP for what raccoon sends: hash, string, sorted set and stream
+ * writes, PUBLISH and MULTI/EXEC, pipelined or not. By default nothing is stored.
+ * Every command gets the reply type Redis would give, with counts taken from its
+ * arguments, e.g. HSET reports all its fields as new, and reads find nothing.
+ *
+ * With `store` set, strings, hashes and sorted sets are kept, so that GET, HGETALL,
+ * HMGET and ZRANGEBYSCORE read them back, and write replies count what changed.
+ * Commands in a transaction are applied as they're queued.
+ *
+ * The server runs its own event loop on its own thread, so it can live in the same
+ * process as the code under test. Replies can be held back by a fixed latency plus
+ * random jitter, in order, to see how clients cope with a slow Redis. Loop timers
+ * tick in milliseconds, so that's the resolution of the delay.
+ */
+class RespServer {
+    // Replies due at some time, for injected latency
+    struct delayed {
+        uint64_t due_ms; // in loop time
+        std::string data;
+    };
+
+    struct client {
+        RespServer* server;
+        uv_tcp_t handle{};
+        uv_timer_t delay_timer{};
+
+        bool closing = false;
+
+        std::string read_buf;
+        std::string pending; // replies written on the next flush
+        std::deque<delayed> delayed_replies;
+        uint64_t last_due_ms = 0;
+
+        // Open transaction
+        bool in_multi = false;
+        size_t queued_count = 0;
+        std::string queued;
+    };
+
+    struct write_req {
+        uv_write_t req{};
+        std::string data;
+    };
+
+    ServerConfig config_;
+
+    uv_loop_t loop_{};
+    uv_tcp_t listener_{};
+    uv_async_t stop_async_{};
+    int port_ = 0;
+
+    std::jthread thread_;
+    std::vector<std::unique_ptr<client>> clients_;
+
+    std::mt19937_64 rng_;
+    uint64_t last_stream_ms_ = 0;
+    uint64_t stream_seq_ = 0;
+
+    Store store_; // only used with `config_.store`
+
+    // Reused buffers
+    std::string read_chunk_;
+    std::vector<std::string_view> args_;
+
+    // Written on the loop thread, read from anywhere
+    std::array<std::atomic<uint64_t>, COMMAND_COUNT> commands_{};
+    std::atomic<uint64_t> bytes_in_ = 0;
+    std::atomic<uint64_t> bytes_out_ = 0;
+    std::atomic<uint64_t> connections_ = 0;
+    std::atomic<uint64_t> errors_ = 0;
+
+public:
+    explicit RespServer(ServerConfig config = {});
+
+    /**
+     * Stops the server if it's running.
+     */
+    ~RespServer();
+
+    RespServer(const RespServer&) = delete;
+    RespServer(RespServer&&) = delete;
+    RespServer& operator=(const RespServer&) = delete;
+    RespServer& operator=(RespServer&&) = delete;
+
+    /**
+     * Start listening and serving on a new thread.
+     *
+     * @returns bool If the server is listening, and port() is valid.
+     */
+    bool start();
+
+    /**
+     * Close every connection and wait for the server thread to finish.
+     */
+    void stop();
+
+    /**
+     * The port the server listens on, which is the chosen one when configured as 0.
+     */
+    [[nodiscard]] int
+    port() const noexcept
+    {
+        return port_;
+    }
+
+    /**
+     * Safe to call from any thread, while the server is running.
+     */
+    [[nodiscard]] ServerStats stats() const;
+
+    void reset_stats();
+
+private:
+    static void on_connection_(uv_stream_t* listener, int status);
+    static void on_read_(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf);
+    static void on_delay_(uv_timer_t* timer);
+
+    void handle_input_(client& conn);
+    void handle_command_(client& conn, std::string& out);
+    void reply_(Command command, std::string& out);
+
+    /**
+     * Reply to ZRANGEBYSCORE or ZREVRANGEBYSCORE.
+     *
+     * @returns std::string_view An error for the client, or empty.
+     */
+    std::string_view range_by_score_(bool reverse, std::string& out);
+    std::string next_stream_id_();
+
+    void schedule_(client& conn);
+    void flush_(client& conn);
+    void close_(client& conn);
+};
+
+} // namespace resp
+} // namespace raccoon
@@ -0,0 +1,275 @@
+#include "store.hpp"
+
+#include "resp.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <limits>
+#include <vector>
+
+namespace raccoon {
+namespace resp {
+
+bool
+score_bound::parse(std::string_view str, score_bound& bound)
+{
+    bound.exclusive = str.starts_with('(');
+    if (bound.exclusive)
+        str.remove_prefix(1);
+
+    // from_chars takes "inf" but not "+inf"
+    if (str.starts_with('+'))
+        str.remove_prefix(1);
+
+    const auto* end = str.data() + str.size();
+    auto [ptr, err] = std::from_chars(str.data(), end, bound.value);
+
+    return !str.empty() && err == std::errc() && ptr == end;
+}
+
+void
+Store::set(std::string_view key, std::string_view value)
+{
+    strings_[std::string(key)] = value;
+}
+
+int64_t
+Store::hset(std::string_view key, std::span<const std::string_view> fields)
+{
+    auto& hash = hashes_[std::string(key)];
+    int64_t added = 0;
+
+    for (size_t i = 0; i + 1 < fields.size(); i += 2) {
+        auto [it, inserted] = hash.insert_or_assign(
+            std::string(fields[i]), std::string(fields[i + 1])
+        );
+        added += inserted ? 1 : 0;
+    }
+
+    return added;
+}
+
+int64_t
+Store::hdel(std::string_view key, std::span<const std::string_view> fields)
+{
+    auto it = hashes_.find(std::string(key));
+    if (it == hashes_.end())
+        return 0;
+
+    int64_t removed = 0;
+
+    for (auto field : fields)
+        removed += static_cast<int64_t>(it->second.erase(std::string(field)));
+
+    if (it->second.empty())
+        hashes_.erase(it);
+
+    return removed;
+}
+
+int64_t
+Store::zadd(std::string_view key, std::span<const std::string_view> pairs)
+{
+    auto& set = sorted_sets_[std::string(key)];
+    int64_t added = 0;
+
+    for (size_t i = 0; i + 1 < pairs.size(); i += 2) {
+        score_bound score;
+        score_bound::parse(pairs[i], score);
+
+        std::string member(pairs[i + 1]);
+        auto [it, inserted] = set.scores.try_emplace(member, score.value);
+
+        if (!inserted)
+            set.by_score.erase({it->second, member});
+
+        it->second = score.value;
+        set.by_score.emplace(score.value, std::move(member));
+
+        added += inserted ? 1 : 0;
+    }
+
+    return added;
+}
+
+int64_t
+Store::zrem(std::string_view key, std::span<const std::string_view> members)
+{
+    auto it = sorted_sets_.find(std::string(key));
+    if (it == sorted_sets_.end())
+        return 0;
+
+    auto& set = it->second;
+    int64_t removed = 0;
+
+    for (auto name : members) {
+        std::string member(name);
+        auto found = set.scores.find(member);
+
+        if (found == set.scores.end())
+            continue;
+
+        set.by_score.erase({found->second, member});
+        set.scores.erase(found);
+        removed++;
+    }
+
+    if (set.scores.empty())
+        sorted_sets_.erase(it);
+
+    return removed;
+}
+
+int64_t
+Store::del(std::span<const std::string_view> keys)
+{
+    int64_t removed = 0;
+
+    for (auto name : keys) {
+        std::string key(name);
+
+        // Counted once, however many types the key had
+        bool any = strings_.erase(key) != 0;
+        any = hashes_.erase(key) != 0 || any;
+        any = sorted_sets_.erase(key) != 0 || any;
+
+        removed += any ? 1 : 0;
+    }
+
+    return removed;
+}
+
+static void
+append_nil(std::string& out)
+{
+    out += "$-1\r\n";
+}
+
+void
+Store::get(std::string_view key, std::string& out) const
+{
+    auto it = strings_.find(std::string(key));
+
+    if (it == strings_.end())
+        append_nil(out);
+    else
+        append_bulk(out, it->second);
+}
+
+void
+Store::hgetall(std::string_view key, std::string& out) const
+{
+    auto it = hashes_.find(std::string(key));
+
+    if (it == hashes_.end()) {
+        append_array_header(out, 0);
+        return;
+    }
+
+    append_array_header(out, 2 * it->second.size());
+
+    for (const auto& [field, value] : it->second) {
+        append_bulk(out, field);
+        append_bulk(out, value);
+    }
+}
+
+void
+Store::hmget(
+    std::string_view key, std::span<const std::string_view> fields, std::string& out
+) const
+{
+    auto it = hashes_.find(std::string(key));
+    append_array_header(out, fields.size());
+
+    for (auto field : fields) {
+        if (it == hashes_.end()) {
+            append_nil(out);
+            continue;
+        }
+
+        auto value = it->second.find(std::string(field));
+
+        if (value == it->second.end())
+            append_nil(out);
+        else
+            append_bulk(out, value->second);
+    }
+}
+
+void
+Store::zrange_by_score(
+    std::string_view key,
+    score_bound min,
+    score_bound max,
+    bool reverse,
+    bool with_scores,
+    size_t offset,
+    int64_t count,
+    std::string& out
+) const
+{
+    auto it = sorted_sets_.find(std::string(key));
+
+    if (it == sorted_sets_.end() || count == 0) {
+        append_array_header(out, 0);
+        return;
+    }
+
+    const auto& by_score = it->second.by_score;
+
+    auto above_min = [&min](double score) {
+        return min.exclusive ? score > min.value : score >= min.value;
+    };
+    auto below_max = [&max](double score) {
+        return max.exclusive ? score < max.value : score <= max.value;
+    };
+
+    // Members in range, in reply order
+    std::vector<const std::pair<double, std::string>*> members;
+    auto limit = count < 0 ? std::numeric_limits<size_t>::max()
+                           : offset + static_cast<size_t>(count);
+
+    if (!reverse) {
+        auto first = by_score.lower_bound({min.value, std::string()});
+
+        for (; first != by_score.end() && members.size() < limit; ++first) {
+            if (!below_max(first->first))
+                break;
+
+            if (above_min(first->first))
+                members.push_back(&*first);
+        }
+    }
+    else {
+        // Past the last member at or under max
+        auto last = by_score.upper_bound(
+            {max.value, std::string(1, std::numeric_limits<char>::max())}
+        );
+
+        while (last != by_score.begin() && members.size() < limit) {
+            --last;
+
+            if (!above_min(last->first))
+                break;
+
+            if (below_max(last->first))
+                members.push_back(&*last);
+        }
+    }
+
+    auto skip = std::min(offset, members.size());
+    auto replied = members.size() - skip;
+
+    append_array_header(out, with_scores ? 2 * replied : replied);
+
+    for (size_t i = skip; i < members.size(); i++) {
+        append_bulk(out, members[i]->second);
+
+        if (with_scores)
+            append_bulk(out, fmt::format("{}", members[i]->first));
+    }
+}
+
+} // namespace resp
+} // namespace raccoon
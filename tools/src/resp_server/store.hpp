@@ -0,0 +1,107 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace raccoon {
+namespace resp {
+
+/**
+ * A bound of a score range, as ZRANGEBYSCORE takes them: a number, -inf or +inf,
+ * exclusive if it starts with "(".
+ */
+struct score_bound {
+    double value = 0;
+    bool exclusive = false;
+
+    /**
+     * Parse a bound.
+     *
+     * @returns bool If it was valid.
+     */
+    static bool parse(std::string_view str, score_bound& bound);
+};
+
+/**
+ * Keys written to the RESP server, so tests and benchmarks can read them back.
+ *
+ * Holds the types raccoon writes: strings, hashes and sorted sets. Types aren't
+ * checked against each other, a key can name one of each at once. Replies are
+ * appended to an output buffer, in RESP.
+ */
+class Store {
+    struct sorted_set {
+        std::unordered_map<std::string, double> scores;
+        std::set<std::pair<double, std::string>> by_score;
+    };
+
+    std::unordered_map<std::string, std::string> strings_;
+    std::unordered_map<std::string, std::unordered_map<std::string, std::string>>
+        hashes_;
+    std::unordered_map<std::string, sorted_set> sorted_sets_;
+
+public:
+    /*
+     * Writes, returning the count Redis would reply with
+     */
+
+    void set(std::string_view key, std::string_view value);
+
+    /**
+     * @param fields Field and value pairs.
+     * @returns int64_t Fields added.
+     */
+    int64_t hset(std::string_view key, std::span<const std::string_view> fields);
+
+    int64_t hdel(std::string_view key, std::span<const std::string_view> fields);
+
+    /**
+     * @param pairs Score and member pairs; scores must already be valid.
+     * @returns int64_t Members added.
+     */
+    int64_t zadd(std::string_view key, std::span<const std::string_view> pairs);
+
+    int64_t zrem(std::string_view key, std::span<const std::string_view> members);
+
+    /**
+     * Delete keys of every type.
+     */
+    int64_t del(std::span<const std::string_view> keys);
+
+    /*
+     * Reads, appending their reply
+     */
+
+    void get(std::string_view key, std::string& out) const;
+
+    void hgetall(std::string_view key, std::string& out) const;
+
+    void hmget(
+        std::string_view key, std::span<const std::string_view> fields, std::string& out
+    ) const;
+
+    /**
+     * Members with scores in a range, lowest first, or highest first if reversed.
+     *
+     * @param count Members to return at most, after skipping `offset`; negative for
+     *              all.
+     */
+    void zrange_by_score(
+        std::string_view key,
+        score_bound min,
+        score_bound max,
+        bool reverse,
+        bool with_scores,
+        size_t offset,
+        int64_t count,
+        std::string& out
+    ) const;
+};
+
+} // namespace resp
+} // namespace raccoon